@@ -0,0 +1,318 @@
+#include "base/eventing/trace/eventlog.h"
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+#include "base/util/logging.h"
+
+namespace gp = google::protobuf;
+
+namespace vertexai {
+namespace eventing {
+namespace trace {
+namespace {
+
+// The host process; clocks use their (one-based) index as their process ID.
+constexpr std::uint64_t kHostPid = 0;
+
+// Write the buffered JSON once it gets this large.
+constexpr std::size_t kFlushBytes = 1 << 16;
+
+// Convert the buffered events once a thread has logged this many.
+constexpr std::size_t kFlushEvents = 1 << 12;
+
+std::atomic<std::uint64_t> next_log_id{0};
+
+double ToMicros(const gp::Duration& duration) { return duration.seconds() * 1e6 + duration.nanos() / 1e3; }
+
+void AppendNumber(std::string* out, double value) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%.3f", value);
+  out->append(buf);
+}
+
+void AppendString(std::string* out, const std::string& str) {
+  out->push_back('"');
+  for (char c : str) {
+    switch (c) {
+      case '"':
+        out->append("\\\"");
+        break;
+      case '\\':
+        out->append("\\\\");
+        break;
+      case '\n':
+        out->append("\\n");
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char buf[8];
+          std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+          out->append(buf);
+        } else {
+          out->push_back(c);
+        }
+    }
+  }
+  out->push_back('"');
+}
+
+// Appends the top-level scalar fields of a metadata message to a comma-separated list of JSON members.  Nested
+// messages and repeated fields are skipped: they can be large (e.g. a whole program), and the viewer only shows args
+// as a flat table anyway.
+void AppendArgs(std::string* args, const gp::Any& metadata) {
+  auto slash = metadata.type_url().rfind('/');
+  const auto* desc = gp::DescriptorPool::generated_pool()->FindMessageTypeByName(
+      slash == std::string::npos ? metadata.type_url() : metadata.type_url().substr(slash + 1));
+  if (!desc) {
+    return;
+  }
+  std::unique_ptr<gp::Message> msg{gp::MessageFactory::generated_factory()->GetPrototype(desc)->New()};
+  if (!msg->ParseFromString(metadata.value())) {
+    return;
+  }
+  const auto* refl = msg->GetReflection();
+  std::vector<const gp::FieldDescriptor*> fields;
+  refl->ListFields(*msg, &fields);
+  for (const auto* field : fields) {
+    if (field->is_repeated() || field->cpp_type() == gp::FieldDescriptor::CPPTYPE_MESSAGE) {
+      continue;
+    }
+    if (!args->empty()) {
+      args->push_back(',');
+    }
+    AppendString(args, field->name());
+    args->push_back(':');
+    switch (field->cpp_type()) {
+      case gp::FieldDescriptor::CPPTYPE_INT32:
+        args->append(std::to_string(refl->GetInt32(*msg, field)));
+        break;
+      case gp::FieldDescriptor::CPPTYPE_INT64:
+        args->append(std::to_string(refl->GetInt64(*msg, field)));
+        break;
+      case gp::FieldDescriptor::CPPTYPE_UINT32:
+        args->append(std::to_string(refl->GetUInt32(*msg, field)));
+        break;
+      case gp::FieldDescriptor::CPPTYPE_UINT64:
+        args->append(std::to_string(refl->GetUInt64(*msg, field)));
+        break;
+      case gp::FieldDescriptor::CPPTYPE_DOUBLE:
+        AppendNumber(args, refl->GetDouble(*msg, field));
+        break;
+      case gp::FieldDescriptor::CPPTYPE_FLOAT:
+        AppendNumber(args, refl->GetFloat(*msg, field));
+        break;
+      case gp::FieldDescriptor::CPPTYPE_BOOL:
+        args->append(refl->GetBool(*msg, field) ? "true" : "false");
+        break;
+      case gp::FieldDescriptor::CPPTYPE_ENUM:
+        AppendString(args, refl->GetEnum(*msg, field)->name());
+        break;
+      default:
+        AppendString(args, refl->GetString(*msg, field));
+        break;
+    }
+  }
+}
+
+// The category of a verb: its namespace, e.g. "tile::hal::cpu" for "tile::hal::cpu::Executing".
+std::string Category(const std::string& verb) {
+  auto pos = verb.rfind("::");
+  return pos == std::string::npos ? verb : verb.substr(0, pos);
+}
+
+}  // namespace
+
+EventLog::EventLog(const proto::EventLog& config)
+    : config_{config}, id_{next_log_id++}, out_{config.filename()} {
+  if (!out_) {
+    throw std::runtime_error(std::string("unable to open \"") + config.filename() + "\" for writing");
+  }
+  LOG(INFO) << "Writing trace to " << config.filename();
+  buf_.push_back('[');
+  WriteProcessNameLocked(kHostPid, "host");
+}
+
+EventLog::~EventLog() { FlushAndClose(); }
+
+void EventLog::LogEvent(context::proto::Event event) {
+  if (closed_) {
+    return;
+  }
+  auto* buffer = LocalBuffer();
+  bool full;
+  {
+    std::lock_guard<std::mutex> lock{buffer->mu};
+    buffer->events.emplace_back(RawEvent{next_seq_++, buffer->tid, std::move(event)});
+    full = kFlushEvents <= buffer->events.size();
+  }
+  if (full) {
+    std::lock_guard<std::mutex> lock{mu_};
+    if (!closed_) {
+      FlushLocked();
+    }
+  }
+}
+
+void EventLog::FlushAndClose() {
+  std::lock_guard<std::mutex> lock{mu_};
+  if (closed_) {
+    return;
+  }
+  closed_ = true;
+  FlushLocked();
+  for (const auto& kvp : pending_) {
+    const auto& pending = kvp.second;
+    if (pending.started) {
+      WriteEventLocked(pending.verb, 'B', pending.start_us, 0, kHostPid, pending.tid, pending.args);
+    }
+  }
+  pending_.clear();
+  buf_.append("\n]\n");
+  WriteLocked();
+  out_.close();
+}
+
+EventLog::ThreadBuffer* EventLog::LocalBuffer() {
+  // Keyed by log ID rather than by log address, so that a log allocated where a destroyed one used to be doesn't
+  // pick up its buffers.
+  thread_local std::unordered_map<std::uint64_t, std::shared_ptr<ThreadBuffer>> buffers;
+  auto& buffer = buffers[id_];
+  if (!buffer) {
+    buffer = std::make_shared<ThreadBuffer>();
+    std::lock_guard<std::mutex> lock{mu_};
+    buffer->tid = buffers_.size();
+    buffers_.push_back(buffer);
+  }
+  return buffer.get();
+}
+
+void EventLog::FlushLocked() {
+  std::vector<RawEvent> events;
+  for (const auto& buffer : buffers_) {
+    std::lock_guard<std::mutex> lock{buffer->mu};
+    std::move(buffer->events.begin(), buffer->events.end(), std::back_inserter(events));
+    buffer->events.clear();
+  }
+  std::sort(events.begin(), events.end(), [](const RawEvent& lhs, const RawEvent& rhs) { return lhs.seq < rhs.seq; });
+  for (const auto& raw : events) {
+    ConvertEventLocked(raw.tid, raw.event);
+  }
+  WriteLocked();
+}
+
+void EventLog::ConvertEventLocked(std::size_t tid, const context::proto::Event& event) {
+  if (event.has_clock_id()) {
+    // Clock activities arrive whole, typically some time after they've completed.
+    auto start_us = ToMicros(event.start_time());
+    auto end_us = ToMicros(event.end_time());
+    auto pid = event.clock_id().index();
+    auto lane = ClockLaneLocked(pid, start_us, end_us);
+    std::string args;
+    for (const auto& md : event.metadata()) {
+      AppendArgs(&args, md);
+    }
+    WriteEventLocked(event.verb(), 'X', start_us, end_us - start_us, pid, lane, args);
+    return;
+  }
+
+  // A thread logging an activity's metadata or end can race with a flush, so its events may be converted out of
+  // order; the activity is written once both its start and its end have been seen.
+  auto idx = event.activity_id().index();
+  auto& pending = pending_[idx];
+  if (event.has_start_time()) {
+    pending.verb = event.verb();
+    pending.started = true;
+    pending.start_us = ToMicros(event.start_time());
+    pending.tid = tid;
+  }
+  for (const auto& md : event.metadata()) {
+    AppendArgs(&pending.args, md);
+  }
+  if (event.has_end_time()) {
+    pending.ended = true;
+    pending.end_us = ToMicros(event.end_time());
+  }
+  if (pending.started && pending.ended) {
+    WriteEventLocked(pending.verb, 'X', pending.start_us, pending.end_us - pending.start_us, kHostPid, pending.tid,
+                     pending.args);
+    pending_.erase(idx);
+  }
+}
+
+std::size_t EventLog::ClockLaneLocked(std::uint64_t clock, double start_us, double end_us) {
+  auto res = clock_lanes_.emplace(clock, std::vector<double>{});
+  auto& lanes = res.first->second;
+  if (res.second) {
+    WriteProcessNameLocked(clock, "clock " + std::to_string(clock));
+  }
+  // Each lane tracks the latest end of the activities on it, so an activity starting after that can't overlap any of
+  // them, regardless of the order in which they were logged.
+  for (std::size_t lane = 0; lane < lanes.size(); ++lane) {
+    if (lanes[lane] <= start_us) {
+      lanes[lane] = end_us;
+      return lane;
+    }
+  }
+  lanes.push_back(end_us);
+  return lanes.size() - 1;
+}
+
+void EventLog::WriteEventLocked(const std::string& verb, char phase, double ts_us, double dur_us, std::uint64_t pid,
+                                std::size_t tid, const std::string& args) {
+  BeginRecordLocked();
+  buf_.append("{\"name\":");
+  AppendString(&buf_, verb);
+  buf_.append(",\"cat\":");
+  AppendString(&buf_, Category(verb));
+  buf_.append(",\"ph\":\"");
+  buf_.push_back(phase);
+  buf_.append("\",\"ts\":");
+  AppendNumber(&buf_, ts_us);
+  if (phase == 'X') {
+    buf_.append(",\"dur\":");
+    AppendNumber(&buf_, dur_us);
+  }
+  buf_.append(",\"pid\":");
+  buf_.append(std::to_string(pid));
+  buf_.append(",\"tid\":");
+  buf_.append(std::to_string(tid));
+  if (!args.empty()) {
+    buf_.append(",\"args\":{");
+    buf_.append(args);
+    buf_.push_back('}');
+  }
+  buf_.push_back('}');
+  if (kFlushBytes <= buf_.size()) {
+    WriteLocked();
+  }
+}
+
+void EventLog::WriteProcessNameLocked(std::uint64_t pid, const std::string& name) {
+  BeginRecordLocked();
+  buf_.append("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":");
+  buf_.append(std::to_string(pid));
+  buf_.append(",\"args\":{\"name\":");
+  AppendString(&buf_, name);
+  buf_.append("}}");
+}
+
+void EventLog::BeginRecordLocked() {
+  buf_.append(wrote_record_ ? ",\n" : "\n");
+  wrote_record_ = true;
+}
+
+void EventLog::WriteLocked() {
+  out_.write(buf_.data(), buf_.size());
+  buf_.clear();
+}
+
+}  // namespace trace
+}  // namespace eventing
+}  // namespace vertexai
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "base/context/eventlog.h"
+#include "base/eventing/trace/eventlog.pb.h"
+
+namespace vertexai {
+namespace eventing {
+namespace trace {
+
+// Writes events as a Chrome trace-event JSON array, for viewing in chrome://tracing or Perfetto.
+//
+// Activities become complete ("X") events on the host process, on a lane for the thread which started them; their
+// metadata's top-level scalar fields (e.g. a kernel's flops and bytes) become the event's args.  Activities logged
+// against a Clock go to a separate process per clock, spread over as many lanes as it takes to keep overlapping
+// activities apart.  Note that device clocks may have their own epoch, so their timestamps aren't necessarily
+// comparable with the host's.
+//
+// Logging an event only appends it to a buffer owned by the logging thread; events are converted to JSON and written
+// when a thread's buffer fills up and when the log is closed.  Activities which are still running when the log is
+// closed are written as begin ("B") events with no matching end.
+class EventLog final : public context::EventLog {
+ public:
+  explicit EventLog(const proto::EventLog& config);
+  ~EventLog();
+
+  void LogEvent(context::proto::Event event) override;
+
+  void FlushAndClose() override;
+
+ private:
+  struct RawEvent {
+    std::uint64_t seq;  // The order in which the event was logged
+    std::size_t tid;    // The lane of the thread which logged it
+    context::proto::Event event;
+  };
+
+  // The events logged by one thread since the last flush.
+  struct ThreadBuffer {
+    std::mutex mu;
+    std::size_t tid = 0;
+    std::vector<RawEvent> events;
+  };
+
+  // An activity which has been started or ended, but not both.
+  struct Pending {
+    std::string verb;
+    bool started = false;
+    double start_us = 0;
+    std::size_t tid = 0;
+    bool ended = false;
+    double end_us = 0;
+    std::string args;
+  };
+
+  ThreadBuffer* LocalBuffer();
+  void FlushLocked();
+  void ConvertEventLocked(std::size_t tid, const context::proto::Event& event);
+  std::size_t ClockLaneLocked(std::uint64_t clock, double start_us, double end_us);
+  void WriteEventLocked(const std::string& verb, char phase, double ts_us, double dur_us, std::uint64_t pid,
+                        std::size_t tid, const std::string& args);
+  void WriteProcessNameLocked(std::uint64_t pid, const std::string& name);
+  void BeginRecordLocked();
+  void WriteLocked();
+
+  // The client configuration.
+  proto::EventLog config_;
+
+  // Identifies this log among the logs a thread has buffers for.
+  const std::uint64_t id_;
+
+  std::atomic<std::uint64_t> next_seq_{0};
+
+  // Whether the log's been closed.
+  std::atomic<bool> closed_{false};
+
+  std::mutex mu_;
+  std::ofstream out_;
+  std::string buf_;
+
+  // The buffers of the threads which have logged events, indexed by lane.
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
+
+  // Activities which have been started or ended, but not both, by activity index.
+  std::unordered_map<std::uint64_t, Pending> pending_;
+
+  // The end time of the last activity on each lane of each clock.
+  std::map<std::uint64_t, std::vector<double>> clock_lanes_;
+
+  // Whether any records have been written (so the next one needs a separator).
+  bool wrote_record_ = false;
+};
+
+}  // namespace trace
+}  // namespace eventing
+}  // namespace vertexai
@@ -0,0 +1,153 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "base/eventing/trace/eventlog.h"
+#include "base/eventing/trace/eventlog.pb.h"
+#include "base/util/compat.h"
+#include "base/util/type_url.h"
+
+using ::testing::EndsWith;
+using ::testing::HasSubstr;
+using ::testing::Not;
+using ::testing::StartsWith;
+
+namespace vertexai {
+namespace eventing {
+namespace trace {
+namespace {
+
+constexpr static char kTestFilename[] = "trace.json";
+
+class EventLogTest : public ::testing::Test {
+ protected:
+  EventLogTest() { config_.set_filename(kTestFilename); }
+
+  void SetUp() override { eventlog_ = std::make_unique<EventLog>(config_); }
+
+  std::string ReadTrace() {
+    eventlog_.reset();
+    std::ifstream in{kTestFilename};
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+  }
+
+  static void SetTime(google::protobuf::Duration* time, std::int64_t micros) {
+    time->set_seconds(micros / 1000000);
+    time->set_nanos((micros % 1000000) * 1000);
+  }
+
+  proto::EventLog config_;
+  std::unique_ptr<EventLog> eventlog_;
+};
+
+TEST_F(EventLogTest, WritesCompleteEvents) {
+  {
+    context::proto::Event event;
+    event.set_verb("test::Run");
+    event.mutable_activity_id()->set_index(1);
+    SetTime(event.mutable_start_time(), 1000);
+    eventlog_->LogEvent(std::move(event));
+  }
+  {
+    // Any message will do as metadata; its scalar fields become the args.
+    context::proto::Event event;
+    event.mutable_activity_id()->set_index(1);
+    context::proto::ClockID md;
+    md.set_index(42);
+    event.add_metadata()->PackFrom(md, kTypeVertexAI);
+    eventlog_->LogEvent(std::move(event));
+  }
+  {
+    context::proto::Event event;
+    event.mutable_activity_id()->set_index(1);
+    SetTime(event.mutable_end_time(), 1500);
+    eventlog_->LogEvent(std::move(event));
+  }
+
+  auto trace = ReadTrace();
+  EXPECT_THAT(trace, StartsWith("["));
+  EXPECT_THAT(trace, EndsWith("]\n"));
+  EXPECT_THAT(trace, HasSubstr(R"({"name":"test::Run","cat":"test","ph":"X","ts":1000.000,"dur":500.000,)"
+                               R"("pid":0,"tid":0,"args":{"index":42}})"));
+}
+
+TEST_F(EventLogTest, SpreadsOverlappingClockActivitiesOverLanes) {
+  for (std::int64_t start : {0, 50, 100}) {
+    context::proto::Event event;
+    event.set_verb("test::Kernel");
+    event.mutable_clock_id()->set_index(1);
+    SetTime(event.mutable_start_time(), start);
+    SetTime(event.mutable_end_time(), start + 100);
+    eventlog_->LogEvent(std::move(event));
+  }
+
+  auto trace = ReadTrace();
+  EXPECT_THAT(trace, HasSubstr(R"({"name":"process_name","ph":"M","pid":1,"args":{"name":"clock 1"}})"));
+  EXPECT_THAT(trace, HasSubstr(R"("ts":0.000,"dur":100.000,"pid":1,"tid":0})"));
+  EXPECT_THAT(trace, HasSubstr(R"("ts":50.000,"dur":100.000,"pid":1,"tid":1})"));
+  EXPECT_THAT(trace, HasSubstr(R"("ts":100.000,"dur":100.000,"pid":1,"tid":0})"));
+}
+
+TEST_F(EventLogTest, WritesUnfinishedActivitiesOnClose) {
+  context::proto::Event event;
+  event.set_verb("test::Stuck");
+  event.mutable_activity_id()->set_index(1);
+  SetTime(event.mutable_start_time(), 2000);
+  eventlog_->LogEvent(std::move(event));
+
+  EXPECT_THAT(ReadTrace(), HasSubstr(R"({"name":"test::Stuck","cat":"test","ph":"B","ts":2000.000,"pid":0,"tid":0})"));
+}
+
+TEST_F(EventLogTest, WritesActivitiesLoggedConcurrently) {
+  // Enough events per thread to fill its buffer more than once, so some activities are converted while other threads
+  // are still logging theirs.
+  constexpr std::uint64_t kThreads = 4;
+  constexpr std::uint64_t kActivities = 2000;
+  std::vector<std::thread> threads;
+  for (std::uint64_t t = 0; t < kThreads; ++t) {
+    threads.emplace_back([this, t]() {
+      for (std::uint64_t i = 0; i < kActivities; ++i) {
+        auto idx = t * kActivities + i + 1;
+        context::proto::Event start;
+        start.set_verb("test::Run");
+        start.mutable_activity_id()->set_index(idx);
+        SetTime(start.mutable_start_time(), idx);
+        eventlog_->LogEvent(std::move(start));
+
+        context::proto::Event end;
+        end.mutable_activity_id()->set_index(idx);
+        context::proto::ClockID md;
+        md.set_index(idx);
+        end.add_metadata()->PackFrom(md, kTypeVertexAI);
+        SetTime(end.mutable_end_time(), idx + 1);
+        eventlog_->LogEvent(std::move(end));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  auto trace = ReadTrace();
+  std::size_t complete = 0;
+  for (auto pos = trace.find(R"("ph":"X")"); pos != std::string::npos; pos = trace.find(R"("ph":"X")", pos + 1)) {
+    ++complete;
+  }
+  EXPECT_EQ(complete, kThreads * kActivities);
+  EXPECT_THAT(trace, Not(HasSubstr(R"("ph":"B")")));
+  EXPECT_THAT(trace, HasSubstr(R"("ts":8000.000,"dur":1.000,"pid":0,)"));
+  EXPECT_THAT(trace, HasSubstr(R"("args":{"index":8000}})"));
+}
+
+}  // namespace
+}  // namespace trace
+}  // namespace eventing
+}  // namespace vertexai
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <memory>
+
+#include "base/eventing/trace/eventlog.pb.h"
+#include "base/util/any_factory.h"
+
+namespace vertexai {
+namespace eventing {
+namespace trace {
+
+class EventLogFactory final : public TypedAnyFactory<context::EventLog, proto::EventLog> {
+ public:
+  std::unique_ptr<context::EventLog> MakeTypedInstance(const context::Context& ctx,
+                                                       const proto::EventLog& config) override;
+};
+
+}  // namespace trace
+}  // namespace eventing
+}  // namespace vertexai
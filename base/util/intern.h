@@ -3,7 +3,10 @@
 #include <map>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
+#include <string>
 #include <tuple>
+#include <unordered_set>
 #include <utility>
 
 namespace vertexai {
@@ -102,4 +105,24 @@ struct Interned {
   }
 };
 
+// Returns the canonical copy of a string: interning equal strings returns the same object, so canonical copies may be
+// compared by address.  Unlike Interned, this hands out plain references, and lookups of strings that are already
+// interned only take a shared lock; interned strings are never freed, so it's meant for small vocabularies which are
+// looked up constantly, such as index names.
+inline const std::string& InternString(const std::string& value) {
+  static std::shared_timed_mutex mu;
+  // N.B. This is deliberately leaked, so interned strings remain valid during static destruction.  The set's elements
+  // don't move when it rehashes, so references to them stay valid as it grows.
+  static auto strings = new std::unordered_set<std::string>;
+  {
+    std::shared_lock<std::shared_timed_mutex> lock{mu};
+    auto it = strings->find(value);
+    if (it != strings->end()) {
+      return *it;
+    }
+  }
+  std::lock_guard<std::shared_timed_mutex> lock{mu};
+  return *strings->insert(value).first;
+}
+
 }  // namespace vertexai
@@ -729,6 +729,16 @@ class _Library(plaidml.library.Library):
         self.plaidml_set_invoker_output.restype = ctypes.c_bool
         self.plaidml_set_invoker_output.errcheck = self._check_err
 
+        # PLAIDML_API bool plaidml_set_invoker_input_donated(plaidml_invoker* invoker, const char* name, bool donated);
+        self.plaidml_set_invoker_input_donated = lib.plaidml_set_invoker_input_donated
+        self.plaidml_set_invoker_input_donated.argtypes = [
+            ctypes.POINTER(_C_Invoker),  # plaidml_invoker* invoker
+            ctypes.c_char_p,  # const char* name
+            ctypes.c_bool  # bool donated
+        ]
+        self.plaidml_set_invoker_input_donated.restype = ctypes.c_bool
+        self.plaidml_set_invoker_input_donated.errcheck = self._check_err
+
         # PLAIDML_API plaidml_invocation* plaidml_schedule_invocation(vai_ctx* ctx, plaidml_invoker* invoker);
         self.plaidml_schedule_invocation = lib.plaidml_schedule_invocation
         self.plaidml_schedule_invocation.argtypes = [
@@ -1448,6 +1458,9 @@ class Invoker(object):
         for (name, value) in outputs.items():
             self.set_output(name, value)
 
+    def set_input_donated(self, name, donated=True):
+        _lib().plaidml_set_invoker_input_donated(self, name.encode(), donated)
+
     def set_const(self):
         _lib().plaidml_set_invoker_const(self)
 
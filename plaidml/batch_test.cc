@@ -0,0 +1,144 @@
+// Copyright 2018 Intel Corporation.
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/util/env.h"
+#include "plaidml/plaidml++.h"
+#include "testing/plaidml_config.h"
+
+using ::testing::Gt;
+using ::testing::Lt;
+
+extern "C" size_t vai_internal_batched_runs();
+
+namespace {
+
+namespace plaidml = vertexai::plaidml;
+
+// The batcher reads its configuration on first use, so it's enabled before any test runs.
+const bool kBatchingEnabled = []() {
+  vertexai::env::Set("PLAIDML_BATCH_WINDOW_US", "1000000");
+  vertexai::env::Set("PLAIDML_BATCH_MAX", "4");
+  return true;
+}();
+
+constexpr size_t kThreads = 4;
+constexpr size_t kRows = 3;
+constexpr size_t kCols = 16;
+
+plaidml::device OpenDevice(const std::shared_ptr<vertexai::ctx>& ctx) {
+  auto devices = plaidml::enumerate_devices(ctx, vertexai::testing::PlaidMLConfig());
+  return devices[0].open();
+}
+
+// Invokes the function from several threads at once, each with its own invoker and tensors, and checks that every
+// invocation sees its own results.  Each element of an input is a distinct value, so a request which received another
+// request's slice of a batched output is caught.
+void InvokeConcurrently(plaidml::device* dev, const plaidml::function& func, size_t iterations,
+                        float (*expected)(float)) {
+  std::atomic<size_t> ready{0};
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      auto ctx = std::make_shared<vertexai::ctx>();
+      plaidml::tensor<float> in = dev->allocate(plaidml::shape<float>(ctx, {kRows, kCols}));
+      plaidml::tensor<float> out = dev->allocate(plaidml::shape<float>(ctx, {kRows, kCols}));
+      plaidml::invoker invoker(ctx, func);
+      invoker.set_input("X", in).set_output("Y", out);
+      ready++;
+      while (ready < kThreads) {
+        std::this_thread::yield();
+      }
+      for (size_t iter = 0; iter < iterations; ++iter) {
+        float base = 1000 * t + 100 * iter;
+        {
+          plaidml::mapping<float> data = in.map(plaidml::map_for_write);
+          for (size_t i = 0; i < kRows; i++) {
+            for (size_t j = 0; j < kCols; j++) {
+              data(i, j) = base + i * kCols + j;
+            }
+          }
+        }
+        invoker.invoke();
+        {
+          plaidml::mapping<float> data = out.map(plaidml::map_for_read);
+          for (size_t i = 0; i < kRows; i++) {
+            for (size_t j = 0; j < kCols; j++) {
+              EXPECT_FLOAT_EQ(data(i, j), expected(base + i * kCols + j)) << "thread " << t << ", iteration " << iter;
+            }
+          }
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+TEST(PlaidML_Batching, ConcurrentInvocationsGetTheirOwnOutputs) {
+  vai_clear_status();
+  auto ctx = std::make_shared<vertexai::ctx>();
+  plaidml::device dev = OpenDevice(ctx);
+  plaidml::function add_one("function (X) -> (Y) { Y = X + 1; }");
+
+  size_t runs = vai_internal_batched_runs();
+  InvokeConcurrently(&dev, add_one, 10, [](float x) { return x + 1; });
+  EXPECT_THAT(vai_internal_batched_runs(), Gt(runs));
+}
+
+TEST(PlaidML_Batching, LoneInvocationIsNotDelayed) {
+  vai_clear_status();
+  auto ctx = std::make_shared<vertexai::ctx>();
+  plaidml::device dev = OpenDevice(ctx);
+  plaidml::function add_one("function (X) -> (Y) { Y = X + 1; }");
+  plaidml::tensor<float> in = dev.allocate(plaidml::shape<float>(ctx, {kRows, kCols}));
+  plaidml::tensor<float> out = dev.allocate(plaidml::shape<float>(ctx, {kRows, kCols}));
+  {
+    plaidml::mapping<float> data = in.map(plaidml::map_for_write);
+    for (size_t i = 0; i < kRows; i++) {
+      for (size_t j = 0; j < kCols; j++) {
+        data(i, j) = 1;
+      }
+    }
+  }
+  plaidml::invoker invoker(ctx, add_one);
+  invoker.set_input("X", in).set_output("Y", out);
+
+  // The first invocation compiles the program; the second shouldn't wait out the one second batching window.
+  invoker.invoke();
+  out.map(plaidml::map_for_read);
+  auto start = std::chrono::steady_clock::now();
+  invoker.invoke();
+  {
+    plaidml::mapping<float> data = out.map(plaidml::map_for_read);
+    EXPECT_FLOAT_EQ(data(0u, 0u), 2);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_THAT(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), Lt(500));
+}
+
+TEST(PlaidML_Batching, ReallocatedFunctionUsesItsOwnProgram) {
+  vai_clear_status();
+  auto ctx = std::make_shared<vertexai::ctx>();
+  plaidml::device dev = OpenDevice(ctx);
+
+  // The second function may well be allocated where the first one was; its batches must still run its own code.
+  {
+    plaidml::function add_one("function (X) -> (Y) { Y = X + 1; }");
+    InvokeConcurrently(&dev, add_one, 4, [](float x) { return x + 1; });
+  }
+  {
+    plaidml::function double_it("function (X) -> (Y) { Y = X * 2; }");
+    InvokeConcurrently(&dev, double_it, 4, [](float x) { return x * 2; });
+  }
+}
+
+}  // namespace
@@ -27,6 +27,13 @@ class Context(object):
         }
         self._set_eventlog(self, json.dumps(config).encode())
 
+    def set_trace_filename(self, filename):
+        config = {
+            '@type': 'type.vertex.ai/vertexai.eventing.trace.proto.EventLog',
+            'filename': filename
+        }
+        self._set_eventlog(self, json.dumps(config).encode())
+
     def shutdown(self):
         if hasattr(self, '_free') and self._as_parameter_:
             self._free(self)
@@ -68,9 +68,14 @@ _app_stack = []
 _ctx = plaidml.Context()
 
 PLAIDML_EVENTLOG_FILENAME = os.getenv('PLAIDML_EVENTLOG_FILENAME')
+PLAIDML_TRACE_FILENAME = os.getenv('PLAIDML_TRACE_FILENAME')
 if PLAIDML_EVENTLOG_FILENAME:
     print('Logging events to', PLAIDML_EVENTLOG_FILENAME)
     _ctx.set_eventlog_filename(PLAIDML_EVENTLOG_FILENAME)
+elif PLAIDML_TRACE_FILENAME:
+    print('Tracing to', PLAIDML_TRACE_FILENAME)
+    _ctx.set_trace_filename(PLAIDML_TRACE_FILENAME)
+if PLAIDML_EVENTLOG_FILENAME or PLAIDML_TRACE_FILENAME:
 
     @atexit.register
     def close_eventlog():
@@ -458,12 +463,14 @@ ceil = op.ceiling
 
 
 def clear_session():
-    global _in_train_phase, _ctx, _dev, PLAIDML_EVENTLOG_FILENAME
+    global _in_train_phase, _ctx, _dev, PLAIDML_EVENTLOG_FILENAME, PLAIDML_TRACE_FILENAME
     _in_train_phase = None
     _ctx = plaidml.Context()
     _dev = None
     if PLAIDML_EVENTLOG_FILENAME:
         _ctx.set_eventlog_filename(PLAIDML_EVENTLOG_FILENAME)
+    elif PLAIDML_TRACE_FILENAME:
+        _ctx.set_trace_filename(PLAIDML_TRACE_FILENAME)
 
 
 clip = op.clip
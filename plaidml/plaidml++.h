@@ -642,6 +642,12 @@ class invoker {
     return *this;
   }
 
+  invoker& set_input_donated(const std::string& name, bool donated = true) {
+    auto r = plaidml_set_invoker_input_donated(invoker_.get(), name.c_str(), donated);
+    vai_exception::check_and_throw(r);
+    return *this;
+  }
+
   base_shape output_shape(const std::string& name) {
     std::shared_ptr<plaidml_shape> shp{plaidml_alloc_invoker_output_shape(invoker_.get(), name.c_str()),
                                        plaidml_free_shape};
@@ -11,6 +11,7 @@
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <cstddef>
 #include <cstdlib>
@@ -23,7 +24,9 @@
 #include <mutex>
 #include <set>
 #include <string>
+#include <tuple>
 #include <utility>
+#include <vector>
 
 #include <boost/filesystem.hpp>
 
@@ -1337,6 +1340,7 @@ struct plaidml_invoker {
   std::shared_ptr<BoundFunction> func;
   std::map<std::string, std::shared_ptr<Value>> inputs;
   std::map<std::string, std::shared_ptr<TensorValue>> outputs;
+  std::set<std::string> donated_inputs;
 
   tile::LruCache<std::map<std::string, ApplierParameterShape>, std::shared_ptr<FunctionApplication>>
       applier_for_output_shape_cache{kApplierForShapeCacheSize};
@@ -1346,41 +1350,83 @@ struct plaidml_invoker {
                  std::shared_ptr<RunInfo>>
       runinfo_cache{kRuninfoCacheSize};
 
+  // Programs running batches of invocations of the function; see InvocationBatcher.
+  tile::LruCache<std::tuple<std::map<std::string, ApplierParameterShape>, std::map<std::string, ApplierParameterShape>,
+                            std::size_t>,
+                 std::shared_ptr<RunInfo>>
+      batched_runinfo_cache{kRuninfoCacheSize};
+
   std::shared_ptr<RunInfo> runinfo;
 };
 
 namespace {
 
+// Computes the shape of batch tensors of the supplied shape, stacked along
+// their leading dimension.  Returns false if the shape has no dimensions, or
+// if its elements aren't densely laid out in row-major order.
+bool BatchedShape(const tile::TensorShape& shape, std::size_t batch, tile::TensorShape* result) {
+  if (shape.dims.empty()) {
+    return false;
+  }
+  std::int64_t stride = 1;
+  for (auto it = shape.dims.rbegin(); it != shape.dims.rend(); ++it) {
+    if (it->stride != stride) {
+      return false;
+    }
+    stride *= it->size;
+  }
+  *result = shape;
+  result->dims[0].size *= batch;
+  return true;
+}
+
+// Prepares a function to be run on an invoker's inputs and outputs.  When
+// batch is greater than one, the function is instead prepared to run on batch
+// copies of each non-constant tensor, stacked along its leading dimension.
+std::shared_ptr<RunInfo> MakeRunInfo(const std::shared_ptr<BoundFunction>& func,
+                                     const std::map<std::string, std::shared_ptr<Value>>& inputs,
+                                     const std::map<std::string, std::shared_ptr<TensorValue>>& outputs,
+                                     const std::string& name, std::size_t batch) {
+  auto shape_of = [batch](const TensorValue& value) {
+    if (batch == 1 || value.is_const()) {
+      return value.shape();
+    }
+    tile::TensorShape shape;
+    if (!BatchedShape(value.shape(), batch, &shape)) {
+      throw vertexai::error::InvalidArgument{"Unable to batch a tensor with a non-dense layout"};
+    }
+    return shape;
+  };
+  auto applier = std::make_shared<FunctionApplication>(func);
+  for (const auto& it : inputs) {
+    if (it.second->type() == Value::TENSOR) {
+      auto from = std::dynamic_pointer_cast<TensorValue>(it.second);
+      auto value = std::make_shared<TensorValue>(std::make_shared<NamedBuffer>(it.first), shape_of(*from),
+                                                 from->is_const());
+      applier->SetInput(it.first, value);
+    } else {
+      applier->SetInput(it.first, it.second);
+    }
+  }
+  applier->SetDone();
+  auto composer = std::make_unique<BoundFunction>();
+  composer->AddDependency(*applier);
+  for (const auto& it : outputs) {
+    auto value = std::make_shared<TensorValue>(std::make_shared<NamedBuffer>(it.first), shape_of(*it.second),
+                                               it.second->is_const());
+    composer->AddUpdate(value, applier->GetOutput(it.first));
+  }
+  composer->Done();
+  return std::make_shared<RunInfo>(composer->PrepareToRun(name));
+}
+
 void BuildInvokerRunInfo(plaidml_invoker* invoker, const std::string& name) {
   if (invoker->runinfo) {
     return;
   }
   invoker->runinfo = invoker->runinfo_cache.Lookup(
       std::make_pair(ToApplierParameterShapes(invoker->inputs), ToApplierParameterShapes(invoker->outputs)),
-      [invoker, &name]() {
-        auto applier = std::make_shared<FunctionApplication>(invoker->func);
-        for (const auto& it : invoker->inputs) {
-          if (it.second->type() == Value::TENSOR) {
-            auto from = std::dynamic_pointer_cast<TensorValue>(it.second);
-            auto value =
-                std::make_shared<TensorValue>(std::make_shared<NamedBuffer>(it.first), from->shape(), from->is_const());
-            applier->SetInput(it.first, value);
-          } else {
-            applier->SetInput(it.first, it.second);
-          }
-        }
-        applier->SetDone();
-        auto composer = std::make_unique<BoundFunction>();
-        composer->AddDependency(*applier);
-        for (const auto& it : invoker->outputs) {
-          auto from = std::dynamic_pointer_cast<TensorValue>(it.second);
-          auto value =
-              std::make_shared<TensorValue>(std::make_shared<NamedBuffer>(it.first), from->shape(), from->is_const());
-          composer->AddUpdate(value, applier->GetOutput(it.first));
-        }
-        composer->Done();
-        return std::make_shared<RunInfo>(composer->PrepareToRun(name));
-      });
+      [invoker, &name]() { return MakeRunInfo(invoker->func, invoker->inputs, invoker->outputs, name, 1); });
 }
 
 }  // namespace
@@ -1485,6 +1531,24 @@ extern "C" bool plaidml_set_invoker_output(plaidml_invoker* invoker, const char*
   }
 }
 
+extern "C" bool plaidml_set_invoker_input_donated(plaidml_invoker* invoker, const char* name, bool donated) {
+  if (!invoker || !name) {
+    vertexai::SetLastOOM();
+    return false;
+  }
+  try {
+    if (donated) {
+      invoker->donated_inputs.insert(name);
+    } else {
+      invoker->donated_inputs.erase(name);
+    }
+    return true;
+  } catch (...) {
+    vertexai::SetLastException(std::current_exception());
+    return false;
+  }
+}
+
 extern "C" bool plaidml_set_invoker_const(plaidml_invoker* invoker) {
   invoker->func->SetBoundConst();
   return true;
@@ -1582,8 +1646,307 @@ class PlatformAllocator : public tile::Allocator {
   std::string id_;
 };
 
+// Coalesces concurrent invocations of a function into batched runs.
+//
+// When PLAIDML_BATCH_WINDOW_US is set, an invocation made while other
+// invocations of the same function with the same shapes, constants, and
+// constant tensors are in flight waits up to that many microseconds for them
+// to join it (up to PLAIDML_BATCH_MAX of them in all); an invocation with
+// nothing else in flight runs immediately.  The invocation which opened the batch then stacks the batch's
+// non-constant tensors along their leading dimension, runs the batched program
+// (compiled through the device's ProgramCache), and scatters the outputs back.
+//
+// This is only valid for functions which process each index of their tensors'
+// leading dimension independently, which is why it's opt-in.  Batched
+// invocations are complete by the time plaidml_schedule_invocation returns,
+// since the outputs are written after the batched program runs.
+class InvocationBatcher final {
+ public:
+  // Identifies the requests which may be batched together.
+  struct Key {
+    std::shared_ptr<BoundFunction> func;
+    std::shared_ptr<Evaluator> evaluator;
+    std::map<std::string, ApplierParameterShape> inputs;
+    std::map<std::string, ApplierParameterShape> outputs;
+    std::map<std::string, std::shared_ptr<tile::Buffer>> consts;
+
+    bool operator<(const Key& rhs) const {
+      return std::tie(func, evaluator, inputs, outputs, consts) <
+             std::tie(rhs.func, rhs.evaluator, rhs.inputs, rhs.outputs, rhs.consts);
+    }
+  };
+
+  // An invocation.  A request passed to Invoke() counts as in flight with its
+  // key until it's destroyed, so that a caller running its request directly
+  // is still expected to be back with another soon.
+  struct Request {
+    Request(plaidml_invoker* invoker_, std::shared_ptr<Evaluator> evaluator_, const tile::proto::Program* prog_,
+            std::map<std::string, std::shared_ptr<tile::Buffer>> in_buffers_,
+            std::map<std::string, std::shared_ptr<tile::Buffer>> out_buffers_)
+        : invoker{invoker_},
+          evaluator{std::move(evaluator_)},
+          prog{prog_},
+          in_buffers{std::move(in_buffers_)},
+          out_buffers{std::move(out_buffers_)} {}
+    Request(const Request&) = delete;
+    Request& operator=(const Request&) = delete;
+    ~Request() {
+      if (batcher) {
+        batcher->Leave(key);
+      }
+    }
+
+    plaidml_invoker* invoker;
+    std::shared_ptr<Evaluator> evaluator;
+    const tile::proto::Program* prog;
+    std::map<std::string, std::shared_ptr<tile::Buffer>> in_buffers;
+    std::map<std::string, std::shared_ptr<tile::Buffer>> out_buffers;
+
+    InvocationBatcher* batcher = nullptr;
+    Key key;
+    bool done = false;
+    bool batched = false;
+    std::exception_ptr error;
+  };
+
+  // Returns the batcher, or nullptr if batching isn't enabled.
+  static InvocationBatcher* Instance() {
+    static InvocationBatcher* batcher = []() -> InvocationBatcher* {
+      auto window = std::atoi(vertexai::env::Get("PLAIDML_BATCH_WINDOW_US").c_str());
+      if (window <= 0) {
+        return nullptr;
+      }
+      auto max_batch = std::atoi(vertexai::env::Get("PLAIDML_BATCH_MAX").c_str());
+      return new InvocationBatcher{std::chrono::microseconds{window}, max_batch > 1 ? std::size_t(max_batch) : 8};
+    }();
+    return batcher;
+  }
+
+  // The number of batched programs which have been run.
+  std::size_t batched_runs() const { return batched_runs_; }
+
+  // Runs the request as part of a batch.  Returns false if the request wasn't
+  // batched (it can't be, or no other request arrived in time to join it), in
+  // which case the caller should run it directly.
+  bool Invoke(const context::Context& ctx, Request* req) {
+    if (!MakeKey(*req, &req->key)) {
+      return false;
+    }
+    const Key& key = req->key;
+    std::unique_lock<std::mutex> lock{mu_};
+    req->batcher = this;
+    std::size_t& callers = callers_[key];
+    ++callers;
+    std::shared_ptr<Batch> batch;
+    auto it = open_.find(key);
+    bool leader = it == open_.end();
+    if (leader) {
+      if (callers == 1) {
+        // Nobody else is running this function; don't hold up the caller.
+        return false;
+      }
+      batch = std::make_shared<Batch>();
+      open_.emplace(key, batch);
+    } else {
+      batch = it->second;
+      cv_.notify_all();
+    }
+    batch->requests.push_back(req);
+    if (batch->requests.size() == max_batch_) {
+      Close(key, batch.get());
+    }
+
+    if (!leader) {
+      cv_.wait(lock, [req]() { return req->done; });
+    } else {
+      // Stop waiting early once every caller in flight has joined the batch.
+      cv_.wait_for(lock, window_,
+                   [&batch, &callers]() { return batch->closed || batch->requests.size() == callers; });
+      Close(key, batch.get());
+      lock.unlock();
+      std::exception_ptr error;
+      bool batched = false;
+      if (batch->requests.size() > 1) {
+        try {
+          batched = Run(ctx, key, batch->requests);
+        } catch (...) {
+          error = std::current_exception();
+        }
+      }
+      lock.lock();
+      for (Request* member : batch->requests) {
+        member->done = true;
+        member->batched = batched || error;
+        member->error = error;
+      }
+      cv_.notify_all();
+    }
+
+    if (req->error) {
+      std::rethrow_exception(req->error);
+    }
+    return req->batched;
+  }
+
+ private:
+  struct Batch {
+    std::vector<Request*> requests;
+    bool closed = false;
+  };
+
+  InvocationBatcher(std::chrono::microseconds window, std::size_t max_batch)
+      : window_{window}, max_batch_{max_batch} {}
+
+  // Builds the key identifying the requests a request may be batched with,
+  // returning false if it can't be batched at all.
+  static bool MakeKey(const Request& req, Key* key) {
+    const RunInfo& runinfo = *req.invoker->runinfo;
+    std::unordered_set<const tile::Buffer*> outputs;
+    for (const auto& kvp : req.out_buffers) {
+      outputs.insert(kvp.second.get());
+    }
+    tile::TensorShape unused;
+    for (const auto& kvp : runinfo.input_shapes) {
+      const tile::Buffer* buffer = req.in_buffers.at(kvp.first).get();
+      if (outputs.count(buffer)) {
+        // Updates in place can't be batched, since the batched program writes copies.
+        return false;
+      }
+      if (kvp.second.is_const) {
+        key->consts[kvp.first] = req.in_buffers.at(kvp.first);
+      } else if (!BatchedShape(kvp.second, 2, &unused)) {
+        return false;
+      }
+    }
+    for (const auto& kvp : runinfo.output_shapes) {
+      if (!BatchedShape(kvp.second, 2, &unused)) {
+        return false;
+      }
+    }
+    key->func = req.invoker->func;
+    key->evaluator = req.evaluator;
+    key->inputs = ToApplierParameterShapes(req.invoker->inputs);
+    key->outputs = ToApplierParameterShapes(req.invoker->outputs);
+    return true;
+  }
+
+  // Called when a request which was counted in flight is destroyed.
+  void Leave(const Key& key) {
+    std::lock_guard<std::mutex> lock{mu_};
+    auto it = callers_.find(key);
+    if (--it->second == 0) {
+      callers_.erase(it);
+    }
+    cv_.notify_all();
+  }
+
+  // Stops a batch from accepting requests.  Requires mu_.
+  void Close(const Key& key, Batch* batch) {
+    if (batch->closed) {
+      return;
+    }
+    batch->closed = true;
+    open_.erase(key);
+    cv_.notify_all();
+  }
+
+  // Runs a batch, returning false if the function can't be run on the
+  // batched shapes.
+  bool Run(const context::Context& ctx, const Key& key, const std::vector<Request*>& requests) {
+    const Request& first = *requests.front();
+    auto runinfo = first.invoker->batched_runinfo_cache.Lookup(
+        std::make_tuple(key.inputs, key.outputs, requests.size()), [&]() -> std::shared_ptr<RunInfo> {
+          try {
+            return MakeRunInfo(first.invoker->func, first.invoker->inputs, first.invoker->outputs, "batched_program",
+                               requests.size());
+          } catch (const std::exception& ex) {
+            IVLOG(1, "Unable to batch invocations: " << ex.what());
+            return nullptr;
+          }
+        });
+    if (!runinfo) {
+      return false;
+    }
+
+    const Evaluator& evaluator = *first.evaluator;
+    auto make_buffer = [&](const tile::TensorShape& shape) {
+      return evaluator.get_platform()->MakeBuffer(ctx, evaluator.get_id(), shape.byte_size());
+    };
+
+    // Each request's buffers, bound to the names used by the batched program.
+    std::vector<std::map<std::string, std::shared_ptr<tile::Buffer>>> ins;
+    std::vector<std::map<std::string, std::shared_ptr<tile::Buffer>>> outs;
+    for (const Request* req : requests) {
+      std::shared_ptr<Evaluator> unused;
+      ins.emplace_back(BindBuffers(runinfo->input_buffers, req->invoker->inputs, &unused));
+      outs.emplace_back(BindBuffers(runinfo->output_buffers, req->invoker->outputs, &unused));
+    }
+
+    tile::proto::Program prog{*first.prog};
+    prog.set_code(runinfo->code);
+    prog.clear_inputs();
+    prog.clear_outputs();
+    tile::ConstBufferManager const_bufs;
+    const_bufs.allocator = std::make_shared<PlatformAllocator>(evaluator);
+    std::map<std::string, std::shared_ptr<tile::Buffer>> in_buffers;
+    for (const auto& kvp : runinfo->input_shapes) {
+      *(*prog.mutable_inputs())[kvp.first].mutable_shape() = tile::IntoProto(kvp.second);
+      if (kvp.second.is_const) {
+        in_buffers[kvp.first] = ins[0].at(kvp.first);
+        const_bufs.buffers[kvp.first] = in_buffers[kvp.first];
+        continue;
+      }
+      // Gather the requests' inputs.
+      auto buffer = make_buffer(kvp.second);
+      auto view = buffer->MapDiscard(ctx);
+      std::size_t slice = view->size() / requests.size();
+      for (std::size_t idx = 0; idx < requests.size(); ++idx) {
+        auto src = ins[idx].at(kvp.first)->MapCurrent(ctx).get();
+        std::memcpy(view->data() + idx * slice, src->data(), std::min<std::size_t>(slice, src->size()));
+      }
+      view->WriteBack(ctx);
+      in_buffers[kvp.first] = std::move(buffer);
+    }
+    std::map<std::string, std::shared_ptr<tile::Buffer>> out_buffers;
+    for (const auto& kvp : runinfo->output_shapes) {
+      *(*prog.mutable_outputs())[kvp.first].mutable_shape() = tile::IntoProto(kvp.second);
+      out_buffers[kvp.first] = make_buffer(kvp.second);
+    }
+
+    auto program = first.evaluator->MakeProgram(ctx, prog, &const_bufs);
+    program->Run(ctx, in_buffers, out_buffers).get();
+
+    // Scatter the outputs.
+    for (const auto& kvp : out_buffers) {
+      auto view = kvp.second->MapCurrent(ctx).get();
+      std::size_t slice = view->size() / requests.size();
+      for (std::size_t idx = 0; idx < requests.size(); ++idx) {
+        auto dst = outs[idx].at(kvp.first)->MapDiscard(ctx);
+        std::memcpy(dst->data(), view->data() + idx * slice, std::min<std::size_t>(slice, dst->size()));
+        dst->WriteBack(ctx);
+      }
+    }
+    batched_runs_ += 1;
+    return true;
+  }
+
+  const std::chrono::microseconds window_;
+  const std::size_t max_batch_;
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::map<Key, std::shared_ptr<Batch>> open_;
+  std::map<Key, std::size_t> callers_;  // The number of requests in flight with each key
+  std::atomic<std::size_t> batched_runs_{0};
+};
+
 };  // namespace
 
+extern "C" VAI_API size_t vai_internal_batched_runs() {
+  auto* batcher = InvocationBatcher::Instance();
+  return batcher ? batcher->batched_runs() : 0;
+}
+
 extern "C" plaidml_invocation* plaidml_schedule_invocation(vai_ctx* ctx, plaidml_invoker* invoker) {
   if (!ctx || !invoker) {
     vertexai::SetLastOOM();
@@ -1617,7 +1980,7 @@ extern "C" plaidml_invocation* plaidml_schedule_invocation(vai_ctx* ctx, plaidml
     for (const auto& kv : invoker->runinfo->input_shapes) {
       auto& input = (*prog.mutable_inputs())[kv.first];
       *input.mutable_shape() = tile::IntoProto(kv.second);
-      if (output_set.count(in_buffers[kv.first].get())) {
+      if (output_set.count(in_buffers[kv.first].get()) || invoker->donated_inputs.count(kv.first)) {
         input.set_consumed(true);
       }
     }
@@ -1647,6 +2010,15 @@ extern "C" plaidml_invocation* plaidml_schedule_invocation(vai_ctx* ctx, plaidml
     params->set_max_trials(max_trials);
     params->set_max_trial_runs(max_trial_runs);
 
+    auto* batcher = InvocationBatcher::Instance();
+    std::unique_ptr<InvocationBatcher::Request> req;
+    if (batcher) {
+      req = std::make_unique<InvocationBatcher::Request>(invoker, evaluator, &prog, in_buffers, out_buffers);
+      if (batcher->Invoke(activity.ctx(), req.get())) {
+        return invocation.release();
+      }
+    }
+
     tile::ConstBufferManager const_bufs;
     const_bufs.allocator = std::make_shared<PlatformAllocator>(*evaluator);
     for (const auto& kvp : invoker->runinfo->input_shapes) {
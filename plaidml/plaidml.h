@@ -517,6 +517,17 @@ PLAIDML_API plaidml_shape* plaidml_alloc_invoker_output_shape(plaidml_invoker* i
 // needed.
 PLAIDML_API bool plaidml_set_invoker_output(plaidml_invoker* invoker, const char* name, plaidml_var* var);
 
+// Marks a named input of an invocation as donated (or, if donated is
+// false, clears the mark).  The caller promises not to read a donated
+// input's contents once an invocation using it has been scheduled, so
+// the invocation may write its outputs over the input's storage
+// instead of allocating new storage for them -- e.g. for optimizer
+// updates that replace large weight tensors.  After each invocation,
+// a donated input's contents are undefined, although the input
+// variable may still be written and used again.  The mark applies to
+// all subsequent invocations through the invoker.
+PLAIDML_API bool plaidml_set_invoker_input_donated(plaidml_invoker* invoker, const char* name, bool donated);
+
 // PlaidML Stripe file formats.
 typedef enum {
   PLAIDML_FILE_FORMAT_TILE = 1,
@@ -350,6 +350,130 @@ TEST(PlaidML_C_API, MatMul) {
   }
 }
 
+TEST(PlaidML_C_API, DonatedInputIsWrittenInPlace) {
+  vai_clear_status();
+  auto ctx = std::make_shared<vertexai::ctx>();
+  // The default configuration, with its default scheduler.
+  auto devices = plaidml::enumerate_devices(ctx, vertexai::testing::PlaidMLConfig());
+  plaidml::device dev = devices[0].open();
+  plaidml::function add_one("function (X) -> (Y) { Y = X + 1; }");
+
+  plaidml::tensor<float> x = dev.allocate(plaidml::shape<float>(ctx, {64, 64}));
+  plaidml::tensor<float> y = dev.allocate(plaidml::shape<float>(ctx, {64, 64}));
+  {
+    plaidml::mapping<float> data = x.map(plaidml::map_for_write);
+    for (size_t i = 0; i < 64; i++) {
+      for (size_t j = 0; j < 64; j++) {
+        data(i, j) = i * 64 + j;
+      }
+    }
+  }
+
+  int64_t donated = vai_get_perf_counter("donated_inputs");
+  plaidml::invoker(ctx, add_one).set_input("X", x).set_input_donated("X").set_output("Y", y).invoke();
+  EXPECT_EQ(vai_get_perf_counter("donated_inputs"), donated + 1);
+
+  plaidml::mapping<float> data = y.map(plaidml::map_for_read);
+  for (size_t i = 0; i < 64; i++) {
+    for (size_t j = 0; j < 64; j++) {
+      EXPECT_FLOAT_EQ(data(i, j), i * 64 + j + 1);
+    }
+  }
+}
+
+TEST(PlaidML_C_API, DonatedInputWaitsForEarlierReaders) {
+  vai_clear_status();
+  auto ctx = std::make_shared<vertexai::ctx>();
+  auto devices = plaidml::enumerate_devices(ctx, vertexai::testing::PlaidMLConfig());
+  plaidml::device dev = devices[0].open();
+  plaidml::function matmul("function (B[X,Z], C[Z,Y]) -> (A) { A[x,y : X,Y] = +(B[x,z] * C[z,y]); }");
+  plaidml::function add_one("function (X) -> (Y) { Y = X + 1; }");
+
+  plaidml::tensor<float> x = dev.allocate(plaidml::shape<float>(ctx, {256, 256}));
+  {
+    plaidml::mapping<float> data = x.map(plaidml::map_for_write);
+    for (size_t i = 0; i < 256; i++) {
+      for (size_t j = 0; j < 256; j++) {
+        data(i, j) = 1;
+      }
+    }
+  }
+  plaidml::tensor<float> product = dev.allocate(plaidml::shape<float>(ctx, {256, 256}));
+  plaidml::tensor<float> sum = dev.allocate(plaidml::shape<float>(ctx, {256, 256}));
+
+  // The first run only reads x, and may still be running when the second run, which may write its output over x,
+  // is scheduled.
+  plaidml::invoker(ctx, matmul).set_input("B", x).set_input("C", x).set_output("A", product).invoke();
+  plaidml::invoker(ctx, add_one).set_input("X", x).set_input_donated("X").set_output("Y", sum).invoke();
+
+  {
+    plaidml::mapping<float> data = product.map(plaidml::map_for_read);
+    EXPECT_FLOAT_EQ(data(0u, 0u), 256);
+    EXPECT_FLOAT_EQ(data(255u, 255u), 256);
+  }
+  {
+    plaidml::mapping<float> data = sum.map(plaidml::map_for_read);
+    EXPECT_FLOAT_EQ(data(0u, 0u), 2);
+    EXPECT_FLOAT_EQ(data(255u, 255u), 2);
+  }
+}
+
+TEST(PlaidML_C_API, RepeatedRunsReusePreparedPlan) {
+  vai_clear_status();
+  auto ctx = std::make_shared<vertexai::ctx>();
+  auto devices = plaidml::enumerate_devices(ctx, vertexai::testing::PlaidMLConfig());
+  plaidml::device dev = devices[0].open();
+  // T is neither an input nor an output, so the program needs a temporary for it.
+  plaidml::function matmul2(
+      "function (A[N,N], B[N,N]) -> (C) { T[i,j : N,N] = +(A[i,k] * B[k,j]); C[i,j : N,N] = +(T[i,k] * B[k,j]); }");
+
+  plaidml::tensor<float> a = dev.allocate(plaidml::shape<float>(ctx, {16, 16}));
+  plaidml::tensor<float> b = dev.allocate(plaidml::shape<float>(ctx, {16, 16}));
+  plaidml::tensor<float> c = dev.allocate(plaidml::shape<float>(ctx, {16, 16}));
+  {
+    plaidml::mapping<float> data = b.map(plaidml::map_for_write);
+    for (size_t i = 0; i < 16; i++) {
+      for (size_t j = 0; j < 16; j++) {
+        data(i, j) = i == j ? 2 : 0;
+      }
+    }
+  }
+  plaidml::invoker invoker(ctx, matmul2);
+  invoker.set_input("A", a).set_input("B", b).set_output("C", c);
+
+  int64_t runs = vai_get_perf_counter("prepared_runs");
+  int64_t tmps = vai_get_perf_counter("tmp_mem_chunks");
+  for (size_t iter = 0; iter < 4; iter++) {
+    {
+      plaidml::mapping<float> data = a.map(plaidml::map_for_write);
+      for (size_t i = 0; i < 16; i++) {
+        for (size_t j = 0; j < 16; j++) {
+          data(i, j) = iter * 1000 + i * 16 + j;
+        }
+      }
+    }
+    invoker.invoke();
+    {
+      plaidml::mapping<float> data = c.map(plaidml::map_for_read);
+      for (size_t i = 0; i < 16; i++) {
+        for (size_t j = 0; j < 16; j++) {
+          EXPECT_FLOAT_EQ(data(i, j), 4 * (iter * 1000 + i * 16 + j));
+        }
+      }
+    }
+    // Every run goes through the prepared plan; only the first run allocates the temporary for T, and the later runs
+    // execute in the plan's copy of it.
+    EXPECT_EQ(vai_get_perf_counter("prepared_runs"), runs + 1);
+    if (iter == 0) {
+      EXPECT_THAT(vai_get_perf_counter("tmp_mem_chunks"), Gt(tmps));
+    } else {
+      EXPECT_EQ(vai_get_perf_counter("tmp_mem_chunks"), tmps);
+    }
+    runs = vai_get_perf_counter("prepared_runs");
+    tmps = vai_get_perf_counter("tmp_mem_chunks");
+  }
+}
+
 TEST(PlaidML_C_API, Save) {
   vai_clear_status();
   auto ctx = std::make_shared<vertexai::ctx>();
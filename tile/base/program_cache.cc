@@ -2,16 +2,27 @@
 
 #include "tile/base/program_cache.h"
 
+#include <algorithm>
 #include <map>
+#include <set>
 #include <sstream>
 
 #include "base/util/logging.h"
+#include "tile/lang/fnv1a64.h"
 
 namespace vertexai {
 namespace tile {
 
+constexpr std::size_t ProgramCache::kShards;
+
+// Small caches use fewer shards, and the remainder of size_max is spread over the first few shards, so that the cache
+// as a whole holds exactly size_max programs.
 ProgramCache::ProgramCache(std::shared_ptr<Platform> platform, std::size_t size_max)
-    : platform_{platform}, cache_{size_max} {}
+    : platform_{platform}, shards_(std::max<std::size_t>(1, std::min(size_max, kShards))) {
+  for (std::size_t idx = 0; idx < shards_.size(); ++idx) {
+    shards_[idx].size_max = size_max / shards_.size() + (idx < size_max % shards_.size() ? 1 : 0);
+  }
+}
 
 std::tuple<std::string, std::shared_ptr<Program>> ProgramCache::GetProgram(const context::Context& ctx,
                                                                            const std::string& fallback_id,
@@ -48,6 +59,10 @@ void SerializeShapemap(std::ostringstream* serialized, const M& m) {
 
 }  // namespace
 
+std::uint64_t ProgramCache::HashKey(const Key& key) {
+  return fnv1a64::hash(key.ops.data(), key.ops.size(), fnv1a64::hash(key.subdevice.data(), key.subdevice.size()));
+}
+
 std::shared_ptr<ProgramCache::Entry> ProgramCache::GetEntry(const std::string& fallback_id,
                                                             const tile::proto::Program& program) {
   std::ostringstream serialized;
@@ -60,22 +75,78 @@ std::shared_ptr<ProgramCache::Entry> ProgramCache::GetEntry(const std::string& f
   SerializeShapemap(&serialized, program.inputs());
   SerializeShapemap(&serialized, program.outputs());
 
-  // The cache itself must be externally synchronized.
-  std::lock_guard<std::mutex> lock{mu_};
+  // Consumed inputs may be overwritten by the program, so they're part of the key too.
+  std::set<std::string> consumed;
+  for (const auto& input : program.inputs()) {
+    if (input.second.consumed()) {
+      consumed.insert(input.first);
+    }
+  }
+  for (const auto& name : consumed) {
+    serialized << name.length() << ':' << name;
+  }
+
+  Key key{program.dev_id(), serialized.str()};
+  std::uint64_t hash = hash_(key);
+  Shard* shard = &shards_[hash % shards_.size()];
 
-  return cache_.Lookup(Key{program.dev_id(), serialized.str()}, [&]() {
-    std::string cid = "c" + std::to_string(next_id_++);
-    if (program.id().size()) {
-      cid = cid + '_' + program.id();
-    } else if (fallback_id.size()) {
-      cid = cid + '_' + fallback_id;
+  {
+    std::shared_lock<std::shared_timed_mutex> lock{shard->mu};
+    auto entry = FindEntry(shard, hash, key);
+    if (entry) {
+      return entry;
     }
-    VLOG(3) << "Compiling program as " << cid;
-    tile::proto::Program cprog;
-    cprog.CopyFrom(program);
-    cprog.set_id(cid);
-    return std::make_shared<ProgramCache::Entry>(cid, cprog);
-  });
+  }
+
+  std::lock_guard<std::shared_timed_mutex> lock{shard->mu};
+  // Another thread may have added the program while the shard was unlocked.
+  auto entry = FindEntry(shard, hash, key);
+  if (entry) {
+    return entry;
+  }
+
+  std::string cid = "c" + std::to_string(next_id_++);
+  if (program.id().size()) {
+    cid = cid + '_' + program.id();
+  } else if (fallback_id.size()) {
+    cid = cid + '_' + fallback_id;
+  }
+  VLOG(3) << "Compiling program as " << cid;
+  tile::proto::Program cprog;
+  cprog.CopyFrom(program);
+  cprog.set_id(cid);
+  entry = std::make_shared<ProgramCache::Entry>(cid, cprog);
+  if (!shard->size_max) {
+    return entry;
+  }
+
+  if (shard->slots.size() >= shard->size_max) {
+    auto oldest = std::min_element(shard->slots.begin(), shard->slots.end(), [](const auto& lhs, const auto& rhs) {
+      return lhs.second->last_used.load(std::memory_order_relaxed) <
+             rhs.second->last_used.load(std::memory_order_relaxed);
+    });
+    shard->slots.erase(oldest);
+  }
+  std::unique_ptr<Slot> slot{new Slot{std::move(key), entry, {}}};
+  slot->last_used.store(shard->clock.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  shard->slots.emplace(hash, std::move(slot));
+  return entry;
+}
+
+// Requires at least a shared lock on the shard.  The clock is per shard, so concurrent hits only contend on it when
+// they land in the same shard; a hit on the most recently stamped entry doesn't touch it at all.
+std::shared_ptr<ProgramCache::Entry> ProgramCache::FindEntry(Shard* shard, std::uint64_t hash, const Key& key) {
+  auto range = shard->slots.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    Slot* slot = it->second.get();
+    if (slot->key == key) {
+      if (slot->last_used.load(std::memory_order_relaxed) != shard->clock.load(std::memory_order_relaxed)) {
+        slot->last_used.store(shard->clock.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      }
+      return slot->entry;
+    }
+  }
+  return nullptr;
 }
 
 std::shared_ptr<Program> ProgramCache::Entry::GetProgram(const context::Context& ctx, Platform* dev,
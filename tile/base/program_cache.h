@@ -2,14 +2,20 @@
 
 #pragma once
 
+#include <gtest/gtest_prod.h>
+
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <string>
 #include <tuple>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "base/context/context.h"
-#include "tile/base/lru_cache.h"
 #include "tile/base/platform.h"
 #include "tile/base/program.h"
 #include "tile/lang/parser.h"
@@ -18,7 +24,13 @@
 namespace vertexai {
 namespace tile {
 
-// ProgramCache implements an LRU Tile program cache.
+// ProgramCache implements an approximately-LRU Tile program cache.
+//
+// Programs are keyed by a 64-bit hash of the parts of the program which affect code generation; the full key is only
+// compared to confirm a hit.  The cache is split into shards by hash, each guarded by a reader/writer lock, so hits
+// only take a shared lock on one shard: recency is tracked by stamping the hit entry from the shard's atomic clock
+// rather than by reordering a list.  The shard capacities sum to size_max; when a shard is full, inserting evicts its
+// least recently stamped entry.
 class ProgramCache final {
  public:
   ProgramCache(std::shared_ptr<Platform> platform, std::size_t size_max);
@@ -39,21 +51,15 @@ class ProgramCache final {
                                                   const tile::proto::Program& program);
 
  private:
+  FRIEND_TEST(ProgramCacheTest, EvictsLeastRecentlyUsed);
+  FRIEND_TEST(ProgramCacheTest, CollidingHashesCompareFullKey);
+  FRIEND_TEST(ProgramCacheTest, HoldsAtMostSizeMax);
+
   struct Key {
     std::string subdevice;
     std::string ops;
-  };
 
-  struct KeyComp {
-    bool operator()(const Key& lhs, const Key& rhs) const {
-      if (lhs.subdevice < rhs.subdevice) {
-        return true;
-      }
-      if (rhs.subdevice < lhs.subdevice) {
-        return false;
-      }
-      return lhs.ops < rhs.ops;
-    }
+    bool operator==(const Key& rhs) const { return subdevice == rhs.subdevice && ops == rhs.ops; }
   };
 
   class Entry {
@@ -74,13 +80,31 @@ class ProgramCache final {
     std::shared_ptr<lang::Program> parsed_;
   };
 
+  struct Slot {
+    Key key;
+    std::shared_ptr<Entry> entry;
+    std::atomic<std::uint64_t> last_used;
+  };
+
+  struct Shard {
+    std::shared_timed_mutex mu;
+    std::size_t size_max = 0;
+    std::atomic<std::uint64_t> clock{0};
+    std::unordered_multimap<std::uint64_t, std::unique_ptr<Slot>> slots;
+  };
+
+  static std::uint64_t HashKey(const Key& key);
+
   std::shared_ptr<Entry> GetEntry(const std::string& fallback_id, const tile::proto::Program& program);
+  std::shared_ptr<Entry> FindEntry(Shard* shard, std::uint64_t hash, const Key& key);
+
+  static constexpr std::size_t kShards = 16;
 
   std::shared_ptr<Platform> platform_;
 
-  std::mutex mu_;
-  int next_id_ = 1;
-  LruCache<Key, std::shared_ptr<Entry>, KeyComp> cache_;
+  std::vector<Shard> shards_;
+  std::uint64_t (*hash_)(const Key& key) = &HashKey;
+  std::atomic<int> next_id_{1};
 };
 
 }  // namespace tile
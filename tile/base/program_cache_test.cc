@@ -0,0 +1,79 @@
+// Copyright 2018 Intel Corporation.
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+
+#include "tile/base/program_cache.h"
+
+namespace vertexai {
+namespace tile {
+
+namespace {
+
+proto::Program MakeProgram(const std::string& code) {
+  proto::Program program;
+  program.set_dev_id("dev");
+  program.set_code(code);
+  return program;
+}
+
+}  // namespace
+
+TEST(ProgramCacheTest, EvictsLeastRecentlyUsed) {
+  // Every shard holds two programs, and every program goes to the same shard.
+  ProgramCache cache{nullptr, 2 * ProgramCache::kShards};
+  cache.hash_ = [](const ProgramCache::Key&) -> std::uint64_t { return 0; };
+
+  auto a = cache.GetEntry("", MakeProgram("a"));
+  auto b = cache.GetEntry("", MakeProgram("b"));
+  EXPECT_EQ(cache.GetEntry("", MakeProgram("a")), a);
+
+  // b is now the least recently used, so it's the one evicted for c.
+  auto c = cache.GetEntry("", MakeProgram("c"));
+  EXPECT_EQ(cache.GetEntry("", MakeProgram("a")), a);
+  EXPECT_EQ(cache.GetEntry("", MakeProgram("c")), c);
+  EXPECT_NE(cache.GetEntry("", MakeProgram("b")), b);
+}
+
+TEST(ProgramCacheTest, CollidingHashesCompareFullKey) {
+  ProgramCache cache{nullptr, 4 * ProgramCache::kShards};
+  cache.hash_ = [](const ProgramCache::Key&) -> std::uint64_t { return 42; };
+
+  auto a = cache.GetEntry("", MakeProgram("function (A) -> (B) { B = A; }"));
+  auto b = cache.GetEntry("", MakeProgram("function (A) -> (B) { B = -A; }"));
+  auto other_dev = MakeProgram("function (A) -> (B) { B = A; }");
+  other_dev.set_dev_id("other");
+  auto c = cache.GetEntry("", other_dev);
+  EXPECT_NE(a, b);
+  EXPECT_NE(a, c);
+  EXPECT_NE(a->id(), b->id());
+
+  EXPECT_EQ(cache.GetEntry("", MakeProgram("function (A) -> (B) { B = A; }")), a);
+  EXPECT_EQ(cache.GetEntry("", MakeProgram("function (A) -> (B) { B = -A; }")), b);
+  EXPECT_EQ(cache.GetEntry("", other_dev), c);
+}
+
+TEST(ProgramCacheTest, HoldsAtMostSizeMax) {
+  // 20 doesn't divide evenly over the shards; the total capacity must still be 20.
+  ProgramCache cache{nullptr, 20};
+  std::size_t capacity = 0;
+  for (const auto& shard : cache.shards_) {
+    capacity += shard.size_max;
+  }
+  EXPECT_EQ(capacity, 20u);
+
+  for (int i = 0; i < 200; ++i) {
+    cache.GetEntry("", MakeProgram(std::to_string(i)));
+  }
+  std::size_t held = 0;
+  for (const auto& shard : cache.shards_) {
+    EXPECT_LE(shard.slots.size(), shard.size_max);
+    held += shard.slots.size();
+  }
+  EXPECT_LE(held, 20u);
+}
+
+}  // namespace tile
+}  // namespace vertexai
@@ -95,9 +95,9 @@ class AliasMap {
 bool CheckOverlap(const std::vector<Extent>& a_extents, const std::vector<Extent>& b_extents);
 
 template <typename F>
-void RunOnBlocksRecurse(const AliasMap& map, stripe::Block* block, const stripe::Tags& reqs, const F& func,
+void RunOnBlocksRecurse(const AliasMap& map, stripe::Block* block, const stripe::ResolvedTags& reqs, const F& func,
                         bool rec_func) {
-  bool run_func = block->has_tags(reqs) || reqs.count("all") > 0;
+  bool run_func = block->has_tags(reqs);
   if (run_func) {
     func(map, block);
   }
@@ -116,7 +116,9 @@ template <typename F>
 void RunOnBlocks(stripe::Block* root, const stripe::Tags& reqs, const F& func, bool rec_func = false) {
   AliasMap base;
   AliasMap root_map(base, root);
-  RunOnBlocksRecurse(root_map, root, reqs, func, rec_func);
+  // Every block has all of no tags, so "all" resolves to the empty set.
+  stripe::ResolvedTags resolved = reqs.count("all") ? stripe::Tags{} : reqs;
+  RunOnBlocksRecurse(root_map, root, resolved, func, rec_func);
 }
 
 std::ostream& operator<<(std::ostream& os, const AliasInfo& ai);
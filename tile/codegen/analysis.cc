@@ -0,0 +1,97 @@
+// Copyright 2019, Intel Corporation
+
+#include "tile/codegen/analysis.h"
+
+namespace vertexai {
+namespace tile {
+namespace codegen {
+
+const AliasMap& AnalysisCache::RootAliases(const std::shared_ptr<stripe::Block>& root) { return Aliases(base_, root); }
+
+const AliasMap& AnalysisCache::Aliases(const AliasMap& outer, const std::shared_ptr<stripe::Block>& block) {
+  auto& entry = entries_[block.get()];
+  if (!entry.aliases || entry.block.lock() != block) {
+    entry = Entry{block, std::make_unique<AliasMap>(outer, block.get())};
+  }
+  return *entry.aliases;
+}
+
+AnalysisCache::Entry* AnalysisCache::Find(const stripe::Block* block) {
+  auto it = entries_.find(block);
+  if (it == entries_.end() || it->second.block.lock().get() != block) {
+    return nullptr;
+  }
+  return &it->second;
+}
+
+const AnalysisCache::Entry* AnalysisCache::Find(const stripe::Block* block) const {
+  return const_cast<AnalysisCache*>(this)->Find(block);
+}
+
+bool AnalysisCache::HasDeps(const stripe::Block* block) const {
+  auto entry = Find(block);
+  return entry && entry->deps;
+}
+
+void AnalysisCache::SetHasDeps(const stripe::Block* block) {
+  auto entry = Find(block);
+  if (entry) {
+    entry->deps = true;
+  }
+}
+
+void AnalysisCache::Invalidate(const PreservedAnalyses& preserved) {
+  if (!preserved.aliases) {
+    entries_.clear();
+    return;
+  }
+  if (!preserved.deps) {
+    for (auto& entry : entries_) {
+      entry.second.deps = false;
+    }
+  }
+}
+
+void AnalysisCache::Invalidate(const std::vector<RewrittenBlock>& rewritten, const PreservedAnalyses& preserved) {
+  if (preserved.aliases && preserved.deps) {
+    return;
+  }
+  for (const auto& rewrite : rewritten) {
+    InvalidateNested(rewrite.block, preserved);
+    auto parent = Find(rewrite.parent);
+    if (parent) {
+      parent->deps = false;
+    }
+  }
+  if (!preserved.aliases) {
+    // The rewrites may have dropped nested blocks, which the walk above no longer reaches.
+    for (auto it = entries_.begin(); it != entries_.end();) {
+      if (it->second.block.expired()) {
+        it = entries_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+}
+
+void AnalysisCache::InvalidateNested(stripe::Block* block, const PreservedAnalyses& preserved) {
+  if (!preserved.aliases) {
+    entries_.erase(block);
+  } else {
+    auto entry = Find(block);
+    if (entry) {
+      entry->deps = false;
+    }
+  }
+  for (const auto& stmt : block->stmts) {
+    auto inner = stripe::Block::Downcast(stmt);
+    if (inner) {
+      InvalidateNested(inner.get(), preserved);
+    }
+  }
+}
+
+}  // namespace codegen
+}  // namespace tile
+}  // namespace vertexai
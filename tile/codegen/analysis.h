@@ -0,0 +1,104 @@
+// Copyright 2019, Intel Corporation
+
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "tile/codegen/alias.h"
+#include "tile/stripe/stripe.h"
+
+namespace vertexai {
+namespace tile {
+namespace codegen {
+
+// The analyses a pass leaves valid.  Passes preserve nothing by default; a pass that only retags or relocates
+// blocks, or only recomputes dependencies, says so, and the analyses cached by the CompilerState survive it.  For a
+// kernel pass, this covers only the blocks it rewrote; the analyses of every other block survive regardless.
+struct PreservedAnalyses {
+  bool aliases = false;  // No block's indexes, refinements or nesting changed
+  bool deps = false;     // Dependencies recorded as up to date still are
+
+  static PreservedAnalyses None() { return PreservedAnalyses{}; }
+  static PreservedAnalyses All() { return PreservedAnalyses{true, true}; }
+};
+
+// A block a pass rewrote, along with everything nested within it, and the block that holds it (null for the
+// program's entry block).
+struct RewrittenBlock {
+  const stripe::Block* parent;
+  stripe::Block* block;
+};
+
+// Analyses of a program's blocks, kept across passes until they're invalidated: wholesale after a pass that may have
+// changed any block, or block by block after a kernel pass, which only rewrites the blocks it matched.  Each entry
+// holds a weak reference to its block, so an entry outliving its block is never taken for that of a new block which
+// happens to reuse its address.
+class AnalysisCache {
+ public:
+  // Returns the alias map of the program's entry block.
+  const AliasMap& RootAliases(const std::shared_ptr<stripe::Block>& root);
+
+  // Returns the alias map of a block nested directly within the block whose alias map is outer.
+  const AliasMap& Aliases(const AliasMap& outer, const std::shared_ptr<stripe::Block>& block);
+
+  // Whether a block's statement dependencies are known to be up to date.  Only blocks whose alias maps are cached
+  // (as those RunOnBlocks passes to its callback are) can be marked.
+  bool HasDeps(const stripe::Block* block) const;
+  void SetHasDeps(const stripe::Block* block);
+
+  // Drops the analyses a pass didn't preserve.  Dependencies are computed from alias maps, so they're dropped along
+  // with them.
+  void Invalidate(const PreservedAnalyses& preserved);
+
+  // As above, for the blocks a pass rewrote and the blocks nested within them.  A block's refinements feed into the
+  // dependencies of the block holding it, so those are dropped too.
+  void Invalidate(const std::vector<RewrittenBlock>& rewritten, const PreservedAnalyses& preserved);
+
+ private:
+  struct Entry {
+    std::weak_ptr<stripe::Block> block;
+    std::unique_ptr<AliasMap> aliases;
+    bool deps = false;
+  };
+
+  // Returns the entry of a block that's still alive, or null.
+  Entry* Find(const stripe::Block* block);
+  const Entry* Find(const stripe::Block* block) const;
+
+  void InvalidateNested(stripe::Block* block, const PreservedAnalyses& preserved);
+
+  AliasMap base_;
+  std::unordered_map<const stripe::Block*, Entry> entries_;
+};
+
+template <typename F>
+void RunOnBlocksRecurse(AnalysisCache* analyses, const AliasMap& map, stripe::Block* block,
+                        const stripe::ResolvedTags& reqs, const F& func, bool rec_func) {
+  bool run_func = block->has_tags(reqs);
+  if (run_func) {
+    func(map, block);
+  }
+  if (!run_func || rec_func) {
+    for (auto& stmt : block->stmts) {
+      auto inner = stripe::Block::Downcast(stmt);
+      if (inner) {
+        RunOnBlocksRecurse(analyses, analyses->Aliases(map, inner), inner.get(), reqs, func, rec_func);
+      }
+    }
+  }
+}
+
+// Like RunOnBlocks, but reuses the cached alias maps.  Only passes that preserve aliases may use this; a pass that
+// rewrote blocks would see maps of the program as it was before the rewrite.
+template <typename F>
+void RunOnBlocks(AnalysisCache* analyses, const std::shared_ptr<stripe::Block>& root, const stripe::Tags& reqs,
+                 const F& func, bool rec_func = false) {
+  stripe::ResolvedTags resolved = reqs.count("all") ? stripe::Tags{} : reqs;
+  RunOnBlocksRecurse(analyses, analyses->RootAliases(root), root.get(), resolved, func, rec_func);
+}
+
+}  // namespace codegen
+}  // namespace tile
+}  // namespace vertexai
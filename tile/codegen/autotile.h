@@ -9,19 +9,21 @@ namespace vertexai {
 namespace tile {
 namespace codegen {
 
-class AutotilePass final : public CompilePass {
+class AutotilePass final : public KernelPass {
  public:
   explicit AutotilePass(const proto::AutotilePass& options) : options_{options} {}
-  void Apply(CompilerState* state) const final;
+  stripe::Tags reqs() const final { return stripe::FromProto(options_.reqs()); }
+  void ApplyToBlock(const AliasMap& map, stripe::Block* block) const final;
 
  private:
   proto::AutotilePass options_;
 };
 
-class PartitionComputePass final : public CompilePass {
+class PartitionComputePass final : public KernelPass {
  public:
   explicit PartitionComputePass(const proto::PartitionComputePass& options) : options_{options} {}
-  void Apply(CompilerState* state) const final;
+  stripe::Tags reqs() const final { return stripe::FromProto(options_.reqs()); }
+  void ApplyToBlock(const AliasMap& map, stripe::Block* block) const final;
 
  private:
   proto::PartitionComputePass options_;
@@ -8,6 +8,7 @@
 
 #include "base/util/stream_container.h"
 #include "tile/codegen/localize.h"
+#include "tile/codegen/tile.h"
 #include "tile/stripe/stripe.h"
 
 namespace vertexai {
@@ -153,9 +154,149 @@ void CachePass::Apply(CompilerState* state) const {
   });
 }
 
+namespace {
+
+// Whether a refinement's elements already lie in one dense row-major run.
+bool IsDense(const TensorShape& shape) {
+  int64_t stride = 1;
+  for (auto it = shape.dims.rbegin(); it != shape.dims.rend(); ++it) {
+    if (it->size > 1 && it->stride != stride) {
+      return false;
+    }
+    stride *= it->size;
+  }
+  return true;
+}
+
+// How many times each element of a refinement is read by a block: the product
+// of the ranges of the indexes the refinement's access does not depend on.
+uint64_t Reuse(const Block& block, const Refinement& ref, std::vector<size_t>* reuse_idxs = nullptr) {
+  uint64_t reuse = 1;
+  for (size_t i = 0; i < block.idxs.size(); i++) {
+    const auto& idx = block.idxs[i];
+    bool used = false;
+    for (const auto& access : ref.access) {
+      used |= access.get(idx.name) != 0;
+    }
+    if (!used && idx.range > 1) {
+      reuse *= idx.range;
+      if (reuse_idxs) {
+        reuse_idxs->push_back(i);
+      }
+    }
+  }
+  return reuse;
+}
+
+// The reuse of a refinement within the sub-blocks that read it.
+uint64_t InnerReuse(const Block& block, const std::string& var_name) {
+  uint64_t reuse = 1;
+  for (const auto& stmt : block.stmts) {
+    auto inner = Block::Downcast(stmt);
+    if (!inner) {
+      continue;
+    }
+    for (const auto& ref : inner->refs) {
+      if (ref.from == var_name) {
+        reuse = std::max(reuse, Reuse(*inner, ref) * InnerReuse(*inner, ref.into()));
+      }
+    }
+  }
+  return reuse;
+}
+
+}  // namespace
+
+bool ApplyPack(const AliasMap& map,              //
+               Block* block,                     //
+               const Location& mem_loc,          //
+               const Location& xfer_loc,         //
+               uint64_t min_reuse,               //
+               const Tags& inner_set,            //
+               bool add_constraints,             //
+               const Tags& move_tags) {
+  // Inputs which are already contiguous gain nothing from a copy, and
+  // neither do inputs whose elements are each read only once per tile.
+  std::vector<std::string> candidates;
+  for (const auto& ref : block->refs) {
+    if (ref.dir == RefDir::In && !IsDense(ref.interior_shape) && InnerReuse(*block, ref.into()) >= min_reuse) {
+      candidates.push_back(ref.into());
+    }
+  }
+  if (candidates.empty()) {
+    return false;
+  }
+  // The candidate reused across the most iterations of this block becomes the
+  // panel: the block is split so that the iterations which reuse it run
+  // inside a new inner block, and the panel is packed once outside of it.
+  std::string panel;
+  uint64_t panel_reuse = 1;
+  std::vector<size_t> panel_idxs;
+  for (const auto& name : candidates) {
+    std::vector<size_t> reuse_idxs;
+    uint64_t reuse = Reuse(*block, *block->ref_by_into(name), &reuse_idxs);
+    if (reuse >= min_reuse && reuse > panel_reuse) {
+      panel = name;
+      panel_reuse = reuse;
+      panel_idxs = reuse_idxs;
+    }
+  }
+  // Every other candidate is packed once per tile, which is amortized over
+  // its reuse within the tile.
+  auto pack_tiles = [&](const AliasMap& tile_map, Block* tile_block) {
+    for (const auto& name : candidates) {
+      if (name != panel) {
+        ApplyCache(tile_map, tile_block, name, mem_loc, xfer_loc, {"pack", "pack_load"}, {"pack", "pack_store"},
+                   add_constraints);
+      }
+    }
+  };
+  if (panel.empty()) {
+    pack_tiles(map, block);
+    return true;
+  }
+  if (!map.parent_alias_map()) {
+    throw std::runtime_error("ApplyPack: Cannot split the root block");
+  }
+  TileShape shape(block->idxs.size(), 1);
+  for (auto i : panel_idxs) {
+    shape[i] = block->idxs[i].range;
+  }
+  ApplyTile(block, shape, false);
+  auto inner = Block::Downcast(block->stmts.front());
+  inner->name = block->name;
+  inner->set_tags(inner_set);
+  for (const auto& tag : move_tags) {
+    if (block->has_tag(tag)) {
+      block->remove_tag(tag);
+      inner->add_tags({tag});
+    }
+  }
+  // Splitting changed the block's refinements, so its aliases are recomputed.
+  AliasMap split_map(*map.parent_alias_map(), block);
+  ApplyCache(split_map, block, panel, mem_loc, xfer_loc, {"pack", "pack_load"}, {"pack", "pack_store"},
+             add_constraints);
+  AliasMap outer_map(*map.parent_alias_map(), block);
+  AliasMap inner_map(outer_map, inner.get());
+  pack_tiles(inner_map, inner.get());
+  return true;
+}
+
+void PackPass::Apply(CompilerState* state) const {
+  auto reqs = FromProto(options_.reqs());
+  auto inner_set = FromProto(options_.inner_set());
+  auto move_tags = FromProto(options_.move_tags());
+  auto mem_loc = stripe::FromProto(options_.mem_loc());
+  auto xfer_loc = stripe::FromProto(options_.xfer_loc());
+  RunOnBlocks(state->entry(), reqs, [&](const AliasMap& map, Block* block) {  //
+    ApplyPack(map, block, mem_loc, xfer_loc, options_.min_reuse(), inner_set, options_.add_constraints(), move_tags);
+  });
+}
+
 namespace {
 [[gnu::unused]] char reg = []() -> char {
   CompilePassFactory<CachePass, proto::CachePass>::Register();
+  CompilePassFactory<PackPass, proto::PackPass>::Register();
   return 0;
 }();
 }  // namespace
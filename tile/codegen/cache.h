@@ -22,6 +22,17 @@ void ApplyCache(const AliasMap& map,                                       //
                 const stripe::Tags store_tags = {"cache", "cache_store"},  //
                 bool add_constraints = true);
 
+// Packs the non-contiguous input tiles of a tiled block into dense local
+// buffers; returns whether anything was packed. See proto::PackPass.
+bool ApplyPack(const AliasMap& map,                  //
+               stripe::Block* block,                 //
+               const stripe::Location& mem_loc,      //
+               const stripe::Location& xfer_loc,     //
+               uint64_t min_reuse = 2,               //
+               const stripe::Tags& inner_set = {},   //
+               bool add_constraints = true,          //
+               const stripe::Tags& move_tags = {});
+
 class CachePass final : public CompilePass {
  public:
   explicit CachePass(const proto::CachePass& options) : options_{options} {}
@@ -31,6 +42,15 @@ class CachePass final : public CompilePass {
   proto::CachePass options_;
 };
 
+class PackPass final : public CompilePass {
+ public:
+  explicit PackPass(const proto::PackPass& options) : options_{options} {}
+  void Apply(CompilerState* state) const final;
+
+ private:
+  proto::PackPass options_;
+};
+
 }  // namespace codegen
 }  // namespace tile
 }  // namespace vertexai
@@ -3,10 +3,13 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
+#include "base/context/context.h"
 #include "base/util/any_factory.h"
 #include "base/util/any_factory_map.h"
 #include "tile/base/buffer.h"
+#include "tile/codegen/analysis.h"
 #include "tile/stripe/stripe.h"
 
 namespace vertexai {
@@ -19,6 +22,8 @@ class CompilerState {
 
   std::shared_ptr<stripe::Program> prog;
   ConstBufferManager* const_bufs;
+  context::Context ctx;     // Each pass is logged as an activity within this context
+  AnalysisCache analyses;  // Invalidated according to what each pass preserves
 
   stripe::Block* entry() { return prog->entry.get(); }
 };
@@ -29,6 +34,50 @@ class CompilePass {
  public:
   virtual ~CompilePass() {}
   virtual void Apply(CompilerState* root) const = 0;
+
+  // The analyses that Apply leaves valid.
+  virtual PreservedAnalyses preserved() const { return PreservedAnalyses::None(); }
+};
+
+// A KernelPass rewrites the blocks that match its requirements, and the
+// blocks nested within them, without touching anything outside those
+// blocks.  That makes each kernel's subtree independent of the others, so
+// Optimize may apply a sequence of kernel passes to different kernels
+// concurrently, and only the analyses of the rewritten blocks need be
+// invalidated.
+class KernelPass : public CompilePass {
+ public:
+  // Applies the pass and invalidates the analyses of the blocks it rewrote.
+  void Apply(CompilerState* state) const final {
+    auto tags = reqs();
+    stripe::ResolvedTags resolved = tags.count("all") ? stripe::Tags{} : tags;
+    AliasMap base;
+    std::vector<RewrittenBlock> rewritten;
+    ApplyWithin(AliasMap{base, state->entry()}, nullptr, state->entry(), resolved, &rewritten);
+    state->analyses.Invalidate(rewritten, preserved());
+  }
+
+  // The tags of the blocks this pass rewrites.
+  virtual stripe::Tags reqs() const = 0;
+
+  // Rewrites one block that matches reqs().
+  virtual void ApplyToBlock(const AliasMap& map, stripe::Block* block) const = 0;
+
+ private:
+  void ApplyWithin(const AliasMap& map, const stripe::Block* parent, stripe::Block* block,
+                   const stripe::ResolvedTags& reqs, std::vector<RewrittenBlock>* rewritten) const {
+    if (block->has_tags(reqs)) {
+      ApplyToBlock(map, block);
+      rewritten->emplace_back(RewrittenBlock{parent, block});
+      return;
+    }
+    for (const auto& stmt : block->stmts) {
+      auto inner = stripe::Block::Downcast(stmt);
+      if (inner) {
+        ApplyWithin(AliasMap{map, inner.get()}, block, inner.get(), reqs, rewritten);
+      }
+    }
+  }
 };
 
 // CompilePassFactory implements the TypedAnyFactory abstraction by
@@ -16,9 +16,9 @@ namespace codegen {
 
 // Traverse backward and the innermost first
 template <typename F>
-void RunOnBlocksRecurseBackward(const AliasMap& map, stripe::Block* block, const stripe::Tags& reqs, const F& func,
-                                bool rec_func) {
-  bool run_func = block->has_tags(reqs) || reqs.count("all") > 0;
+void RunOnBlocksRecurseBackward(const AliasMap& map, stripe::Block* block, const stripe::ResolvedTags& reqs,
+                                const F& func, bool rec_func) {
+  bool run_func = block->has_tags(reqs);
   if (!run_func || rec_func) {
     for (auto stmt_it = block->stmts.rbegin(); stmt_it != block->stmts.rend(); ++stmt_it) {
       auto inner = stripe::Block::Downcast(*stmt_it);
@@ -44,7 +44,9 @@ template <typename F>
 void RunOnBlocksBackward(stripe::Block* root, const stripe::Tags& reqs, const F& func, bool rec_func = false) {
   AliasMap base;
   AliasMap root_map(base, root);
-  RunOnBlocksRecurseBackward(root_map, root, reqs, func, rec_func);
+  // Every block has all of no tags, so "all" resolves to the empty set.
+  stripe::ResolvedTags resolved = reqs.count("all") ? stripe::Tags{} : reqs;
+  RunOnBlocksRecurseBackward(root_map, root, resolved, func, rec_func);
 }
 
 void DeadCodeElimination(const AliasMap& alias_map, stripe::Block* block);
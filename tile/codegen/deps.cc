@@ -217,11 +217,17 @@ void ComputeDepsForBlock(Block* block, const AliasMap& alias_map) {
   }
 }
 
-// Recomputes Statement dependencies within all matching Blocks.
+// Recomputes Statement dependencies within all matching Blocks, skipping
+// those whose dependencies haven't been invalidated since they were last
+// computed.
 void ComputeDepsPass::Apply(CompilerState* state) const {
   auto reqs = stripe::FromProto(options_.reqs());
-  RunOnBlocks(state->entry(), reqs, [](const AliasMap& map, stripe::Block* block) {  //
-    ComputeDepsForBlock(block, map);
+  auto analyses = &state->analyses;
+  RunOnBlocks(analyses, state->prog->entry, reqs, [analyses](const AliasMap& map, stripe::Block* block) {
+    if (!analyses->HasDeps(block)) {
+      ComputeDepsForBlock(block, map);
+      analyses->SetHasDeps(block);
+    }
   });
 }
 
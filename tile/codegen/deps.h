@@ -33,6 +33,7 @@ class ComputeDepsPass final : public CompilePass {
  public:
   explicit ComputeDepsPass(const proto::ComputeDepsPass& options) : options_{options} {}
   void Apply(CompilerState* state) const final;
+  PreservedAnalyses preserved() const final { return PreservedAnalyses::All(); }
 
  private:
   proto::ComputeDepsPass options_;
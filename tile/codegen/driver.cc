@@ -2,10 +2,22 @@
 
 #include "tile/codegen/driver.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
 #include <boost/format.hpp>
 
 #include "base/config/config.h"
 #include "base/util/any_factory_map.h"
+#include "base/util/perf_counter.h"
 #include "base/util/throw.h"
 #include "tile/codegen/alias.h"
 #include "tile/codegen/compile_pass.h"
@@ -19,6 +31,8 @@ using namespace stripe;  // NOLINT
 
 namespace {
 
+PerfCounter parallel_kernel_groups("codegen_parallel_kernel_groups");
+
 void DumpProgram(const Block& program,            //
                  const OptimizeOptions& options,  //
                  const std::string& name,         //
@@ -50,24 +64,107 @@ void DumpProgram(const Block& program,            //
   }
 }
 
-void ValidateBlock(Block* root) {
-  RunOnBlocks(  //
-      root, {},
-      [&](auto map, auto block) {
-        for (const auto& ref : block->refs) {
-          if (ref.dir == RefDir::None && !ref.from.empty()) {
-            throw_with_trace(std::runtime_error(
-                str(boost::format("ref.dir == RefDir::None && !ref.from.empty(). ref: %1% in block: %2%") % ref.into() %
-                    block->name)));
-          }
-          if (ref.from.empty() && ref.dir != RefDir::None) {
-            throw_with_trace(std::runtime_error(
-                str(boost::format("ref.from.empty() && ref.dir != RefDir::None. ref: %1% in block: %2%") % ref.into() %
-                    block->name)));
-          }
+// N.B. This runs after every pass, and doesn't need alias maps, so it walks
+// the blocks directly rather than through RunOnBlocks.
+void ValidateBlock(Block* block) {
+  for (const auto& ref : block->refs) {
+    if (ref.dir == RefDir::None && !ref.from.empty()) {
+      throw_with_trace(std::runtime_error(
+          str(boost::format("ref.dir == RefDir::None && !ref.from.empty(). ref: %1% in block: %2%") % ref.into() %
+              block->name)));
+    }
+    if (ref.from.empty() && ref.dir != RefDir::None) {
+      throw_with_trace(std::runtime_error(
+          str(boost::format("ref.from.empty() && ref.dir != RefDir::None. ref: %1% in block: %2%") % ref.into() %
+              block->name)));
+    }
+  }
+  for (const auto& stmt : block->stmts) {
+    auto inner = Block::Downcast(stmt);
+    if (inner) {
+      ValidateBlock(inner.get());
+    }
+  }
+}
+
+std::unique_ptr<CompilePass> MakePass(const context::Context& ctx, const proto::Pass& pass) {
+  std::unique_ptr<CompilePass> compile_pass =
+      AnyFactoryMap<CompilePass>::Instance()->MakeInstanceIfSupported(ctx, pass.pass());
+  if (!compile_pass) {
+    throw_with_trace(std::runtime_error(
+        str(boost::format("Unsupported pass: %1% -> %2%") % pass.name() % pass.pass().type_url())));
+  }
+  return compile_pass;
+}
+
+// A kernel, and the block that holds it along with its alias map.
+struct Kernel {
+  const AliasMap* outer;
+  Block* parent;
+  Block* block;
+};
+
+// Finds the kernels within a block, building the alias maps of the blocks that hold them.  Returns false if the
+// block, or any other block outside the kernels, matches one of reqs: applying those passes could then change more
+// than the kernels.
+bool FindKernels(const AliasMap& map,                    //
+                 Block* block,                            //
+                 const std::vector<ResolvedTags>& reqs,  //
+                 std::list<AliasMap>* maps,               //
+                 std::vector<Kernel>* kernels) {
+  for (const auto& pass_reqs : reqs) {
+    if (block->has_tags(pass_reqs)) {
+      return false;
+    }
+  }
+  for (const auto& stmt : block->stmts) {
+    auto inner = Block::Downcast(stmt);
+    if (!inner) {
+      continue;
+    }
+    if (inner->has_tag("kernel")) {
+      kernels->emplace_back(Kernel{&map, block, inner.get()});
+      continue;
+    }
+    maps->emplace_back(map, inner.get());
+    if (!FindKernels(maps->back(), inner.get(), reqs, maps, kernels)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Calls body(i) for each i in [0, count), on up to the given number of threads including the calling one.  Rethrows
+// the first exception thrown by body, once every call has finished.  The threads are started per call rather than
+// pooled: Optimize makes one call per run of kernel passes, which is a handful per program.
+void ParallelFor(size_t count, size_t threads, const std::function<void(size_t)>& body) {
+  std::atomic<size_t> next{0};
+  std::mutex mu;
+  std::exception_ptr error;
+  auto worker = [&] {
+    for (size_t i = next++; i < count; i = next++) {
+      try {
+        body(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock{mu};
+        if (!error) {
+          error = std::current_exception();
         }
-      },
-      true);
+        next = count;
+      }
+    }
+  };
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < std::min(count, threads); i++) {
+    workers.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : workers) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
 }
 
 class ConfigsRegistry {
@@ -98,17 +195,112 @@ class ConfigsRegistry {
 void Optimize(CompilerState* state, const Passes& passes, const OptimizeOptions& options) {
   size_t counter = 0;
   DumpProgram(*state->entry(), options, "initial", counter++);
+  std::vector<std::unique_ptr<CompilePass>> compile_passes;
   for (const auto& pass : passes) {
+    compile_passes.emplace_back(MakePass(state->ctx, pass));
+  }
+  // Dumps show the program after each pass, so they need the passes applied one at a time.
+  bool dumping = options.dump_passes || options.dump_passes_proto || options.dump_code;
+  size_t threads = options.threads ? options.threads : std::thread::hardware_concurrency();
+  // The time each pass took; for passes applied to kernels concurrently, summed over the kernels.
+  std::vector<std::pair<std::string, std::chrono::duration<double, std::milli>>> timings;
+  auto optimize_start = std::chrono::steady_clock::now();
+  for (int idx = 0; idx < passes.size();) {
+    // Apply runs of kernel passes to the program's kernels concurrently, when no block outside the kernels matches
+    // any of them.
+    std::vector<const KernelPass*> kernel_passes;
+    std::vector<ResolvedTags> kernel_reqs;
+    std::string name;
+    for (int next = idx; 1 < threads && !dumping && next < passes.size(); next++) {
+      auto kernel_pass = dynamic_cast<const KernelPass*>(compile_passes[next].get());
+      if (!kernel_pass) {
+        break;
+      }
+      auto reqs = kernel_pass->reqs();
+      kernel_passes.push_back(kernel_pass);
+      kernel_reqs.emplace_back(reqs.count("all") ? Tags{} : reqs);
+      name += (name.empty() ? "" : "+") + passes[next].name();
+    }
+    AliasMap base;
+    std::list<AliasMap> maps;
+    std::vector<Kernel> kernels;
+    if (kernel_passes.size()) {
+      maps.emplace_back(base, state->entry());
+      if (!FindKernels(maps.back(), state->entry(), kernel_reqs, &maps, &kernels)) {
+        kernels.clear();
+      }
+    }
+    if (1 < kernels.size()) {
+      IVLOG(1, "Optimization Passes " << name << " on " << kernels.size() << " kernels");
+      parallel_kernel_groups.inc();
+      // Each pass is logged and timed per kernel, so the trace and the timings still show what each pass cost.
+      using Duration = std::chrono::duration<double, std::milli>;
+      std::vector<std::vector<Duration>> durations(kernels.size(), std::vector<Duration>(kernel_passes.size()));
+      auto start = std::chrono::steady_clock::now();
+      ParallelFor(kernels.size(), threads, [&](size_t k) {
+        const auto& kernel = kernels[k];
+        for (size_t p = 0; p < kernel_passes.size(); p++) {
+          auto kernel_pass = kernel_passes[p];
+          context::Activity activity{state->ctx, "tile::codegen::" + passes[idx + p].name()};
+          auto pass_start = std::chrono::steady_clock::now();
+          AliasMap kernel_map{*kernel.outer, kernel.block};
+          RunOnBlocksRecurse(kernel_map, kernel.block, kernel_reqs[p],
+                             [kernel_pass](const AliasMap& map, Block* block) {  //
+                               kernel_pass->ApplyToBlock(map, block);
+                             },
+                             false);
+          durations[k][p] = std::chrono::steady_clock::now() - pass_start;
+        }
+      });
+      Duration elapsed = std::chrono::steady_clock::now() - start;
+      for (size_t p = 0; p < kernel_passes.size(); p++) {
+        Duration total{0};
+        for (const auto& kernel_durations : durations) {
+          total += kernel_durations[p];
+        }
+        timings.emplace_back(passes[idx + p].name(), total);
+        IVLOG(1, "Optimization Pass " << passes[idx + p].name() << " took " << total.count() << " ms over "
+                                      << kernels.size() << " kernels");
+      }
+      IVLOG(1, "Optimization Passes " << name << " took " << elapsed.count() << " ms");
+      std::vector<RewrittenBlock> rewritten;
+      for (const auto& kernel : kernels) {
+        rewritten.emplace_back(RewrittenBlock{kernel.parent, kernel.block});
+      }
+      for (auto kernel_pass : kernel_passes) {
+        state->analyses.Invalidate(rewritten, kernel_pass->preserved());
+      }
+      ValidateBlock(state->entry());
+      counter += kernel_passes.size();
+      idx += kernel_passes.size();
+      continue;
+    }
+    const auto& pass = passes[idx];
+    const auto& compile_pass = compile_passes[idx];
     IVLOG(1, "Optimization Pass " << pass.name());
-    std::unique_ptr<CompilePass> compile_pass =
-        AnyFactoryMap<CompilePass>::Instance()->MakeInstanceIfSupported(context::Context{}, pass.pass());
-    if (!compile_pass) {
-      throw_with_trace(std::runtime_error(
-          str(boost::format("Unsupported pass: %1% -> %2%") % pass.name() % pass.pass().type_url())));
+    {
+      context::Activity activity{state->ctx, "tile::codegen::" + pass.name()};
+      auto start = std::chrono::steady_clock::now();
+      compile_pass->Apply(state);
+      timings.emplace_back(pass.name(), std::chrono::steady_clock::now() - start);
+    }
+    IVLOG(1, "Optimization Pass " << pass.name() << " took " << timings.back().second.count() << " ms");
+    // Kernel passes invalidate the analyses of the blocks they rewrote themselves.
+    if (!dynamic_cast<const KernelPass*>(compile_pass.get())) {
+      state->analyses.Invalidate(compile_pass->preserved());
     }
-    compile_pass->Apply(state);
     DumpProgram(*state->entry(), options, pass.name(), counter++);
     ValidateBlock(state->entry());
+    idx++;
+  }
+  if (VLOG_IS_ON(1)) {
+    std::chrono::duration<double, std::milli> total = std::chrono::steady_clock::now() - optimize_start;
+    std::stable_sort(timings.begin(), timings.end(),
+                     [](const auto& lhs, const auto& rhs) { return lhs.second > rhs.second; });
+    VLOG(1) << "Optimization passes took " << total.count() << " ms:";
+    for (const auto& timing : timings) {
+      VLOG(1) << "  " << timing.first << ": " << timing.second.count() << " ms";
+    }
   }
   // Remove constants that are no longer used
   if (state->const_bufs == nullptr) {
@@ -19,6 +19,7 @@ struct OptimizeOptions {
   bool dump_passes_proto = false;
   bool dump_code = false;
   boost::filesystem::path dbg_dir;
+  size_t threads = 0;  // For applying kernel passes to kernels concurrently; 0 uses every hardware thread
 };
 
 using Passes = google::protobuf::RepeatedPtrField<proto::Pass>;
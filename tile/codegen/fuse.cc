@@ -578,11 +578,11 @@ void FusionInner(const AliasMap& scope, Block* block, FusionStrategy* strategy,
 }
 
 struct FusionPassOptions {
-  Tags parent_reqs;
-  Tags a_block_reqs;
-  Tags b_block_reqs;
+  ResolvedTags parent_reqs;
+  ResolvedTags a_block_reqs;
+  ResolvedTags b_block_reqs;
   Tags fused_set;
-  Tags exclude;
+  ResolvedTags exclude;
   bool perfect;
   bool output_match;
   bool no_inner;
@@ -71,7 +71,7 @@ void KernelTag(const AliasMap& alias_map, Block* block) {
 
 void KernelTagPass::Apply(CompilerState* state) const {
   auto reqs = stripe::FromProto(options_.reqs());
-  RunOnBlocks(state->entry(), reqs,
+  RunOnBlocks(&state->analyses, state->prog->entry, reqs,
               [](const AliasMap& alias_map, stripe::Block* block) {  //
                 KernelTag(alias_map, block);
               },
@@ -17,6 +17,7 @@ class KernelTagPass final : public CompilePass {
  public:
   explicit KernelTagPass(const proto::KernelTagPass& options) : options_{options} {}
   void Apply(CompilerState* state) const final;
+  PreservedAnalyses preserved() const final { return PreservedAnalyses::All(); }
 
  private:
   proto::KernelTagPass options_;
@@ -161,7 +161,7 @@ void LocateMemoryPass::Apply(CompilerState* state) const {
 void LocateBlockPass::Apply(CompilerState* state) const {
   auto reqs = FromProto(options_.reqs());
   auto loc = stripe::FromProto(options_.loc());
-  RunOnBlocks(state->entry(), reqs, [&loc, this](const AliasMap& map, Block* block) {  //
+  RunOnBlocks(&state->analyses, state->prog->entry, reqs, [&loc, this](const AliasMap& map, Block* block) {  //
     auto* block_loc = &block->location;
     if (options_.append_devs()) {
       block_loc->devs.insert(block_loc->devs.end(), loc.devs.begin(), loc.devs.end());
@@ -175,7 +175,7 @@ void LocateInnerBlockPass::Apply(CompilerState* state) const {
   auto reqs = FromProto(options_.reqs());
   auto inner_reqs = FromProto(options_.inner_reqs());
   auto loc = stripe::FromProto(options_.loc());
-  RunOnBlocks(state->entry(), reqs, [&](const AliasMap& map, Block* block) {  //
+  RunOnBlocks(&state->analyses, state->prog->entry, reqs, [&](const AliasMap& map, Block* block) {  //
     LocateInnerBlock(block, inner_reqs, loc, options_);
   });
 }
@@ -48,6 +48,7 @@ class LocateBlockPass final : public CompilePass {
  public:
   explicit LocateBlockPass(const proto::LocateBlockPass& options) : options_{options} {}
   void Apply(CompilerState* state) const final;
+  PreservedAnalyses preserved() const final { return PreservedAnalyses::All(); }
 
  private:
   proto::LocateBlockPass options_;
@@ -57,6 +58,7 @@ class LocateInnerBlockPass final : public CompilePass {
  public:
   explicit LocateInnerBlockPass(const proto::LocateInnerBlockPass& options) : options_{options} {}
   void Apply(CompilerState* state) const final;
+  PreservedAnalyses preserved() const final { return PreservedAnalyses::All(); }
 
  private:
   proto::LocateInnerBlockPass options_;
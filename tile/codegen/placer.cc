@@ -2,13 +2,20 @@
 
 #include "tile/codegen/placer.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <list>
+#include <map>
+#include <queue>
+#include <random>
 #include <set>
 #include <stack>
+#include <utility>
+#include <vector>
 
 #include <boost/dynamic_bitset.hpp>
-#include <boost/graph/undirected_graph.hpp>
 
+#include "base/util/logging.h"
 #include "tile/base/shape.h"
 #include "tile/codegen/alias.h"
 #include "tile/math/util.h"
@@ -61,10 +68,22 @@
 //   finding an optimal placement, we use a simple approximation: we
 //   place the chunks in largest-to-smallest order, using best-fit.
 //
-//   More concretely: for each chunk (in largest-to-smallest order),
-//   we take the set of temporally-overlapping chunks, sort them by
-//   existing offset, and then walk the list in order, looking for the
-//   smallest free range that's big enough for the chunk.
+//   More concretely: for each chunk (in largest-to-smallest order,
+//   longer-lived chunks first among chunks of the same size), we take
+//   the set of temporally-overlapping chunks, sort them by existing
+//   offset, and then walk the list in order, looking for the smallest
+//   free range that's big enough for the chunk.
+//
+// * Since the result depends on the order in which chunks are placed,
+//   we also try placing them by area (size times lifetime), and then
+//   spend a bounded number of rounds (options.search_rounds()) trying
+//   small perturbations of the best order found so far, keeping
+//   whichever order yields the smallest total arena size.
+//
+// * Finally, we compute a lower bound on each arena's size: chunks
+//   whose lifetimes (in statement order) overlap must all interfere
+//   with each other, so no placement can use less than the largest
+//   total size of the chunks live at any one statement.
 
 namespace vertexai {
 namespace tile {
@@ -73,14 +92,6 @@ namespace {
 
 constexpr std::size_t kDefaultAlignment = 4;
 
-struct Chunk;
-
-struct InterferenceVertex {
-  Chunk* chunk;
-};
-
-typedef boost::adjacency_list<boost::listS, boost::listS, boost::undirectedS, InterferenceVertex> InterferenceGraph;
-
 struct Chunk {
   Chunk(stripe::Refinement* ref_, std::size_t alignment, std::size_t stmt_limit)
       : ref{ref_},
@@ -91,13 +102,15 @@ struct Chunk {
 
   stripe::Refinement* ref;
   std::size_t size;
+  std::size_t offset = 0;
   bool placed = false;
   bool saw_first_accessor = false;
   std::size_t first_accessor_idx = 0;
+  std::size_t last_accessor_idx = 0;
   boost::dynamic_bitset<> accessors;
   boost::dynamic_bitset<> transitive_accessor_deps;
   boost::dynamic_bitset<> subsequent_accessor_deps;
-  InterferenceGraph::vertex_descriptor interference_vertex;
+  std::vector<Chunk*> interferences;
 };
 
 struct StmtInfo {
@@ -164,6 +177,7 @@ class ChunkUseRecorder : public stripe::MutableStmtVisitor {
     }
     Chunk* chunk = it->second;
     chunk->accessors.set(stmt_info_->idx);
+    chunk->last_accessor_idx = stmt_info_->idx;
     if (!chunk->saw_first_accessor) {
       chunk->saw_first_accessor = true;
       chunk->first_accessor_idx = stmt_info_->idx;
@@ -273,9 +287,101 @@ std::size_t CountStatements(stripe::Block* outermost_block) {
   return result;
 }
 
+// Places the chunks in the supplied order, setting their offsets, and
+// returns the resulting total arena size.
+std::size_t PackChunks(const std::vector<Chunk*>& order) {
+  for (Chunk* chunk : order) {
+    chunk->placed = false;
+  }
+
+  std::size_t total = 0;
+  std::map<stripe::Location, std::size_t> arenas;
+  std::vector<Chunk*> already_placed;
+  for (Chunk* chunk : order) {
+    // Build a vector of already-placed chunks that we need to
+    // consider when placing this chunk.
+    already_placed.clear();
+    for (Chunk* candidate : chunk->interferences) {
+      if (candidate->placed) {
+        already_placed.push_back(candidate);
+      }
+    }
+
+    // Sort the vector by placement offset, lowest-offset first.
+    std::sort(already_placed.begin(), already_placed.end(),
+              [](const Chunk* lhs, const Chunk* rhs) { return lhs->offset < rhs->offset; });
+
+    // Scan for usable gaps in the already_placed vector.
+    // N.B. The already_placed vector may contain overlapping chunks.
+    //
+    // We keep track of the overall limit offset we've seen so far, as
+    // well as whether we've seen a usable gap at all, the location of
+    // that gap, and the known size of that gap.
+    //
+    // Note that the gap we're considering is always
+    // [offset_limit...current->offset).  This is because either:
+    //
+    // * We don't have a gap yet; some earlier-processed
+    //   already-placed chunk must have started at an offset that's
+    //   too low for the current chunk we're placing to fit before it,
+    //   and subsequent chunks have either been overlapping or had too
+    //   small a gap for us to consider.  offset_limit is the first
+    //   offset that's known to be past all these earlier-processed
+    //   chunks.
+    //
+    // * We do have a candidate gap.  It's the best gap we know about
+    //   given all the chunks we've seen so far, which cover the
+    //   entire space up to offset_limit.  So any better gap has to
+    //   start at offset_limit.
+    std::size_t offset_limit = 0;
+    bool have_gap = false;
+    std::size_t gap_offset = 0;
+    std::size_t gap_size = 0;
+
+    for (Chunk* placed_chunk : already_placed) {
+      // See whether we have a usable gap here.
+      if (offset_limit < placed_chunk->offset) {
+        std::size_t candidate_size = placed_chunk->offset - offset_limit;
+        if (chunk->size <= candidate_size && (!have_gap || (candidate_size < gap_size))) {
+          // This is a usable gap, and either we don't have a gap or
+          // the candidate gap is smaller than the best gap we've
+          // found so far.
+          have_gap = true;
+          gap_offset = offset_limit;
+          gap_size = candidate_size;
+        }
+      }
+
+      // Update offset_limit.
+      std::size_t placed_chunk_limit = placed_chunk->offset + placed_chunk->size;
+      if (offset_limit < placed_chunk_limit) {
+        offset_limit = placed_chunk_limit;
+      }
+    }
+
+    // If we don't have a gap yet, offset_limit is where we have to put the current chunk.
+    if (!have_gap) {
+      gap_offset = offset_limit;
+    }
+
+    // We have an offset for this chunk.
+    chunk->offset = gap_offset;
+    chunk->placed = true;
+
+    std::size_t& arena = arenas[chunk->ref->location];
+    if (arena < chunk->offset + chunk->size) {
+      total += chunk->offset + chunk->size - arena;
+      arena = chunk->offset + chunk->size;
+    }
+  }
+  return total;
+}
+
+std::size_t Lifetime(const Chunk& chunk) { return chunk.last_accessor_idx - chunk.first_accessor_idx + 1; }
+
 }  // namespace
 
-void PlaceRefinements(stripe::Block* outermost_block, const proto::MemoryPlacementPass& options) {
+PlacementReport PlaceRefinements(stripe::Block* outermost_block, const proto::MemoryPlacementPass& options) {
   std::set<stripe::Location> locations;
   for (const auto& loc : options.locs()) {
     locations.emplace(stripe::FromProto(loc));
@@ -289,7 +395,7 @@ void PlaceRefinements(stripe::Block* outermost_block, const proto::MemoryPlaceme
   // Edge case: no chunks means nothing to do.  And then after this,
   // we can assume there's at least one chunk.
   if (!chunks.size()) {
-    return;
+    return PlacementReport{};
   }
 
   // Ensure chunks are sorted by earliest accessor.
@@ -304,12 +410,6 @@ void PlaceRefinements(stripe::Block* outermost_block, const proto::MemoryPlaceme
     }
   }
 
-  // Initialize the graph.
-  InterferenceGraph interference_graph;
-  for (auto& chunk : chunks) {
-    chunk.interference_vertex = boost::add_vertex(InterferenceVertex{&chunk}, interference_graph);
-  }
-
   // Compute the interference edges.  Note that this is O(N^2) in the
   // worst case.  :-/
   for (auto earlier = chunks.begin(); earlier != chunks.end(); ++earlier) {
@@ -337,96 +437,88 @@ void PlaceRefinements(stripe::Block* outermost_block, const proto::MemoryPlaceme
       }
       // Otherwise, these chunks may be alive at the same time in the
       // same location; they may interfere with each other.
-      add_edge(earlier->interference_vertex, later->interference_vertex, interference_graph);
+      earlier->interferences.push_back(&*later);
+      later->interferences.push_back(&*earlier);
     }
   }
 
-  // Re-sort chunks by size, since we want to place them in
-  // largest-to-smallest order.
-  chunks.sort([](const Chunk& lhs, const Chunk& rhs) { return lhs.size > rhs.size; });
-
-  // Place the chunks.
-  std::vector<Chunk*> already_placed;
+  // Try the candidate orders, keeping the one with the smallest
+  // total arena size.  Ties go to the earlier order.
+  std::vector<Chunk*> order;
   for (auto& chunk : chunks) {
-    // Build a vector of already-placed chunks that we need to
-    // consider when placing this chunk.
-    already_placed.clear();
-    auto edges = out_edges(chunk.interference_vertex, interference_graph);
-    for (auto it = edges.first; it != edges.second; ++it) {
-      InterferenceGraph::vertex_descriptor tgt = target(*it, interference_graph);
-      Chunk* candidate = interference_graph[tgt].chunk;
-      if (candidate->placed) {
-        already_placed.push_back(candidate);
-      }
-    }
-
-    // Sort the vector by placement offset, lowest-offset first.
-    std::sort(already_placed.begin(), already_placed.end(),
-              [](const Chunk* lhs, const Chunk* rhs) { return lhs->ref->offset < rhs->ref->offset; });
-
-    // Scan for usable gaps in the already_placed vector.
-    // N.B. The already_placed vector may contain overlapping chunks.
-    //
-    // We keep track of the overall limit offset we've seen so far, as
-    // well as whether we've seen a usable gap at all, the location of
-    // that gap, and the known size of that gap.
-    //
-    // Note that the gap we're considering is always
-    // [offset_limit...current->ref->offset).  This is because either:
-    //
-    // * We don't have a gap yet; some earlier-processed
-    //   already-placed chunk must have started at an offset that's
-    //   too low for the current chunk we're placing to fit before it,
-    //   and subsequent chunks have either been overlapping or had too
-    //   small a gap for us to consider.  offset_limit is the first
-    //   offset that's known to be past all these earlier-processed
-    //   chunks.
-    //
-    // * We do have a candidate gap.  It's the best gap we know about
-    //   given all the chunks we've seen so far, which cover the
-    //   entire space up to offset_limit.  So any better gap has to
-    //   start at offset_limit.
-    std::size_t offset_limit = 0;
-    bool have_gap = false;
-    std::size_t gap_offset = 0;
-    std::size_t gap_size = 0;
+    order.push_back(&chunk);
+  }
+  std::stable_sort(order.begin(), order.end(), [](const Chunk* lhs, const Chunk* rhs) {
+    return std::make_pair(lhs->size, Lifetime(*lhs)) > std::make_pair(rhs->size, Lifetime(*rhs));
+  });
+  std::vector<Chunk*> best_order = order;
+  std::size_t best_total = PackChunks(order);
 
-    for (Chunk* placed_chunk : already_placed) {
-      // See whether we have a usable gap here.
-      if (offset_limit < placed_chunk->ref->offset) {
-        std::size_t candidate_size = placed_chunk->ref->offset - offset_limit;
-        if (chunk.size <= candidate_size && (!have_gap || (candidate_size < gap_size))) {
-          // This is a usable gap, and either we don't have a gap or
-          // the candidate gap is smaller than the best gap we've
-          // found so far.
-          have_gap = true;
-          gap_offset = offset_limit;
-          gap_size = candidate_size;
-        }
-      }
+  std::stable_sort(order.begin(), order.end(), [](const Chunk* lhs, const Chunk* rhs) {
+    return lhs->size * Lifetime(*lhs) > rhs->size * Lifetime(*rhs);
+  });
+  std::size_t total = PackChunks(order);
+  if (total < best_total) {
+    best_order = order;
+    best_total = total;
+  }
 
-      // Update offset_limit.
-      std::size_t placed_chunk_limit = placed_chunk->ref->offset + placed_chunk->size;
-      if (offset_limit < placed_chunk_limit) {
-        offset_limit = placed_chunk_limit;
-      }
+  std::mt19937 rng;
+  for (std::size_t round = 0; round < options.search_rounds() && 1 < best_order.size(); ++round) {
+    order = best_order;
+    std::uniform_int_distribution<std::size_t> pick{0, order.size() - 1};
+    std::swap(order[pick(rng)], order[pick(rng)]);
+    total = PackChunks(order);
+    if (total < best_total) {
+      best_order = order;
+      best_total = total;
     }
+  }
 
-    // If we don't have a gap yet, offset_limit is where we have to put the current chunk.
-    if (!have_gap) {
-      gap_offset = offset_limit;
-    }
+  // Place the chunks.
+  PackChunks(best_order);
+  PlacementReport report;
+  for (auto& chunk : chunks) {
+    chunk.ref->offset = chunk.offset;
+    auto& arena = report.arenas[chunk.ref->location];
+    arena.bytes = std::max(arena.bytes, chunk.offset + chunk.size);
+  }
 
-    // We have an offset for this chunk.
-    chunk.ref->offset = gap_offset;
-    chunk.placed = true;
+  // Compute the lower bounds, by sweeping over the chunks' lifetimes.
+  std::map<stripe::Location, std::map<std::size_t, std::int64_t>> deltas;
+  for (auto& chunk : chunks) {
+    auto& loc_deltas = deltas[chunk.ref->location];
+    loc_deltas[chunk.first_accessor_idx] += chunk.size;
+    loc_deltas[chunk.last_accessor_idx + 1] -= chunk.size;
   }
+  for (const auto& loc_deltas : deltas) {
+    auto& arena = report.arenas[loc_deltas.first];
+    std::int64_t live = 0;
+    for (const auto& delta : loc_deltas.second) {
+      live += delta.second;
+      arena.lower_bound_bytes = std::max(arena.lower_bound_bytes, static_cast<std::size_t>(live));
+    }
+  }
+
+  return report;
 }
 
 void MemoryPlacementPass::Apply(CompilerState* state) const {
   auto reqs = stripe::FromProto(options_.reqs());
   RunOnBlocks(state->entry(), reqs, [&](const AliasMap& map, stripe::Block* block) {  //
-    PlaceRefinements(block, options_);
+    context::Activity activity{state->ctx, "tile::codegen::PlaceRefinements"};
+    auto report = PlaceRefinements(block, options_);
+    proto::MemoryPlacementReport info;
+    info.set_block(block->name);
+    for (const auto& arena : report.arenas) {
+      IVLOG(2, "Placed " << block->name << " at " << arena.first << ": " << arena.second.bytes
+                         << " bytes (lower bound " << arena.second.lower_bound_bytes << ")");
+      auto* arena_info = info.add_arenas();
+      arena_info->set_loc(to_string(arena.first));
+      arena_info->set_bytes(arena.second.bytes);
+      arena_info->set_lower_bound_bytes(arena.second.lower_bound_bytes);
+    }
+    activity.AddMetadata(info);
   });
 }
 
@@ -2,6 +2,9 @@
 
 #pragma once
 
+#include <cstddef>
+#include <map>
+
 #include "tile/codegen/codegen.pb.h"
 #include "tile/codegen/compile_pass.h"
 #include "tile/stripe/stripe.h"
@@ -10,11 +13,26 @@ namespace vertexai {
 namespace tile {
 namespace codegen {
 
+// The arena sizes resulting from a placement.
+struct PlacementReport {
+  struct Arena {
+    std::size_t bytes = 0;              // The size needed to hold every placed chunk
+    std::size_t lower_bound_bytes = 0;  // No placement of the chunks could use less
+  };
+
+  std::map<stripe::Location, Arena> arenas;
+};
+
 // Assigns locations to all Refinements within a Block, including all
 // nested sub-Blocks.  Note that all dependencies for the block and
 // sub-blocks should be established when this function is called.
-void PlaceRefinements(stripe::Block* outermost_block, const proto::MemoryPlacementPass& options);
+//
+// Every chunk placed in a location is given an offset within a single
+// arena for that location; the report describes each arena's size.
+PlacementReport PlaceRefinements(stripe::Block* outermost_block, const proto::MemoryPlacementPass& options);
 
+// Places the refinements of each matching block, logging the block's
+// report as the metadata of a tile::codegen::PlaceRefinements activity.
 class MemoryPlacementPass final : public CompilePass {
  public:
   explicit MemoryPlacementPass(const proto::MemoryPlacementPass& options) : options_{options} {}
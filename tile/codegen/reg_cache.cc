@@ -589,7 +589,7 @@ static void BlocksForRegisterCache(Block* parent, Block* cache, const RegisterPa
 }
 
 static void RegisterCacheRecurse(Block* parent, Block* block,  //
-                                 const Tags& reqs,             //
+                                 const ResolvedTags& reqs,     //
                                  const RegisterPassOptions& opt) {
   if (block->has_tags(reqs)) {
     BlocksForRegisterCache(parent, block, opt);
@@ -605,7 +605,7 @@ static void RegisterCacheRecurse(Block* parent, Block* block,  //
 
 void RegisterCachePass::Apply(CompilerState* state) const {
   RegisterPassOptions opt;
-  auto reqs = FromProto(options_.reqs());
+  ResolvedTags reqs = FromProto(options_.reqs());
   opt.local_loc = stripe::FromProto(options_.local_loc());
   opt.reg_loc = stripe::FromProto(options_.register_loc());
   opt.reg_size = options_.register_size();
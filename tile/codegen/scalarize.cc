@@ -106,13 +106,6 @@ void Scalarize(Block* block, bool recursive) {
   }
 }
 
-void ScalarizePass::Apply(CompilerState* state) const {
-  auto reqs = stripe::FromProto(options_.reqs());
-  RunOnBlocks(state->entry(), reqs, [](const AliasMap& map, stripe::Block* block) {  //
-    Scalarize(block, true);
-  });
-}
-
 namespace {
 [[gnu::unused]] char reg = []() -> char {
   CompilePassFactory<ScalarizePass, proto::ScalarizePass>::Register();
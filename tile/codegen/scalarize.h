@@ -12,10 +12,11 @@ namespace codegen {
 
 void Scalarize(stripe::Block* block, bool recursive = false);
 
-class ScalarizePass final : public CompilePass {
+class ScalarizePass final : public KernelPass {
  public:
   explicit ScalarizePass(const proto::ScalarizePass& options) : options_{options} {}
-  void Apply(CompilerState* state) const final;
+  stripe::Tags reqs() const final { return stripe::FromProto(options_.reqs()); }
+  void ApplyToBlock(const AliasMap& map, stripe::Block* block) const final { Scalarize(block, true); }
 
  private:
   proto::ScalarizePass options_;
@@ -194,7 +194,7 @@ boost::optional<StencilMatch> FindBestStencil(const std::vector<proto::Stencil>&
 }
 
 struct StencilPassOptions {
-  Tags reqs;
+  ResolvedTags reqs;
   std::vector<proto::Stencil> specs;
   Tags set_outer;
   Tags set_inner;
@@ -0,0 +1,115 @@
+// Copyright 2019, Intel Corporation
+
+// Times the codegen work that's dominated by affine arithmetic -- AliasMap
+// construction and autotiling -- on a synthetic chain of convolutions.
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+#include <boost/program_options.hpp>
+
+#include "base/util/logging.h"
+#include "tile/codegen/alias.h"
+#include "tile/codegen/autotile.h"
+#include "tile/lang/gen_stripe.h"
+#include "tile/stripe/stripe.h"
+
+namespace po = boost::program_options;
+
+namespace vertexai {
+namespace tile {
+namespace codegen {
+namespace test {
+namespace bench {
+namespace {
+
+lang::RunInfo MakeConvChain(size_t layers) {
+  lang::RunInfo runinfo;
+  runinfo.program_name = "conv_chain";
+  auto shape = SimpleShape(DataType::FLOAT32, {1, 56, 56, 64});
+  std::stringstream code;
+  code << "function (I";
+  for (size_t i = 0; i < layers; i++) {
+    code << ", K" << i;
+    runinfo.input_shapes.emplace("K" + std::to_string(i), SimpleShape(DataType::FLOAT32, {3, 3, 64, 64}));
+  }
+  code << ") -> (O) {\n";
+  std::string prev = "I";
+  for (size_t i = 0; i < layers; i++) {
+    auto conv = "C" + std::to_string(i);
+    auto out = i + 1 == layers ? std::string{"O"} : "R" + std::to_string(i);
+    code << "  " << conv << "[n, x, y, co : 1, 56, 56, 64] = +(" << prev << "[n, x + kx - 1, y + ky - 1, ci] * K" << i
+         << "[kx, ky, ci, co]);\n";
+    code << "  " << out << " = relu(" << conv << ");\n";
+    prev = out;
+  }
+  code << "}\n";
+  runinfo.code = code.str();
+  runinfo.input_shapes.emplace("I", shape);
+  runinfo.output_shapes.emplace("O", shape);
+  return runinfo;
+}
+
+template <typename F>
+void Time(const char* name, size_t iterations, F func) {
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; i++) {
+    func();
+  }
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << name << ": " << elapsed.count() / iterations << " ms/iteration" << std::endl;
+}
+
+void Run(size_t layers, size_t iterations) {
+  auto runinfo = MakeConvChain(layers);
+  auto program = GenerateStripe(runinfo);
+
+  Time("AliasMap", iterations, [&] {
+    RunOnBlocks(program->entry.get(), {"all"}, [](const AliasMap&, stripe::Block*) {}, true);
+  });
+
+  proto::AutotilePass options;
+  options.add_reqs("contraction");
+  options.add_outer_set("contract_outer");
+  options.add_inner_set("contract_inner");
+  options.set_only_po2(true);
+  options.set_max_total_size(32 * 1024);
+  AutotilePass pass{options};
+  auto proto = IntoProto(*program);
+  Time("AutotilePass", iterations, [&] {
+    CompilerState state{stripe::FromProto(proto)};
+    pass.Apply(&state);
+  });
+}
+
+}  // namespace
+}  // namespace bench
+}  // namespace test
+}  // namespace codegen
+}  // namespace tile
+}  // namespace vertexai
+
+int main(int argc, char* argv[]) {
+  START_EASYLOGGINGPP(argc, argv);
+
+  try {
+    po::variables_map args;
+    po::options_description opts;
+    opts.add_options()                                                                  //
+        ("help,h", "produce help message")                                              //
+        ("layers", po::value<size_t>()->default_value(16), "convolutions in the chain")  //
+        ("iterations", po::value<size_t>()->default_value(10), "times to run each benchmark");
+    po::store(po::command_line_parser(argc, argv).options(opts).run(), args);
+    if (args.count("help")) {
+      std::cout << opts << std::endl;
+      return EXIT_SUCCESS;
+    }
+    args.notify();
+    vertexai::tile::codegen::test::bench::Run(args["layers"].as<size_t>(), args["iterations"].as<size_t>());
+    return EXIT_SUCCESS;
+  } catch (const std::exception& ex) {
+    std::cerr << "Caught unhandled exception: " << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
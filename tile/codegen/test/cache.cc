@@ -81,6 +81,96 @@ TEST(Codegen, Cache) {
   // EXPECT_THAT(data["C"], ContainerEq(expected));
 }
 
+TEST(Codegen, Pack) {
+  std::map<std::string, std::vector<float>> data = {
+      {"A",
+       {
+           1, 2, 3, 4, 5,  //
+           4, 5, 6, 7, 8,  //
+           7, 8, 9, 7, 8,  //
+           1, 2, 3, 1, 2,  //
+           1, 2, 3, 1, 2,  //
+       }},
+      {"B",
+       {
+           1, 2, 3, 1, 2,  //
+           1, 2, 3, 1, 2,  //
+           1, 2, 3, 1, 2,  //
+           1, 2, 3, 1, 2,  //
+           1, 2, 3, 1, 2,  //
+       }},
+      {"C", std::vector<float>(25)},
+  };
+
+  std::vector<float> expected = {
+      15, 30, 45,  15, 30,  //
+      30, 60, 90,  30, 60,  //
+      39, 78, 117, 39, 78,  //
+      9,  18, 27,  9,  18,  //
+      9,  18, 27,  9,  18,  //
+  };
+
+  size_t dim = sqrt(expected.size());
+  auto runinfo = lib::LoadMatMul("matmul",                                       //
+                                 TensorShape(PLAIDML_DATA_FLOAT32, {dim, dim}),  //
+                                 TensorShape(PLAIDML_DATA_FLOAT32, {dim, dim}));
+  auto program = GenerateStripe(runinfo);
+  auto main = program->entry->SubBlock(0);
+  auto kernel = main->SubBlock(0);
+
+  // Uneven tiles, so the packing copies need their bounds constraints.
+  ApplyTile(kernel.get(), {2, 2, 2});
+  AliasMap base;
+  AliasMap program_map(base, program->entry.get());
+  AliasMap main_map(program_map, main.get());
+  AliasMap kernel_map(main_map, kernel.get());
+  EXPECT_TRUE(ApplyPack(kernel_map, kernel.get(), {{{"PACK"}}}, {{{"TX"}}}));
+  IVLOG(2, "Packed\n" << *program->entry);
+
+  // One input is hoisted out of a new inner block and packed at the outer
+  // level, the other is packed per tile inside it.
+  size_t outer_packs = 0;
+  for (const auto& stmt : kernel->stmts) {
+    auto block = Block::Downcast(stmt);
+    outer_packs += block && block->has_tag("pack_load");
+  }
+  EXPECT_THAT(outer_packs, Eq(1));
+
+  ExecuteProgram(*program->entry, &data);
+  EXPECT_THAT(data["C"], ContainerEq(expected));
+}
+
+TEST(Codegen, PackMovesTags) {
+  auto runinfo = lib::LoadMatMul("matmul",                                   //
+                                 TensorShape(PLAIDML_DATA_FLOAT32, {8, 8}),  //
+                                 TensorShape(PLAIDML_DATA_FLOAT32, {8, 8}));
+  auto program = GenerateStripe(runinfo);
+  auto main = program->entry->SubBlock(0);
+  auto kernel = main->SubBlock(0);
+
+  ApplyTile(kernel.get(), {2, 2, 2});
+  kernel->add_tags({"cpu_thread"});
+  AliasMap base;
+  AliasMap program_map(base, program->entry.get());
+  AliasMap main_map(program_map, main.get());
+  AliasMap kernel_map(main_map, kernel.get());
+  EXPECT_TRUE(ApplyPack(kernel_map, kernel.get(), {{{"PACK"}}}, {{{"TX"}}}, 2, {"middle"}, true, {"cpu_thread"}));
+  IVLOG(2, "Packed\n" << *program->entry);
+
+  // The split block now loops only around the hoisted panel; the tag moves to
+  // the new inner block, whose iterations share the panel.
+  EXPECT_FALSE(kernel->has_tag("cpu_thread"));
+  size_t tagged = 0;
+  for (const auto& stmt : kernel->stmts) {
+    auto block = Block::Downcast(stmt);
+    if (block && block->has_tag("middle")) {
+      EXPECT_TRUE(block->has_tag("cpu_thread"));
+      tagged++;
+    }
+  }
+  EXPECT_THAT(tagged, Eq(1));
+}
+
 }  // namespace test
 }  // namespace codegen
 }  // namespace tile
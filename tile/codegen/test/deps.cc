@@ -197,6 +197,108 @@ TEST(DepsTest, Subregion) {
   EXPECT_THAT(output_proto, EqualsProtoText(expected));
 }
 
+TEST(DepsTest, ReusesDepsUntilInvalidated) {
+  auto input_text = R"(
+    loc {}
+    stmts {
+      attrs: { key: "main" value {} }
+      block {
+        loc {}
+        refs: [{
+          key: "b1"
+          value: {
+            loc {}
+            interior_shape { type: FLOAT32 dims: {size:1 stride:1} }
+          }
+        }]
+        stmts { constant { name:"$1" iconst: 0 } }
+        stmts { store { from:"$1" into:"b1" } }
+      }
+    }
+  )";
+  stripe::proto::Block input_proto;
+  gp::TextFormat::ParseFromString(input_text, &input_proto);
+
+  auto prog = std::make_shared<stripe::Program>();
+  prog->entry = stripe::FromProto(input_proto);
+  CompilerState state(prog);
+  proto::ComputeDepsPass options;
+  options.add_reqs("main");
+  ComputeDepsPass pass(options);
+  pass.Apply(&state);
+  auto main = prog->entry->SubBlock(0);
+  ASSERT_EQ(main->stmts.back()->deps.size(), 1);
+
+  // The deps are still current, so the pass leaves the block alone...
+  main->stmts.back()->deps.clear();
+  state.analyses.Invalidate(pass.preserved());
+  pass.Apply(&state);
+  EXPECT_EQ(main->stmts.back()->deps.size(), 0);
+
+  // ...until a pass that doesn't preserve them runs.
+  state.analyses.Invalidate(PreservedAnalyses::None());
+  pass.Apply(&state);
+  EXPECT_EQ(main->stmts.back()->deps.size(), 1);
+}
+
+TEST(DepsTest, KeepsDepsOutsideRewrittenBlocks) {
+  auto input_text = R"(
+    loc {}
+    stmts {
+      attrs: { key: "main" value {} }
+      block {
+        loc {}
+        stmts {
+          attrs: { key: "kernel" value {} }
+          block { loc {} name: "k1" }
+        }
+        stmts {
+          attrs: { key: "kernel" value {} }
+          block {
+            loc {}
+            name: "k2"
+            stmts {
+              attrs: { key: "kernel" value {} }
+              block { loc {} name: "k2_inner" }
+            }
+          }
+        }
+      }
+    }
+  )";
+  stripe::proto::Block input_proto;
+  gp::TextFormat::ParseFromString(input_text, &input_proto);
+
+  auto prog = std::make_shared<stripe::Program>();
+  prog->entry = stripe::FromProto(input_proto);
+  CompilerState state(prog);
+  for (const auto& reqs : {"main", "kernel"}) {
+    proto::ComputeDepsPass options;
+    options.add_reqs(reqs);
+    ComputeDepsPass(options).Apply(&state);
+  }
+  auto main = prog->entry->SubBlock(0);
+  auto k1 = main->SubBlock(0);
+  auto k2 = main->SubBlock(1);
+  ASSERT_TRUE(state.analyses.HasDeps(main.get()));
+  ASSERT_TRUE(state.analyses.HasDeps(k1.get()));
+  ASSERT_TRUE(state.analyses.HasDeps(k2.get()));
+
+  // Rewriting k2 invalidates k2, and the blocks within it and holding it, but not its sibling.
+  state.analyses.Invalidate({RewrittenBlock{main.get(), k2.get()}}, PreservedAnalyses::None());
+  EXPECT_FALSE(state.analyses.HasDeps(main.get()));
+  EXPECT_TRUE(state.analyses.HasDeps(k1.get()));
+  EXPECT_FALSE(state.analyses.HasDeps(k2.get()));
+
+  // Blocks are recognized by more than their address: a block replacing one that's gone starts out unanalyzed.
+  auto k1_addr = k1.get();
+  main->stmts.pop_front();
+  k1.reset();
+  auto replacement = std::make_shared<stripe::Block>();
+  EXPECT_FALSE(state.analyses.HasDeps(k1_addr));
+  EXPECT_FALSE(state.analyses.HasDeps(replacement.get()));
+}
+
 }  // namespace codegen
 }  // namespace tile
 }  // namespace vertexai
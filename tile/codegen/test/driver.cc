@@ -0,0 +1,151 @@
+// Copyright 2018, Intel Corp.
+
+#include <gmock/gmock.h>
+
+#include <mutex>
+#include <set>
+#include <string>
+
+#include "base/context/eventlog.h"
+#include "base/proto/proto.h"
+#include "base/util/perf_counter.h"
+#include "tile/codegen/driver.h"
+#include "tile/lang/compose.h"
+#include "tile/lang/gen_stripe.h"
+#include "tile/stripe/stripe.h"
+
+namespace vertexai {
+namespace tile {
+namespace codegen {
+namespace test {
+
+using namespace stripe;  // NOLINT
+using ::testing::ContainerEq;
+using ::testing::Eq;
+using ::testing::Gt;
+
+// Autotile and Scalarize are both kernel passes, so Optimize may apply them to each kernel concurrently.
+static const char* kKernelPasses = R"(
+  {
+    name: "tile_contract"
+    pass: {
+      [type.vertex.ai/vertexai.tile.codegen.proto.AutotilePass] {
+        reqs: ["contraction"]
+        outer_set: ["contract_outer", "kernel"]
+        inner_set: ["contract_inner"]
+        clear_outer: true
+        only_po2: true
+        max_output_size: 1024
+      }
+    }
+  }, {
+    name: "scalarize"
+    pass: {
+      [type.vertex.ai/vertexai.tile.codegen.proto.ScalarizePass] {
+        reqs: ["kernel"]
+      }
+    }
+  }
+)";
+
+static proto::Stage GenerateStage(const std::string& extra_passes = "") {
+  return ParseProtoText<proto::Stage>("passes: [" + std::string(kKernelPasses) + extra_passes + "]");
+}
+
+static std::shared_ptr<Program> GenerateProgram() {
+  lang::RunInfo runinfo;
+  runinfo.program_name = "kernels";
+  runinfo.code = R"***(
+    function (A[M, K], B[K, N], D[M, N]) -> (E, F, G) {
+      C[m, n : M, N] = +(A[m, k] * B[k, n]);
+      E = C + D;
+      F[m : M] = >(E[m, n]);
+      G[n : N] = +(A[m, n] * D[m, n]);
+    }
+  )***";
+  runinfo.input_shapes.emplace("A", SimpleShape(DataType::FLOAT32, {32, 16}));
+  runinfo.input_shapes.emplace("B", SimpleShape(DataType::FLOAT32, {16, 16}));
+  runinfo.input_shapes.emplace("D", SimpleShape(DataType::FLOAT32, {32, 16}));
+  runinfo.output_shapes.emplace("E", SimpleShape(DataType::FLOAT32, {32, 16}));
+  runinfo.output_shapes.emplace("F", SimpleShape(DataType::FLOAT32, {32}));
+  runinfo.output_shapes.emplace("G", SimpleShape(DataType::FLOAT32, {16}));
+  return GenerateStripe(runinfo);
+}
+
+// Records the verbs of the activities logged to it.
+class VerbLog final : public context::EventLog {
+ public:
+  void LogEvent(context::proto::Event event) final {
+    if (event.verb().size()) {
+      std::lock_guard<std::mutex> lock{mu_};
+      verbs_.insert(event.verb());
+    }
+  }
+
+  void FlushAndClose() final {}
+
+  std::set<std::string> verbs() {
+    std::lock_guard<std::mutex> lock{mu_};
+    return verbs_;
+  }
+
+ private:
+  std::mutex mu_;
+  std::set<std::string> verbs_;
+};
+
+static std::string Optimized(const proto::Stage& stage, size_t threads,
+                             const std::shared_ptr<context::EventLog>& eventlog = nullptr) {
+  auto program = GenerateProgram();
+  OptimizeOptions options;
+  options.threads = threads;
+  CompilerState state(program);
+  if (eventlog) {
+    state.ctx.set_eventlog(eventlog).set_is_logging_events(true);
+  }
+  Optimize(&state, stage.passes(), options);
+  return IntoProto(*program->entry).DebugString();
+}
+
+TEST(DriverTest, ParallelKernelPassesMatchSerial) {
+  auto stage = GenerateStage();
+  auto groups = GetPerfCounter("codegen_parallel_kernel_groups");
+  auto serial = Optimized(stage, 1);
+  EXPECT_THAT(GetPerfCounter("codegen_parallel_kernel_groups"), Eq(groups));
+
+  auto parallel = Optimized(stage, 4);
+  EXPECT_THAT(GetPerfCounter("codegen_parallel_kernel_groups"), Gt(groups));
+  EXPECT_THAT(parallel, Eq(serial));
+}
+
+TEST(DriverTest, ParallelKernelPassesLogEachPass) {
+  auto eventlog = std::make_shared<VerbLog>();
+  Optimized(GenerateStage(), 4, eventlog);
+  EXPECT_THAT(eventlog->verbs(),
+              ContainerEq(std::set<std::string>{"tile::codegen::tile_contract", "tile::codegen::scalarize"}));
+}
+
+TEST(DriverTest, NonKernelMatchFallsBackToSerial) {
+  // The main block isn't a kernel, and scalarizing it could change more than the kernels, so this run of kernel
+  // passes must be applied one pass at a time over the whole program.
+  auto stage = GenerateStage(R"(
+    , {
+      name: "scalarize_main"
+      pass: {
+        [type.vertex.ai/vertexai.tile.codegen.proto.ScalarizePass] {
+          reqs: ["main"]
+        }
+      }
+    }
+  )");
+  auto serial = Optimized(stage, 1);
+  auto groups = GetPerfCounter("codegen_parallel_kernel_groups");
+  auto parallel = Optimized(stage, 4);
+  EXPECT_THAT(GetPerfCounter("codegen_parallel_kernel_groups"), Eq(groups));
+  EXPECT_THAT(parallel, Eq(serial));
+}
+
+}  // namespace test
+}  // namespace codegen
+}  // namespace tile
+}  // namespace vertexai
@@ -2,6 +2,11 @@
 
 #include <gtest/gtest.h>
 
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "base/context/eventlog.h"
 #include "testing/matchers.h"
 #include "tile/codegen/placer.h"
 #include "tile/stripe/stripe.h"
@@ -276,6 +281,127 @@ TEST(PlacerTest, LocationSubsetCanBePlaced) {
   EXPECT_THAT(output_proto, EqualsProtoText(expected));
 }
 
+TEST(PlacerTest, ReportsArenaSizeAndLowerBound) {
+  stripe::proto::Block input_proto;
+  gp::TextFormat::ParseFromString(R"(
+    loc {}
+    refs [
+      {
+        key: "b1"
+        value: {
+          loc { devs: [{name: "loc_1"}]}
+          interior_shape { type: FLOAT32 dims: {size:4 stride:1} }
+        }
+      },
+      {
+        key: "b2"
+        value: {
+          loc { devs: [{name: "loc_1"}]}
+          interior_shape { type: FLOAT32 dims: {size:2 stride:1} }
+        }
+      },
+      {
+        key: "b3"
+        value: {
+          loc { devs: [{name: "loc_1"}]}
+          interior_shape { type: FLOAT32 dims: {size:4 stride:1} }
+        }
+      }
+    ]
+    stmts { special { name:"COPY" inputs:"b1" outputs:"b2"} }
+    stmts { special { name:"COPY" inputs:"b2" outputs:"b3"} deps: 0 }
+  )",
+                                  &input_proto);
+
+  std::shared_ptr<stripe::Block> block{stripe::FromProto(input_proto)};
+
+  proto::MemoryPlacementPass options;
+  options.add_locs()->add_devs()->set_name("loc_1");
+  options.set_search_rounds(4);
+
+  auto report = PlaceRefinements(block.get(), options);
+
+  // b1 and b3 can share space, so the arena only needs to hold one of
+  // them alongside b2.
+  ASSERT_EQ(report.arenas.size(), 1);
+  const auto& arena = report.arenas.begin()->second;
+  EXPECT_EQ(arena.lower_bound_bytes, 24);
+  EXPECT_EQ(arena.bytes, 24);
+}
+
+// Records the placement reports logged to it.
+class ReportLog final : public context::EventLog {
+ public:
+  void LogEvent(context::proto::Event event) final {
+    std::lock_guard<std::mutex> lock{mu_};
+    for (const auto& metadata : event.metadata()) {
+      proto::MemoryPlacementReport report;
+      if (metadata.UnpackTo(&report)) {
+        reports_.emplace_back(std::move(report));
+      }
+    }
+  }
+
+  void FlushAndClose() final {}
+
+  std::vector<proto::MemoryPlacementReport> reports() {
+    std::lock_guard<std::mutex> lock{mu_};
+    return reports_;
+  }
+
+ private:
+  std::mutex mu_;
+  std::vector<proto::MemoryPlacementReport> reports_;
+};
+
+TEST(PlacerTest, PassLogsPlacementReport) {
+  stripe::proto::Block input_proto;
+  gp::TextFormat::ParseFromString(R"(
+    name: "program"
+    loc {}
+    refs [
+      {
+        key: "b1"
+        value: {
+          loc { devs: [{name: "loc_1"}]}
+          interior_shape { type: FLOAT32 dims: {size:4 stride:1} }
+        }
+      },
+      {
+        key: "b2"
+        value: {
+          loc { devs: [{name: "loc_1"}]}
+          interior_shape { type: FLOAT32 dims: {size:4 stride:1} }
+        }
+      }
+    ]
+    stmts { special { name:"COPY" inputs:"b1" outputs:"b2"} }
+  )",
+                                  &input_proto);
+
+  auto program = std::make_shared<stripe::Program>();
+  program->entry = stripe::FromProto(input_proto);
+  program->entry->set_tag("program");
+  CompilerState state(program);
+  auto eventlog = std::make_shared<ReportLog>();
+  state.ctx.set_eventlog(eventlog).set_is_logging_events(true);
+
+  proto::MemoryPlacementPass options;
+  options.add_reqs("program");
+  options.add_locs()->add_devs()->set_name("loc_1");
+  options.set_alignment(4);
+  MemoryPlacementPass(options).Apply(&state);
+
+  // b1 and b2 are both live during the copy, so neither can share space.
+  auto reports = eventlog->reports();
+  ASSERT_EQ(reports.size(), 1);
+  EXPECT_EQ(reports[0].block(), "program");
+  ASSERT_EQ(reports[0].arenas_size(), 1);
+  EXPECT_EQ(reports[0].arenas(0).loc(), "loc_1");
+  EXPECT_EQ(reports[0].arenas(0).bytes(), 32);
+  EXPECT_EQ(reports[0].arenas(0).lower_bound_bytes(), 32);
+}
+
 }  // namespace codegen
 }  // namespace tile
 }  // namespace vertexai
@@ -257,7 +257,7 @@ void UnrollBlock(Block* outer,                     //
                  Block* block,                     //
                  const AliasMap& outer_alias_map,  //
                  const StatementIt& it_stmt,       //
-                 const Tags& reqs,                 //
+                 const ResolvedTags& reqs,         //
                  const proto::UnrollPass& options) {
   if (block->has_tags(reqs)) {
     RefMap ref_map;
@@ -308,7 +308,7 @@ void UnrollBlock(Block* outer,                     //
 }  // namespace
 
 void UnrollPass::Apply(CompilerState* state) const {
-  auto reqs = FromProto(options_.reqs());
+  ResolvedTags reqs = FromProto(options_.reqs());
   Block* root = state->entry();
   AliasMap base_alias_map;
   AliasMap alias_map{base_alias_map, root};
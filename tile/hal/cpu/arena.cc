@@ -2,6 +2,17 @@
 
 #include "tile/hal/cpu/arena.h"
 
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
 #include "base/util/error.h"
 #include "tile/hal/cpu/buffer.h"
 
@@ -10,13 +21,157 @@ namespace tile {
 namespace hal {
 namespace cpu {
 
-Arena::Arena(std::uint64_t size) { mem_.resize(size, '\0'); }
+namespace {
+
+// Pages are the unit of mapping and of first-touch placement.
+const std::uint64_t page_size_ = 4096;
+const std::uint64_t huge_page_size_ = 2 * 1024 * 1024;
+
+// Heap allocations are aligned for the widest vector loads we generate.
+const std::size_t heap_alignment_ = 64;
+
+// Below this size, the cost of handing the zeroing to the pool outweighs any
+// benefit from placing the pages.
+const std::uint64_t first_touch_min_ = 1 << 20;
+
+std::uint64_t RoundUp(std::uint64_t size, std::uint64_t align) { return (size + align - 1) / align * align; }
+
+char* HeapAlloc(std::uint64_t size) {
+  void* ptr = nullptr;
+#ifdef _WIN32
+  ptr = _aligned_malloc(std::max<std::uint64_t>(size, 1), heap_alignment_);
+#else
+  if (posix_memalign(&ptr, heap_alignment_, std::max<std::uint64_t>(size, 1))) {
+    ptr = nullptr;
+  }
+#endif
+  if (!ptr) {
+    throw std::bad_alloc{};
+  }
+  return static_cast<char*>(ptr);
+}
+
+void HeapFree(char* ptr) {
+#ifdef _WIN32
+  _aligned_free(ptr);
+#else
+  std::free(ptr);
+#endif
+}
+
+#ifndef _WIN32
+// Maps length bytes aligned to align, trimming the slop from either end of
+// an oversized mapping. Returns nullptr if the mapping fails.
+char* MapAligned(std::uint64_t length, std::uint64_t align) {
+  std::uint64_t slop = align > page_size_ ? align : 0;
+  void* ptr = mmap(nullptr, length + slop, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    return nullptr;
+  }
+  char* raw = static_cast<char*>(ptr);
+  if (!slop) {
+    return raw;
+  }
+  char* base = reinterpret_cast<char*>(RoundUp(reinterpret_cast<std::uintptr_t>(raw), align));
+  if (base != raw) {
+    munmap(raw, base - raw);
+  }
+  std::uint64_t tail = slop - (base - raw);
+  if (tail) {
+    munmap(base + length, tail);
+  }
+  return base;
+}
+#endif
+
+}  // namespace
+
+void ArenaConfig::Apply(const hal::proto::HardwareSettings& settings) {
+  mode = settings.host_allocator();
+  if (settings.mmap_threshold()) {
+    mmap_threshold = settings.mmap_threshold();
+  }
+  if (settings.huge_page_threshold()) {
+    huge_page_threshold = settings.huge_page_threshold();
+  }
+}
+
+Arena::Arena(std::uint64_t size, const ArenaConfig& config, std::shared_ptr<NodePool> thread_pool)
+    : size_{size}, thread_pool_{std::move(thread_pool)} {
+#ifndef _WIN32
+  if (config.mode != hal::proto::HostAllocator::Heap && size && config.mmap_threshold <= size) {
+    // Anonymous mappings arrive zeroed, and large ones can be backed by
+    // transparent huge pages, which need 2MiB-aligned ranges to be used.
+    bool huge = config.mode != hal::proto::HostAllocator::Mmap && config.huge_page_threshold <= size;
+    std::uint64_t length = RoundUp(size, huge ? huge_page_size_ : page_size_);
+    base_ = MapAligned(length, huge ? huge_page_size_ : page_size_);
+    if (base_) {
+      mapped_ = length;
+#ifdef MADV_HUGEPAGE
+      if (huge) {
+        // Advisory only; without THP support we simply keep 4KiB pages.
+        madvise(base_, length, MADV_HUGEPAGE);
+      }
+#endif
+    }
+  }
+#endif
+  if (!base_) {
+    base_ = HeapAlloc(size);
+  }
+}
+
+Arena::~Arena() {
+#ifndef _WIN32
+  if (mapped_) {
+    munmap(base_, mapped_);
+    return;
+  }
+#endif
+  HeapFree(base_);
+}
 
 std::shared_ptr<hal::Buffer> Arena::MakeBuffer(std::uint64_t offset, std::uint64_t size) {
-  if (mem_.size() < offset || mem_.size() < size || mem_.size() < (offset + size)) {
+  if (size_ < offset || size_ < size || size_ < (offset + size)) {
     throw error::OutOfRange{"Requesting memory outside arena bounds"};
   }
-  return std::make_shared<Buffer>(shared_from_this(), mem_.data() + offset, size);
+  return std::make_shared<Buffer>(shared_from_this(), base_ + offset, size);
+}
+
+void Arena::Prepare(bool discard) {
+  if (ready_.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock{mu_};
+  if (ready_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  if (!discard) {
+    Zero();
+  }
+  ready_.store(true, std::memory_order_release);
+}
+
+void Arena::Zero() {
+  bool place = thread_pool_ && 1 < thread_pool_->node_count() && first_touch_min_ <= size_;
+  if (mapped_ && !place) {
+    // Already zero; the pages will be faulted in by whoever touches them.
+    return;
+  }
+  if (!place) {
+    std::memset(base_, 0, size_);
+    return;
+  }
+  // Kernels write their outputs roughly in grid order, and the pool gives
+  // each node a contiguous slice of every grid, so the same proportional
+  // split of the arena's pages places most data on the node which uses it.
+  char* base = base_;
+  std::uint64_t size = size_;
+  std::uint64_t pages = (size + page_size_ - 1) / page_size_;
+  thread_pool_->ParallelFor(pages, 16, [base, size](size_t begin, size_t end) {
+    std::uint64_t first = begin * page_size_;
+    std::memset(base + first, 0, std::min<std::uint64_t>(end * page_size_, size) - first);
+  });
 }
 
 }  // namespace cpu
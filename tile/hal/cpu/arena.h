@@ -2,24 +2,57 @@
 
 #pragma once
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include "tile/base/hal.h"
+#include "tile/hal/cpu/numa.h"
 
 namespace vertexai {
 namespace tile {
 namespace hal {
 namespace cpu {
 
+// How arenas obtain their memory; see hal::proto::HostAllocator.
+struct ArenaConfig {
+  hal::proto::HostAllocator::Value mode = hal::proto::HostAllocator::Default;
+  std::uint64_t mmap_threshold = 256 * 1024;
+  std::uint64_t huge_page_threshold = 4 * 1024 * 1024;
+
+  // Applies the allocator fields of the supplied settings, keeping the
+  // defaults for any which are unset.
+  void Apply(const hal::proto::HardwareSettings& settings);
+};
+
 class Arena : public hal::Arena, public std::enable_shared_from_this<Arena> {
  public:
-  explicit Arena(std::uint64_t size);
+  // When a pool is supplied, large arenas are zeroed by its workers so that
+  // each page is first touched on the NUMA node which will process it.
+  Arena(std::uint64_t size, const ArenaConfig& config = ArenaConfig{},
+        std::shared_ptr<NodePool> thread_pool = nullptr);
+  ~Arena();
 
   std::shared_ptr<hal::Buffer> MakeBuffer(std::uint64_t offset, std::uint64_t size) final;
 
+  // Arena memory is zeroed lazily. Callers must prepare the arena before its
+  // contents are first observed; when discard is set (the caller is about to
+  // overwrite the whole arena), no zeroing is done at all.
+  void Prepare(bool discard);
+
+  void* base() const { return base_; }
+  std::uint64_t size() const { return size_; }
+
  private:
-  std::vector<char> mem_;
+  void Zero();
+
+  const std::uint64_t size_;
+  char* base_ = nullptr;
+  std::uint64_t mapped_ = 0;  // The mapping length, or zero for heap memory
+  std::shared_ptr<NodePool> thread_pool_;
+  std::atomic<bool> ready_{false};
+  std::mutex mu_;
 };
 
 }  // namespace cpu
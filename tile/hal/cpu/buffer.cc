@@ -24,9 +24,17 @@ std::shared_ptr<Buffer> Buffer::Downcast(const std::shared_ptr<hal::Buffer>& buf
 Buffer::Buffer(std::shared_ptr<Arena> arena, void* base, std::uint64_t size)
     : size_{size}, base_{base}, arena_{std::move(arena)} {}
 
-boost::future<void*> Buffer::MapCurrent(const std::vector<std::shared_ptr<hal::Event>>& deps) { return Sync(deps); }
+void Buffer::Prepare(bool discard) { arena_->Prepare(discard && base_ == arena_->base() && size_ == arena_->size()); }
 
-boost::future<void*> Buffer::MapDiscard(const std::vector<std::shared_ptr<hal::Event>>& deps) { return Sync(deps); }
+boost::future<void*> Buffer::MapCurrent(const std::vector<std::shared_ptr<hal::Event>>& deps) {
+  Prepare(false);
+  return Sync(deps);
+}
+
+boost::future<void*> Buffer::MapDiscard(const std::vector<std::shared_ptr<hal::Event>>& deps) {
+  Prepare(true);
+  return Sync(deps);
+}
 
 boost::future<void*> Buffer::Sync(const std::vector<std::shared_ptr<hal::Event>>& deps) {
   // Return a future which waits for all of the events, then returns the base
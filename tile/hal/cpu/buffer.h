@@ -26,6 +26,11 @@ class Buffer : public hal::Buffer {
   void* base() const { return base_; }
   std::uint64_t size() const { return size_; }
 
+  // Ensures the buffer's contents are defined before they are first used.
+  // Discarding callers overwrite the buffer, so when it spans its whole
+  // arena the arena never needs to be zeroed.
+  void Prepare(bool discard);
+
  private:
   boost::future<void*> Sync(const std::vector<std::shared_ptr<hal::Event>>& deps);
 
@@ -18,6 +18,7 @@
 #include "tile/hal/cpu/library.h"
 #include "tile/hal/cpu/runtime.h"
 #include "tile/lang/semprinter.h"
+#include "tile/util/object_cache.h"
 
 namespace vertexai {
 namespace tile {
@@ -43,9 +44,12 @@ boost::future<std::unique_ptr<hal::Library>> Compiler::Build(const context::Cont
     return boost::make_ready_future(std::unique_ptr<hal::Library>{
         std::make_unique<cpu::Library>(llvm_ctx, std::vector<std::shared_ptr<llvm::ExecutionEngine>>{}, kernel_info)});
   }
+  context::Activity activity{ctx, "tile::hal::cpu::Build"};
   std::vector<std::shared_ptr<llvm::ExecutionEngine>> engines;
   for (const auto& ki : kernel_info) {
+    context::Activity kbuild{activity.ctx(), "tile::hal::cpu::BuildKernel"};
     BuildKernel(ki, llvm_ctx.get(), &engines);
+    kbuild.AddMetadata(ki.info);
   }
   std::unique_ptr<hal::Library> lib(new cpu::Library(llvm_ctx, engines, kernel_info));
   return boost::make_ready_future<>(std::move(lib));
@@ -69,19 +73,44 @@ void Compiler::BuildKernel(const lang::KernelInfo& ki, llvm::LLVMContext* contex
   if (VLOG_IS_ON(4)) {
     VLOG(4) << "Generated IR:\n" << emit.str();
   }
+  // The object cache keys the module on its unoptimized IR, so that on a hit
+  // neither the optimization passes nor codegen need to run.
+  auto cache = tile::util::ObjectCache::Instance();
+  std::string object_key;
+  std::shared_ptr<llvm::MemoryBuffer> object;
+  if (cache) {
+    object_key = cache->Key(*emit.result());
+    object = cache->Load(object_key);
+  }
+  if (!object) {
+    Optimize(emit.result().get());
+  }
   // Compile the IR into executable code.
+  std::unique_ptr<llvm::Module> module{std::move(emit.result())};
+  const llvm::Module* bound = module.get();
+  if (cache) {
+    cache->Bind(bound, object_key, object);
+  }
   std::string errStr;
   std::unique_ptr<llvm::LegacyJITSymbolResolver> rez(new Runtime);
-  llvm::ExecutionEngine* ee = llvm::EngineBuilder(std::move(emit.result()))
+  llvm::ExecutionEngine* ee = llvm::EngineBuilder(std::move(module))
                                   .setErrorStr(&errStr)
                                   .setEngineKind(llvm::EngineKind::JIT)
                                   .setVerifyModules(true)
                                   .setSymbolResolver(std::move(rez))
                                   .create();
   if (ee) {
+    // With a persistent object cache configured, codegen is skipped for any
+    // kernel some earlier process has already compiled.
+    if (cache) {
+      ee->setObjectCache(cache);
+    }
     ee->finalizeObject();
     engines->emplace_back(ee);
   } else {
+    if (cache) {
+      cache->Unbind(bound);
+    }
     std::cerr << "Failed to create ExecutionEngine: " << errStr << std::endl;
   }
 }
@@ -91,8 +120,12 @@ void Compiler::GenerateInvoker(const lang::KernelInfo& ki, llvm::Module* module)
   // generically no matter how many parameters it expects. The wrapper will
   // accept a pointer to an array of pointers, and it will call the kernel
   // using each element of the array as an argument. Following the array of
-  // buffer pointers, it will pass along the GridSize value for the current
-  // work index.
+  // buffer pointers, it accepts a half-open range of flattened grid cell
+  // numbers; it loops over that range, passing the GridSize value for each
+  // cell along to the kernel. Running a whole range per call keeps the
+  // executor's per-workgroup cost down to a loop iteration instead of an
+  // indirect call. BuildKernel optimizes the module only once the invoker is
+  // in place, so the kernel is inlined into the loop.
   llvm::LLVMContext& context(module->getContext());
   llvm::IRBuilder<> builder(context);
   // LLVM doesn't have the notion of a void pointer, so we'll pretend all of
@@ -105,44 +138,90 @@ void Compiler::GenerateInvoker(const lang::KernelInfo& ki, llvm::Module* module)
   llvm::Type* sizetype = llvm::IntegerType::get(context, archbits);
   auto gridSizeCount = std::tuple_size<lang::GridSize>::value;
   llvm::Type* gridSizeType = llvm::ArrayType::get(sizetype, gridSizeCount);
-  // The invoker gets two arguments: the first is a pointer to an array of
-  // buffer pointers, one for each kernel parameter; the second is the workIndex
-  // value, a lang::GridSize array of three indexes. All output is produced by
-  // writing to the buffers, so the return type is void.
-  std::vector<llvm::Type*> invoker_args{arrayptr, gridSizeType->getPointerTo()};
+  // The invoker gets three arguments: the first is a pointer to an array of
+  // buffer pointers, one for each kernel parameter; the second and third are
+  // the first and one-past-the-last grid cell to run. All output is produced
+  // by writing to the buffers, so the return type is void.
+  std::vector<llvm::Type*> invoker_args{arrayptr, sizetype, sizetype};
   llvm::Type* voidtype = llvm::Type::getVoidTy(context);
   auto invokertype = llvm::FunctionType::get(voidtype, invoker_args, false);
   auto linkage = llvm::Function::ExternalLinkage;
   std::string invokername = Executable::InvokerName(ki.kname);
   const char* nstr = invokername.c_str();
   auto invoker = llvm::Function::Create(invokertype, linkage, nstr, module);
-  // The invoker has no branches so we'll only need a single basic block.
-  auto block = llvm::BasicBlock::Create(context, "block", invoker);
-  builder.SetInsertPoint(block);
-  // We'll look up the kernel by name and implicitly bitcast it so we can call
-  // it using our int32-pointers in place of whatever it actually expects;
-  // LLVM will tolerate this mismatch when we use getOrInsertFunction.
-  std::vector<llvm::Type*> kernel_args(param_count, ptrtype);
-  kernel_args.push_back(gridSizeType->getPointerTo());
-  auto kerneltype = llvm::FunctionType::get(voidtype, kernel_args, false);
-  auto kernel = module->getOrInsertFunction(ki.kname, kerneltype);
+  auto entry = llvm::BasicBlock::Create(context, "entry", invoker);
+  auto test = llvm::BasicBlock::Create(context, "test", invoker);
+  auto body = llvm::BasicBlock::Create(context, "body", invoker);
+  auto done = llvm::BasicBlock::Create(context, "done", invoker);
+  builder.SetInsertPoint(entry);
+  // We'll look up the kernel by name and cast our int32-pointers to whatever
+  // it actually expects, so the invoker makes a direct call which the
+  // optimizer can inline.
+  llvm::Function* kernel = module->getFunction(ki.kname);
+  assert(kernel);
   auto ai = invoker->arg_begin();
   llvm::Value* argvec = &(*ai);
-  llvm::Value* workIndex = &(*++ai);
-  // The body of the invoker will simply compute the element pointer for each
-  // argument value in order, then load the value.
+  llvm::Value* begin = &(*++ai);
+  llvm::Value* end = &(*++ai);
+  // The entry block computes the element pointer for each argument value in
+  // order, then loads the value; these are the same for every grid cell.
   std::vector<llvm::Value*> args;
   for (unsigned i = 0; i < param_count; ++i) {
     llvm::Value* index = llvm::ConstantInt::get(inttype, i);
     std::vector<llvm::Value*> idxList{index};
     llvm::Value* elptr = builder.CreateGEP(argvec, idxList);
-    args.push_back(builder.CreateLoad(elptr));
+    llvm::Type* paramtype = kernel->getFunctionType()->getParamType(i);
+    args.push_back(builder.CreatePointerCast(builder.CreateLoad(elptr), paramtype));
   }
+  llvm::Value* workIndex = builder.CreateAlloca(gridSizeType);
   args.push_back(workIndex);
-  // Having built the argument list, we'll call the actual kernel using the
-  // parameter signature it expects.
+  // Split the first cell number into grid coordinates; this is the only
+  // place the invoker needs to divide.
+  llvm::Value* zero = llvm::ConstantInt::get(sizetype, 0);
+  llvm::Value* one = llvm::ConstantInt::get(sizetype, 1);
+  llvm::Value* g1 = llvm::ConstantInt::get(sizetype, ki.gwork[1]);
+  llvm::Value* g2 = llvm::ConstantInt::get(sizetype, ki.gwork[2]);
+  llvm::Value* plane = llvm::ConstantInt::get(sizetype, ki.gwork[1] * ki.gwork[2]);
+  llvm::Value* x0 = builder.CreateUDiv(begin, plane);
+  llvm::Value* rem = builder.CreateURem(begin, plane);
+  llvm::Value* y0 = builder.CreateUDiv(rem, g2);
+  llvm::Value* z0 = builder.CreateURem(rem, g2);
+  builder.CreateBr(test);
+  // The loop carries the cell number and its coordinates, stepping the
+  // coordinates like an odometer.
+  builder.SetInsertPoint(test);
+  auto i = builder.CreatePHI(sizetype, 2, "i");
+  auto x = builder.CreatePHI(sizetype, 2, "x");
+  auto y = builder.CreatePHI(sizetype, 2, "y");
+  auto z = builder.CreatePHI(sizetype, 2, "z");
+  builder.CreateCondBr(builder.CreateICmpULT(i, end), body, done);
+  builder.SetInsertPoint(body);
+  llvm::Value* coords[] = {x, y, z};
+  for (unsigned d = 0; d < gridSizeCount; ++d) {
+    std::vector<llvm::Value*> idxList{llvm::ConstantInt::get(inttype, 0), llvm::ConstantInt::get(inttype, d)};
+    builder.CreateStore(coords[d], builder.CreateGEP(workIndex, idxList));
+  }
+  // Having built the argument list, we'll call the actual kernel.
   builder.CreateCall(kernel, args, "");
-  builder.CreateRet(nullptr);
+  llvm::Value* i_next = builder.CreateAdd(i, one);
+  llvm::Value* z_inc = builder.CreateAdd(z, one);
+  llvm::Value* z_wrap = builder.CreateICmpEQ(z_inc, g2);
+  llvm::Value* z_next = builder.CreateSelect(z_wrap, zero, z_inc);
+  llvm::Value* y_inc = builder.CreateAdd(y, builder.CreateZExt(z_wrap, sizetype));
+  llvm::Value* y_wrap = builder.CreateICmpEQ(y_inc, g1);
+  llvm::Value* y_next = builder.CreateSelect(y_wrap, zero, y_inc);
+  llvm::Value* x_next = builder.CreateAdd(x, builder.CreateZExt(y_wrap, sizetype));
+  builder.CreateBr(test);
+  i->addIncoming(begin, entry);
+  i->addIncoming(i_next, body);
+  x->addIncoming(x0, entry);
+  x->addIncoming(x_next, body);
+  y->addIncoming(y0, entry);
+  y->addIncoming(y_next, body);
+  z->addIncoming(z0, entry);
+  z->addIncoming(z_next, body);
+  builder.SetInsertPoint(done);
+  builder.CreateRetVoid();
 }
 
 }  // namespace cpu
@@ -0,0 +1,113 @@
+// Copyright 2019 Intel Corporation.
+
+#include <gtest/gtest.h>
+
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "base/util/env.h"
+#include "base/util/perf_counter.h"
+#include "tile/hal/cpu/compiler.h"
+#include "tile/hal/cpu/executable.h"
+#include "tile/hal/cpu/library.h"
+#include "tile/lang/sembuilder.h"
+
+namespace fs = boost::filesystem;
+
+namespace vertexai {
+namespace tile {
+namespace hal {
+namespace cpu {
+namespace {
+
+class CpuCompilerTest : public ::testing::Test {
+ protected:
+  // The object cache is created from the environment the first time a kernel
+  // is built, so it has to be configured before any test builds one.
+  static void SetUpTestCase() {
+    dir_ = new fs::path(fs::temp_directory_path() / fs::unique_path("cpu_compiler_test_%%%%-%%%%-%%%%"));
+    env::Set("PLAIDML_LLVM_CACHE", dir_->string());
+  }
+
+  static void TearDownTestCase() {
+    boost::system::error_code ec;
+    fs::remove_all(*dir_, ec);
+    delete dir_;
+  }
+
+  // Builds a kernel writing 1 + the flattened number of each cell of a grid to
+  // the matching element of its output.
+  static lang::KernelInfo CellKernel(const std::string& name, const lang::GridSize& gwork) {
+    using namespace sem::builder;  // NOLINT
+    sem::Type ptrInt32Type{sem::Type::POINTER_MUT, DataType::INT32};
+    auto x = _Index(sem::IndexExpr::GROUP, 0);
+    auto y = _Index(sem::IndexExpr::GROUP, 1);
+    auto z = _Index(sem::IndexExpr::GROUP, 2);
+    auto cell = (x * _Const(gwork[1]) + y) * _Const(gwork[2]) + z;
+    lang::KernelInfo ki;
+    ki.kname = name;
+    ki.gwork = gwork;
+    ki.lwork = {{1, 1, 1}};
+    ki.kfunc = _Function(name, sem::Type{sem::Type::TVOID}, {{ptrInt32Type, "out"}},
+                         {_("out")[cell] = cell + _Const(1)});
+    return ki;
+  }
+
+  std::unique_ptr<hal::Library> Build(const lang::KernelInfo& ki) {
+    return compiler_.Build(ctx_, {ki}, hal::proto::HardwareSettings{}).get();
+  }
+
+  static fs::path* dir_;
+  context::Context ctx_;
+  Compiler compiler_;
+};
+
+fs::path* CpuCompilerTest::dir_ = nullptr;
+
+TEST_F(CpuCompilerTest, CachedKernelSkipsOptimizer) {
+  auto ki = CellKernel("cached_kernel", {{2, 3, 4}});
+  auto optimized = GetPerfCounter("cpu_optimized_modules");
+  auto hits = GetPerfCounter("llvm_object_cache_hits");
+
+  Build(ki);
+  EXPECT_EQ(GetPerfCounter("cpu_optimized_modules"), optimized + 1);
+
+  // The second build loads the object stored by the first one, keyed on the
+  // IR as it was before optimization, so the optimizer never runs.
+  Build(ki);
+  EXPECT_EQ(GetPerfCounter("cpu_optimized_modules"), optimized + 1);
+  EXPECT_EQ(GetPerfCounter("llvm_object_cache_hits"), hits + 1);
+}
+
+TEST_F(CpuCompilerTest, InvokerRunsUnalignedRangeAcrossWraparound) {
+  // Cells 7 through 46 of a 3x4x5 grid start mid-row at (0, 1, 2), wrap z
+  // from 4 to 0 on every row and y from 3 to 0 on entering x = 1 and x = 2,
+  // and stop mid-row at (2, 1, 1).
+  lang::GridSize gwork{{3, 4, 5}};
+  auto lib = Build(CellKernel("range_kernel", gwork));
+  auto engine = Library::Downcast(lib.get())->engines()[0];
+  auto invoker = reinterpret_cast<void (*)(void*, size_t, size_t)>(
+      engine->getFunctionAddress(Executable::InvokerName("range_kernel")));
+  ASSERT_NE(invoker, nullptr);
+
+  std::vector<std::int32_t> out(gwork[0] * gwork[1] * gwork[2]);
+  void* argvec[] = {out.data()};
+  invoker(argvec, 7, 47);
+
+  for (size_t cell = 0; cell < out.size(); ++cell) {
+    std::int32_t expected = cell >= 7 && cell < 47 ? cell + 1 : 0;
+    EXPECT_EQ(out[cell], expected) << "cell " << cell;
+  }
+}
+
+}  // namespace
+}  // namespace cpu
+}  // namespace hal
+}  // namespace tile
+}  // namespace vertexai
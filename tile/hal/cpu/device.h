@@ -9,6 +9,7 @@
 
 #include "base/context/context.h"
 #include "tile/base/hal.h"
+#include "tile/hal/cpu/executor.h"
 
 namespace vertexai {
 namespace tile {
@@ -20,9 +21,7 @@ class Device final : public hal::Device {
  public:
   Device();
 
-  void Initialize(const hal::proto::HardwareSettings& settings) final {
-    // NOP
-  }
+  void Initialize(const hal::proto::HardwareSettings& settings) final { executor_->Initialize(settings); }
 
   std::string description() final { return "CPU (LLVM)"; }
 
@@ -38,7 +37,7 @@ class Device final : public hal::Device {
   const std::unique_ptr<hal::Compiler> compiler_;
   const std::unique_ptr<hal::Loader> loader_;
   const std::unordered_map<std::string, std::unique_ptr<hal::Loader>> il_loader_map_;
-  const std::unique_ptr<hal::Executor> executor_;
+  const std::unique_ptr<Executor> executor_;
 };
 
 }  // namespace cpu
@@ -11,6 +11,7 @@
 #include <utility>
 #include <vector>
 
+#include "base/util/perf_counter.h"
 #include "tile/lang/exprtype.h"
 #include "tile/lang/fnv1a64.h"
 #include "tile/lang/generate.h"
@@ -26,11 +27,40 @@ class Error : public std::runtime_error {
   using std::runtime_error::runtime_error;
 };
 
+namespace {
+
+PerfCounter optimized_modules("cpu_optimized_modules");
+
+}  // namespace
+
+void Optimize(llvm::Module* module) {
+  // Configure the pass managers for specific optimization passes which might
+  // be relevant for Tile code.
+  llvm::PassManagerBuilder pmb;
+  pmb.OptLevel = 3;
+  pmb.SizeLevel = 0;
+  pmb.SLPVectorize = true;
+  pmb.LoopVectorize = true;
+  pmb.MergeFunctions = true;
+  llvm::legacy::FunctionPassManager funcopt{module};
+  llvm::legacy::PassManager modopt;
+  pmb.populateFunctionPassManager(funcopt);
+  pmb.populateModulePassManager(modopt);
+  funcopt.doInitialization();
+  for (auto& function : *module) {
+    if (!function.isDeclaration()) {
+      funcopt.run(function);
+    }
+  }
+  funcopt.doFinalization();
+  modopt.run(*module);
+  optimized_modules.inc();
+}
+
 Emit::Emit(llvm::LLVMContext& context)
     : context_(context),
       builder_{context_},
       module_{new llvm::Module("tile", context_)},
-      funcopt_{module_.get()},
       int32type_{llvm::IntegerType::get(context_, 32)},
       booltype_{llvm::IntegerType::get(context_, 1)},
       blocks_{1} {
@@ -46,18 +76,6 @@ Emit::Emit(llvm::LLVMContext& context)
   auto link = llvm::Function::ExternalLinkage;
   std::string name = "Barrier";
   barrier_func_ = llvm::Function::Create(functype, link, name, module_.get());
-
-  // Configure the function pass manager for specific optimization passes which
-  // might be relevant for Tile code.
-  llvm::PassManagerBuilder pmb;
-  pmb.OptLevel = 3;
-  pmb.SizeLevel = 0;
-  pmb.SLPVectorize = true;
-  pmb.LoopVectorize = true;
-  pmb.MergeFunctions = true;
-  pmb.populateFunctionPassManager(funcopt_);
-  pmb.populateModulePassManager(modopt_);
-  funcopt_.doInitialization();
 }
 
 void Emit::Visit(const sem::IntConst& n) {
@@ -846,8 +864,6 @@ void Emit::Visit(const sem::Function& n) {
 
   Leave();
   returntype_.base = sem::Type::TVOID;
-
-  funcopt_.run(*function_);
 }
 
 std::string Emit::str() const {
@@ -858,10 +874,7 @@ std::string Emit::str() const {
   return r;
 }
 
-std::unique_ptr<llvm::Module>&& Emit::result() {
-  modopt_.run(*module_);
-  return std::move(module_);
-}
+std::unique_ptr<llvm::Module>&& Emit::result() { return std::move(module_); }
 
 Emit::value Emit::Process(const sem::Node& n) {
   value nv;
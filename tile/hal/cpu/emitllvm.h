@@ -92,8 +92,6 @@ class Emit : public sem::Visitor {
   llvm::LLVMContext& context_;
   llvm::IRBuilder<> builder_;
   std::unique_ptr<llvm::Module> module_;
-  llvm::legacy::FunctionPassManager funcopt_;
-  llvm::legacy::PassManager modopt_;
   llvm::IntegerType* int32type_ = nullptr;
   llvm::IntegerType* booltype_ = nullptr;
   llvm::IntegerType* ssizetype_ = nullptr;
@@ -110,6 +108,12 @@ class Emit : public sem::Visitor {
   sem::Type returntype_{sem::Type::TVOID};
 };
 
+// Runs the O3 function and module pipelines over an emitted module. Emit
+// leaves its IR unoptimized so that callers can key the object cache on it
+// and add their own glue before optimizing; each run is counted in the
+// "cpu_optimized_modules" perf counter.
+void Optimize(llvm::Module* module);
+
 }  // namespace cpu
 }  // namespace hal
 }  // namespace tile
@@ -5,14 +5,8 @@
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 
 #include <algorithm>
-#include <condition_variable>
-#include <mutex>
-#include <thread>
 #include <utility>
 
-#include <boost/asio.hpp>
-#include <boost/asio/thread_pool.hpp>
-
 #include "base/util/error.h"
 #include "tile/hal/cpu/buffer.h"
 #include "tile/hal/cpu/event.h"
@@ -26,18 +20,25 @@ namespace {
 
 const char invoker_prefix_[] = "__invoke_";
 
-// std::thread::hardware_concurrency reports the number of cores including
-// hyperthreaded cores, but hyperthreading does not help our performance and
-// the overhead of additional threads harms it; we will therefore use only the
-// physical number of cores when dividing up our workloads. This function takes
-// a long time, so we'll perform the count only once at startup.
-const size_t physical_cores_ = boost::thread::physical_concurrency();
+// The number of grid chunks to aim for per thread when dividing a kernel's
+// grid for dynamic load balancing.
+const size_t chunks_per_thread_ = 8;
+
+// The estimated work (in flops, or bytes moved if greater) below which
+// another worker isn't worth its start-up and balancing costs.
+const size_t work_per_worker_ = 1 << 22;
 
 }  // namespace
 
+size_t WorkersFor(const lang::KernelInfo& ki, size_t iterations, size_t pool_size) {
+  size_t work = std::max(ki.tot_flops, ki.tot_bytes);
+  size_t workers = (work + work_per_worker_ - 1) / work_per_worker_;
+  return std::max<size_t>(1, std::min({workers, iterations, pool_size}));
+}
+
 Executable::Executable(std::shared_ptr<llvm::LLVMContext> llvm_ctx,
                        std::vector<std::shared_ptr<llvm::ExecutionEngine>> engines, std::vector<lang::KernelInfo> kis,
-                       std::shared_ptr<boost::asio::thread_pool> thread_pool)
+                       std::shared_ptr<NodePool> thread_pool)
     : llvm_context_{llvm_ctx}, engines_{engines}, kis_(kis), thread_pool_(thread_pool) {}
 
 std::shared_ptr<hal::Event> Executable::Run(const context::Context& ctx, std::size_t kidx,
@@ -45,56 +46,47 @@ std::shared_ptr<hal::Event> Executable::Run(const context::Context& ctx, std::si
                                             const std::vector<std::shared_ptr<hal::Event>>& dependencies,
                                             bool /* enable_profiling */) {
   context::Activity activity(ctx, "tile::hal::cpu::Kernel::Run");
+  activity.AddMetadata(kis_[kidx].info);
   std::vector<std::shared_ptr<hal::Buffer>> param_refs{params};
   auto deps = Event::WaitFor(dependencies);
+  const auto& gwork = kis_[kidx].gwork;
+  size_t iterations = gwork[0] * gwork[1] * gwork[2];
+  size_t workers = WorkersFor(kis_[kidx], iterations, thread_pool_->size());
   auto evt = deps.then([params = std::move(param_refs), act = std::move(activity), engine = engines_[kidx],
                         invoker_name = InvokerName(kis_[kidx].kname), thread_pool = thread_pool_,
-                        gwork = kis_[kidx].gwork](decltype(deps) future) -> std::shared_ptr<hal::Result> {
+                        iterations, workers](decltype(deps) future) -> std::shared_ptr<hal::Result> {
     future.get();
+    // Kernels whose dependencies are satisfied run concurrently, each on its
+    // own lease of the pool's workers; this waits for at least one worker to
+    // be free.
+    auto lease = thread_pool->Reserve(workers);
     auto start = std::chrono::high_resolution_clock::now();
     // Get the base address for all of these buffers, populating an argument
     // array, which we will pass in to the kernel's main function.
     std::vector<void*> args(params.size());
     for (size_t i = 0; i < args.size(); ++i) {
-      args[i] = Buffer::Downcast(params[i])->base();
+      auto buffer = Buffer::Downcast(params[i]);
+      buffer->Prepare(false);
+      args[i] = buffer->base();
     }
     void* argvec = args.data();
     uint64_t entrypoint = engine->getFunctionAddress(invoker_name);
-    // Iterate through the grid coordinates specified for this kernel, invoking
-    // the kernel function once for each. We'll create one thread per core and
-    // run one loop in each thread, staggering kernel invocations accordingly.
-    size_t iterations = gwork[0] * gwork[1] * gwork[2];
-    lang::GridSize denom = {{gwork[2] * gwork[1], gwork[2], 1}};
-    size_t threads = std::min(iterations, physical_cores_);
-
-    // The condition variable will guard the completion count. Each worker
-    // will increment the completion count, and we'll wait until it reaches
-    // the number of threads before returning.
-    std::mutex mutex;
-    std::condition_variable cv;
-    size_t completed = 0;
-
-    for (size_t offset = 0; offset < threads; ++offset) {
-      boost::asio::post(*thread_pool, [=, &mutex, &cv, &completed]() {
-        for (size_t i = offset; i < iterations; i += threads) {
-          lang::GridSize index;
-          index[0] = i / denom[0] % gwork[0];
-          index[1] = i / denom[1] % gwork[1];
-          index[2] = i / denom[2] % gwork[2];
-          ((void (*)(void*, lang::GridSize*))entrypoint)(argvec, &index);
-        }
-        {
-          std::unique_lock<std::mutex> lock{mutex};
-          if (++completed == threads) {
-            cv.notify_all();
-          }
-        }
-      });
-    }
-    {
-      std::unique_lock<std::mutex> lock{mutex};
-      cv.wait(lock, [&]() { return threads <= completed; });
-    }
+    // The invoker runs the kernel over a contiguous range of flattened grid
+    // coordinates. The lease gives each of its nodes a contiguous slice of
+    // the grid in proportion to its leased workers, and that node's workers
+    // repeatedly claim the next chunk of it until none remain, so
+    // neighbouring workgroups run back to back on the same node while faster
+    // workers still pick up the slack from slower ones. Only a lease of the
+    // whole pool splits the grid the way arenas split their pages when
+    // zeroing them, so only the largest kernels run on the node holding
+    // their data; smaller leases are kept to as few nodes as possible and
+    // read remote memory instead, in exchange for running alongside other
+    // kernels.
+    auto invoker = reinterpret_cast<void (*)(void*, size_t, size_t)>(entrypoint);
+    // Several chunks per thread give the balancing something to work with,
+    // without making the shared counters a hot spot.
+    size_t chunk = std::max<size_t>(1, iterations / (lease->size() * chunks_per_thread_));
+    lease->ParallelFor(iterations, chunk, [invoker, argvec](size_t begin, size_t end) { invoker(argvec, begin, end); });
 
     return std::make_shared<Result>(act.ctx(), "tile::hal::cpu::Executing", start,
                                     std::chrono::high_resolution_clock::now());
@@ -7,9 +7,8 @@
 #include <string>
 #include <vector>
 
-#include <boost/asio/thread_pool.hpp>
-
 #include "tile/base/hal.h"
+#include "tile/hal/cpu/numa.h"
 
 namespace llvm {
 class ExecutionEngine;
@@ -21,11 +20,17 @@ namespace tile {
 namespace hal {
 namespace cpu {
 
+// The number of workers to lease for a kernel: enough that each has a
+// useful amount of work, and no more than there are workgroups. Small
+// kernels thus leave the rest of the pool free to run independent kernels
+// alongside them.
+std::size_t WorkersFor(const lang::KernelInfo& ki, std::size_t iterations, std::size_t pool_size);
+
 class Executable final : public hal::Executable {
  public:
   Executable(std::shared_ptr<llvm::LLVMContext> llvm_context,
              std::vector<std::shared_ptr<llvm::ExecutionEngine>> engines, std::vector<lang::KernelInfo> kis,
-             std::shared_ptr<boost::asio::thread_pool> thread_pool);
+             std::shared_ptr<NodePool> thread_pool);
   virtual ~Executable();
 
   std::shared_ptr<hal::Event> Run(const context::Context& ctx, std::size_t kidx,
@@ -39,7 +44,7 @@ class Executable final : public hal::Executable {
   std::shared_ptr<llvm::LLVMContext> llvm_context_;
   std::vector<std::shared_ptr<llvm::ExecutionEngine>> engines_;
   std::vector<lang::KernelInfo> kis_;
-  std::shared_ptr<boost::asio::thread_pool> thread_pool_;
+  std::shared_ptr<NodePool> thread_pool_;
 };
 
 }  // namespace cpu
@@ -74,7 +74,8 @@ hal::proto::HardwareInfo GetHardwareInfo() {
 
 }  // namespace
 
-Executor::Executor() : info_{GetHardwareInfo()}, memory_{new Memory()}, thread_pool_{new boost::asio::thread_pool} {}
+Executor::Executor()
+    : info_{GetHardwareInfo()}, thread_pool_{std::make_shared<NodePool>()}, memory_{new Memory(thread_pool_)} {}
 
 std::shared_ptr<hal::Event> Executor::Copy(const context::Context& ctx, const std::shared_ptr<hal::Buffer>& from,
                                            std::size_t from_offset, const std::shared_ptr<hal::Buffer>& to,
@@ -86,16 +87,23 @@ std::shared_ptr<hal::Event> Executor::Copy(const context::Context& ctx, const st
       t->size() < length || t->size() < to_offset + length) {
     throw error::InvalidArgument{"Invalid copy request"};
   }
+  context::Activity activity{ctx, "tile::hal::cpu::Copy"};
+  if (activity.ctx().is_logging_events()) {
+    hal::proto::CopyInfo info;
+    info.set_bytes(length);
+    activity.AddMetadata(info);
+  }
   auto deps = Event::WaitFor(dependencies);
-  context::Context ctx_copy{ctx};
-  auto evt = deps.then([ctx = std::move(ctx_copy), f, t, from_offset, to_offset,
+  auto evt = deps.then([act = std::move(activity), f, t, from_offset, to_offset,
                         length](decltype(deps) fut) -> std::shared_ptr<hal::Result> {
     fut.get();
-    char* fb = static_cast<char*>(f->base()) + to_offset;
-    char* tb = static_cast<char*>(t->base()) + from_offset;
+    f->Prepare(false);
+    t->Prepare(to_offset == 0 && length == t->size());
+    char* fb = static_cast<char*>(f->base()) + from_offset;
+    char* tb = static_cast<char*>(t->base()) + to_offset;
     auto start = std::chrono::high_resolution_clock::now();
     memcpy(tb, fb, length);
-    return std::make_shared<Result>(ctx, "tile::hal::cpu::CopyMemory", start,
+    return std::make_shared<Result>(act.ctx(), "tile::hal::cpu::CopyMemory", start,
                                     std::chrono::high_resolution_clock::now());
   });
   return std::make_shared<cpu::Event>(std::move(evt));
@@ -5,9 +5,9 @@
 #include <memory>
 #include <vector>
 
-#include <boost/asio/thread_pool.hpp>
-
 #include "tile/base/hal.h"
+#include "tile/hal/cpu/memory.h"
+#include "tile/hal/cpu/numa.h"
 
 namespace vertexai {
 namespace tile {
@@ -31,7 +31,7 @@ class Executor : public hal::Executor {
                                    std::size_t to_offset, std::size_t length,
                                    const std::vector<std::shared_ptr<hal::Event>>& dependencies) final;
 
-  boost::future<std::unique_ptr<Executable>> Prepare(Library* library) final;
+  boost::future<std::unique_ptr<hal::Executable>> Prepare(hal::Library* library) final;
 
   boost::future<std::vector<std::shared_ptr<hal::Result>>> WaitFor(
       const std::vector<std::shared_ptr<hal::Event>>& events) final;
@@ -40,10 +40,12 @@ class Executor : public hal::Executor {
     // NOP
   }
 
+  void Initialize(const hal::proto::HardwareSettings& settings) { memory_->Configure(settings); }
+
  private:
   const hal::proto::HardwareInfo info_;
+  std::shared_ptr<NodePool> thread_pool_;
   std::unique_ptr<Memory> memory_;
-  std::shared_ptr<boost::asio::thread_pool> thread_pool_;
 };
 
 }  // namespace cpu
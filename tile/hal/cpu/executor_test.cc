@@ -0,0 +1,87 @@
+// Copyright 2019 Intel Corporation.
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "tile/hal/cpu/buffer.h"
+#include "tile/hal/cpu/executable.h"
+#include "tile/hal/cpu/executor.h"
+
+namespace vertexai {
+namespace tile {
+namespace hal {
+namespace cpu {
+namespace {
+
+std::vector<std::uint8_t> Contents(const std::shared_ptr<hal::Buffer>& buffer) {
+  auto b = Buffer::Downcast(buffer);
+  auto base = static_cast<std::uint8_t*>(b->base());
+  return std::vector<std::uint8_t>(base, base + b->size());
+}
+
+std::shared_ptr<hal::Buffer> MakeSource(Executor* executor, std::size_t size) {
+  auto buffer = executor->device_memory()->MakeBuffer(size, BufferAccessMask::ALL);
+  auto base = static_cast<std::uint8_t*>(buffer->MapDiscard({}).get());
+  for (std::size_t i = 0; i < size; ++i) {
+    base[i] = i + 1;
+  }
+  return buffer;
+}
+
+TEST(CpuExecutorTest, CopyReadsAndWritesAtTheirOwnOffsets) {
+  context::Context ctx;
+  Executor executor;
+  auto from = MakeSource(&executor, 64);
+  auto to = executor.device_memory()->MakeBuffer(32, BufferAccessMask::ALL);
+
+  // The destination was never written, so the bytes around the copy must read as zero.
+  executor.WaitFor({executor.Copy(ctx, from, 4, to, 8, 16, {})}).get();
+
+  std::vector<std::uint8_t> expected(32);
+  for (std::size_t i = 0; i < 16; ++i) {
+    expected[8 + i] = 4 + i + 1;
+  }
+  EXPECT_EQ(Contents(to), expected);
+}
+
+TEST(CpuExecutorTest, WholeBufferCopyFromAnOffset) {
+  context::Context ctx;
+  Executor executor;
+  auto from = MakeSource(&executor, 64);
+  auto to = executor.device_memory()->MakeBuffer(32, BufferAccessMask::ALL);
+
+  executor.WaitFor({executor.Copy(ctx, from, 16, to, 0, 32, {})}).get();
+
+  std::vector<std::uint8_t> expected(32);
+  for (std::size_t i = 0; i < 32; ++i) {
+    expected[i] = 16 + i + 1;
+  }
+  EXPECT_EQ(Contents(to), expected);
+}
+
+TEST(CpuExecutorTest, WorkersForScalesWithAKernelsWork) {
+  lang::KernelInfo ki;
+  ki.tot_flops = 0;
+  ki.tot_bytes = 0;
+  EXPECT_EQ(WorkersFor(ki, 1000, 16), 1);
+
+  // Sixteen workers' worth of flops, or of bytes moved.
+  ki.tot_flops = 16 << 22;
+  EXPECT_EQ(WorkersFor(ki, 1000, 64), 16);
+  ki.tot_flops = 0;
+  ki.tot_bytes = 16 << 22;
+  EXPECT_EQ(WorkersFor(ki, 1000, 64), 16);
+
+  // Never more than the pool or the kernel's workgroups, never fewer than one.
+  EXPECT_EQ(WorkersFor(ki, 1000, 4), 4);
+  EXPECT_EQ(WorkersFor(ki, 3, 64), 3);
+  EXPECT_EQ(WorkersFor(ki, 0, 64), 1);
+}
+
+}  // namespace
+}  // namespace cpu
+}  // namespace hal
+}  // namespace tile
+}  // namespace vertexai
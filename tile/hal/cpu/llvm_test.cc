@@ -37,6 +37,7 @@ static const sem::Type ptrFP32Type{sem::Type::POINTER_MUT, DataType::FLOAT32};
 static llvm::ExecutionEngine* JIT(llvm::LLVMContext& context, const sem::Node& n) {  // NOLINT(runtime/references)
   tile::hal::cpu::Emit emit(context);
   n.Accept(emit);
+  tile::hal::cpu::Optimize(emit.result().get());
   std::string errStr;
   std::unique_ptr<llvm::LegacyJITSymbolResolver> rez(new tile::hal::cpu::Runtime);
   LLVMInitializeNativeTarget();
@@ -13,11 +13,11 @@ namespace hal {
 namespace cpu {
 
 std::shared_ptr<hal::Buffer> Memory::MakeBuffer(std::uint64_t size, BufferAccessMask /* access */) {
-  return std::make_shared<Arena>(size)->MakeBuffer(0, size);
+  return std::make_shared<Arena>(size, config_, thread_pool_)->MakeBuffer(0, size);
 }
 
 std::shared_ptr<hal::Arena> Memory::MakeArena(std::uint64_t size, BufferAccessMask /* access */) {
-  return std::make_shared<Arena>(size);
+  return std::make_shared<Arena>(size, config_, thread_pool_);
 }
 
 }  // namespace cpu
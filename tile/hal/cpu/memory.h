@@ -6,8 +6,11 @@
 #include <cstdint>
 #include <memory>
 #include <ratio>
+#include <utility>
 
 #include "tile/base/hal.h"
+#include "tile/hal/cpu/arena.h"
+#include "tile/hal/cpu/numa.h"
 
 namespace vertexai {
 namespace tile {
@@ -16,7 +19,9 @@ namespace cpu {
 
 class Memory final : public hal::Memory {
  public:
-  Memory() {}
+  // Memory is first touched by the pool's workers, matching the way the
+  // pool partitions kernel grids; with no pool, by the allocating thread.
+  explicit Memory(std::shared_ptr<NodePool> thread_pool = nullptr) : thread_pool_{std::move(thread_pool)} {}
 
   std::uint64_t size_goal() const final {
     // TODO: Actually query the system physical memory size.
@@ -27,6 +32,13 @@ class Memory final : public hal::Memory {
 
   std::shared_ptr<hal::Buffer> MakeBuffer(std::uint64_t size, BufferAccessMask access) final;
   std::shared_ptr<hal::Arena> MakeArena(std::uint64_t size, BufferAccessMask access) final;
+
+  // Applies the allocator settings to subsequently created arenas.
+  void Configure(const hal::proto::HardwareSettings& settings) { config_.Apply(settings); }
+
+ private:
+  std::shared_ptr<NodePool> thread_pool_;
+  ArenaConfig config_;
 };
 
 }  // namespace cpu
@@ -0,0 +1,342 @@
+// Copyright 2019 Intel Corporation.
+
+#include "tile/hal/cpu/numa.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <boost/thread/thread.hpp>
+
+namespace vertexai {
+namespace tile {
+namespace hal {
+namespace cpu {
+namespace {
+
+void PinCurrentThread(const std::vector<int>& cpus) {
+#ifdef __linux__
+  if (cpus.empty()) {
+    return;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    CPU_SET(cpu, &set);
+  }
+  // Pinning is an optimization; if the CPUs are not available to this
+  // process (e.g. under a restricted cpuset) the thread simply floats.
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+}  // namespace
+
+std::vector<int> ParseCpuList(const std::string& list) {
+  std::vector<int> cpus;
+  std::stringstream ss{list};
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty() || range == "\n") {
+      continue;
+    }
+    auto dash = range.find('-');
+    int first = std::stoi(range.substr(0, dash));
+    int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+std::vector<NumaNode> HostNumaNodes() {
+  std::vector<NumaNode> nodes;
+#ifdef __linux__
+  // Node ids may be sparse, but in practice are small; stop after a run of
+  // missing ids.
+  for (std::size_t id = 0, missing = 0; missing < 8; ++id) {
+    std::ifstream in{"/sys/devices/system/node/node" + std::to_string(id) + "/cpulist"};
+    std::string list;
+    if (!in || !std::getline(in, list)) {
+      ++missing;
+      continue;
+    }
+    missing = 0;
+    auto cpus = ParseCpuList(list);
+    if (!cpus.empty()) {
+      nodes.emplace_back(NumaNode{id, std::move(cpus)});
+    }
+  }
+#endif
+  if (nodes.empty()) {
+    nodes.emplace_back(NumaNode{0, {}});
+  }
+  return nodes;
+}
+
+NodePool::NodePool(std::vector<NumaNode> nodes, std::size_t threads) {
+  if (nodes.empty()) {
+    nodes.emplace_back(NumaNode{0, {}});
+  }
+  if (!threads) {
+    // Hyperthreads do not help our kernels, and the extra threads harm them,
+    // so we only run one thread per physical core.
+    threads = std::max(1u, boost::thread::physical_concurrency());
+  }
+  std::size_t total_cpus = 0;
+  for (const auto& node : nodes) {
+    total_cpus += node.cpus.size();
+  }
+  nodes_.resize(nodes.size());
+  idle_.resize(nodes.size());
+  std::size_t cpus_before = 0;
+  for (std::size_t i = 0; i < nodes.size(); ++i) {
+    // Split on the running totals so the rounding never loses threads.
+    std::size_t cpus_after = cpus_before + (total_cpus ? nodes[i].cpus.size() : 1);
+    std::size_t total = total_cpus ? total_cpus : nodes.size();
+    std::size_t count = threads * cpus_after / total - threads * cpus_before / total;
+    cpus_before = cpus_after;
+    count = std::max<std::size_t>(count, 1);
+    nodes_[i].cpus = std::move(nodes[i].cpus);
+    for (std::size_t t = 0; t < count; ++t) {
+      nodes_[i].workers.push_back(workers_.size());
+      idle_[i].push_back(workers_.size());
+      workers_.emplace_back(std::make_unique<Worker>());
+    }
+  }
+  idle_count_ = workers_.size();
+  // The nodes are complete before any worker starts, so workers can refer
+  // to their node's CPU list.
+  for (auto& node : nodes_) {
+    for (auto w : node.workers) {
+      workers_[w]->thread = std::thread{&NodePool::WorkerMain, this, workers_[w].get(), &node.cpus};
+    }
+  }
+}
+
+NodePool::~NodePool() {
+  for (auto& worker : workers_) {
+    {
+      std::lock_guard<std::mutex> lock{worker->mu};
+      worker->shutdown = true;
+    }
+    worker->cv.notify_all();
+  }
+  for (auto& worker : workers_) {
+    worker->thread.join();
+  }
+}
+
+NodePool::Lease::Lease(NodePool* pool, std::vector<std::vector<std::size_t>> workers)
+    : pool_{pool}, workers_{std::move(workers)} {
+  for (const auto& node : workers_) {
+    size_ += node.size();
+  }
+}
+
+NodePool::Lease::~Lease() { pool_->Release(workers_); }
+
+void NodePool::Lease::ParallelFor(std::size_t range, std::size_t grain, const Body& body) {
+  std::vector<std::size_t> counts;
+  for (const auto& node : workers_) {
+    counts.push_back(node.size());
+  }
+  pool_->Run(workers_, Partition(range, counts), grain, body);
+}
+
+std::unique_ptr<NodePool::Lease> NodePool::Reserve(std::size_t workers) {
+  std::vector<std::vector<std::size_t>> leased;
+  {
+    std::unique_lock<std::mutex> lock{lease_mu_};
+    lease_cv_.wait(lock, [this]() { return idle_count_ > 0; });
+    leased = TakeIdle(std::max<std::size_t>(workers, 1));
+  }
+  return std::unique_ptr<Lease>{new Lease{this, std::move(leased)}};
+}
+
+std::vector<std::vector<std::size_t>> NodePool::TakeIdle(std::size_t workers) {
+  std::vector<std::vector<std::size_t>> taken(nodes_.size());
+  // Take the nodes with the most idle workers first, so that small leases
+  // stay within a node.
+  std::vector<std::size_t> order(nodes_.size());
+  for (std::size_t n = 0; n < order.size(); ++n) {
+    order[n] = n;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [this](std::size_t a, std::size_t b) { return idle_[b].size() < idle_[a].size(); });
+  for (std::size_t n : order) {
+    while (workers && !idle_[n].empty()) {
+      taken[n].push_back(idle_[n].back());
+      idle_[n].pop_back();
+      --idle_count_;
+      --workers;
+    }
+    if (!workers) {
+      break;
+    }
+  }
+  return taken;
+}
+
+void NodePool::Release(const std::vector<std::vector<std::size_t>>& workers) {
+  {
+    std::lock_guard<std::mutex> lock{lease_mu_};
+    for (std::size_t n = 0; n < workers.size(); ++n) {
+      idle_[n].insert(idle_[n].end(), workers[n].begin(), workers[n].end());
+      idle_count_ += workers[n].size();
+    }
+  }
+  lease_cv_.notify_all();
+}
+
+std::vector<std::pair<std::size_t, std::size_t>> NodePool::Partition(std::size_t range) const {
+  std::vector<std::size_t> workers;
+  for (const auto& node : nodes_) {
+    workers.push_back(node.workers.size());
+  }
+  return Partition(range, workers);
+}
+
+std::vector<std::pair<std::size_t, std::size_t>> NodePool::Partition(std::size_t range,
+                                                                      const std::vector<std::size_t>& workers) {
+  std::size_t total = 0;
+  for (std::size_t count : workers) {
+    total += count;
+  }
+  std::vector<std::pair<std::size_t, std::size_t>> slices;
+  std::size_t before = 0;
+  for (std::size_t count : workers) {
+    std::size_t begin = range * before / total;
+    before += count;
+    slices.emplace_back(begin, range * before / total);
+  }
+  return slices;
+}
+
+void NodePool::ParallelFor(std::size_t range, std::size_t grain, const Body& body) {
+  if (!range) {
+    return;
+  }
+  std::vector<std::vector<std::size_t>> taken;
+  {
+    std::lock_guard<std::mutex> lock{lease_mu_};
+    taken = TakeIdle(workers_.size());
+  }
+  std::size_t count = 0;
+  for (const auto& node : taken) {
+    count += node.size();
+  }
+  if (!count) {
+    grain = std::max<std::size_t>(grain, 1);
+    for (std::size_t begin = 0; begin < range; begin += grain) {
+      body(begin, std::min(begin + grain, range));
+    }
+    return;
+  }
+  // The slices follow the whole pool's proportions, whichever workers are
+  // idle, so that each node's part of the range is the same from call to
+  // call; a node without idle workers has its slice taken by the others.
+  // The lease returns the workers once the loop is done, even if it throws.
+  Lease lease{this, std::move(taken)};
+  Run(lease.workers_, Partition(range), grain, body);
+}
+
+void NodePool::Run(const std::vector<std::vector<std::size_t>>& workers,
+                   const std::vector<std::pair<std::size_t, std::size_t>>& slices, std::size_t grain,
+                   const Body& body) {
+  if (slices.empty() || slices.back().second == 0) {
+    return;
+  }
+  grain = std::max<std::size_t>(grain, 1);
+  std::vector<std::atomic<std::size_t>> next(slices.size());
+  for (std::size_t i = 0; i < slices.size(); ++i) {
+    next[i] = slices[i].first;
+  }
+
+  // One task per worker. The mutex guards the completion count and the
+  // first error; we wait until every task has finished before returning,
+  // since the tasks refer to our locals.
+  std::size_t tasks = 0;
+  for (const auto& node : workers) {
+    tasks += node.size();
+  }
+  std::mutex mu;
+  std::condition_variable cv;
+  std::size_t completed = 0;
+  std::exception_ptr error;
+
+  for (std::size_t n = 0; n < workers.size(); ++n) {
+    for (std::size_t w : workers[n]) {
+      Post(w, [&, n]() {
+        try {
+          for (std::size_t k = 0; k < slices.size(); ++k) {
+            std::size_t s = (n + k) % slices.size();
+            for (;;) {
+              std::size_t begin = next[s].fetch_add(grain);
+              if (slices[s].second <= begin) {
+                break;
+              }
+              body(begin, std::min(begin + grain, slices[s].second));
+            }
+          }
+        } catch (...) {
+          std::lock_guard<std::mutex> lock{mu};
+          if (!error) {
+            error = std::current_exception();
+          }
+        }
+        std::lock_guard<std::mutex> lock{mu};
+        if (++completed == tasks) {
+          cv.notify_all();
+        }
+      });
+    }
+  }
+  {
+    std::unique_lock<std::mutex> lock{mu};
+    cv.wait(lock, [&]() { return tasks <= completed; });
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void NodePool::Post(std::size_t worker, std::function<void()> task) {
+  auto& w = *workers_[worker];
+  {
+    std::lock_guard<std::mutex> lock{w.mu};
+    w.tasks.emplace_back(std::move(task));
+  }
+  w.cv.notify_one();
+}
+
+void NodePool::WorkerMain(Worker* worker, const std::vector<int>* cpus) {
+  PinCurrentThread(*cpus);
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock{worker->mu};
+      worker->cv.wait(lock, [worker]() { return worker->shutdown || !worker->tasks.empty(); });
+      if (worker->tasks.empty()) {
+        return;
+      }
+      task = std::move(worker->tasks.front());
+      worker->tasks.pop_front();
+    }
+    task();
+  }
+}
+
+}  // namespace cpu
+}  // namespace hal
+}  // namespace tile
+}  // namespace vertexai
@@ -0,0 +1,145 @@
+// Copyright 2019 Intel Corporation.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace vertexai {
+namespace tile {
+namespace hal {
+namespace cpu {
+
+// A NUMA node: a set of logical CPUs sharing the same local memory.
+struct NumaNode {
+  std::size_t id;
+  std::vector<int> cpus;
+};
+
+// Parses a kernel CPU list, as found in sysfs, such as "0-3,8-11".
+std::vector<int> ParseCpuList(const std::string& list);
+
+// Returns the host's NUMA nodes, in id order. Hosts which do not expose a
+// topology are reported as a single node with no CPU list, which disables
+// thread pinning.
+std::vector<NumaNode> HostNumaNodes();
+
+// A set of worker threads grouped by NUMA node. Each node's workers are
+// pinned to that node's CPUs, so the memory they first touch comes from the
+// node's local memory. Parallel loops hand each node a contiguous slice of
+// the range in proportion to its worker count; allocations which are
+// initialized through the same partitioning are therefore local to the
+// workers which later run over them.
+//
+// Each worker has its own task queue, and a worker only runs tasks for the
+// loops of whoever holds it: the lease it belongs to, or a pool-wide loop
+// which found it idle.
+class NodePool {
+ public:
+  using Body = std::function<void(std::size_t begin, std::size_t end)>;
+
+  // Distributes threads (zero meaning one per physical core) across nodes
+  // in proportion to each node's CPU count.
+  explicit NodePool(std::vector<NumaNode> nodes = HostNumaNodes(), std::size_t threads = 0);
+  ~NodePool();
+
+  NodePool(const NodePool&) = delete;
+  NodePool& operator=(const NodePool&) = delete;
+
+  std::size_t node_count() const { return nodes_.size(); }
+  std::size_t size() const { return workers_.size(); }
+
+  // The number of workers pinned to the given node.
+  std::size_t node_size(std::size_t node) const { return nodes_[node].workers.size(); }
+
+  // A set of workers, reserved for one caller's loops until the lease is
+  // destroyed. Loops run over a lease run only on its workers, and no other
+  // loop runs on them while the lease is held, so loops over different
+  // leases run side by side on disjoint sets of cores.
+  class Lease {
+   public:
+    ~Lease();
+
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+
+    std::size_t size() const { return size_; }
+
+    // The number of leased workers on the given node.
+    std::size_t node_size(std::size_t node) const { return workers_[node].size(); }
+
+    // As NodePool::ParallelFor, using only the leased workers.
+    void ParallelFor(std::size_t range, std::size_t grain, const Body& body);
+
+   private:
+    friend class NodePool;
+    Lease(NodePool* pool, std::vector<std::vector<std::size_t>> workers);
+
+    NodePool* pool_;
+    std::vector<std::vector<std::size_t>> workers_;  // Per node
+    std::size_t size_ = 0;
+  };
+
+  // Leases up to the requested number of workers (at least one), taking
+  // them from as few nodes as possible. Blocks until a worker is idle; if
+  // fewer are idle than requested, the lease holds only those.
+  std::unique_ptr<Lease> Reserve(std::size_t workers);
+
+  // The contiguous slice of [0, range) which belongs to each node.
+  std::vector<std::pair<std::size_t, std::size_t>> Partition(std::size_t range) const;
+
+  // Invokes body over chunks of at most grain iterations which together
+  // cover [0, range), and waits for them to complete. Runs on whichever
+  // workers no lease holds, without waiting for leased ones; if every
+  // worker is leased, runs on the calling thread. Workers start on their
+  // own node's slice, and only move on to other nodes' slices once it is
+  // exhausted. Rethrows the first exception raised by body.
+  void ParallelFor(std::size_t range, std::size_t grain, const Body& body);
+
+ private:
+  struct Worker {
+    std::mutex mu;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> tasks;
+    bool shutdown = false;
+    std::thread thread;
+  };
+
+  struct Node {
+    std::vector<int> cpus;
+    std::vector<std::size_t> workers;  // Indices into workers_
+  };
+
+  // Slices [0, range) between the nodes in proportion to the supplied
+  // per-node worker counts.
+  static std::vector<std::pair<std::size_t, std::size_t>> Partition(std::size_t range,
+                                                                     const std::vector<std::size_t>& workers);
+  // Takes up to the requested number of idle workers; lease_mu_ must be held.
+  std::vector<std::vector<std::size_t>> TakeIdle(std::size_t workers);
+  void Run(const std::vector<std::vector<std::size_t>>& workers,
+           const std::vector<std::pair<std::size_t, std::size_t>>& slices, std::size_t grain, const Body& body);
+  void Release(const std::vector<std::vector<std::size_t>>& workers);
+  void Post(std::size_t worker, std::function<void()> task);
+  void WorkerMain(Worker* worker, const std::vector<int>* cpus);
+
+  std::vector<Node> nodes_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  std::mutex lease_mu_;
+  std::condition_variable lease_cv_;
+  std::vector<std::vector<std::size_t>> idle_;  // Unleased workers, per node
+  std::size_t idle_count_ = 0;
+};
+
+}  // namespace cpu
+}  // namespace hal
+}  // namespace tile
+}  // namespace vertexai
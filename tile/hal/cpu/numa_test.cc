@@ -0,0 +1,259 @@
+// Copyright 2019 Intel Corporation.
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "tile/hal/cpu/arena.h"
+#include "tile/hal/cpu/numa.h"
+
+namespace vertexai {
+namespace tile {
+namespace hal {
+namespace cpu {
+namespace {
+
+// A topology with four CPUs on node 0 and two on node 1. The CPU ids need not
+// exist on the test host; pinning to CPUs the process can't use is ignored.
+std::vector<NumaNode> TwoNodes() { return {NumaNode{0, {0, 1, 2, 3}}, NumaNode{1, {4, 5}}}; }
+
+TEST(CpuNumaTest, ParseCpuList) {
+  EXPECT_EQ(ParseCpuList("0-3,8-11"), (std::vector<int>{0, 1, 2, 3, 8, 9, 10, 11}));
+  EXPECT_EQ(ParseCpuList("5"), (std::vector<int>{5}));
+  EXPECT_EQ(ParseCpuList("0,2,4-5"), (std::vector<int>{0, 2, 4, 5}));
+  EXPECT_EQ(ParseCpuList(""), (std::vector<int>{}));
+}
+
+TEST(CpuNumaTest, WorkersFollowEachNodesCpus) {
+  NodePool pool{TwoNodes(), 6};
+  EXPECT_EQ(pool.node_count(), 2);
+  EXPECT_EQ(pool.size(), 6);
+  EXPECT_EQ(pool.node_size(0), 4);
+  EXPECT_EQ(pool.node_size(1), 2);
+}
+
+TEST(CpuNumaTest, EveryNodeGetsAWorker) {
+  NodePool pool{TwoNodes(), 1};
+  EXPECT_EQ(pool.node_size(0), 1);
+  EXPECT_EQ(pool.node_size(1), 1);
+  EXPECT_EQ(pool.size(), 2);
+}
+
+TEST(CpuNumaTest, NodesWithoutCpuListsShareWorkersEvenly) {
+  NodePool pool{{NumaNode{0, {}}, NumaNode{1, {}}, NumaNode{2, {}}}, 7};
+  EXPECT_EQ(pool.size(), 7);
+  EXPECT_EQ(pool.node_size(0) + pool.node_size(1) + pool.node_size(2), 7);
+  for (std::size_t n = 0; n < 3; ++n) {
+    EXPECT_LE(2, pool.node_size(n));
+    EXPECT_LE(pool.node_size(n), 3);
+  }
+}
+
+TEST(CpuNumaTest, PartitionIsProportionalAndContiguous) {
+  NodePool pool{TwoNodes(), 6};
+  using Slices = std::vector<std::pair<std::size_t, std::size_t>>;
+  EXPECT_EQ(pool.Partition(600), (Slices{{0, 400}, {400, 600}}));
+  EXPECT_EQ(pool.Partition(7), (Slices{{0, 4}, {4, 7}}));
+  EXPECT_EQ(pool.Partition(0), (Slices{{0, 0}, {0, 0}}));
+}
+
+TEST(CpuNumaTest, ParallelForCoversTheRangeOnce) {
+  NodePool pool{TwoNodes(), 6};
+  for (std::size_t range : {1, 5, 1000, 4097}) {
+    for (std::size_t grain : {1, 7, 64, 10000}) {
+      std::vector<std::atomic<int>> hits(range);
+      for (auto& hit : hits) {
+        hit = 0;
+      }
+      pool.ParallelFor(range, grain, [&](std::size_t begin, std::size_t end) {
+        EXPECT_LT(begin, end);
+        EXPECT_LE(end - begin, grain);
+        for (std::size_t i = begin; i < end; ++i) {
+          ++hits[i];
+        }
+      });
+      for (std::size_t i = 0; i < range; ++i) {
+        ASSERT_EQ(hits[i], 1) << "range " << range << ", grain " << grain << ", index " << i;
+      }
+    }
+  }
+}
+
+TEST(CpuNumaTest, ParallelForRunsOnThePoolsWorkers) {
+  NodePool pool{TwoNodes(), 6};
+  std::mutex mu;
+  std::set<std::thread::id> threads;
+  pool.ParallelFor(6000, 1, [&](std::size_t, std::size_t) {
+    std::lock_guard<std::mutex> lock{mu};
+    threads.insert(std::this_thread::get_id());
+  });
+  EXPECT_EQ(threads.count(std::this_thread::get_id()), 0);
+  EXPECT_LE(threads.size(), 6);
+}
+
+TEST(CpuNumaTest, ParallelForRethrowsAfterEveryTaskFinishes) {
+  NodePool pool{TwoNodes(), 6};
+  std::atomic<std::size_t> running{0};
+  EXPECT_THROW(pool.ParallelFor(1000, 1,
+                                [&](std::size_t begin, std::size_t) {
+                                  ++running;
+                                  if (begin == 500) {
+                                    --running;
+                                    throw std::runtime_error{"failed"};
+                                  }
+                                  --running;
+                                }),
+               std::runtime_error);
+  EXPECT_EQ(running, 0);
+
+  // The pool remains usable afterwards.
+  std::atomic<std::size_t> total{0};
+  pool.ParallelFor(100, 10, [&](std::size_t begin, std::size_t end) { total += end - begin; });
+  EXPECT_EQ(total, 100);
+}
+
+// Records the threads which run a loop's chunks.
+std::set<std::thread::id> ThreadsRunning(const std::function<void(const NodePool::Body&)>& loop) {
+  std::mutex mu;
+  std::set<std::thread::id> threads;
+  loop([&](std::size_t, std::size_t) {
+    std::lock_guard<std::mutex> lock{mu};
+    threads.insert(std::this_thread::get_id());
+  });
+  return threads;
+}
+
+TEST(CpuNumaTest, ReserveKeepsSmallLeasesOnOneNode) {
+  NodePool pool{TwoNodes(), 6};
+  auto small = pool.Reserve(3);
+  EXPECT_EQ(small->size(), 3);
+  EXPECT_EQ(small->node_size(0), 3);
+  EXPECT_EQ(small->node_size(1), 0);
+
+  // Node 1 now has the most idle workers, so it's used first.
+  auto spanning = pool.Reserve(3);
+  EXPECT_EQ(spanning->size(), 3);
+  EXPECT_EQ(spanning->node_size(0), 1);
+  EXPECT_EQ(spanning->node_size(1), 2);
+}
+
+TEST(CpuNumaTest, ReserveTakesWhatIsIdle) {
+  NodePool pool{TwoNodes(), 6};
+  EXPECT_EQ(pool.Reserve(0)->size(), 1);
+  auto most = pool.Reserve(5);
+  EXPECT_EQ(most->size(), 5);
+  EXPECT_EQ(pool.Reserve(100)->size(), 1);
+}
+
+TEST(CpuNumaTest, ReserveWaitsForARelease) {
+  NodePool pool{TwoNodes(), 2};
+  auto all = pool.Reserve(2);
+  std::atomic<bool> reserved{false};
+  std::thread waiter{[&]() {
+    auto lease = pool.Reserve(2);
+    reserved = true;
+    EXPECT_EQ(lease->size(), 2);
+  }};
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(reserved);
+  all.reset();
+  waiter.join();
+  EXPECT_TRUE(reserved);
+}
+
+TEST(CpuNumaTest, LeasesRunOnlyOnTheirOwnWorkers) {
+  NodePool pool{TwoNodes(), 6};
+  auto a = pool.Reserve(3);
+  auto b = pool.Reserve(3);
+  std::set<std::thread::id> a_threads;
+  std::set<std::thread::id> b_threads;
+  for (int i = 0; i < 20; ++i) {
+    auto ta = ThreadsRunning([&](const NodePool::Body& body) { a->ParallelFor(3000, 1, body); });
+    auto tb = ThreadsRunning([&](const NodePool::Body& body) { b->ParallelFor(3000, 1, body); });
+    a_threads.insert(ta.begin(), ta.end());
+    b_threads.insert(tb.begin(), tb.end());
+  }
+  EXPECT_LE(a_threads.size(), 3);
+  EXPECT_LE(b_threads.size(), 3);
+  for (const auto& id : a_threads) {
+    EXPECT_EQ(b_threads.count(id), 0);
+  }
+}
+
+TEST(CpuNumaTest, LeasedWorkersDoNotRunOtherLoops) {
+  NodePool pool{TwoNodes(), 6};
+  auto lease = pool.Reserve(4);
+  auto leased = ThreadsRunning([&](const NodePool::Body& body) { lease->ParallelFor(4000, 1, body); });
+
+  // While one of the lease's loops is blocked, a pool-wide loop still runs,
+  // on the unleased workers.
+  std::mutex mu;
+  std::condition_variable cv;
+  bool release = false;
+  std::thread blocked{[&]() {
+    lease->ParallelFor(1, 1, [&](std::size_t, std::size_t) {
+      std::unique_lock<std::mutex> lock{mu};
+      cv.wait(lock, [&]() { return release; });
+    });
+  }};
+  auto pooled = ThreadsRunning([&](const NodePool::Body& body) { pool.ParallelFor(2000, 1, body); });
+  {
+    std::lock_guard<std::mutex> lock{mu};
+    release = true;
+  }
+  cv.notify_all();
+  blocked.join();
+
+  EXPECT_LE(pooled.size(), 2);
+  for (const auto& id : pooled) {
+    EXPECT_EQ(leased.count(id), 0);
+  }
+}
+
+TEST(CpuNumaTest, ParallelForRunsInlineWhenEveryWorkerIsLeased) {
+  NodePool pool{TwoNodes(), 6};
+  auto all = pool.Reserve(6);
+  auto threads = ThreadsRunning([&](const NodePool::Body& body) { pool.ParallelFor(100, 7, body); });
+  EXPECT_EQ(threads, std::set<std::thread::id>{std::this_thread::get_id()});
+}
+
+TEST(CpuNumaTest, ArenasZeroedAcrossNodesReadAsZero) {
+  auto pool = std::make_shared<NodePool>(TwoNodes(), 6);
+  ArenaConfig config;
+  config.mode = hal::proto::HostAllocator::Heap;
+  // Large enough to be placed by the pool, and not a whole number of pages.
+  std::uint64_t size = (4 << 20) + 123;
+  auto arena = std::make_shared<Arena>(size, config, pool);
+  auto base = static_cast<unsigned char*>(arena->base());
+  std::memset(base, 0xff, size);
+  arena->Prepare(false);
+  std::vector<unsigned char> expected(size);
+  EXPECT_EQ(std::memcmp(base, expected.data(), size), 0);
+}
+
+TEST(CpuNumaTest, MappedArenasPlacedAcrossNodesReadAsZero) {
+  auto pool = std::make_shared<NodePool>(TwoNodes(), 6);
+  std::uint64_t size = (4 << 20) + 123;
+  auto arena = std::make_shared<Arena>(size, ArenaConfig{}, pool);
+  arena->Prepare(false);
+  auto base = static_cast<unsigned char*>(arena->base());
+  std::vector<unsigned char> expected(size);
+  EXPECT_EQ(std::memcmp(base, expected.data(), size), 0);
+}
+
+}  // namespace
+}  // namespace cpu
+}  // namespace hal
+}  // namespace tile
+}  // namespace vertexai
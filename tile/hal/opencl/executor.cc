@@ -49,6 +49,11 @@ std::shared_ptr<hal::Event> Executor::Copy(const context::Context& ctx, const st
   }
 
   context::Activity activity{ctx, "tile::hal::opencl::Copy"};
+  if (activity.ctx().is_logging_events()) {
+    hal::proto::CopyInfo info;
+    info.set_bytes(length);
+    activity.AddMetadata(info);
+  }
 
   auto from_base = from_buf->base();
   auto from_ptr = from_buf->mem();
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 namespace fnv1a64 {
@@ -23,4 +24,13 @@ static std::uint64_t hash(char const* str) {
   return ret;
 }
 
+// continue a hash over a buffer of known length at run time
+inline std::uint64_t hash(char const* str, std::size_t len, std::uint64_t prev = basis) {
+  for (std::size_t i = 0; i < len; i++) {
+    prev ^= static_cast<unsigned char>(str[i]);
+    prev *= prime;
+  }
+  return prev;
+}
+
 }  // namespace fnv1a64
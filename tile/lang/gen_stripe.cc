@@ -557,6 +557,13 @@ class StripeGenerator {
     stmt->name = "prng_step";
     stmt->inputs = {op.inputs[0]};
     stmt->outputs = {};
+    // A [[generator(name)]] attribute selects the sequence on backends which
+    // offer more than one.
+    for (const auto& attr : op.attributes) {
+      if (attr.name() == "generator" && attr.params_size() == 1) {
+        stmt->str_params["generator"] = attr.params(0);
+      }
+    }
     std::string tup = op.output;
     std::string sout;
     std::string vout;
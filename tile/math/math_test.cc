@@ -118,6 +118,27 @@ TEST_CASE("Basic Polynomial<Rational> evaluation", "[]") {
   REQUIRE(r.eval({{"a0", 5}, {"a1", 9}}) == 33);
 }
 
+TEST_CASE("Polynomial<int64_t> terms stay in name order", "[polynomial]") {
+  Polynomial<int64_t> p = Polynomial<int64_t>("j", 2) + Polynomial<int64_t>("i", 3) + 5;
+  REQUIRE(to_string(p) == "5 + 3*i + 2*j");
+  p -= Polynomial<int64_t>("i", 3);
+  REQUIRE(p.getMap().size() == 2);
+  REQUIRE(p["i"] == 0);
+  REQUIRE(p.constant() == 5);
+  REQUIRE(p == Polynomial<int64_t>("j", 2) + 5);
+  REQUIRE(Polynomial<int64_t>("i") < Polynomial<int64_t>("j"));
+}
+
+TEST_CASE("Polynomial<int64_t> substitution", "[polynomial]") {
+  Polynomial<int64_t> p = Polynomial<int64_t>("i", 2) + Polynomial<int64_t>("j") + 1;
+  std::map<std::string, Polynomial<int64_t>> values{{"i", Polynomial<int64_t>("x") + 1},
+                                                    {"j", Polynomial<int64_t>("x", -2)}};
+  REQUIRE(p.sym_eval(values) == Polynomial<int64_t>(3));
+  REQUIRE(p.partial_eval({{"i", 4}}) == Polynomial<int64_t>("j") + 9);
+  p.substitute("j", Polynomial<int64_t>("i", -2));
+  REQUIRE(p == Polynomial<int64_t>(1));
+}
+
 TEST_CASE("HNFMatrix", "[hnf]") {
   Matrix m = MatrixLit({{0, Rational(1, 2)}, {Rational(1, 2), Rational(1, 2)}, {1, 0}});
   bool r = HermiteNormalForm(m);
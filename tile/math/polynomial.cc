@@ -21,14 +21,24 @@ Polynomial<T>::Polynomial(const std::string& i, const T& c) {
   }
 }
 
+template <typename T>
+Polynomial<T>::Polynomial(const Symbol& i, const T& c) {
+  if (c) {
+    map_[i] = c;
+  }
+}
+
 template <typename T>
 T Polynomial<T>::eval(const std::map<std::string, T>& values) const {
   T res = 0;
   for (const auto& kvp : map_) {
-    if (kvp.first == "") {
+    if (kvp.first.empty()) {
       res += kvp.second;
-    } else if (values.find(kvp.first) != values.end()) {
-      res += kvp.second * safe_at(values, kvp.first);
+      continue;
+    }
+    auto it = values.find(kvp.first);
+    if (it != values.end()) {
+      res += kvp.second * it->second;
     } else {
       throw std::runtime_error(
           str(boost::format("Failed to find value for %s, when evaluating %s") % kvp.first % toString()));
@@ -39,11 +49,16 @@ T Polynomial<T>::eval(const std::map<std::string, T>& values) const {
 
 template <typename T>
 Polynomial<T> Polynomial<T>::partial_eval(const std::map<std::string, T>& values) const {
+  // Polynomials usually have far fewer terms than there are values, so look the terms up in the values rather than
+  // the other way around.
   Polynomial<T> r = *this;
   T off = 0;
-  for (const auto& kvp : values) {
-    off += get(kvp.first) * kvp.second;
-    r.map_.erase(kvp.first);
+  for (const auto& kvp : map_) {
+    auto it = values.find(kvp.first);
+    if (it != values.end()) {
+      off += kvp.second * it->second;
+      r.map_.erase(kvp.first);
+    }
   }
   r += off;
   return r;
@@ -59,23 +74,18 @@ T Polynomial<T>::operator[](const std::string& var) const {
 }
 
 template <typename T>
-const std::map<std::string, T>& Polynomial<T>::getMap() const {
+const SymbolMap<T>& Polynomial<T>::getMap() const {
   return map_;
 }
 
 template <typename T>
-std::map<std::string, T>& Polynomial<T>::mutateMap() {
+SymbolMap<T>& Polynomial<T>::mutateMap() {
   return map_;
 }
 
 template <typename T>
 Polynomial<T>& Polynomial<T>::operator+=(const Polynomial<T>& rhs) {
-  for (const auto& kvp : rhs.map_) {
-    T new_val = (map_[kvp.first] += kvp.second);
-    if (new_val == 0) {
-      map_.erase(kvp.first);
-    }
-  }
+  map_.AddScaled(rhs.map_, 1);
   return *this;
 }
 
@@ -91,7 +101,8 @@ bool Polynomial<T>::operator<(const Polynomial<T>& rhs) const {
 
 template <typename T>
 Polynomial<T>& Polynomial<T>::operator-=(const Polynomial<T>& rhs) {
-  return *this += -1 * rhs;
+  map_.AddScaled(rhs.map_, -1);
+  return *this;
 }
 
 template <typename T>
@@ -118,8 +129,8 @@ Polynomial<T>& Polynomial<T>::operator/=(const T& rhs) {
 
 template <typename T>
 T Polynomial<T>::constant() const {
-  auto it = map_.find("");
-  return (it == map_.end() ? 0 : it->second);
+  auto it = map_.begin();
+  return (it == map_.end() || !it->first.empty() ? 0 : it->second);
 }
 
 template <typename T>
@@ -160,13 +171,14 @@ T Polynomial<T>::tryDivide(const Polynomial<T>& p, bool ignoreConst) const {
 
 template <typename T>
 void Polynomial<T>::substitute(const std::string& var, const Polynomial<T>& replacement) {
-  if (map_.count(var) == 0) {
+  auto it = map_.find(var);
+  if (it == map_.end()) {
     // If var isn't in this polynomial, nothing needs to be done
     return;
   }
-  T coeff = safe_at(map_, var);
-  map_.erase(var);
-  (*this) += coeff * replacement;
+  T coeff = it->second;
+  map_.erase(it);
+  map_.AddScaled(replacement.map_, coeff);
 }
 
 template <typename T>
@@ -178,9 +190,9 @@ void Polynomial<T>::substitute(const std::map<std::string, Polynomial<T>>& repla
       result += Polynomial{name_value.first, name_value.second};
       continue;
     }
-    result += replacement->second * name_value.second;
+    result.map_.AddScaled(replacement->second.map_, name_value.second);
   }
-  map_.swap(result.map_);
+  std::swap(map_, result.map_);
 }
 
 template <typename T>
@@ -195,7 +207,7 @@ Polynomial<T> Polynomial<T>::sym_eval(const std::map<std::string, Polynomial> va
     if (kvp.first.empty()) {
       out += Polynomial<T>(kvp.second);
     } else {
-      out += safe_at(values, kvp.first) * kvp.second;
+      out.map_.AddScaled(safe_at(values, kvp.first).map_, kvp.second);
     }
   }
   return out;
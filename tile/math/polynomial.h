@@ -11,12 +11,16 @@
 
 #include "base/util/logging.h"
 #include "tile/math/bignum.h"
+#include "tile/math/symbol.h"
 
 namespace vertexai {
 namespace tile {
 namespace math {
 
 // A linear Polynomial<Rational> of Rational coefficients
+//
+// Index names are interned, and the terms are kept in a small vector sorted by name (see SymbolMap), so copying and
+// combining polynomials doesn't allocate strings or tree nodes.
 template <typename T>
 class Polynomial : boost::additive<Polynomial<T>>,
                    boost::ring_operators<Polynomial<T>, T>,
@@ -30,10 +34,12 @@ class Polynomial : boost::additive<Polynomial<T>>,
   Polynomial(const T& c);  // Constant Polynomial<T>  // NOLINT
   //cppcheck-suppress noExplicitConstructor  // NOLINT
   Polynomial(const std::string& i, const T& c = 1);  // Monomial  // NOLINT
+  //cppcheck-suppress noExplicitConstructor  // NOLINT
+  Polynomial(const Symbol& i, const T& c = 1);  // Monomial  // NOLINT
   // clang-format on
   T operator[](const std::string& var) const;      // Quick coefficent access
-  const std::map<std::string, T>& getMap() const;  // Get inner map
-  std::map<std::string, T>& mutateMap();           // Get inner map for editing
+  const SymbolMap<T>& getMap() const;              // Get inner map
+  SymbolMap<T>& mutateMap();                       // Get inner map for editing
   bool operator==(const Polynomial& rhs) const;    // Equality
   bool operator<(const Polynomial& rhs) const;     // Lexigraphical order
   Polynomial& operator+=(const Polynomial& rhs);   // Addition
@@ -41,7 +47,7 @@ class Polynomial : boost::additive<Polynomial<T>>,
   Polynomial operator-() const;                    // Unary minus
   Polynomial& operator*=(const T& rhs);            // Multiplication by a T
   Polynomial& operator/=(const T& rhs);            // Division by a rations
-  bool isConstant() const { return map_.size() == 0 || (map_.size() == 1 && map_.find("") != map_.end()); }
+  bool isConstant() const { return map_.size() == 0 || (map_.size() == 1 && map_.begin()->first.empty()); }
   T constant() const;         // Get the constant part of the Polynomial<T>
   void setConstant(T value);  // Set the constant part of the Polynomial<T> to value
   T eval(const std::map<std::string, T>& values) const;
@@ -66,8 +72,8 @@ class Polynomial : boost::additive<Polynomial<T>>,
 
  private:
   // Map from index -> coefficient
-  // Constant offset is a coefficent of empty string
-  std::map<std::string, T> map_;
+  // Constant offset is a coefficent of empty string, which sorts first
+  SymbolMap<T> map_;
 };
 
 extern template class Polynomial<Rational>;
@@ -0,0 +1,20 @@
+// Copyright 2019, Intel Corporation
+
+#include "tile/math/symbol.h"
+
+#include "base/util/intern.h"
+
+namespace vertexai {
+namespace tile {
+namespace math {
+
+Symbol::Symbol() {
+  static const std::string* empty = &InternString(std::string{});
+  name_ = empty;
+}
+
+Symbol::Symbol(const std::string& name) : name_{&InternString(name)} {}
+
+}  // namespace math
+}  // namespace tile
+}  // namespace vertexai
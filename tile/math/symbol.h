@@ -0,0 +1,195 @@
+// Copyright 2019, Intel Corporation
+
+#pragma once
+
+#include <algorithm>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <boost/container/small_vector.hpp>
+
+namespace vertexai {
+namespace tile {
+namespace math {
+
+// An interned name.  Symbols with the same name share a single copy of it, so copying a symbol is copying a pointer,
+// and two symbols are equal exactly when they share a copy.  Symbols order by name.
+//
+// Names are interned with InternString, so they are never freed: the names in use are the index names of the programs
+// being compiled, and there aren't enough of those for it to matter.
+class Symbol {
+ public:
+  Symbol();                         // The empty name
+  Symbol(const std::string& name);  // NOLINT
+
+  const std::string& str() const { return *name_; }
+  operator const std::string&() const { return *name_; }  // NOLINT
+
+  bool empty() const { return name_->empty(); }
+  std::size_t size() const { return name_->size(); }
+  const char* c_str() const { return name_->c_str(); }
+
+  bool operator==(const Symbol& rhs) const { return name_ == rhs.name_; }
+  bool operator!=(const Symbol& rhs) const { return name_ != rhs.name_; }
+  bool operator<(const Symbol& rhs) const { return name_ != rhs.name_ && *name_ < *rhs.name_; }
+
+  // N.B. These are only found by argument-dependent lookup, so they can't hide other operators from code that uses
+  // this namespace.
+  friend bool operator==(const Symbol& lhs, const std::string& rhs) { return lhs.str() == rhs; }
+  friend bool operator==(const std::string& lhs, const Symbol& rhs) { return lhs == rhs.str(); }
+  friend bool operator==(const Symbol& lhs, const char* rhs) { return lhs.str() == rhs; }
+  friend bool operator==(const char* lhs, const Symbol& rhs) { return lhs == rhs.str(); }
+  friend bool operator!=(const Symbol& lhs, const std::string& rhs) { return lhs.str() != rhs; }
+  friend bool operator!=(const std::string& lhs, const Symbol& rhs) { return lhs != rhs.str(); }
+  friend bool operator!=(const Symbol& lhs, const char* rhs) { return lhs.str() != rhs; }
+  friend bool operator!=(const char* lhs, const Symbol& rhs) { return lhs != rhs.str(); }
+  friend std::string operator+(const std::string& lhs, const Symbol& rhs) { return lhs + rhs.str(); }
+  friend std::string operator+(const Symbol& lhs, const std::string& rhs) { return lhs.str() + rhs; }
+  friend std::string operator+(const char* lhs, const Symbol& rhs) { return lhs + rhs.str(); }
+  friend std::string operator+(const Symbol& lhs, const char* rhs) { return lhs.str() + rhs; }
+  friend std::ostream& operator<<(std::ostream& os, const Symbol& sym) { return os << sym.str(); }
+  friend std::string to_string(const Symbol& sym) { return sym.str(); }
+
+ private:
+  const std::string* name_;
+};
+
+// A map from symbols to values, kept as a vector of terms sorted by name.
+//
+// This is the storage for Polynomial: polynomials rarely have more than a handful of terms, so a small sorted vector
+// avoids the per-term allocations and pointer chasing of a std::map, while iterating in the same order.  The
+// interface is the subset of std::map's that polynomial code uses; lookups by string compare names in place, without
+// interning the key.
+template <typename T>
+class SymbolMap {
+ public:
+  using key_type = Symbol;
+  using mapped_type = T;
+  using value_type = std::pair<Symbol, T>;
+  using size_type = std::size_t;
+
+ private:
+  using Terms = boost::container::small_vector<value_type, 4>;
+
+ public:
+  using iterator = typename Terms::iterator;
+  using const_iterator = typename Terms::const_iterator;
+
+  iterator begin() { return terms_.begin(); }
+  iterator end() { return terms_.end(); }
+  const_iterator begin() const { return terms_.begin(); }
+  const_iterator end() const { return terms_.end(); }
+
+  bool empty() const { return terms_.empty(); }
+  size_type size() const { return terms_.size(); }
+  void clear() { terms_.clear(); }
+
+  iterator find(const std::string& key) {
+    auto it = LowerBound(key);
+    return (it != terms_.end() && it->first.str() == key) ? it : terms_.end();
+  }
+  const_iterator find(const std::string& key) const { return const_cast<SymbolMap*>(this)->find(key); }
+  iterator find(const Symbol& key) {
+    auto it = LowerBound(key);
+    return (it != terms_.end() && it->first == key) ? it : terms_.end();
+  }
+  const_iterator find(const Symbol& key) const { return const_cast<SymbolMap*>(this)->find(key); }
+
+  size_type count(const std::string& key) const { return find(key) == end() ? 0 : 1; }
+  size_type count(const Symbol& key) const { return find(key) == end() ? 0 : 1; }
+
+  T& at(const std::string& key) {
+    auto it = find(key);
+    if (it == terms_.end()) {
+      throw std::out_of_range("SymbolMap::at: " + key);
+    }
+    return it->second;
+  }
+  const T& at(const std::string& key) const { return const_cast<SymbolMap*>(this)->at(key); }
+
+  T& operator[](const std::string& key) {
+    auto it = LowerBound(key);
+    if (it == terms_.end() || it->first.str() != key) {
+      it = terms_.emplace(it, Symbol{key}, T());
+    }
+    return it->second;
+  }
+  T& operator[](const Symbol& key) {
+    auto it = LowerBound(key);
+    if (it == terms_.end() || it->first != key) {
+      it = terms_.emplace(it, key, T());
+    }
+    return it->second;
+  }
+
+  std::pair<iterator, bool> emplace(const Symbol& key, const T& value) {
+    auto it = LowerBound(key);
+    if (it != terms_.end() && it->first == key) {
+      return std::make_pair(it, false);
+    }
+    return std::make_pair(terms_.emplace(it, key, value), true);
+  }
+  std::pair<iterator, bool> emplace(const std::string& key, const T& value) { return emplace(Symbol{key}, value); }
+  std::pair<iterator, bool> insert(const value_type& term) { return emplace(term.first, term.second); }
+
+  size_type erase(const std::string& key) { return EraseFound(find(key)); }
+  size_type erase(const Symbol& key) { return EraseFound(find(key)); }
+  iterator erase(const_iterator it) { return terms_.erase(it); }
+
+  // Adds scale times each of rhs's terms to this map, dropping any terms that become zero.
+  void AddScaled(const SymbolMap& rhs, const T& scale) {
+    if (rhs.terms_.empty() || scale == T(0)) {
+      return;
+    }
+    Terms sum;
+    sum.reserve(terms_.size() + rhs.terms_.size());
+    auto a = terms_.begin();
+    auto b = rhs.terms_.begin();
+    while (a != terms_.end() || b != rhs.terms_.end()) {
+      if (b == rhs.terms_.end() || (a != terms_.end() && a->first < b->first)) {
+        sum.emplace_back(std::move(*a++));
+      } else if (a == terms_.end() || b->first < a->first) {
+        sum.emplace_back(b->first, b->second * scale);
+        ++b;
+      } else {
+        T value = a->second + b->second * scale;
+        if (value != T(0)) {
+          sum.emplace_back(a->first, value);
+        }
+        ++a;
+        ++b;
+      }
+    }
+    terms_.swap(sum);
+  }
+
+  bool operator==(const SymbolMap& rhs) const { return terms_ == rhs.terms_; }
+  bool operator!=(const SymbolMap& rhs) const { return terms_ != rhs.terms_; }
+  bool operator<(const SymbolMap& rhs) const { return terms_ < rhs.terms_; }
+
+ private:
+  size_type EraseFound(iterator it) {
+    if (it == terms_.end()) {
+      return 0;
+    }
+    terms_.erase(it);
+    return 1;
+  }
+
+  iterator LowerBound(const std::string& key) {
+    return std::lower_bound(terms_.begin(), terms_.end(), key,
+                            [](const value_type& term, const std::string& key) { return term.first.str() < key; });
+  }
+  iterator LowerBound(const Symbol& key) {
+    return std::lower_bound(terms_.begin(), terms_.end(), key,
+                            [](const value_type& term, const Symbol& key) { return term.first < key; });
+  }
+
+  Terms terms_;
+};
+
+}  // namespace math
+}  // namespace tile
+}  // namespace vertexai
@@ -17,14 +17,19 @@ namespace codegen {
 
 using namespace lang;  // NOLINT
 
-KernelList GenerateProgram(const RunInfo& runinfo,       //
+KernelList GenerateProgram(const context::Context& ctx,  //
+                           const RunInfo& runinfo,       //
                            const std::string& cfg_name,  //
                            const std::string& out_dir,   //
                            ConstBufferManager* const_bufs) {
   IVLOG(1, runinfo.input_shapes);
   IVLOG(1, runinfo.output_shapes);
   IVLOG(1, to_string(runinfo.program));
-  auto stripe = GenerateStripe(runinfo);
+  std::shared_ptr<stripe::Program> stripe;
+  {
+    context::Activity activity{ctx, "tile::lang::GenerateStripe"};
+    stripe = GenerateStripe(runinfo);
+  }
   codegen::OptimizeOptions options;
   options.dump_passes = !out_dir.empty();
   options.dbg_dir = out_dir + "/passes";
@@ -34,6 +39,7 @@ KernelList GenerateProgram(const RunInfo& runinfo,       //
   const auto& stage = cfg.stages().at("default");
   codegen::CompilerState state(stripe);
   state.const_bufs = const_bufs;
+  state.ctx = ctx;
   codegen::Optimize(&state, stage.passes(), options);
   IVLOG(1, *stripe->entry);
   codegen::SemtreeEmitter emit(codegen::AliasMap{}, 256);
@@ -2,6 +2,7 @@
 
 #include <string>
 
+#include "base/context/context.h"
 #include "tile/base/buffer.h"
 #include "tile/lang/compose.h"
 #include "tile/lang/generate.h"
@@ -10,7 +11,8 @@ namespace vertexai {
 namespace tile {
 namespace codegen {
 
-lang::KernelList GenerateProgram(const lang::RunInfo& runinfo,     //
+lang::KernelList GenerateProgram(const context::Context& ctx,      //
+                                 const lang::RunInfo& runinfo,     //
                                  const std::string& cfg_name,      //
                                  const std::string& out_dir = "",  //
                                  ConstBufferManager* const_bufs = {});
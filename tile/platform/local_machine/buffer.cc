@@ -25,20 +25,38 @@ std::shared_ptr<Buffer> Buffer::Downcast(const std::shared_ptr<tile::Buffer>& bu
 
 Buffer::Buffer(const std::shared_ptr<DevInfo>& devinfo, const std::shared_ptr<MemStrategy>& mem_strategy,
                std::shared_ptr<MemChunk> chunk)
-    : devinfo_{devinfo}, mem_strategy_{mem_strategy}, size_{chunk->size()}, chunk_{std::move(chunk)} {}
+    : devinfo_{devinfo}, mem_strategy_{mem_strategy}, size_{chunk->size()}, chunk_{std::move(chunk)} {
+  chunk_->deps()->AddOwner();
+}
 
 Buffer::Buffer(const std::shared_ptr<DevInfo>& devinfo, const std::shared_ptr<MemStrategy>& mem_strategy,
                std::uint64_t size)
     : devinfo_{devinfo}, mem_strategy_{mem_strategy}, size_{size} {}
 
+Buffer::~Buffer() {
+  if (chunk_) {
+    chunk_->deps()->RemoveOwner();
+  }
+}
+
 boost::future<std::unique_ptr<View>> Buffer::MapCurrent(const context::Context& ctx) {
   EnsureChunk(ctx);
   return chunk()->MapCurrent(ctx);
 }
 
 std::unique_ptr<View> Buffer::MapDiscard(const context::Context& ctx) {
-  EnsureChunk(ctx);
-  return chunk()->MapDiscard(ctx);
+  std::shared_ptr<MemChunk> chunk;
+  {
+    std::lock_guard<std::mutex> lock{mu_};
+    if (!chunk_ || chunk_->deps()->busy()) {
+      // Since the contents are being replaced, there's no need to wait for runs still using the current chunk: the
+      // caller writes into a fresh chunk from the memory strategy's pool, and the old one stays with the runs until
+      // they complete.  This lets a caller fill in the next run's inputs while the current run executes.
+      SetChunkLocked(mem_strategy_->MakeChunk(ctx, size_));
+    }
+    chunk = chunk_;
+  }
+  return chunk->MapDiscard(ctx);
 }
 
 std::uint64_t Buffer::size() const { return size_; }
@@ -48,14 +66,32 @@ void Buffer::RemapTo(std::shared_ptr<MemChunk> chunk) {
     throw std::runtime_error("The requested buffer remapping required a change in buffer size");
   }
   std::lock_guard<std::mutex> lock{mu_};
-  chunk_ = std::move(chunk);
+  SetChunkLocked(std::move(chunk));
+}
+
+void Buffer::ReleaseChunk() {
+  std::lock_guard<std::mutex> lock{mu_};
+  SetChunkLocked(nullptr);
 }
 
 void Buffer::EnsureChunk(const context::Context& ctx) {
   std::lock_guard<std::mutex> lock{mu_};
   if (!chunk_) {
-    chunk_ = mem_strategy_->MakeChunk(ctx, size_);
+    SetChunkLocked(mem_strategy_->MakeChunk(ctx, size_));
+  }
+}
+
+void Buffer::SetChunkLocked(std::shared_ptr<MemChunk> chunk) {
+  if (chunk == chunk_) {
+    return;
+  }
+  if (chunk) {
+    chunk->deps()->AddOwner();
   }
+  if (chunk_) {
+    chunk_->deps()->RemoveOwner();
+  }
+  chunk_ = std::move(chunk);
 }
 
 }  // namespace local_machine
@@ -28,6 +28,8 @@ class Buffer : public tile::Buffer, public std::enable_shared_from_this<Buffer>
 
   Buffer(const std::shared_ptr<DevInfo>& devinfo, const std::shared_ptr<MemStrategy>& mem_strategy, std::uint64_t size);
 
+  ~Buffer();
+
   const std::shared_ptr<DevInfo>& devinfo() const { return devinfo_; }
 
   std::shared_ptr<MemChunk> chunk() const {
@@ -43,7 +45,14 @@ class Buffer : public tile::Buffer, public std::enable_shared_from_this<Buffer>
   void RemapTo(std::shared_ptr<MemChunk> chunk);
   void EnsureChunk(const context::Context& ctx);
 
+  // Drops the buffer's chunk, e.g. when its memory has been donated to another buffer.  A new chunk is allocated the
+  // next time the buffer's memory is needed.
+  void ReleaseChunk();
+
  private:
+  // Replaces the buffer's chunk, keeping the chunks' owner counts up to date.  mu_ must be held.
+  void SetChunkLocked(std::shared_ptr<MemChunk> chunk);
+
   const std::shared_ptr<DevInfo> devinfo_;
   const std::shared_ptr<MemStrategy> mem_strategy_;
   const std::uint64_t size_;
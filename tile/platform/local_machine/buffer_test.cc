@@ -0,0 +1,166 @@
+// Copyright 2019 Intel Corporation.
+
+#include "tile/platform/local_machine/buffer.h"
+
+#include <gmock/gmock.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tile/platform/local_machine/direct_mem_strategy.h"
+
+namespace vertexai {
+namespace tile {
+namespace local_machine {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Ne;
+
+class FakeEvent final : public hal::Event {
+ public:
+  FakeEvent() : future_{promise_.get_future().share()} {}
+  ~FakeEvent() {
+    if (!future_.is_ready()) {
+      Complete();
+    }
+  }
+
+  boost::shared_future<std::shared_ptr<hal::Result>> GetFuture() final { return future_; }
+
+  void Complete() { promise_.set_value(nullptr); }
+
+ private:
+  boost::promise<std::shared_ptr<hal::Result>> promise_;
+  boost::shared_future<std::shared_ptr<hal::Result>> future_;
+};
+
+class FakeBuffer final : public hal::Buffer {
+ public:
+  explicit FakeBuffer(std::uint64_t size) : data_(size) {}
+
+  boost::future<void*> MapCurrent(const std::vector<std::shared_ptr<hal::Event>>&) final {
+    return boost::make_ready_future(static_cast<void*>(data_.data()));
+  }
+  boost::future<void*> MapDiscard(const std::vector<std::shared_ptr<hal::Event>>&) final {
+    return boost::make_ready_future(static_cast<void*>(data_.data()));
+  }
+  std::shared_ptr<hal::Event> Unmap(const context::Context&) final {
+    auto event = std::make_shared<FakeEvent>();
+    event->Complete();
+    return event;
+  }
+
+ private:
+  std::vector<char> data_;
+};
+
+class FakeMemory final : public hal::Memory {
+ public:
+  std::uint64_t size_goal() const final { return 1 << 30; }
+  hal::BufferAccessMask AllowedAccesses() const final { return hal::BufferAccessMask::ALL; }
+  std::size_t ArenaBufferAlignment() const final { return 1; }
+  std::shared_ptr<hal::Buffer> MakeBuffer(std::uint64_t size, hal::BufferAccessMask) final {
+    return std::make_shared<FakeBuffer>(size);
+  }
+  std::shared_ptr<hal::Arena> MakeArena(std::uint64_t, hal::BufferAccessMask) final { return nullptr; }
+};
+
+// Completed events are dropped from a MemDeps asynchronously.
+void WaitUntilIdle(const std::shared_ptr<MemChunk>& chunk) {
+  while (chunk->deps()->busy()) {
+    std::this_thread::yield();
+  }
+}
+
+void Write(const context::Context& ctx, Buffer* buffer, const std::string& contents) {
+  auto view = buffer->MapDiscard(ctx);
+  std::copy(contents.begin(), contents.end(), view->data());
+  view->WriteBack(ctx);
+}
+
+std::string Read(const context::Context& ctx, const std::shared_ptr<MemChunk>& chunk, std::size_t size) {
+  auto view = chunk->MapCurrent(ctx).get();
+  return std::string(view->data(), size);
+}
+
+class BufferTest : public ::testing::Test {
+ protected:
+  BufferTest()
+      : devinfo_{std::make_shared<DevInfo>(DevInfo{nullptr, nullptr, {}})},
+        strategy_{std::make_shared<DirectMemStrategy>(devinfo_, &memory_)},
+        buffer_{devinfo_, strategy_, MemCache::SizeClass(1)} {}
+
+  context::Context ctx_;
+  FakeMemory memory_;
+  std::shared_ptr<DevInfo> devinfo_;
+  std::shared_ptr<DirectMemStrategy> strategy_;
+  Buffer buffer_;
+};
+
+TEST_F(BufferTest, DiscardWhileReadGivesTheReaderTheOldContents) {
+  Write(ctx_, &buffer_, "first");
+  auto running = buffer_.chunk();
+  WaitUntilIdle(running);
+
+  // A run still reading the buffer, as its shim records.
+  running->deps()->AddUser();
+  Write(ctx_, &buffer_, "second");
+  EXPECT_THAT(buffer_.chunk(), Ne(running));
+  EXPECT_THAT(Read(ctx_, running, 5), Eq("first"));
+  EXPECT_THAT(Read(ctx_, buffer_.chunk(), 6), Eq("second"));
+  running->deps()->RemoveUser();
+}
+
+TEST_F(BufferTest, DiscardWhileWrittenLeavesTheRunItsChunk) {
+  Write(ctx_, &buffer_, "first");
+  auto running = buffer_.chunk();
+  WaitUntilIdle(running);
+
+  // A run still writing the buffer.
+  auto kernel = std::make_shared<FakeEvent>();
+  running->deps()->AddReadDependency(kernel);
+  Write(ctx_, &buffer_, "second");
+  EXPECT_THAT(buffer_.chunk(), Ne(running));
+  kernel->Complete();
+  EXPECT_THAT(Read(ctx_, running, 5), Eq("first"));
+}
+
+TEST_F(BufferTest, DiscardWhenIdleReusesTheChunk) {
+  Write(ctx_, &buffer_, "first");
+  auto chunk = buffer_.chunk();
+  chunk->deps()->AddUser();
+  chunk->deps()->RemoveUser();
+  WaitUntilIdle(chunk);
+
+  Write(ctx_, &buffer_, "second");
+  EXPECT_THAT(buffer_.chunk(), Eq(chunk));
+}
+
+TEST(MemDeps, CountsUsers) {
+  auto deps = std::make_shared<MemDeps>();
+  EXPECT_FALSE(deps->busy());
+
+  deps->AddUser();
+  deps->AddUser();
+  EXPECT_TRUE(deps->has_users());
+  deps->RemoveUser();
+  EXPECT_TRUE(deps->has_users());
+  EXPECT_TRUE(deps->busy());
+  deps->RemoveUser();
+  EXPECT_FALSE(deps->has_users());
+  EXPECT_FALSE(deps->busy());
+
+  // Users don't hold up readers: only writes are read dependencies.
+  deps->AddUser();
+  std::vector<std::shared_ptr<hal::Event>> events;
+  deps->GetReadDependencies(&events);
+  EXPECT_TRUE(events.empty());
+  deps->RemoveUser();
+}
+
+}  // namespace
+}  // namespace local_machine
+}  // namespace tile
+}  // namespace vertexai
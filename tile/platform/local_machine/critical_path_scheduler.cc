@@ -0,0 +1,476 @@
+// Copyright 2019 Intel Corporation.
+
+#include "tile/platform/local_machine/critical_path_scheduler.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <boost/dynamic_bitset.hpp>
+
+#include "base/util/error.h"
+
+namespace vertexai {
+namespace tile {
+namespace local_machine {
+namespace {
+
+// How far above the memory-minimizing peak the critical-path ordering may
+// go, as a fraction of that peak: 1/kPeakSlackDivisor.
+constexpr std::uint64_t kPeakSlackDivisor = 8;
+
+// The scheduling problem, in terms of the steps of a ToScheduleSteps()
+// schedule (in program order) and the temporary allocs they access.
+struct Graph {
+  std::vector<schedule::Step*> steps;
+  std::vector<std::vector<std::size_t>> succs;
+  std::vector<std::size_t> pred_counts;
+  std::vector<std::uint64_t> ranks;                 // Cost of the longest path from each step to the end
+  std::vector<std::vector<schedule::Alloc*>> tmps;  // The temporaries accessed by each step
+  std::unordered_map<schedule::Alloc*, std::size_t> tmp_accessors;
+};
+
+Graph BuildGraph(schedule::Schedule* schedule, const lang::KernelList& kl, std::uint64_t flops_per_byte) {
+  Graph g;
+  for (auto& step : schedule->steps) {
+    g.steps.push_back(&step);
+  }
+  std::size_t count = g.steps.size();
+  g.succs.resize(count);
+  g.pred_counts.resize(count);
+  g.ranks.resize(count);
+  g.tmps.resize(count);
+
+  // Each tensor has its own alloc, so the accesses to the allocs
+  // describe the only ordering constraints on the steps: reads follow
+  // the latest write, and writes follow the latest write and every read
+  // since then.
+  struct Access {
+    bool written = false;
+    std::size_t writer = 0;
+    std::vector<std::size_t> readers;
+  };
+  std::unordered_map<schedule::Alloc*, Access> accesses;
+  for (std::size_t sidx = 0; sidx < count; ++sidx) {
+    const schedule::Step& step = *g.steps[sidx];
+    std::set<std::size_t> preds;
+    std::set<schedule::Alloc*> tmps;
+    for (schedule::Alloc* allocp : step.inputs) {
+      auto& access = accesses[allocp];
+      if (access.written) {
+        preds.insert(access.writer);
+      } else if (!allocp->is_input() && allocp->byte_size) {
+        throw error::Internal{"Program fails to initialize non-empty temporary for a" + std::to_string(allocp->idx)};
+      }
+      access.readers.push_back(sidx);
+      if (allocp->is_tmp()) {
+        tmps.insert(allocp);
+      }
+    }
+    for (const schedule::OutputInfo& oi : step.outputs) {
+      auto& access = accesses[oi.allocp];
+      if (access.written) {
+        preds.insert(access.writer);
+      }
+      preds.insert(access.readers.begin(), access.readers.end());
+      access.written = true;
+      access.writer = sidx;
+      access.readers.clear();
+      if (oi.allocp->is_tmp()) {
+        tmps.insert(oi.allocp);
+      }
+    }
+    preds.erase(sidx);
+    for (std::size_t pred : preds) {
+      g.succs[pred].push_back(sidx);
+    }
+    g.pred_counts[sidx] = preds.size();
+    for (schedule::Alloc* tmp : tmps) {
+      g.tmp_accessors[tmp]++;
+    }
+    g.tmps[sidx].assign(tmps.begin(), tmps.end());
+  }
+
+  // Successors always follow their predecessors in program order, so a
+  // reverse pass computes the ranks.
+  for (std::size_t sidx = count; sidx--;) {
+    std::uint64_t tail = 0;
+    for (std::size_t succ : g.succs[sidx]) {
+      tail = std::max(tail, g.ranks[succ]);
+    }
+    g.ranks[sidx] = KernelCost(kl.kernels[g.steps[sidx]->kidx], flops_per_byte) + tail;
+  }
+
+  return g;
+}
+
+// Orders the steps of a graph.  When by_rank is set, the highest-ranked
+// ready step which keeps the live temporaries within peak_bound is chosen;
+// otherwise (or if there is no such step), the step growing the live
+// temporaries the least is chosen.  Returns the order, and sets *peak to
+// the peak bytes of live temporaries.
+std::vector<std::size_t> OrderSteps(const Graph& g, std::size_t alignment, bool by_rank, std::uint64_t peak_bound,
+                                    std::uint64_t* peak) {
+  auto aligned = [alignment](std::uint64_t size) { return ((size + alignment - 1) / alignment) * alignment; };
+
+  std::vector<std::size_t> pred_counts = g.pred_counts;
+  std::unordered_map<schedule::Alloc*, std::size_t> remaining = g.tmp_accessors;
+  std::set<schedule::Alloc*> live;
+  std::uint64_t live_bytes = 0;
+  std::vector<std::size_t> ready;
+  std::vector<std::size_t> order;
+
+  for (std::size_t sidx = 0; sidx < g.steps.size(); ++sidx) {
+    if (!pred_counts[sidx]) {
+      ready.push_back(sidx);
+    }
+  }
+
+  *peak = 0;
+  while (ready.size()) {
+    struct Choice {
+      std::size_t pos;
+      std::uint64_t grow;
+      std::uint64_t shrink;
+    };
+    bool have_fit = false;
+    bool have_least = false;
+    Choice fit{0, 0, 0};
+    Choice least{0, 0, 0};
+    for (std::size_t pos = 0; pos < ready.size(); ++pos) {
+      Choice c{pos, 0, 0};
+      for (schedule::Alloc* tmp : g.tmps[ready[pos]]) {
+        if (!live.count(tmp)) {
+          c.grow += aligned(tmp->byte_size);
+        }
+        if (remaining.at(tmp) == 1) {
+          c.shrink += aligned(tmp->byte_size);
+        }
+      }
+      std::uint64_t rank = g.ranks[ready[pos]];
+      // Highest rank first; ties go to the least net growth.
+      if (by_rank && live_bytes + c.grow <= peak_bound &&
+          (!have_fit || g.ranks[ready[fit.pos]] < rank ||
+           (g.ranks[ready[fit.pos]] == rank && c.grow + fit.shrink < fit.grow + c.shrink))) {
+        fit = c;
+        have_fit = true;
+      }
+      // Least net growth first; ties go to the higher rank.
+      std::int64_t net = static_cast<std::int64_t>(c.grow) - static_cast<std::int64_t>(c.shrink);
+      std::int64_t least_net = static_cast<std::int64_t>(least.grow) - static_cast<std::int64_t>(least.shrink);
+      if (!have_least || net < least_net || (net == least_net && g.ranks[ready[least.pos]] < rank)) {
+        least = c;
+        have_least = true;
+      }
+    }
+
+    const Choice& choice = have_fit ? fit : least;
+    std::size_t sidx = ready[choice.pos];
+    ready.erase(ready.begin() + choice.pos);
+    order.push_back(sidx);
+
+    live_bytes += choice.grow;
+    *peak = std::max(*peak, live_bytes);
+    for (schedule::Alloc* tmp : g.tmps[sidx]) {
+      live.insert(tmp);
+      if (!--remaining.at(tmp)) {
+        live.erase(tmp);
+      }
+    }
+    live_bytes -= choice.shrink;
+
+    for (std::size_t succ : g.succs[sidx]) {
+      if (!--pred_counts[succ]) {
+        ready.push_back(succ);
+      }
+    }
+  }
+
+  if (order.size() != g.steps.size()) {
+    throw error::Internal{"Critical path scheduler: program steps have cyclic dependencies"};
+  }
+  return order;
+}
+
+// An alloc produced by interval colouring.
+struct Colour {
+  std::size_t idx = 0;
+  std::uint64_t byte_size = 0;
+  std::size_t last = 0;              // The last position at which the alloc is accessed
+  schedule::Alloc* holder = nullptr;  // The temporary currently held
+  schedule::Alloc* result = nullptr;
+};
+
+// Packs the temporaries into allocs, given the order of the steps.
+// Returns the colour of each temporary.
+std::unordered_map<schedule::Alloc*, Colour*> ColourTmps(const Graph& g, const std::vector<std::size_t>& order,
+                                                        std::vector<std::unique_ptr<Colour>>* colours) {
+  struct Lifetime {
+    std::size_t first;
+    std::size_t last;
+  };
+  std::unordered_map<schedule::Alloc*, Lifetime> lifetimes;
+  for (std::size_t pos = 0; pos < order.size(); ++pos) {
+    for (schedule::Alloc* tmp : g.tmps[order[pos]]) {
+      auto res = lifetimes.emplace(tmp, Lifetime{pos, pos});
+      res.first->second.last = pos;
+    }
+  }
+
+  // Visit the temporaries by the start of their lifetimes, larger ones
+  // first, so that each starting temporary gets the best pick of the
+  // allocs released before it.
+  std::vector<schedule::Alloc*> tmps;
+  for (const auto& kvp : lifetimes) {
+    tmps.push_back(kvp.first);
+  }
+  std::sort(tmps.begin(), tmps.end(), [&lifetimes](schedule::Alloc* a, schedule::Alloc* b) {
+    const auto& la = lifetimes.at(a);
+    const auto& lb = lifetimes.at(b);
+    if (la.first != lb.first) {
+      return la.first < lb.first;
+    }
+    if (a->byte_size != b->byte_size) {
+      return a->byte_size > b->byte_size;
+    }
+    return a->idx < b->idx;
+  });
+
+  std::unordered_map<schedule::Alloc*, Colour*> result;
+  std::set<std::pair<std::size_t, std::size_t>> busy;  // Colour indices, by last access
+  std::multimap<std::uint64_t, Colour*> free;          // By size
+
+  for (schedule::Alloc* tmp : tmps) {
+    const Lifetime& lifetime = lifetimes.at(tmp);
+
+    // Release the allocs whose contents are dead before this temporary is written.
+    while (busy.size() && busy.begin()->first < lifetime.first) {
+      Colour* colour = (*colours)[busy.begin()->second].get();
+      busy.erase(busy.begin());
+      colour->holder = nullptr;
+      free.emplace(colour->byte_size, colour);
+    }
+
+    Colour* colour = nullptr;
+
+    // The step which first writes the temporary may be able to write it
+    // over an input whose last access is that same step.
+    const schedule::Step& writer = *g.steps[order[lifetime.first]];
+    for (schedule::Alloc* input : writer.inputs) {
+      if (!tmp->safe_self_alias_allocs.count(input)) {
+        continue;
+      }
+      auto it = result.find(input);
+      if (it == result.end() || it->second->holder != input || lifetimes.at(input).last != lifetime.first) {
+        continue;
+      }
+      colour = it->second;
+      busy.erase(std::make_pair(colour->last, colour->idx));
+      break;
+    }
+
+    if (!colour) {
+      auto it = free.lower_bound(tmp->byte_size);
+      if (it == free.end() && free.size()) {
+        // Nothing free is big enough; growing the largest free alloc
+        // costs less than adding another.
+        --it;
+      }
+      if (it != free.end()) {
+        colour = it->second;
+        free.erase(it);
+      } else {
+        colours->emplace_back(std::make_unique<Colour>());
+        colour = colours->back().get();
+        colour->idx = colours->size() - 1;
+      }
+    }
+
+    colour->byte_size = std::max(colour->byte_size, tmp->byte_size);
+    colour->last = lifetime.last;
+    colour->holder = tmp;
+    busy.emplace(colour->last, colour->idx);
+    result[tmp] = colour;
+  }
+
+  return result;
+}
+
+// Sets each step's dependencies to the minimal set implied by the steps'
+// alloc accesses.
+void AddAccessDeps(schedule::Schedule* schedule) {
+  struct Access {
+    schedule::Step* writer = nullptr;
+    std::vector<schedule::Step*> readers;
+  };
+  std::unordered_map<schedule::Alloc*, Access> accesses;
+  std::vector<boost::dynamic_bitset<>> transitive_deps{schedule->steps.size(),
+                                                       boost::dynamic_bitset<>(schedule->steps.size())};
+  for (auto& step : schedule->steps) {
+    std::map<std::size_t, schedule::Step*> deps;
+    for (schedule::Alloc* allocp : step.inputs) {
+      auto& access = accesses[allocp];
+      if (access.writer) {
+        deps.emplace(access.writer->idx, access.writer);
+      }
+      access.readers.push_back(&step);
+    }
+    for (const schedule::OutputInfo& oi : step.outputs) {
+      auto& access = accesses[oi.allocp];
+      if (access.writer) {
+        deps.emplace(access.writer->idx, access.writer);
+      }
+      for (schedule::Step* reader : access.readers) {
+        deps.emplace(reader->idx, reader);
+      }
+      access.writer = &step;
+      access.readers.clear();
+    }
+    deps.erase(step.idx);
+
+    // A dependency implied by another one is always earlier than it, so
+    // walking them latest-first finds each implied one after the
+    // dependency implying it.
+    step.deps.clear();
+    auto& tdeps = transitive_deps[step.idx];
+    for (auto it = deps.rbegin(); it != deps.rend(); ++it) {
+      if (tdeps.test(it->first)) {
+        continue;
+      }
+      step.deps.insert(it->second);
+      tdeps |= transitive_deps[it->first];
+      tdeps.set(it->first);
+    }
+  }
+}
+
+// Finds the program outputs which can be written in place over program
+// inputs the caller allows to be consumed: the output's first writer
+// must be allowed to alias the input, must be the input's last
+// accessor, and the two must be the same size.  Returns the input
+// chosen for each such output.
+std::unordered_map<schedule::Alloc*, schedule::Alloc*> FindDonatedInputs(const tile::proto::Program& program,
+                                                                         const Graph& g,
+                                                                         const std::vector<std::size_t>& order) {
+  std::unordered_map<schedule::Alloc*, std::size_t> last_accesses;
+  for (std::size_t pos = 0; pos < order.size(); ++pos) {
+    for (schedule::Alloc* input : g.steps[order[pos]]->inputs) {
+      last_accesses[input] = pos;
+    }
+  }
+
+  std::unordered_map<schedule::Alloc*, schedule::Alloc*> result;
+  std::unordered_set<schedule::Alloc*> written;
+  std::unordered_set<schedule::Alloc*> donated;
+  for (std::size_t pos = 0; pos < order.size(); ++pos) {
+    const schedule::Step& step = *g.steps[order[pos]];
+    for (const schedule::OutputInfo& oi : step.outputs) {
+      schedule::Alloc* output = oi.allocp;
+      if (!written.insert(output).second || !output->is_output() || output->is_input()) {
+        continue;
+      }
+      for (schedule::Alloc* input : step.inputs) {
+        if (!input->is_input() || !program.inputs().at(input->input).consumed() || donated.count(input) ||
+            input->byte_size != output->byte_size || !output->safe_self_alias_allocs.count(input) ||
+            last_accesses.at(input) != pos) {
+          continue;
+        }
+        result[output] = input;
+        donated.insert(input);
+        break;
+      }
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+CriticalPathScheduler::CriticalPathScheduler(std::size_t alignment, std::uint64_t size_goal,
+                                             const hal::proto::HardwareSettings& settings)
+    : alignment_{std::max<std::size_t>(alignment, 1)},
+      size_goal_{size_goal},
+      flops_per_byte_{settings.goal_flops_per_byte()} {}
+
+schedule::Schedule CriticalPathScheduler::BuildSchedule(const tile::proto::Program& program,
+                                                        const lang::KernelList& kl) {
+  schedule::Schedule start = ToScheduleSteps(program, kl);
+  IVLOG(3, "Critical path scheduler: initial schedule:\n" << start);
+
+  Graph g = BuildGraph(&start, kl, flops_per_byte_);
+
+  // Find the peak an ordering for memory alone would reach, and then
+  // order for the critical path within a margin of it.
+  std::uint64_t min_peak;
+  OrderSteps(g, alignment_, false, 0, &min_peak);
+  std::uint64_t bound = std::min(size_goal_, min_peak + min_peak / kPeakSlackDivisor);
+  std::uint64_t peak;
+  std::vector<std::size_t> order = OrderSteps(g, alignment_, true, bound, &peak);
+  IVLOG(1, "Critical path scheduler: live temporaries peak at " << peak << " bytes (bound " << bound
+                                                                << ", memory-minimizing peak " << min_peak << ")");
+
+  std::vector<std::unique_ptr<Colour>> colours;
+  auto tmp_colours = ColourTmps(g, order, &colours);
+  auto donated_inputs = FindDonatedInputs(program, g, order);
+
+  schedule::Schedule result;
+  std::unordered_map<schedule::Alloc*, schedule::Alloc*> allocs;
+  for (auto& alloc : start.allocs) {
+    if (alloc.is_tmp() || donated_inputs.count(&alloc)) {
+      continue;
+    }
+    schedule::Alloc io;
+    io.byte_size = alloc.byte_size;
+    io.input = alloc.input;
+    io.output = alloc.output;
+    allocs[&alloc] = &*result.allocs.emplace(result.allocs.end(), std::move(io));
+  }
+  for (const auto& kvp : donated_inputs) {
+    schedule::Alloc* io = allocs.at(kvp.second);
+    io->output = kvp.first->output;
+    allocs[kvp.first] = io;
+  }
+  for (auto& colour : colours) {
+    schedule::Alloc tmp;
+    tmp.byte_size = colour->byte_size;
+    colour->result = &*result.allocs.emplace(result.allocs.end(), std::move(tmp));
+  }
+  for (const auto& kvp : tmp_colours) {
+    allocs[kvp.first] = kvp.second->result;
+  }
+
+  for (std::size_t sidx : order) {
+    const schedule::Step& original = *g.steps[sidx];
+    schedule::Step step{original.tag};
+    step.kidx = original.kidx;
+    step.byte_count = original.byte_count;
+    for (schedule::Alloc* input : original.inputs) {
+      step.inputs.emplace_back(allocs.at(input));
+    }
+    for (const schedule::OutputInfo& oi : original.outputs) {
+      step.outputs.emplace_back(schedule::OutputInfo{allocs.at(oi.allocp), oi.add_dep});
+    }
+    result.steps.emplace_back(std::move(step));
+  }
+
+  result.Reindex();
+  AddAccessDeps(&result);
+
+  IVLOG(1, "Critical path scheduler: packed " << tmp_colours.size() << " temporaries into " << colours.size()
+                                              << " allocs; wrote " << donated_inputs.size()
+                                              << " outputs over donated inputs");
+  IVLOG(3, "Critical path scheduler: final schedule:\n" << result);
+  return result;
+}
+
+const char* CriticalPathScheduler::name() const { return "CriticalPath"; }
+
+}  // namespace local_machine
+}  // namespace tile
+}  // namespace vertexai
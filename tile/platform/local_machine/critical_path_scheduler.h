@@ -0,0 +1,47 @@
+// Copyright 2019 Intel Corporation.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "tile/platform/local_machine/scheduler.h"
+
+namespace vertexai {
+namespace tile {
+namespace local_machine {
+
+// A list scheduler driven by kernel cost estimates.
+//
+// Each step is ranked by the estimated cost of the longest path from
+// the step to the end of the program (see KernelCost()).  Steps are
+// then issued one at a time, always choosing the highest-ranked ready
+// step whose temporaries fit within a memory bound; when none fit, the
+// step which grows the live temporaries the least is chosen instead.
+//
+// The memory bound is the smaller of the size goal and a small margin
+// over the peak reached by an ordering which only minimizes memory, so
+// the critical path is only favoured where it doesn't cost much memory.
+//
+// Once the order is fixed, the temporaries' lifetimes are known, and
+// they're packed into allocs by interval colouring: each temporary takes
+// the best-fitting alloc which is free for its lifetime (or the alloc of
+// an input it's allowed to alias), and the schedule's dependencies are
+// rebuilt from the resulting alloc accesses.
+class CriticalPathScheduler final : public Scheduler {
+ public:
+  CriticalPathScheduler(std::size_t alignment, std::uint64_t size_goal, const hal::proto::HardwareSettings& settings);
+
+  schedule::Schedule BuildSchedule(const tile::proto::Program& program, const lang::KernelList& kl) final;
+
+  const char* name() const final;
+
+ private:
+  std::size_t alignment_;
+  std::uint64_t size_goal_;
+  std::uint64_t flops_per_byte_;
+};
+
+}  // namespace local_machine
+}  // namespace tile
+}  // namespace vertexai
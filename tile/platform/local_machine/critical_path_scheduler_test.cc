@@ -0,0 +1,199 @@
+// Copyright 2019 Intel Corporation.
+
+#include <gmock/gmock.h>
+
+#include <string>
+#include <vector>
+
+#include "base/util/logging.h"
+#include "tile/platform/local_machine/critical_path_scheduler.h"
+#include "tile/platform/local_machine/fifo_scheduler.h"
+#include "tile/platform/local_machine/scheduler_test.h"
+#include "tile/proto/support.h"
+
+using ::testing::Combine;
+using ::testing::Eq;
+using ::testing::Le;
+using ::testing::Lt;
+using ::testing::Values;
+using ::testing::ValuesIn;
+
+namespace vertexai {
+namespace tile {
+namespace local_machine {
+namespace {
+
+hal::proto::HardwareSettings TestHardwareSettings() {
+  hal::proto::HardwareSettings result;
+  result.set_goal_groups(32);
+  result.set_goal_flops_per_byte(50);
+  return result;
+}
+
+INSTANTIATE_TEST_CASE_P(CriticalPathScheduler, SchedulerTest,
+                        Combine(Values(std::make_shared<CriticalPathScheduler>(std::kilo::num, std::giga::num,
+                                                                               TestHardwareSettings())),
+                                ValuesIn(SchedulerTest::GetTestPrograms())));
+
+// Builds small programs directly as kernel lists.
+class CriticalPathSchedulerTest : public ::testing::Test {
+ protected:
+  void AddInput(const std::string& name, std::size_t elements, bool consumed = false) {
+    auto shape = SimpleShape(DataType::FLOAT32, {elements});
+    tile::proto::ProgramInput input;
+    *input.mutable_shape() = IntoProto(shape);
+    input.set_consumed(consumed);
+    (*program_.mutable_inputs())[name] = input;
+    kl_.types[name] = shape;
+  }
+
+  void AddOutput(const std::string& name, std::size_t elements) {
+    auto shape = SimpleShape(DataType::FLOAT32, {elements});
+    tile::proto::ProgramOutput output;
+    *output.mutable_shape() = IntoProto(shape);
+    (*program_.mutable_outputs())[name] = output;
+    kl_.types[name] = shape;
+  }
+
+  void AddTmp(const std::string& name, std::size_t elements) {
+    kl_.types[name] = SimpleShape(DataType::FLOAT32, {elements});
+  }
+
+  void AddKernel(const std::vector<std::string>& inputs, const std::string& output, std::size_t flops) {
+    lang::KernelInfo ki;
+    ki.kname = "k" + std::to_string(kl_.kernels.size());
+    ki.inputs = inputs;
+    ki.outputs = {output};
+    ki.tot_flops = flops;
+    ki.tot_bytes = 0;
+    kl_.kernels.emplace_back(std::move(ki));
+  }
+
+  schedule::Schedule Schedule(Scheduler* scheduler) {
+    auto schedule = scheduler->BuildSchedule(program_, kl_);
+    ValidateSchedule(program_, kl_, schedule);
+    return schedule;
+  }
+
+  std::uint64_t TmpBytes(const schedule::Schedule& schedule) {
+    return EstimateSchedule(kl_, schedule, TestHardwareSettings().goal_flops_per_byte()).total_tmp_bytes;
+  }
+
+  tile::proto::Program program_;
+  lang::KernelList kl_;
+  CriticalPathScheduler scheduler_{1, std::giga::num, TestHardwareSettings()};
+};
+
+TEST_F(CriticalPathSchedulerTest, RunsCriticalPathFirst) {
+  AddInput("I", 256);
+  AddTmp("A", 256);
+  AddTmp("B", 256);
+  AddOutput("O", 256);
+  AddKernel({"I"}, "A", 1);
+  AddKernel({"I"}, "B", 1000000);
+  AddKernel({"A", "B"}, "O", 1);
+
+  auto schedule = Schedule(&scheduler_);
+  ASSERT_THAT(schedule.steps.size(), Eq(3));
+  EXPECT_THAT(schedule.steps.front().kidx, Eq(1));
+  EXPECT_THAT(schedule.steps.back().kidx, Eq(2));
+}
+
+TEST_F(CriticalPathSchedulerTest, ReusesAllocsAlongChains) {
+  AddInput("I", 256);
+  AddTmp("T0", 256);
+  AddTmp("T1", 128);
+  AddTmp("T2", 256);
+  AddTmp("T3", 64);
+  AddOutput("O", 256);
+  AddKernel({"I"}, "T0", 1);
+  AddKernel({"T0"}, "T1", 1);
+  AddKernel({"T1"}, "T2", 1);
+  AddKernel({"T2"}, "T3", 1);
+  AddKernel({"T3"}, "O", 1);
+
+  auto schedule = Schedule(&scheduler_);
+  std::size_t tmp_allocs = 0;
+  for (const auto& alloc : schedule.allocs) {
+    if (alloc.is_tmp()) {
+      ++tmp_allocs;
+    }
+  }
+  EXPECT_THAT(tmp_allocs, Eq(2));
+  EXPECT_THAT(TmpBytes(schedule), Eq((256 + 128) * 4));
+}
+
+TEST_F(CriticalPathSchedulerTest, UsesLessMemoryThanFifoOnResidualBlocks) {
+  // A chain of residual blocks, each with a main path of two kernels and
+  // a skip connection.  The block weights are cheap to compute but only
+  // needed late in the block, which tempts a scheduler to compute them
+  // all up front.
+  const std::size_t kBlocks = 6;
+  AddInput("X", 4096);
+  std::string x = "X";
+  for (std::size_t b = 0; b < kBlocks; ++b) {
+    std::string p = "b" + std::to_string(b) + "_";
+    AddTmp(p + "w", 4096);
+    AddTmp(p + "t1", 4096);
+    AddTmp(p + "t2", 4096);
+    AddKernel({"X"}, p + "w", 1);
+    AddKernel({x}, p + "t1", 100000);
+    AddKernel({p + "t1", p + "w"}, p + "t2", 100000);
+    std::string y = b + 1 == kBlocks ? "Y" : p + "y";
+    if (b + 1 == kBlocks) {
+      AddOutput(y, 4096);
+    } else {
+      AddTmp(y, 4096);
+    }
+    AddKernel({x, p + "t2"}, y, 1000);
+    x = y;
+  }
+
+  auto critical_path = Schedule(&scheduler_);
+  fifo_scheduler::FifoScheduler fifo{1, std::giga::num, TestHardwareSettings()};
+  auto fifo_schedule = Schedule(&fifo);
+  EXPECT_THAT(TmpBytes(critical_path), Lt(TmpBytes(fifo_schedule)));
+}
+
+TEST_F(CriticalPathSchedulerTest, UsesNoMoreMemoryThanFifoOnResNet50Training) {
+  program_ = SchedulerTest::GetTestProgram("resnet50_train.tpb");
+  kl_ = SchedulerTest::GenerateKernels(program_);
+
+  CriticalPathScheduler critical_path{std::kilo::num, std::giga::num, TestHardwareSettings()};
+  fifo_scheduler::FifoScheduler fifo{std::kilo::num, std::giga::num, TestHardwareSettings()};
+  auto critical_path_bytes = TmpBytes(Schedule(&critical_path));
+  auto fifo_bytes = TmpBytes(Schedule(&fifo));
+  IVLOG(1, "ResNet50 training temporaries: critical path " << critical_path_bytes << " bytes, FIFO " << fifo_bytes
+                                                            << " bytes");
+  EXPECT_THAT(critical_path_bytes, Le(fifo_bytes));
+}
+
+TEST_F(CriticalPathSchedulerTest, WritesOutputsOverDonatedInputs) {
+  AddInput("W", 256, true);
+  AddInput("G", 256);
+  AddInput("V", 256);
+  AddOutput("W2", 256);
+  AddOutput("V2", 256);
+  AddKernel({"W", "G"}, "W2", 1);
+  kl_.kernels.back().safe_self_aliases["W2"] = {"W"};
+  AddKernel({"V", "G"}, "V2", 1);
+  kl_.kernels.back().safe_self_aliases["V2"] = {"V"};
+
+  auto schedule = Schedule(&scheduler_);
+  std::size_t in_place = 0;
+  for (const auto& alloc : schedule.allocs) {
+    if (alloc.is_input() && alloc.is_output()) {
+      ++in_place;
+      EXPECT_THAT(alloc.input, Eq("W"));
+      EXPECT_THAT(alloc.output, Eq("W2"));
+    }
+  }
+  // V wasn't donated, so V2 gets its own alloc.
+  EXPECT_THAT(in_place, Eq(1));
+  EXPECT_THAT(schedule.allocs.size(), Eq(4));
+}
+
+}  // namespace
+}  // namespace local_machine
+}  // namespace tile
+}  // namespace vertexai
@@ -31,7 +31,8 @@ class DirectMemView final : public View {
 class DirectMemChunk final : public MemChunk {
  public:
   DirectMemChunk(const context::Context& ctx, const std::shared_ptr<DevInfo>& devinfo, std::uint64_t size,
-                 hal::Memory* source);
+                 std::shared_ptr<MemCache> cache);
+  ~DirectMemChunk();
 
   // Buffer implementation
   boost::future<std::unique_ptr<View>> MapCurrent(const context::Context& ctx) final;
@@ -46,6 +47,7 @@ class DirectMemChunk final : public MemChunk {
   std::uint64_t size_;
   std::shared_ptr<DevInfo> devinfo_;
   std::shared_ptr<MemDeps> deps_;
+  std::shared_ptr<MemCache> cache_;
   std::shared_ptr<hal::Buffer> mem_;
 };
 
@@ -55,10 +57,12 @@ DirectMemView::DirectMemView(const context::Context& ctx, std::shared_ptr<MemDep
                              std::shared_ptr<hal::Buffer> mem)
     : View(static_cast<char*>(data), size), unmap_ctx_{ctx}, deps_{std::move(deps)}, mem_{std::move(mem)} {}
 
+// The view's mapping was recorded by the chunk when it was requested.
 DirectMemView::~DirectMemView() {
   if (data()) {
     deps_->AddReadDependency(mem_->Unmap(unmap_ctx_));
   }
+  deps_->RemoveView();
 }
 
 void DirectMemView::WriteBack(const context::Context& ctx) {
@@ -67,18 +71,43 @@ void DirectMemView::WriteBack(const context::Context& ctx) {
 }
 
 DirectMemChunk::DirectMemChunk(const context::Context& ctx, const std::shared_ptr<DevInfo>& devinfo, std::uint64_t size,
-                               hal::Memory* source)
-    : size_{size}, devinfo_{devinfo}, deps_{std::make_shared<MemDeps>()} {
-  mem_ = source->MakeBuffer(size_, hal::BufferAccessMask::ALL);
+                               std::shared_ptr<MemCache> cache)
+    : size_{size}, devinfo_{devinfo}, deps_{std::make_shared<MemDeps>()}, cache_{std::move(cache)} {
+  mem_ = cache_->Alloc(size_);
+}
+
+DirectMemChunk::~DirectMemChunk() {
+  // The buffer may only be reused once nothing is still reading or writing it; if work is outstanding (or the chunk
+  // was poisoned), it's released instead.
+  std::vector<std::shared_ptr<hal::Event>> deps;
+  try {
+    deps_->GetReadDependencies(&deps);
+  } catch (...) {
+    mem_.reset();
+  }
+  for (const auto& dep : deps) {
+    if (!dep->GetFuture().is_ready()) {
+      mem_.reset();
+      break;
+    }
+  }
+  cache_->Free(size_, std::move(mem_));
 }
 
 boost::future<std::unique_ptr<View>> DirectMemChunk::MapCurrent(const context::Context& ctx) {
   context::Context ctx_copy{ctx};
   std::vector<std::shared_ptr<hal::Event>> deps;
   deps_->GetReadDependencies(&deps);
+  deps_->AddView();
   return mem_->MapCurrent(deps).then([ctx = std::move(ctx_copy), deps = deps_, size = size_,
                                       mem = mem_](boost::future<void*> data_future) mutable -> std::unique_ptr<View> {
-    void* data = data_future.get();
+    void* data;
+    try {
+      data = data_future.get();
+    } catch (...) {
+      deps->RemoveView();
+      throw;
+    }
     return std::make_unique<DirectMemView>(ctx, std::move(deps), data, size, std::move(mem));
   });
 }
@@ -86,7 +115,17 @@ boost::future<std::unique_ptr<View>> DirectMemChunk::MapCurrent(const context::C
 std::unique_ptr<View> DirectMemChunk::MapDiscard(const context::Context& ctx) {
   std::vector<std::shared_ptr<hal::Event>> deps;
   deps_->GetReadDependencies(&deps);
-  void* data = mem_->MapDiscard(deps).get();
+  // The buffer is rounded up to its size class, and the caller only overwrites the chunk's bytes; unless those are
+  // the whole buffer, the rest of it must still be defined, so the buffer is mapped with its current contents.
+  bool whole_buffer = MemCache::SizeClass(size_) == size_;
+  deps_->AddView();
+  void* data;
+  try {
+    data = (whole_buffer ? mem_->MapDiscard(deps) : mem_->MapCurrent(deps)).get();
+  } catch (...) {
+    deps_->RemoveView();
+    throw;
+  }
   return std::make_unique<DirectMemView>(ctx, deps_, data, size_, mem_);
 }
 
@@ -97,10 +136,11 @@ DirectMemStrategy::DirectMemStrategy(const std::shared_ptr<DevInfo>& devinfo, ha
   if (!source_) {
     throw std::logic_error{"The direct memory management strategy requires source memory"};
   }
+  cache_ = std::make_shared<MemCache>(source_, hal::BufferAccessMask::ALL, MemCacheBudget(devinfo_->settings, source_));
 }
 
 std::shared_ptr<MemChunk> DirectMemStrategy::MakeChunk(const context::Context& ctx, std::uint64_t size) const {
-  return std::make_shared<DirectMemChunk>(ctx, devinfo_, size, source_);
+  return std::make_shared<DirectMemChunk>(ctx, devinfo_, size, cache_);
 }
 
 }  // namespace local_machine
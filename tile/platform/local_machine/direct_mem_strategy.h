@@ -5,6 +5,7 @@
 #include <memory>
 
 #include "tile/platform/local_machine/devinfo.h"
+#include "tile/platform/local_machine/mem_cache.h"
 #include "tile/platform/local_machine/mem_strategy.h"
 
 namespace vertexai {
@@ -12,6 +13,8 @@ namespace tile {
 namespace local_machine {
 
 // DirectMemStrategy manages memory by copying buffers to and from devices.
+//
+// Device buffers are recycled through a MemCache when their chunks are deleted.
 class DirectMemStrategy final : public MemStrategy {
  public:
   DirectMemStrategy(const std::shared_ptr<DevInfo>& devinfo, hal::Memory* source);
@@ -21,6 +24,7 @@ class DirectMemStrategy final : public MemStrategy {
  private:
   std::shared_ptr<DevInfo> devinfo_;
   hal::Memory* source_ = nullptr;
+  std::shared_ptr<MemCache> cache_;
 };
 
 }  // namespace local_machine
@@ -0,0 +1,80 @@
+// Copyright 2019 Intel Corporation.
+
+#include "tile/platform/local_machine/direct_mem_strategy.h"
+
+#include <gmock/gmock.h>
+
+#include <vector>
+
+namespace vertexai {
+namespace tile {
+namespace local_machine {
+namespace {
+
+using ::testing::Eq;
+
+class FakeEvent final : public hal::Event {
+ public:
+  boost::shared_future<std::shared_ptr<hal::Result>> GetFuture() final {
+    return boost::make_ready_future(std::shared_ptr<hal::Result>{}).share();
+  }
+};
+
+class FakeBuffer final : public hal::Buffer {
+ public:
+  explicit FakeBuffer(std::uint64_t size) : data_(size) {}
+
+  boost::future<void*> MapCurrent(const std::vector<std::shared_ptr<hal::Event>>&) final {
+    ++current_maps;
+    return boost::make_ready_future(static_cast<void*>(data_.data()));
+  }
+  boost::future<void*> MapDiscard(const std::vector<std::shared_ptr<hal::Event>>&) final {
+    ++discard_maps;
+    return boost::make_ready_future(static_cast<void*>(data_.data()));
+  }
+  std::shared_ptr<hal::Event> Unmap(const context::Context&) final { return std::make_shared<FakeEvent>(); }
+
+  std::size_t current_maps = 0;
+  std::size_t discard_maps = 0;
+
+ private:
+  std::vector<char> data_;
+};
+
+class FakeMemory final : public hal::Memory {
+ public:
+  std::uint64_t size_goal() const final { return 1 << 30; }
+  hal::BufferAccessMask AllowedAccesses() const final { return hal::BufferAccessMask::ALL; }
+  std::size_t ArenaBufferAlignment() const final { return 1; }
+  std::shared_ptr<hal::Buffer> MakeBuffer(std::uint64_t size, hal::BufferAccessMask) final {
+    return std::make_shared<FakeBuffer>(size);
+  }
+  std::shared_ptr<hal::Arena> MakeArena(std::uint64_t, hal::BufferAccessMask) final { return nullptr; }
+};
+
+FakeBuffer* HalBuffer(const std::shared_ptr<MemChunk>& chunk) {
+  return static_cast<FakeBuffer*>(chunk->hal_buffer().get());
+}
+
+TEST(DirectMemStrategy, DiscardsOnlyWholeBuffers) {
+  context::Context ctx;
+  FakeMemory memory;
+  DirectMemStrategy strategy{std::make_shared<DevInfo>(DevInfo{nullptr, nullptr, {}}), &memory};
+
+  // A chunk which fills its size class may be discarded outright.
+  auto whole = strategy.MakeChunk(ctx, MemCache::SizeClass(1000));
+  whole->MapDiscard(ctx);
+  EXPECT_THAT(HalBuffer(whole)->discard_maps, Eq(1u));
+  EXPECT_THAT(HalBuffer(whole)->current_maps, Eq(0u));
+
+  // A chunk which is smaller than its buffer leaves the tail of the buffer as it was.
+  auto partial = strategy.MakeChunk(ctx, 1000);
+  partial->MapDiscard(ctx);
+  EXPECT_THAT(HalBuffer(partial)->discard_maps, Eq(0u));
+  EXPECT_THAT(HalBuffer(partial)->current_maps, Eq(1u));
+}
+
+}  // namespace
+}  // namespace local_machine
+}  // namespace tile
+}  // namespace vertexai
@@ -251,7 +251,10 @@ void TryRetireScheduledStep(Build* b) {
       if (lit == b->value_locs.end()) {
         LOG(FATAL) << "Unable to find alloc " << alloc << " in value_locs";
       }
-      b->free_locs.emplace(lit->second->byte_size, lit->second);
+      if (lit->second->contents == alloc) {
+        b->free_locs.emplace(lit->second->byte_size, lit->second);
+      }
+      // Otherwise, the alloc was a donated input, and the step wrote an output over it; the loc now holds the output.
       b->value_locs.erase(lit);
     }
   }
@@ -633,6 +636,8 @@ void AddDeps(schedule::Schedule* schedule) {
         deps.insert(res.first->second.latest_writer);
       }
       deps.insert(res.first->second.active_readers.begin(), res.first->second.active_readers.end());
+      // A step writing an output over one of its own inputs (e.g. a donated input) is one of those readers.
+      deps.erase(&step);
 
       // The current step becomes the latest writer, and current readers don't matter anymore.
       res.first->second.latest_writer = &step;
@@ -865,6 +870,30 @@ RunnableStepsIterator& RunnableStepsIterator::operator++() noexcept {
   return *this;
 }
 
+// Finds the loc of a program input which a step may write one of its program outputs over: the caller must allow the
+// input to be consumed, the step must be the input's last remaining reader, and the output must be the input's size
+// and safe to write over it.  Returns nullptr if there's no such input.
+Loc* FindDonatedInputLoc(Build* b, const PendingStep* ps, const schedule::Alloc* output) {
+  if (output->is_input()) {
+    return nullptr;
+  }
+  for (const auto& zero_input : ps->zero_inputs) {
+    if (zero_input.second == output) {
+      // The output is initialized by a zero step, which runs ahead of this step.
+      return nullptr;
+    }
+  }
+  for (schedule::Alloc* input : ps->step->inputs) {
+    if (!input->is_input() || !b->program->inputs().at(input->input).consumed() ||
+        input->byte_size != output->byte_size || !output->safe_self_alias_allocs.count(input) ||
+        b->alloc_refcounts.at(input) != 1) {
+      continue;
+    }
+    return b->value_locs.at(input);
+  }
+  return nullptr;
+}
+
 StepPlan::StepPlan(Build* b, PendingStep* ps) : ps_{ps} {
   // TODO: Consider the order in which we consider the outputs; sorting by size or considering
   // exact-fit-first may produce more-optimal assignments.
@@ -884,6 +913,15 @@ StepPlan::StepPlan(Build* b, PendingStep* ps) : ps_{ps} {
       outputs_.emplace_back(it->second);
       continue;
     }
+    if (is_io) {
+      // Write the output over a donated input if possible.  The input's loc isn't free, but it's taken over the same
+      // way a free loc is once the plan is applied.
+      Loc* loc = FindDonatedInputLoc(b, ps, oi.allocp);
+      if (loc && used_free_locs_.emplace(loc, LocManip{oi.add_dep, true, oi.allocp, 0}).second) {
+        outputs_.emplace_back(loc);
+        continue;
+      }
+    }
     // Try to find a free loc big enough for this value.
     auto lower_fit = b->free_locs.lower_bound(mem_size);
     auto fit = lower_fit;
@@ -1,8 +1,12 @@
 // Copyright 2018, Intel Corporation.
 #include <gmock/gmock.h>
 
+#include <string>
+#include <vector>
+
 #include "tile/platform/local_machine/fifo_scheduler.h"
 #include "tile/platform/local_machine/scheduler_test.h"
+#include "tile/proto/support.h"
 
 using ::testing::AnyOf;
 using ::testing::Combine;
@@ -174,6 +178,65 @@ TEST_F(RunnableStepsTest, SomeRunnable) {
   EXPECT_THAT(runnable, UnorderedElementsAre(s0, s2, s7, s9));
 }
 
+class FifoSchedulerTest : public ::testing::Test {
+ protected:
+  void AddInput(const std::string& name, std::size_t elements, bool consumed = false) {
+    auto shape = SimpleShape(DataType::FLOAT32, {elements});
+    tile::proto::ProgramInput input;
+    *input.mutable_shape() = IntoProto(shape);
+    input.set_consumed(consumed);
+    (*program_.mutable_inputs())[name] = input;
+    kl_.types[name] = shape;
+  }
+
+  void AddOutput(const std::string& name, std::size_t elements) {
+    auto shape = SimpleShape(DataType::FLOAT32, {elements});
+    tile::proto::ProgramOutput output;
+    *output.mutable_shape() = IntoProto(shape);
+    (*program_.mutable_outputs())[name] = output;
+    kl_.types[name] = shape;
+  }
+
+  void AddKernel(const std::vector<std::string>& inputs, const std::string& output) {
+    lang::KernelInfo ki;
+    ki.kname = "k" + std::to_string(kl_.kernels.size());
+    ki.inputs = inputs;
+    ki.outputs = {output};
+    kl_.kernels.emplace_back(std::move(ki));
+  }
+
+  tile::proto::Program program_;
+  lang::KernelList kl_;
+  FifoScheduler scheduler_{std::kilo::num, std::giga::num, TestHardwareSettings()};
+};
+
+// FIFO is the default scheduler, so donated inputs have to be honored here too.
+TEST_F(FifoSchedulerTest, WritesOutputsOverDonatedInputs) {
+  AddInput("W", 256, true);
+  AddInput("G", 256);
+  AddInput("V", 256);
+  AddOutput("W2", 256);
+  AddOutput("V2", 256);
+  AddKernel({"W", "G"}, "W2");
+  kl_.kernels.back().safe_self_aliases["W2"] = {"W"};
+  AddKernel({"V", "G"}, "V2");
+  kl_.kernels.back().safe_self_aliases["V2"] = {"V"};
+
+  auto schedule = scheduler_.BuildSchedule(program_, kl_);
+  ValidateSchedule(program_, kl_, schedule);
+  std::size_t in_place = 0;
+  for (const auto& alloc : schedule.allocs) {
+    if (alloc.is_input() && alloc.is_output()) {
+      ++in_place;
+      EXPECT_THAT(alloc.input, Eq("W"));
+      EXPECT_THAT(alloc.output, Eq("W2"));
+    }
+  }
+  // V wasn't donated, so V2 gets its own alloc.
+  EXPECT_THAT(in_place, Eq(1));
+  EXPECT_THAT(schedule.allocs.size(), Eq(4));
+}
+
 }  // namespace
 }  // namespace fifo_scheduler
 }  // namespace local_machine
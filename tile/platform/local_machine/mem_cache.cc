@@ -2,26 +2,214 @@
 
 #include "tile/platform/local_machine/mem_cache.h"
 
+#include <algorithm>
+#include <functional>
+#include <thread>
 #include <utility>
 
+#include "base/util/logging.h"
+
 namespace vertexai {
 namespace tile {
 namespace local_machine {
+namespace {
+
+// The smallest size class; smaller requests are rounded up to it.
+const std::uint64_t kMinClassBits = 8;
+
+std::size_t Log2Floor(std::uint64_t value) {
+  std::size_t bits = 0;
+  while (value >>= 1) {
+    ++bits;
+  }
+  return bits;
+}
+
+}  // namespace
+
+constexpr std::size_t MemCache::kShards;
+constexpr std::size_t MemCache::kClasses;
+
+MemCache::MemCache(hal::Memory* source, hal::BufferAccessMask access, std::uint64_t budget)
+    : source_{source}, access_{access}, budget_{budget} {
+  for (std::size_t idx = 0; idx < kClasses; ++idx) {
+    in_use_[idx] = 0;
+    high_water_[idx] = 0;
+  }
+}
+
+MemCache::~MemCache() {
+  auto s = stats();
+  IVLOG(1, "MemCache: hits=" << s.hits << " misses=" << s.misses << " evictions=" << s.evictions
+                             << " bytes_held=" << s.bytes_held << " bytes_in_use=" << s.bytes_in_use);
+}
 
-std::shared_ptr<hal::Buffer> MemCache::TryAlloc(std::size_t size) {
-  std::lock_guard<std::mutex> lock{mu_};
-  auto& l = mem_[size];
-  if (l.size()) {
-    std::shared_ptr<hal::Buffer> result{std::move(l.top())};
-    l.pop();
-    return result;
+// Classes above the minimum split each power of two into four equal steps: a request of size in (2^k, 2^(k+1)] is
+// rounded up to the next multiple of 2^(k-2).
+std::size_t MemCache::ClassIndex(std::uint64_t size) {
+  if (size <= (1ull << kMinClassBits)) {
+    return 0;
+  }
+  std::size_t bits = Log2Floor(size - 1);
+  std::uint64_t step = 1ull << (bits - 2);
+  std::uint64_t steps = (size + step - 1) / step;  // In (4, 8]
+  return (bits - kMinClassBits) * 4 + (steps - 4);
+}
+
+std::uint64_t MemCache::ClassSize(std::size_t index) {
+  if (!index) {
+    return 1ull << kMinClassBits;
+  }
+  std::size_t bits = kMinClassBits + (index - 1) / 4;
+  std::uint64_t steps = 5 + (index - 1) % 4;
+  return steps << (bits - 2);
+}
+
+std::uint64_t MemCache::SizeClass(std::uint64_t size) { return ClassSize(ClassIndex(size)); }
+
+std::shared_ptr<hal::Buffer> MemCache::Alloc(std::uint64_t size) {
+  std::size_t idx = ClassIndex(size);
+  std::uint64_t class_size = ClassSize(idx);
+  std::uint64_t use = ++in_use_[idx];
+  std::uint64_t high = high_water_[idx].load();
+  while (high < use && !high_water_[idx].compare_exchange_weak(high, use)) {
+  }
+  bytes_in_use_ += class_size;
+
+  auto& local = LocalShard();
+  auto buffer = TakeFrom(&local, idx);
+  for (std::size_t i = 0; !buffer && i < kShards; ++i) {
+    if (&shards_[i] != &local) {
+      buffer = TakeFrom(&shards_[i], idx);
+    }
+  }
+  if (buffer) {
+    ++hits_;
+    return buffer;
+  }
+  ++misses_;
+  try {
+    return source_->MakeBuffer(class_size, access_);
+  } catch (...) {
+    // The device may be out of memory because of what we're holding; give it all back and retry once.
+    Release(kClasses, 0);
+    try {
+      return source_->MakeBuffer(class_size, access_);
+    } catch (...) {
+      --in_use_[idx];
+      bytes_in_use_ -= class_size;
+      throw;
+    }
   }
-  return std::shared_ptr<hal::Buffer>{};
 }
 
-void MemCache::Free(std::size_t size, std::shared_ptr<hal::Buffer> mem) {
-  std::lock_guard<std::mutex> lock{mu_};
-  mem_[size].push(std::move(mem));
+void MemCache::Free(std::uint64_t size, std::shared_ptr<hal::Buffer> buffer) {
+  std::size_t idx = ClassIndex(size);
+  std::uint64_t class_size = ClassSize(idx);
+  --in_use_[idx];
+  bytes_in_use_ -= class_size;
+  if (!buffer) {
+    return;
+  }
+  // Count the buffer before publishing it, so that bytes_held_ never drops below what the shards hold.
+  std::uint64_t held = bytes_held_ += class_size;
+  {
+    auto& local = LocalShard();
+    std::lock_guard<std::mutex> lock{local.mu};
+    local.free[idx].emplace_back(std::move(buffer));
+  }
+  if (budget_ < held) {
+    EvictToBudget();
+  }
+}
+
+void MemCache::Trim() {
+  std::lock_guard<std::mutex> lock{trim_mu_};
+  for (std::size_t idx = 0; idx < kClasses; ++idx) {
+    std::uint64_t use = in_use_[idx].load();
+    std::uint64_t high = high_water_[idx].exchange(use);
+    Release(idx, high < use ? 0 : high - use);
+  }
+}
+
+MemCache::Stats MemCache::stats() const {
+  Stats s;
+  s.hits = hits_.load();
+  s.misses = misses_.load();
+  s.evictions = evictions_.load();
+  s.bytes_held = bytes_held_.load();
+  s.bytes_in_use = bytes_in_use_.load();
+  return s;
+}
+
+MemCache::Shard& MemCache::LocalShard() {
+  return shards_[std::hash<std::thread::id>{}(std::this_thread::get_id()) % kShards];
+}
+
+std::shared_ptr<hal::Buffer> MemCache::TakeFrom(Shard* shard, std::size_t index) {
+  std::shared_ptr<hal::Buffer> buffer;
+  {
+    std::lock_guard<std::mutex> lock{shard->mu};
+    auto& list = shard->free[index];
+    if (list.empty()) {
+      return buffer;
+    }
+    buffer = std::move(list.back());
+    list.pop_back();
+  }
+  bytes_held_ -= ClassSize(index);
+  return buffer;
+}
+
+// Releases cached buffers of the indicated class (or of every class, if index is kClasses) until at most keep remain
+// across all shards, returning the number released.
+std::size_t MemCache::Release(std::size_t index, std::size_t keep) {
+  std::vector<std::shared_ptr<hal::Buffer>> released;
+  std::size_t first = index == kClasses ? 0 : index;
+  std::size_t last = index == kClasses ? kClasses : index + 1;
+  for (std::size_t idx = first; idx < last; ++idx) {
+    std::size_t before = released.size();
+    std::size_t kept = 0;
+    for (auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock{shard.mu};
+      auto& list = shard.free[idx];
+      std::size_t stay = std::min(list.size(), keep - kept);
+      kept += stay;
+      for (std::size_t i = stay; i < list.size(); ++i) {
+        released.emplace_back(std::move(list[i]));
+      }
+      list.resize(stay);
+    }
+    bytes_held_ -= ClassSize(idx) * (released.size() - before);
+  }
+  evictions_ += released.size();
+  // The buffers themselves are released here, outside of the shard locks.
+  return released.size();
+}
+
+void MemCache::EvictToBudget() {
+  Trim();
+  std::lock_guard<std::mutex> lock{trim_mu_};
+  for (std::size_t idx = kClasses; idx--;) {
+    std::uint64_t held = bytes_held_.load();
+    if (held <= budget_) {
+      break;
+    }
+    std::size_t count = 0;
+    for (auto& shard : shards_) {
+      std::lock_guard<std::mutex> shard_lock{shard.mu};
+      count += shard.free[idx].size();
+    }
+    std::uint64_t excess = (held - budget_ + ClassSize(idx) - 1) / ClassSize(idx);
+    Release(idx, count - std::min<std::uint64_t>(count, excess));
+  }
+}
+
+std::uint64_t MemCacheBudget(const hal::proto::HardwareSettings& settings, hal::Memory* source) {
+  if (settings.mem_cache_budget()) {
+    return settings.mem_cache_budget();
+  }
+  return source->size_goal() / 8;
 }
 
 }  // namespace local_machine
@@ -2,29 +2,93 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <mutex>
-#include <stack>
-#include <unordered_map>
+#include <vector>
 
 #include "tile/base/hal.h"
+#include "tile/proto/hal.pb.h"
 
 namespace vertexai {
 namespace tile {
 namespace local_machine {
 
 // Caches device memory allocations.
+//
+// Requests are rounded up to size classes -- four per power of two, so at most a fifth of a buffer goes unused -- and
+// freed buffers are cached by class, so they can satisfy any later request in the same class.  The free lists are
+// split into shards chosen by the calling thread, so threads allocating and freeing concurrently rarely share a lock;
+// a thread whose own shard is empty looks through the others before giving up.
+//
+// The bytes held by the cache are bounded by a budget.  When a free would exceed it, the cache first trims each class
+// down to the number of buffers its high-water mark since the last trim says could still be needed, and then evicts
+// the largest cached buffers.
 class MemCache {
  public:
-  std::shared_ptr<hal::Buffer> TryAlloc(std::size_t size);
-  void Free(std::size_t size, std::shared_ptr<hal::Buffer>);
+  struct Stats {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t evictions = 0;
+    std::uint64_t bytes_held = 0;    // Bytes of free buffers held for reuse
+    std::uint64_t bytes_in_use = 0;  // Bytes of buffers handed out and not yet freed
+  };
+
+  MemCache(hal::Memory* source, hal::BufferAccessMask access, std::uint64_t budget);
+  ~MemCache();
+
+  // The size of the buffers used for requests of the supplied size.
+  static std::uint64_t SizeClass(std::uint64_t size);
+
+  // Returns a buffer of at least the requested size, reusing a cached one when possible.
+  std::shared_ptr<hal::Buffer> Alloc(std::uint64_t size);
+
+  // Returns a buffer obtained from Alloc(size) to the cache.
+  void Free(std::uint64_t size, std::shared_ptr<hal::Buffer> buffer);
+
+  // Releases cached buffers beyond what each class has needed since the last trim.
+  void Trim();
+
+  Stats stats() const;
 
  private:
-  std::mutex mu_;
-  std::unordered_map<std::size_t, std::stack<std::shared_ptr<hal::Buffer>>> mem_;
+  static constexpr std::size_t kShards = 8;
+  // One class for requests of up to 256 bytes, then four for each larger power of two (the last one stopping short of
+  // 2^64).
+  static constexpr std::size_t kClasses = (64 - 8) * 4;
+
+  struct Shard {
+    std::mutex mu;
+    std::array<std::vector<std::shared_ptr<hal::Buffer>>, kClasses> free;
+  };
+
+  static std::size_t ClassIndex(std::uint64_t size);
+  static std::uint64_t ClassSize(std::size_t index);
+
+  Shard& LocalShard();
+  std::shared_ptr<hal::Buffer> TakeFrom(Shard* shard, std::size_t index);
+  std::size_t Release(std::size_t index, std::size_t count);
+  void EvictToBudget();
+
+  hal::Memory* source_;
+  hal::BufferAccessMask access_;
+  std::uint64_t budget_;
+  std::array<Shard, kShards> shards_;
+  std::array<std::atomic<std::uint64_t>, kClasses> in_use_;
+  std::array<std::atomic<std::uint64_t>, kClasses> high_water_;
+  std::atomic<std::uint64_t> hits_{0};
+  std::atomic<std::uint64_t> misses_{0};
+  std::atomic<std::uint64_t> evictions_{0};
+  std::atomic<std::uint64_t> bytes_held_{0};
+  std::atomic<std::uint64_t> bytes_in_use_{0};
+  std::mutex trim_mu_;  // Serializes trimming and eviction
 };
 
+// The cache budget configured by the supplied settings, defaulting to an eighth of the source memory's size goal.
+std::uint64_t MemCacheBudget(const hal::proto::HardwareSettings& settings, hal::Memory* source);
+
 }  // namespace local_machine
 }  // namespace tile
 }  // namespace vertexai
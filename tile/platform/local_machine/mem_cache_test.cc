@@ -0,0 +1,113 @@
+// Copyright 2019 Intel Corporation.
+
+#include "tile/platform/local_machine/mem_cache.h"
+
+#include <gmock/gmock.h>
+
+#include <vector>
+
+namespace vertexai {
+namespace tile {
+namespace local_machine {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Le;
+
+class FakeBuffer final : public hal::Buffer {
+ public:
+  explicit FakeBuffer(std::uint64_t size) : size_{size} {}
+
+  boost::future<void*> MapCurrent(const std::vector<std::shared_ptr<hal::Event>>&) final {
+    return boost::make_ready_future(static_cast<void*>(nullptr));
+  }
+  boost::future<void*> MapDiscard(const std::vector<std::shared_ptr<hal::Event>>&) final {
+    return boost::make_ready_future(static_cast<void*>(nullptr));
+  }
+  std::shared_ptr<hal::Event> Unmap(const context::Context&) final { return nullptr; }
+
+  std::uint64_t size() const { return size_; }
+
+ private:
+  std::uint64_t size_;
+};
+
+class FakeMemory final : public hal::Memory {
+ public:
+  std::uint64_t size_goal() const final { return 1 << 30; }
+  hal::BufferAccessMask AllowedAccesses() const final { return hal::BufferAccessMask::ALL; }
+  std::size_t ArenaBufferAlignment() const final { return 1; }
+  std::shared_ptr<hal::Buffer> MakeBuffer(std::uint64_t size, hal::BufferAccessMask) final {
+    ++allocations;
+    return std::make_shared<FakeBuffer>(size);
+  }
+  std::shared_ptr<hal::Arena> MakeArena(std::uint64_t, hal::BufferAccessMask) final { return nullptr; }
+
+  std::size_t allocations = 0;
+};
+
+TEST(MemCache, SizeClasses) {
+  EXPECT_THAT(MemCache::SizeClass(1), Eq(256u));
+  EXPECT_THAT(MemCache::SizeClass(256), Eq(256u));
+  EXPECT_THAT(MemCache::SizeClass(257), Eq(320u));
+  EXPECT_THAT(MemCache::SizeClass(512), Eq(512u));
+  EXPECT_THAT(MemCache::SizeClass(513), Eq(640u));
+  EXPECT_THAT(MemCache::SizeClass(1000000), Eq(1048576u));
+  for (std::uint64_t size = 1; size < (1 << 20); size = size * 3 / 2 + 1) {
+    std::uint64_t cls = MemCache::SizeClass(size);
+    EXPECT_THAT(size, Le(cls));
+    EXPECT_THAT(cls - size, Le(std::max<std::uint64_t>(cls / 5, 256)));
+  }
+}
+
+TEST(MemCache, ReusesWithinClass) {
+  FakeMemory memory;
+  MemCache cache{&memory, hal::BufferAccessMask::ALL, 1 << 20};
+  auto buffer = cache.Alloc(1000);
+  EXPECT_THAT(std::static_pointer_cast<FakeBuffer>(buffer)->size(), Eq(MemCache::SizeClass(1000)));
+  cache.Free(1000, buffer);
+  auto reused = cache.Alloc(1010);
+  EXPECT_THAT(reused, Eq(buffer));
+  EXPECT_THAT(memory.allocations, Eq(1u));
+  auto stats = cache.stats();
+  EXPECT_THAT(stats.hits, Eq(1u));
+  EXPECT_THAT(stats.misses, Eq(1u));
+  EXPECT_THAT(stats.bytes_held, Eq(0u));
+  EXPECT_THAT(stats.bytes_in_use, Eq(MemCache::SizeClass(1000)));
+}
+
+TEST(MemCache, StaysWithinBudget) {
+  FakeMemory memory;
+  MemCache cache{&memory, hal::BufferAccessMask::ALL, 4096};
+  std::vector<std::shared_ptr<hal::Buffer>> buffers;
+  for (int i = 0; i < 8; ++i) {
+    buffers.emplace_back(cache.Alloc(1024));
+  }
+  for (auto& buffer : buffers) {
+    cache.Free(1024, std::move(buffer));
+  }
+  auto stats = cache.stats();
+  EXPECT_THAT(stats.bytes_held, Le(4096u));
+  EXPECT_THAT(stats.evictions + stats.bytes_held / 1024, Eq(8u));
+  EXPECT_THAT(stats.bytes_in_use, Eq(0u));
+}
+
+TEST(MemCache, TrimKeepsHighWaterMark) {
+  FakeMemory memory;
+  MemCache cache{&memory, hal::BufferAccessMask::ALL, 1 << 20};
+  auto a = cache.Alloc(300);
+  auto b = cache.Alloc(300);
+  cache.Free(300, std::move(a));
+  cache.Free(300, std::move(b));
+  // Two buffers were needed at once since the cache was created, so both stay.
+  cache.Trim();
+  EXPECT_THAT(cache.stats().bytes_held, Eq(2 * MemCache::SizeClass(300)));
+  // Since that trim, nothing has been needed; the next one releases them.
+  cache.Trim();
+  EXPECT_THAT(cache.stats().bytes_held, Eq(0u));
+}
+
+}  // namespace
+}  // namespace local_machine
+}  // namespace tile
+}  // namespace vertexai
@@ -40,6 +40,48 @@ void MemDeps::Poison(std::exception_ptr ep) noexcept {
   ep_ = ep;
 }
 
+void MemDeps::AddOwner() {
+  std::lock_guard<std::mutex> lock{mu_};
+  ++owners_;
+}
+
+void MemDeps::RemoveOwner() {
+  std::lock_guard<std::mutex> lock{mu_};
+  --owners_;
+}
+
+void MemDeps::AddView() {
+  std::lock_guard<std::mutex> lock{mu_};
+  ++views_;
+}
+
+void MemDeps::RemoveView() {
+  std::lock_guard<std::mutex> lock{mu_};
+  --views_;
+}
+
+bool MemDeps::TryClaim() {
+  std::lock_guard<std::mutex> lock{mu_};
+  if (claimed_ || owners_ != 1 || views_ || users_ || events_.size() || ep_) {
+    return false;
+  }
+  claimed_ = true;
+  return true;
+}
+
+void MemDeps::Unclaim() {
+  std::lock_guard<std::mutex> lock{mu_};
+  claimed_ = false;
+}
+
+bool MemDeps::busy() {
+  if (users_) {
+    return true;
+  }
+  std::lock_guard<std::mutex> lock{mu_};
+  return claimed_ || events_.size() || ep_;
+}
+
 }  // namespace local_machine
 }  // namespace tile
 }  // namespace vertexai
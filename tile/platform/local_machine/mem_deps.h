@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <exception>
 #include <list>
 #include <memory>
@@ -30,8 +31,38 @@ class MemDeps final : public std::enable_shared_from_this<MemDeps> {
   // subsequent calls to Capture.
   void Poison(std::exception_ptr ep) noexcept;
 
+  // Records the start and end of a run which reads the memory without writing it.  Such runs don't block further
+  // reads, so they aren't read dependencies, but the memory can't be overwritten until they're done.
+  void AddUser() { ++users_; }
+  void RemoveUser() { --users_; }
+
+  // Indicates whether a run which only reads the memory may still be outstanding.
+  bool has_users() const { return users_ != 0; }
+
+  // Records a buffer taking or dropping a reference to the memory.
+  void AddOwner();
+  void RemoveOwner();
+
+  // Records the start and end of a host mapping of the memory, from the time the mapping is requested until its view
+  // is destroyed.
+  void AddView();
+  void RemoveView();
+
+  // Claims the memory for a run which overwrites it in place.  This only succeeds if a single buffer owns the memory,
+  // it isn't mapped, and no other work is using or has claimed it; the claim is held until Unclaim is called, which
+  // should happen once the run completes.
+  bool TryClaim();
+  void Unclaim();
+
+  // Indicates whether there may be outstanding work using the memory.
+  bool busy();
+
  private:
+  std::atomic<std::size_t> users_{0};
   std::mutex mu_;
+  std::size_t owners_ = 0;
+  std::size_t views_ = 0;
+  bool claimed_ = false;
   std::list<std::shared_ptr<hal::Event>> events_;
   std::exception_ptr ep_;
 };
@@ -19,6 +19,7 @@
 #include "tile/hal/util/settings.h"
 #include "tile/platform/local_machine/block_placer.h"
 #include "tile/platform/local_machine/buffer.h"
+#include "tile/platform/local_machine/critical_path_scheduler.h"
 #include "tile/platform/local_machine/direct_mem_strategy.h"
 #include "tile/platform/local_machine/fifo_scheduler.h"
 #include "tile/platform/local_machine/loose_scheduler.h"
@@ -56,6 +57,11 @@ void GetMemStrategy(const std::shared_ptr<DevInfo>& devinfo, Platform::PlatformD
   pd->tmp_mem_source = devinfo->devset->host_memory();
 }
 
+void GetTmpMemCache(const std::shared_ptr<DevInfo>& devinfo, Platform::PlatformDev* pd) {
+  pd->tmp_mem_cache = std::make_shared<MemCache>(pd->tmp_mem_source, hal::BufferAccessMask::DEVICE_RW,
+                                                 MemCacheBudget(devinfo->settings, pd->tmp_mem_source));
+}
+
 bool MatchConfig(const proto::Platform& config, const hal::proto::HardwareInfo& info,
                  hal::proto::HardwareSettings* settings) {
   for (const auto& hardware_config : config.hardware_configs()) {
@@ -126,6 +132,7 @@ Platform::Platform(const context::Context& ctx, const proto::Platform& config) {
           }
           VLOG(1) << settings.DebugString();
           GetMemStrategy(devinfo, &pd);
+          GetTmpMemCache(devinfo, &pd);
 
           auto memory = (dev->executor() && dev->executor()->device_memory() ? dev->executor()->device_memory()
                                                                              : devset->host_memory());
@@ -133,9 +140,15 @@ Platform::Platform(const context::Context& ctx, const proto::Platform& config) {
             IVLOG(1, "Device is synchronous");
           }
           auto size_goal = memory->size_goal() * kGoalMemPercentage;
-          IVLOG(1, "Using fifo scheduler; size_goal=" << size_goal);
-          pd.scheduler = std::make_shared<fifo_scheduler::FifoScheduler>(memory->ArenaBufferAlignment(),
-                                                                         std::lround(std::floor(size_goal)), settings);
+          if (settings.scheduler() == hal::proto::SchedulerType::CriticalPath) {
+            IVLOG(1, "Using critical path scheduler; size_goal=" << size_goal);
+            pd.scheduler = std::make_shared<CriticalPathScheduler>(memory->ArenaBufferAlignment(),
+                                                                   std::lround(std::floor(size_goal)), settings);
+          } else {
+            IVLOG(1, "Using fifo scheduler; size_goal=" << size_goal);
+            pd.scheduler = std::make_shared<fifo_scheduler::FifoScheduler>(
+                memory->ArenaBufferAlignment(), std::lround(std::floor(size_goal)), settings);
+          }
           devs_[id] = std::move(pd);
         }
       }
@@ -156,7 +169,8 @@ std::unique_ptr<tile::Program> Platform::MakeProgram(const context::Context& ctx
   auto& platform_dev = LookupDevice(program.dev_id());
   return std::make_unique<Program>(ctx, program, platform_dev.devinfo, platform_dev.scheduler,
                                    platform_dev.mem_strategy,
-                                   std::make_shared<TmpMemStrategy>(platform_dev.devinfo, platform_dev.tmp_mem_source),
+                                   std::make_shared<TmpMemStrategy>(platform_dev.devinfo, platform_dev.tmp_mem_source,
+                                                                    platform_dev.tmp_mem_cache),
                                    platform_dev.tmp_mem_source, tile_optimizer_, const_bufs);
 }
 
@@ -0,0 +1,190 @@
+// Copyright 2019 Intel Corporation.
+
+#include "tile/platform/local_machine/prepared_run.h"
+
+#include <utility>
+
+#include "base/util/error.h"
+#include "base/util/perf_counter.h"
+#include "tile/platform/local_machine/run_request.h"
+#include "tile/platform/local_machine/shim.h"
+
+namespace vertexai {
+namespace tile {
+namespace local_machine {
+namespace {
+
+PerfCounter prepared_plans("prepared_plans");
+PerfCounter prepared_runs("prepared_runs");
+
+}  // namespace
+
+PreparedRun::PreparedRun(const context::Context& ctx, const Program* program) : program_{program} {
+  context::Activity activity{ctx, "tile::local_machine::PreparedRun::Prepare"};
+  const auto& schedule = program_->schedule();
+
+  steps_.resize(schedule.steps.size());
+  std::vector<bool> depended_on(steps_.size());
+  for (const auto& step : schedule.steps) {
+    auto& planned = steps_[step.idx];
+    planned.tag = step.tag;
+    planned.kidx = step.kidx;
+    planned.byte_count = step.byte_count;
+    for (const auto& dep : step.deps) {
+      planned.deps.push_back(dep->idx);
+      depended_on[dep->idx] = true;
+    }
+    auto add_param = [&planned](const schedule::Alloc* alloc, bool add_dep) {
+      if (!alloc->is_tmp()) {
+        planned.io_slots.push_back(planned.params.size());
+      }
+      planned.params.push_back(alloc->idx);
+      if (add_dep) {
+        planned.dep_allocs.push_back(alloc->idx);
+      } else if (alloc->is_tmp()) {
+        planned.tmp_uses.push_back(alloc->idx);
+      }
+    };
+    for (const auto& out : step.outputs) {
+      add_param(out.allocp, out.add_dep);
+    }
+    for (const auto& in : step.inputs) {
+      add_param(in, false);
+    }
+    if (step.tag == schedule::Step::Tag::kCopy && planned.params.size() != 2) {
+      throw error::Internal{"Invalid parameter count for copy step s" + std::to_string(step.idx)};
+    }
+  }
+  for (std::size_t idx = 0; idx < steps_.size(); ++idx) {
+    if (!depended_on[idx]) {
+      terminals_.push_back(idx);
+    }
+  }
+  prepared_plans.inc();
+}
+
+std::unique_ptr<PreparedRun::Frame> PreparedRun::MakeFrame(const context::Context& ctx) const {
+  auto frame = std::make_unique<Frame>();
+  const auto& allocs = program_->schedule().allocs;
+  frame->tmps.resize(allocs.size());
+  for (const auto& alloc : allocs) {
+    if (alloc.is_tmp()) {
+      frame->tmps[alloc.idx] = program_->tmp_mem_strategy()->MakeChunk(ctx, alloc.byte_size);
+    }
+  }
+  frame->params.resize(steps_.size());
+  for (std::size_t idx = 0; idx < steps_.size(); ++idx) {
+    auto& buffers = frame->params[idx];
+    for (auto alloc_idx : steps_[idx].params) {
+      const auto& tmp = frame->tmps[alloc_idx];
+      buffers.emplace_back(tmp ? tmp->hal_buffer() : nullptr);
+    }
+  }
+  return frame;
+}
+
+boost::future<void> PreparedRun::Run(const context::Context& ctx,
+                                     std::map<std::string, std::shared_ptr<tile::Buffer>> inputs,
+                                     std::map<std::string, std::shared_ptr<tile::Buffer>> outputs) const {
+  program_->BindArgs(&inputs, &outputs);
+  RunRequest::LogRequest(program_, inputs, outputs);
+
+  context::Activity running{ctx, "tile::local_machine::Program::Run"};
+  // NOTE: VLOG_IS_ON(1) is needed here because LogResults depends on profiling
+  // being enabled in order to print durations.
+  bool profile = running.ctx().is_logging_events() || VLOG_IS_ON(1);
+  auto executor = program_->devinfo()->dev->executor();
+  boost::future<std::vector<std::shared_ptr<hal::Result>>> results;
+  std::unique_ptr<Shim> shim;
+
+  {
+    context::Activity queueing{running.ctx(), "tile::local_machine::Program::Enqueue"};
+    std::lock_guard<std::mutex> lock{mu_};
+    if (!frame_) {
+      frame_ = MakeFrame(queueing.ctx());
+    }
+    std::vector<std::shared_ptr<hal::Event>> events(steps_.size());
+
+    // The shim binds the run's inputs and outputs, and holds them and the temporaries until the run completes.
+    shim = std::make_unique<Shim>(queueing.ctx(), program_, std::move(inputs), std::move(outputs), true, &frame_->tmps);
+
+    try {
+      for (std::size_t idx = 0; idx < steps_.size(); ++idx) {
+        const auto& step = steps_[idx];
+        auto& buffers = frame_->params[idx];
+        std::vector<std::shared_ptr<hal::Event>> deps;
+        for (auto dep : step.deps) {
+          deps.emplace_back(events[dep]);
+        }
+        for (auto slot : step.io_slots) {
+          buffers[slot] = shim->chunk(step.params[slot])->hal_buffer();
+        }
+        for (auto alloc_idx : step.params) {
+          shim->chunk(alloc_idx)->deps()->GetReadDependencies(&deps);
+        }
+        std::shared_ptr<hal::Event> event;
+        if (step.tag == schedule::Step::Tag::kRun) {
+          event = program_->executable()->Run(queueing.ctx(), step.kidx, buffers, deps, profile);
+        } else {
+          event = executor->Copy(queueing.ctx(), buffers[1], 0, buffers[0], 0, step.byte_count, deps);
+        }
+        for (auto slot : step.io_slots) {
+          buffers[slot].reset();
+        }
+        for (auto alloc_idx : step.dep_allocs) {
+          shim->chunk(alloc_idx)->deps()->AddReadDependency(event);
+        }
+        for (auto alloc_idx : step.tmp_uses) {
+          frame_->tmps[alloc_idx]->deps()->AddReadDependency(event);
+        }
+        events[idx] = std::move(event);
+      }
+    } catch (...) {
+      // The launch poisons the temporaries along with the outputs; the next run makes fresh ones.
+      shim->SetLaunchException(std::current_exception());
+      frame_.reset();
+      return boost::make_ready_future();
+    }
+
+    std::vector<std::shared_ptr<hal::Event>> terminal_events;
+    for (auto idx : terminals_) {
+      terminal_events.emplace_back(events[idx]);
+    }
+    if (terminal_events.empty()) {
+      results = boost::make_ready_future<std::vector<std::shared_ptr<hal::Result>>>();
+    } else {
+      results = executor->WaitFor(terminal_events);
+    }
+    if (profile) {
+      // We want to return results for *all* of the steps.
+      std::vector<boost::shared_future<std::shared_ptr<hal::Result>>> step_futures;
+      for (const auto& event : events) {
+        step_futures.emplace_back(event->GetFuture());
+      }
+      results = results.then(
+          [step_futures = std::move(step_futures)](boost::future<std::vector<std::shared_ptr<hal::Result>>> r) {
+            r.get();
+            std::vector<std::shared_ptr<hal::Result>> all;
+            for (auto& fut : step_futures) {
+              all.push_back(fut.get());
+            }
+            return all;
+          });
+    }
+    shim->OnLaunchSuccess();
+    prepared_runs.inc();
+  }
+
+  auto complete = RunRequest::LogResults(running.ctx(), std::move(results));
+
+  // Covers the time from the end of enqueueing until the program's results are in.
+  context::Activity waiting{running.ctx(), "tile::local_machine::Program::Wait"};
+
+  // Keep the shim referenced until the program is complete: it holds the run's chunks, including its temporaries.
+  return complete.then([shim = std::move(shim), running = std::move(running), waiting = std::move(waiting)](
+                           decltype(complete) fut) { fut.get(); });
+}
+
+}  // namespace local_machine
+}  // namespace tile
+}  // namespace vertexai
@@ -0,0 +1,70 @@
+// Copyright 2019 Intel Corporation.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "base/context/context.h"
+#include "tile/base/buffer.h"
+#include "tile/base/hal.h"
+#include "tile/base/schedule.h"
+#include "tile/platform/local_machine/mem_chunk.h"
+#include "tile/platform/local_machine/program.h"
+
+namespace vertexai {
+namespace tile {
+namespace local_machine {
+
+// PreparedRun is a program's schedule, resolved once for repeated execution.
+//
+// Preparing a run flattens the schedule into vectors of allocation and step indices, and finds the steps which finish
+// a run.  The first run then allocates the program's temporaries and fills in each step's parameter buffers with
+// them; the plan keeps both, so later runs only bind the program's inputs and outputs, patch their slots in the
+// parameter buffers, and issue the steps.
+//
+// Since runs share the temporaries, each run's steps wait for the previous run's steps which used them.  Run may be
+// called from any thread; concurrent runs are enqueued one at a time.
+class PreparedRun {
+ public:
+  PreparedRun(const context::Context& ctx, const Program* program);
+
+  // Runs the program, with the same semantics as Program::Run.
+  boost::future<void> Run(const context::Context& ctx, std::map<std::string, std::shared_ptr<tile::Buffer>> inputs,
+                          std::map<std::string, std::shared_ptr<tile::Buffer>> outputs) const;
+
+ private:
+  struct PlannedStep {
+    schedule::Step::Tag tag = schedule::Step::Tag::kRun;
+    std::size_t kidx = 0;
+    std::uint64_t byte_count = 0;
+    std::vector<std::size_t> params;      // Allocation indices: outputs, then inputs
+    std::vector<std::size_t> dep_allocs;  // Outputs whose chunks depend on the step's completion
+    std::vector<std::size_t> tmp_uses;    // Other temporaries the next run's steps must wait for the step to use
+    std::vector<std::size_t> io_slots;    // Positions in params of program inputs and outputs
+    std::vector<std::size_t> deps;        // Indices of the steps this one follows
+  };
+
+  // The temporaries the plan's runs execute in, and the steps' parameter buffers with the temporaries filled in.
+  struct Frame {
+    std::vector<std::shared_ptr<MemChunk>> tmps;                    // By allocation index; null for inputs and outputs
+    std::vector<std::vector<std::shared_ptr<hal::Buffer>>> params;  // By step index
+  };
+
+  std::unique_ptr<Frame> MakeFrame(const context::Context& ctx) const;
+
+  const Program* program_;
+  std::vector<PlannedStep> steps_;
+  std::vector<std::size_t> terminals_;  // Steps which no other step depends on
+  mutable std::mutex mu_;               // Held while a run is enqueued
+  mutable std::unique_ptr<Frame> frame_;
+};
+
+}  // namespace local_machine
+}  // namespace tile
+}  // namespace vertexai
@@ -17,6 +17,7 @@
 #include "tile/lang/tile_cache.h"
 #include "tile/ocl_exec/stripe_gen.h"
 #include "tile/platform/local_machine/buffer.h"
+#include "tile/platform/local_machine/prepared_run.h"
 #include "tile/platform/local_machine/run_request.h"
 #include "tile/proto/support.h"
 
@@ -73,8 +74,9 @@ int64_t TryKernel(const context::Context& ctx, const lang::KernelInfo& ki,
   return std::numeric_limits<int64_t>::max();
 }
 
-lang::KernelList CompileProgram(const tile::proto::Program& program, const DevInfo& devinfo,
-                                const lang::TileOptimizer& optimizer, ConstBufferManager* const_bufs) {
+lang::KernelList CompileProgram(const context::Context& ctx, const tile::proto::Program& program,
+                                const DevInfo& devinfo, const lang::TileOptimizer& optimizer,
+                                ConstBufferManager* const_bufs) {
   IVLOG(2, "Compiling: " << program.code());
   size_t tile_trials = 1;
   size_t trial_runs = 1;
@@ -83,9 +85,12 @@ lang::KernelList CompileProgram(const tile::proto::Program& program, const DevIn
     trial_runs = program.tile_scanning_params().max_trial_runs();
   }
 
-  context::Context ctx;
-  lang::Parser parser;
-  auto parsed = parser.Parse(program.code());
+  lang::Program parsed;
+  {
+    context::Activity parse{ctx, "tile::lang::Parse"};
+    lang::Parser parser;
+    parsed = parser.Parse(program.code());
+  }
   auto inputs = FromProto(program.inputs());
   auto outputs = FromProto(program.outputs());
 
@@ -106,11 +111,15 @@ lang::KernelList CompileProgram(const tile::proto::Program& program, const DevIn
         runinfo.const_inputs.emplace(kvp.first);
       }
     }
-    return codegen::GenerateProgram(runinfo, stripe_cfg, out_path, const_bufs);
+    return codegen::GenerateProgram(ctx, runinfo, stripe_cfg, out_path, const_bufs);
   }
 
   auto settings = hal::settings::ToHardwareSettings(devinfo.settings);
-  auto kernel_list = lang::GenerateProgram(parsed, inputs, outputs, settings, optimizer, program.id(), tile_trials);
+  lang::KernelList kernel_list;
+  {
+    context::Activity generate{ctx, "tile::lang::GenerateProgram"};
+    kernel_list = lang::GenerateProgram(parsed, inputs, outputs, settings, optimizer, program.id(), tile_trials);
+  }
   if (tile_trials == 1) {
     return kernel_list;
   }
@@ -184,7 +193,7 @@ Program::Program(const context::Context& ctx, const tile::proto::Program& progra
 
   context::Activity activity{ctx, "tile::local_machine::Compile"};
 
-  kernel_list_ = CompileProgram(program, *devinfo_.get(), optimizer, const_bufs);
+  kernel_list_ = CompileProgram(activity.ctx(), program, *devinfo_.get(), optimizer, const_bufs);
   const_bufs_ = const_bufs->buffers;
 
   tile::proto::Program new_program = program;  // Modify logical program inputs for const_bufs
@@ -205,7 +214,7 @@ Program::Program(const context::Context& ctx, const tile::proto::Program& progra
     for (auto kernel : kernel_list_.kernels) {
       (*cinfo.mutable_kernels())[kernel.kname] = kernel.info;
     }
-    SummarizeSchedule(&cinfo, new_program, kernel_list_, schedule_);
+    SummarizeSchedule(&cinfo, new_program, kernel_list_, schedule_, devinfo_->settings.goal_flops_per_byte());
     *(cinfo.mutable_program()) = new_program;
     activity.AddMetadata(cinfo);
     schedule::proto::Schedule sched_pb;
@@ -219,17 +228,38 @@ Program::Program(const context::Context& ctx, const tile::proto::Program& progra
   ValidateSchedule(new_program, kernel_list_, schedule_);
 }
 
+Program::~Program() {}
+
 boost::future<void> Program::Run(const context::Context& ctx,
                                  std::map<std::string, std::shared_ptr<tile::Buffer>> inputs,
                                  std::map<std::string, std::shared_ptr<tile::Buffer>> outputs) {
+  // Runs go through the program's prepared plan.  The plan holds no memory between runs, and runs of it don't
+  // interfere with each other, so every run can use it.
+  const PreparedRun* plan;
+  {
+    std::lock_guard<std::mutex> lock{plan_mu_};
+    if (!plan_) {
+      plan_ = Prepare(ctx);
+    }
+    plan = plan_.get();
+  }
+  return plan->Run(ctx, std::move(inputs), std::move(outputs));
+}
+
+std::unique_ptr<PreparedRun> Program::Prepare(const context::Context& ctx) const {
+  return std::make_unique<PreparedRun>(ctx, this);
+}
+
+void Program::BindArgs(std::map<std::string, std::shared_ptr<tile::Buffer>>* inputs,
+                       std::map<std::string, std::shared_ptr<tile::Buffer>>* outputs) const {
   std::map<std::string, std::shared_ptr<tile::Buffer>> rewrite_outputs;
-  for (auto kvp : outputs) {
+  for (auto& kvp : *outputs) {
     rewrite_outputs.emplace(kernel_list_.var_rewrites.Lookup(kvp.first), std::move(kvp.second));
   }
+  outputs->swap(rewrite_outputs);
   for (const auto& kvp : const_bufs_) {
-    inputs[kvp.first] = kvp.second;
+    (*inputs)[kvp.first] = kvp.second;
   }
-  return RunRequest::Run(ctx, this, std::move(inputs), std::move(rewrite_outputs));
 }
 
 }  // namespace local_machine
@@ -5,6 +5,7 @@
 #include <cstddef>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <unordered_map>
@@ -21,16 +22,28 @@ namespace vertexai {
 namespace tile {
 namespace local_machine {
 
+class PreparedRun;
+
 class Program final : public tile::Program {
  public:
   Program(const context::Context& ctx, const tile::proto::Program& program, const std::shared_ptr<DevInfo>& devinfo,
           const std::shared_ptr<Scheduler>& scheduler, const std::shared_ptr<MemStrategy>& output_mem_strategy,
           const std::shared_ptr<MemStrategy>& tmp_mem_strategy, hal::Memory* tmp_memory,
           const lang::TileOptimizer& optimizer, ConstBufferManager* const_bufs);
+  ~Program();
 
   boost::future<void> Run(const context::Context& ctx, std::map<std::string, std::shared_ptr<tile::Buffer>> inputs,
                           std::map<std::string, std::shared_ptr<tile::Buffer>> outputs) final;
 
+  // Resolves the program's schedule and kernel parameters into a plan which can be run repeatedly with little host
+  // overhead.  The program must outlive the plan.
+  std::unique_ptr<PreparedRun> Prepare(const context::Context& ctx) const;
+
+  // Adjusts run bindings for the compiled program: renames outputs to their rewritten variables, and binds the
+  // program's constant buffers as inputs.
+  void BindArgs(std::map<std::string, std::shared_ptr<tile::Buffer>>* inputs,
+                std::map<std::string, std::shared_ptr<tile::Buffer>>* outputs) const;
+
   const std::shared_ptr<DevInfo>& devinfo() const { return devinfo_; }
   const std::shared_ptr<MemStrategy>& output_mem_strategy() const { return output_mem_strategy_; }
   const std::shared_ptr<MemStrategy>& tmp_mem_strategy() const { return tmp_mem_strategy_; }
@@ -46,6 +59,9 @@ class Program final : public tile::Program {
   schedule::Schedule schedule_;
   std::map<std::string, std::shared_ptr<tile::Buffer>> const_bufs_;
   std::unique_ptr<hal::Executable> executable_;
+
+  std::mutex plan_mu_;
+  std::unique_ptr<const PreparedRun> plan_;  // Created by the first run
 };
 
 }  // namespace local_machine
@@ -135,10 +135,14 @@ boost::future<void> RunRequest::Run(const context::Context& ctx, const Program*
     complete = req.LogResults(queueing.ctx(), std::move(results));
   }
 
-  // Keep the shim and activity referenced until the program is complete.
+  // Covers the time from the end of enqueueing until the program's results are in.
+  context::Activity waiting{running.ctx(), "tile::local_machine::Program::Wait"};
+
+  // Keep the shim and activities referenced until the program is complete.
   // N.B. It's important to keep the shim referenced because it's the thing that's actually holding
   // onto all of our chunk references; if those go away, unfortunate things happen.
-  return complete.then([shim = std::move(shim), running = std::move(running)](decltype(complete) fut) { fut.get(); });
+  return complete.then([shim = std::move(shim), running = std::move(running), waiting = std::move(waiting)](
+                           decltype(complete) fut) { fut.get(); });
 }
 
 void RunRequest::LogRequest(const Program* program, const std::map<std::string, std::shared_ptr<tile::Buffer>>& inputs,
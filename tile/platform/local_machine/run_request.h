@@ -26,6 +26,14 @@ class RunRequest {
 
   void AddProgramDoneDep(const std::shared_ptr<hal::Event>& event);
 
+  // Logs the results of a program run once they're available.
+  static boost::future<void> LogResults(const context::Context& ctx,
+                                        boost::future<std::vector<std::shared_ptr<hal::Result>>> results);
+
+  // Logs the buffers bound to a program run.
+  static void LogRequest(const Program* program, const std::map<std::string, std::shared_ptr<tile::Buffer>>& inputs,
+                         const std::map<std::string, std::shared_ptr<tile::Buffer>>& outputs);
+
   const Program* program() const { return program_; }
 
  private:
@@ -38,12 +46,6 @@ class RunRequest {
 
   explicit RunRequest(const Program* program) : program_{program} {}
 
-  static void LogRequest(const Program* program, const std::map<std::string, std::shared_ptr<tile::Buffer>>& inputs,
-                         const std::map<std::string, std::shared_ptr<tile::Buffer>>& outputs);
-
-  boost::future<void> LogResults(const context::Context& ctx,
-                                 boost::future<std::vector<std::shared_ptr<hal::Result>>> results);
-
   const Program* program_;
 };
 
@@ -2,6 +2,7 @@
 
 #include "tile/platform/local_machine/scheduler.h"
 
+#include <algorithm>
 #include <iterator>
 #include <map>
 #include <set>
@@ -382,8 +383,47 @@ void ValidateSchedule(const tile::proto::Program& program, const lang::KernelLis
   }
 }
 
+std::uint64_t KernelCost(const lang::KernelInfo& ki, std::uint64_t flops_per_byte) {
+  std::uint64_t bytes_cost = ki.tot_bytes * std::max<std::uint64_t>(flops_per_byte, 1);
+  return std::max<std::uint64_t>(ki.tot_flops, bytes_cost) + 1;
+}
+
+ScheduleEstimate EstimateSchedule(const lang::KernelList& kl, const schedule::Schedule& schedule,
+                                  std::uint64_t flops_per_byte) {
+  ScheduleEstimate estimate;
+
+  // Steps only depend on earlier steps, so a single pass finds the
+  // finishing time of each step.
+  std::vector<std::uint64_t> finish(schedule.steps.size());
+  for (const auto& step : schedule.steps) {
+    std::uint64_t start = 0;
+    for (const auto* dep : step.deps) {
+      start = std::max(start, finish[dep->idx]);
+    }
+    std::uint64_t cost = 0;
+    switch (step.tag) {
+      case schedule::Step::Tag::kRun:
+        cost = KernelCost(kl.kernels[step.kidx], flops_per_byte);
+        break;
+      case schedule::Step::Tag::kCopy:
+        cost = step.byte_count * std::max<std::uint64_t>(flops_per_byte, 1) + 1;
+        break;
+    }
+    finish[step.idx] = start + cost;
+    estimate.makespan = std::max(estimate.makespan, finish[step.idx]);
+  }
+
+  for (const auto& alloc : schedule.allocs) {
+    if (alloc.is_tmp()) {
+      estimate.total_tmp_bytes += alloc.byte_size;
+    }
+  }
+
+  return estimate;
+}
+
 void SummarizeSchedule(hal::proto::CompilationInfo* cinfo, const tile::proto::Program& program,
-                       const lang::KernelList& kl, const schedule::Schedule& schedule) {
+                       const lang::KernelList& kl, const schedule::Schedule& schedule, std::uint64_t flops_per_byte) {
   IVLOG(1, "Summary for " << program.id() << ":");
 
   IVLOG(3, "Schedule:\n" << schedule);
@@ -433,6 +473,14 @@ void SummarizeSchedule(hal::proto::CompilationInfo* cinfo, const tile::proto::Pr
     }
   }
   IVLOG(1, "Total memory required: " << total_bytes << " bytes");
+
+  auto estimate = EstimateSchedule(kl, schedule, flops_per_byte);
+  IVLOG(1, "Predicted makespan: " << estimate.makespan << " flop-equivalents");
+  IVLOG(1, "Total temporary memory: " << estimate.total_tmp_bytes << " bytes");
+  if (cinfo) {
+    cinfo->set_predicted_makespan(estimate.makespan);
+    cinfo->set_total_tmp_bytes(estimate.total_tmp_bytes);
+  }
 }
 
 }  // namespace local_machine
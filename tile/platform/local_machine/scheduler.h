@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 #include "tile/base/schedule.h"
@@ -52,11 +53,34 @@ void AddLinearDeps(schedule::Schedule* schedule, std::size_t delta);
 void ValidateSchedule(const tile::proto::Program& program, const lang::KernelList& kl,
                       const schedule::Schedule& schedule);
 
+// Estimates the cost of running a kernel, in flop-equivalents: a kernel
+// is taken to be bound by either its arithmetic or its memory traffic,
+// with each byte moved costing flops_per_byte flops.  Every kernel costs
+// at least one unit, accounting for its launch.
+std::uint64_t KernelCost(const lang::KernelInfo& ki, std::uint64_t flops_per_byte);
+
+// The estimated resource usage of a schedule.
+struct ScheduleEstimate {
+  // The cost (as per KernelCost()) of the most expensive chain of
+  // dependent steps -- i.e. the running time, given enough hardware to
+  // overlap all steps which the schedule allows to run concurrently.
+  std::uint64_t makespan = 0;
+
+  // The total bytes of temporary allocs.  Each alloc is held for the
+  // whole run of the program, so this is also the run's temporary memory
+  // footprint; reusing an alloc for several temporaries is what lowers it.
+  std::uint64_t total_tmp_bytes = 0;
+};
+
+ScheduleEstimate EstimateSchedule(const lang::KernelList& kl, const schedule::Schedule& schedule,
+                                  std::uint64_t flops_per_byte);
+
 // Writes information about a schedule to the debug log, and
-// optionally updates a CompilationInfo proto's tmp_sizes and
-// alloc_sizes fields based on the schedule.
+// optionally updates a CompilationInfo proto's tmp_sizes,
+// alloc_sizes, predicted_makespan, and total_tmp_bytes fields based on
+// the schedule.
 void SummarizeSchedule(hal::proto::CompilationInfo* cinfo, const tile::proto::Program& program,
-                       const lang::KernelList& kl, const schedule::Schedule& schedule);
+                       const lang::KernelList& kl, const schedule::Schedule& schedule, std::uint64_t flops_per_byte);
 
 }  // namespace local_machine
 }  // namespace tile
@@ -6,6 +6,9 @@
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/text_format.h>
 
+#include <fstream>
+#include <string>
+
 #include <boost/core/demangle.hpp>
 
 #include "base/util/logging.h"
@@ -39,18 +42,31 @@ tile::proto::Program MakeProgram(const std::string& filename) {
 }  // namespace
 
 std::vector<tile::proto::Program> SchedulerTest::GetTestPrograms() {
-  RunfilesDB rdb{"com_intel_plaidml/tile/platform/local_machine/testdata"};
   std::vector<tile::proto::Program> result;
-  result.emplace_back(MakeProgram(rdb["concat.tpb"]));
-  result.emplace_back(MakeProgram(rdb["prng.tpb"]));
-  result.emplace_back(MakeProgram(rdb["xception.tpb"]));
+  result.emplace_back(GetTestProgram("concat.tpb"));
+  result.emplace_back(GetTestProgram("prng.tpb"));
+  result.emplace_back(GetTestProgram("xception.tpb"));
   if (FLAGS_test_long_schedules) {
-    result.emplace_back(MakeProgram(rdb["lstm.tpb"]));
-    result.emplace_back(MakeProgram(rdb["resnet50_train.tpb"]));
+    result.emplace_back(GetTestProgram("lstm.tpb"));
+    result.emplace_back(GetTestProgram("resnet50_train.tpb"));
   }
   return result;
 }
 
+tile::proto::Program SchedulerTest::GetTestProgram(const std::string& filename) {
+  RunfilesDB rdb{"com_intel_plaidml/tile/platform/local_machine/testdata"};
+  return MakeProgram(rdb[filename.c_str()]);
+}
+
+lang::KernelList SchedulerTest::GenerateKernels(const tile::proto::Program& program) {
+  lang::Parser parser;
+  lang::TileOptimizer optimizer;
+  auto parsed = parser.Parse(program.code());
+  auto inputs = FromProto(program.inputs());
+  auto outputs = FromProto(program.outputs());
+  return lang::GenerateProgram(parsed, inputs, outputs, GetSettings(), optimizer, program.id(), 1);
+}
+
 void PrintTo(const SchedulerTestParam& param, ::std::ostream* os) {
   *os << std::get<0>(param)->name() << "/" << std::get<1>(param).id();
 }
@@ -75,15 +91,10 @@ namespace {
 
 TEST_P(SchedulerTest, Schedule) {
   const auto& program = GetProgram();
-  lang::Parser parser;
-  lang::TileOptimizer optimizer;
-  auto parsed = parser.Parse(program.code());
-  auto inputs = FromProto(program.inputs());
-  auto outputs = FromProto(program.outputs());
-  auto kernel_list = lang::GenerateProgram(parsed, inputs, outputs, GetSettings(), optimizer, program.id(), 1);
+  auto kernel_list = GenerateKernels(program);
 
   auto schedule = GetScheduler()->BuildSchedule(program, kernel_list);
-  SummarizeSchedule(nullptr, program, kernel_list, schedule);
+  SummarizeSchedule(nullptr, program, kernel_list, schedule, GetSettings().goal_flops_per_byte);
   ValidateSchedule(program, kernel_list, schedule);
 }
 
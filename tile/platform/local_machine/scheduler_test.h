@@ -37,10 +37,16 @@ class SchedulerTest : public ::testing::TestWithParam<SchedulerTestParam> {
  public:
   static std::vector<tile::proto::Program> GetTestPrograms();
 
+  // Loads one of the test programs by filename, e.g. "resnet50_train.tpb".
+  static tile::proto::Program GetTestProgram(const std::string& filename);
+
+  // Generates the kernels of a test program.
+  static lang::KernelList GenerateKernels(const tile::proto::Program& program);
+
  protected:
   std::shared_ptr<Scheduler> GetScheduler() { return std::get<0>(GetParam()); }
   const tile::proto::Program& GetProgram() { return std::get<1>(GetParam()); }
-  tile::lang::HardwareSettings GetSettings();
+  static tile::lang::HardwareSettings GetSettings();
 };
 
 }  // namespace local_machine
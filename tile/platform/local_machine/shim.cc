@@ -5,6 +5,7 @@
 #include <unordered_set>
 
 #include "base/util/error.h"
+#include "base/util/perf_counter.h"
 #include "tile/platform/local_machine/buffer.h"
 
 namespace vertexai {
@@ -12,86 +13,161 @@ namespace tile {
 namespace local_machine {
 namespace {
 
-// Builds a memory allocation map for a particular program run.
-std::pair<std::vector<std::shared_ptr<MemChunk>>, std::list<Shim::AliasUpdate>> BuildChunkMap(
-    const context::Context& ctx, const Program* program,
-    const std::map<std::string, std::shared_ptr<tile::Buffer>>& inputs,
-    const std::map<std::string, std::shared_ptr<tile::Buffer>>& outputs) {
-  std::vector<std::shared_ptr<MemChunk>> chunk_infos;
-  std::list<Shim::AliasUpdate> updates;
-  chunk_infos.reserve(program->schedule().allocs.size());
-  for (const auto& alloc : program->schedule().allocs) {
-    std::shared_ptr<MemChunk> chunk;
+PerfCounter donated_inputs("donated_inputs");
+
+// Binds a program input or output allocation to the chunk it uses for a particular program run, recording the
+// updates to apply to the run's buffers once it's launched.  Chunks of inputs the program only reads are marked as in
+// use as soon as they're bound, so that no output bound after them can claim them.  If reuse_outputs is set, an output
+// which isn't also an input keeps its buffer's current chunk when the run can claim it (see MemDeps::TryClaim).
+std::shared_ptr<MemChunk> BindIoAlloc(const context::Context& ctx, const Program* program,
+                                      const schedule::Alloc& alloc,
+                                      const std::map<std::string, std::shared_ptr<tile::Buffer>>& inputs,
+                                      const std::map<std::string, std::shared_ptr<tile::Buffer>>& outputs,
+                                      bool reuse_outputs, Shim::Bindings* bindings) {
+  std::shared_ptr<MemChunk> chunk;
+  if (alloc.is_input()) {
+    // This is a program input.  If the input has a chunk, we have to use it --
+    // by definition, this is the input data to the program.  Note that the input
+    // might not have a chunk; this is unusual, but it's technically allowed;
+    // this can be useful when a caller's just testing to see whether it's correctly
+    // composed a Tile program.
+    auto iit = inputs.find(alloc.input);
+    if (iit == inputs.end()) {
+      throw error::NotFound{"Missing program input: " + alloc.input};
+    }
+    std::shared_ptr<Buffer> input_buffer = Buffer::Downcast(iit->second, program->devinfo());
+    input_buffer->EnsureChunk(ctx);
+    chunk = input_buffer->chunk();
+
+    if (!alloc.is_output()) {
+      // The chunk is in use until the run completes.  (Chunks the program writes pick up read dependencies on the
+      // writing steps instead.)
+      chunk->deps()->AddUser();
+      bindings->read_only_inputs.push_back(chunk);
+      return chunk;
+    }
+
+    // The chunk is also being used as a program output; the corresponding output buffer
+    // must wind up pointing to this chunk if launch succeeds, regardless of whether it
+    // already has a chunk.
+    auto oit = outputs.find(alloc.output);
+    if (oit == outputs.end()) {
+      throw error::NotFound{"Missing program output: " + alloc.output};
+    }
+    std::shared_ptr<Buffer> output_buffer = Buffer::Downcast(oit->second, program->devinfo());
+    if (chunk->deps()->has_users()) {
+      // Earlier runs which only read the input may still be pending.  They don't leave events for this run to
+      // wait on, so it mustn't overwrite the input; instead, it runs on a copy, which becomes the output.
+      auto copy = program->output_mem_strategy()->MakeChunk(ctx, chunk->size());
+      std::vector<std::shared_ptr<hal::Event>> deps;
+      chunk->deps()->GetReadDependencies(&deps);
+      copy->deps()->AddReadDependency(program->devinfo()->dev->executor()->Copy(
+          ctx, chunk->hal_buffer(), 0, copy->hal_buffer(), 0, chunk->size(), deps));
+      chunk = std::move(copy);
+    } else if (output_buffer != input_buffer) {
+      // The input was donated to the output, and its contents are about to be overwritten; the input buffer
+      // gives up the chunk, and will get a fresh one if it's used again.
+      bindings->updates.emplace_back(Shim::AliasUpdate{std::move(input_buffer), nullptr});
+      donated_inputs.inc();
+    }
+    bindings->updates.emplace_back(Shim::AliasUpdate{std::move(output_buffer), chunk});
+    return chunk;
+  }
+
+  // This is a program output, but not a program input.  So we'll be creating a new chunk
+  // for it here -- typically, the output buffer will not already have a chunk, but if it does,
+  // it's okay to go ahead and replace it iff launch succeeds.
+  auto oit = outputs.find(alloc.output);
+  if (oit == outputs.end()) {
+    throw error::NotFound{"Missing program output: " + alloc.output};
+  }
+  std::shared_ptr<Buffer> output_buffer = Buffer::Downcast(oit->second, program->devinfo());
+  if (reuse_outputs) {
+    chunk = output_buffer->chunk();
+    if (chunk && chunk->size() == output_buffer->size() && chunk->deps()->TryClaim()) {
+      bindings->claimed_outputs.push_back(chunk);
+      return chunk;
+    }
+  }
+  chunk = program->output_mem_strategy()->MakeChunk(ctx, output_buffer->size());
+  bindings->updates.emplace_back(Shim::AliasUpdate{std::move(output_buffer), chunk});
+  return chunk;
+}
+
+// Builds a memory allocation map for a particular program run.  Inputs are bound before outputs, so an output never
+// claims a chunk the run also reads.
+void BuildChunkMap(const context::Context& ctx, const Program* program,
+                   const std::map<std::string, std::shared_ptr<tile::Buffer>>& inputs,
+                   const std::map<std::string, std::shared_ptr<tile::Buffer>>& outputs, bool reuse_outputs,
+                   const std::vector<std::shared_ptr<MemChunk>>* tmps, Shim::Bindings* bindings) {
+  const auto& allocs = program->schedule().allocs;
+  bindings->chunk_infos.resize(allocs.size());
+  for (const auto& alloc : allocs) {
     if (alloc.is_input()) {
-      // This is a program input.  If the input has a chunk, we have to use it --
-      // by definition, this is the input data to the program.  Note that the input
-      // might not have a chunk; this is unusual, but it's technically allowed;
-      // this can be useful when a caller's just testing to see whether it's correctly
-      // composed a Tile program.
-      auto iit = inputs.find(alloc.input);
-      if (iit == inputs.end()) {
-        throw error::NotFound{"Missing program input: " + alloc.input};
-      }
-      std::shared_ptr<Buffer> input_buffer = Buffer::Downcast(iit->second, program->devinfo());
-      input_buffer->EnsureChunk(ctx);
-      chunk = input_buffer->chunk();
-
-      if (alloc.is_output()) {
-        // The chunk is also being used as a program output; the corresponding output buffer
-        // must wind up pointing to this chunk if launch succeeds, regardless of whether it
-        // already has a chunk.
-        auto oit = outputs.find(alloc.output);
-        if (oit == outputs.end()) {
-          throw error::NotFound{"Missing program output: " + alloc.output};
-        }
-        std::shared_ptr<Buffer> output_buffer = Buffer::Downcast(oit->second, program->devinfo());
-        updates.emplace_back(Shim::AliasUpdate{std::move(output_buffer), chunk});
-      }
-    } else if (alloc.is_output()) {
-      // This is a program output, but not a program input.  So we'll be creating a new chunk
-      // for it here -- typically, the output buffer will not already have a chunk, but if it does,
-      // it's okay to go ahead and replace it iff launch succeeds.
-      auto oit = outputs.find(alloc.output);
-      if (oit == outputs.end()) {
-        throw error::NotFound{"Missing program output: " + alloc.output};
-      }
-      std::shared_ptr<Buffer> output_buffer = Buffer::Downcast(oit->second, program->devinfo());
-      chunk = program->output_mem_strategy()->MakeChunk(ctx, output_buffer->size());
-      updates.emplace_back(Shim::AliasUpdate{std::move(output_buffer), chunk});
+      bindings->chunk_infos[alloc.idx] = BindIoAlloc(ctx, program, alloc, inputs, outputs, reuse_outputs, bindings);
+    }
+  }
+  for (const auto& alloc : allocs) {
+    if (alloc.is_input()) {
+      continue;
+    }
+    if (alloc.is_output()) {
+      bindings->chunk_infos[alloc.idx] = BindIoAlloc(ctx, program, alloc, inputs, outputs, reuse_outputs, bindings);
+    } else if (tmps) {
+      bindings->chunk_infos[alloc.idx] = (*tmps)[alloc.idx];
     } else {
       // This is neither a program input nor a program output; the alloc is purely internal
       // to the program.  Make a temporary buffer for it.
-      chunk = program->tmp_mem_strategy()->MakeChunk(ctx, alloc.byte_size);
+      bindings->chunk_infos[alloc.idx] = program->tmp_mem_strategy()->MakeChunk(ctx, alloc.byte_size);
     }
-
-    chunk_infos.emplace_back(std::move(chunk));
   }
-  return std::make_pair(std::move(chunk_infos), std::move(updates));
 }
 
 }  // namespace
 
 Shim::Shim(const context::Context& ctx, const Program* program,
            std::map<std::string, std::shared_ptr<tile::Buffer>> inputs,
-           std::map<std::string, std::shared_ptr<tile::Buffer>> outputs) {
-  std::tie(chunk_infos_, updates_) = BuildChunkMap(ctx, program, inputs, outputs);
+           std::map<std::string, std::shared_ptr<tile::Buffer>> outputs, bool reuse_outputs,
+           const std::vector<std::shared_ptr<MemChunk>>* tmps) {
+  try {
+    BuildChunkMap(ctx, program, inputs, outputs, reuse_outputs, tmps, &bindings_);
+  } catch (...) {
+    Release();
+    throw;
+  }
+}
+
+Shim::~Shim() { Release(); }
+
+// Ends the run's use of the chunks it reads and the chunks it overwrites in place.
+void Shim::Release() noexcept {
+  for (const auto& chunk : bindings_.read_only_inputs) {
+    chunk->deps()->RemoveUser();
+  }
+  for (const auto& chunk : bindings_.claimed_outputs) {
+    chunk->deps()->Unclaim();
+  }
 }
 
 std::shared_ptr<MemChunk> Shim::LookupAlloc(std::size_t /* sidx */, schedule::Alloc* alloc) const {
-  return chunk_infos_[alloc->idx];
+  return bindings_.chunk_infos[alloc->idx];
 }
 
 void Shim::SetLaunchException(std::exception_ptr ep) const noexcept {
   // Any error in the launch poisons all output buffers.
-  for (const auto& chunk : chunk_infos_) {
+  for (const auto& chunk : bindings_.chunk_infos) {
     chunk->deps()->Poison(ep);
   }
 }
 
 void Shim::OnLaunchSuccess() noexcept {
   // Apply updates to outputs.
-  for (const auto& update : updates_) {
-    update.buffer->RemapTo(std::move(update.chunk));
+  for (const auto& update : bindings_.updates) {
+    if (update.chunk) {
+      update.buffer->RemapTo(std::move(update.chunk));
+    } else {
+      update.buffer->ReleaseChunk();
+    }
   }
 }
 
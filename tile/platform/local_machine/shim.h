@@ -25,23 +25,39 @@ namespace local_machine {
 // program (e.g. dealiasing input and output buffers).
 class Shim {
  public:
+  // An update to apply to a buffer once the program's been launched: the buffer is remapped to the chunk, or if the
+  // chunk is null, drops its current chunk.
   struct AliasUpdate {
     std::shared_ptr<Buffer> buffer;
     std::shared_ptr<MemChunk> chunk;
   };
 
+  // The chunks bound for a run, and the state the run holds on them.
+  struct Bindings {
+    std::vector<std::shared_ptr<MemChunk>> chunk_infos;      // By allocation index
+    std::list<AliasUpdate> updates;                          // Applied on launch success
+    std::vector<std::shared_ptr<MemChunk>> read_only_inputs;  // Marked as in use until the run completes
+    std::vector<std::shared_ptr<MemChunk>> claimed_outputs;   // Claimed until the run completes
+  };
+
   // Construct the Shim.  This should be done at the start of queueing
-  // the program's steps.
+  // the program's steps.  If reuse_outputs is set, an output which isn't also an input is written in place when the
+  // run can claim its buffer's current chunk, instead of being given a fresh chunk.  If tmps is supplied, it holds the
+  // chunks to use for the program's temporaries, by allocation index; otherwise, the shim makes fresh ones.
   Shim(const context::Context& ctx, const Program* program, std::map<std::string, std::shared_ptr<tile::Buffer>> inputs,
-       std::map<std::string, std::shared_ptr<tile::Buffer>> outputs);
+       std::map<std::string, std::shared_ptr<tile::Buffer>> outputs, bool reuse_outputs = false,
+       const std::vector<std::shared_ptr<MemChunk>>* tmps = nullptr);
 
-  // Destroys the Shim.  Note that this does not apply side-effects;
+  // Destroys the Shim, releasing the run's hold on its chunks.  Note that this does not apply side-effects;
   // OnLaunchSuccess must be invoked in order to remap program output buffers.
-  ~Shim() {}
+  ~Shim();
 
   // Translate an input or output for a step.
   std::shared_ptr<MemChunk> LookupAlloc(std::size_t sidx, schedule::Alloc* alloc) const;
 
+  // Translate an allocation by index.
+  const std::shared_ptr<MemChunk>& chunk(std::size_t alloc_idx) const { return bindings_.chunk_infos[alloc_idx]; }
+
   // Handle execution errors.
   void SetLaunchException(std::exception_ptr ep) const noexcept;
 
@@ -50,8 +66,9 @@ class Shim {
   void OnLaunchSuccess() noexcept;
 
  private:
-  std::vector<std::shared_ptr<MemChunk>> chunk_infos_;
-  std::list<AliasUpdate> updates_;
+  void Release() noexcept;
+
+  Bindings bindings_;
 };
 
 }  // namespace local_machine
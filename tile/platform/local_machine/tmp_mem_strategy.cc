@@ -5,11 +5,15 @@
 #include <exception>
 #include <utility>
 
+#include "base/util/perf_counter.h"
+
 namespace vertexai {
 namespace tile {
 namespace local_machine {
 namespace {
 
+PerfCounter tmp_mem_chunks("tmp_mem_chunks");
+
 // A MemChunk implementation that frees its underlying memory to a MemCache when the chunk is deleted.
 class TmpMemChunk final : public MemChunk {
  public:
@@ -51,20 +55,21 @@ std::shared_ptr<hal::Buffer> TmpMemChunk::hal_buffer() { return hal_buffer_; }
 
 }  // namespace
 
-TmpMemStrategy::TmpMemStrategy(const std::shared_ptr<DevInfo>& devinfo, hal::Memory* source)
-    : devinfo_{devinfo}, source_{source}, cache_{std::make_shared<MemCache>()} {
+TmpMemStrategy::TmpMemStrategy(const std::shared_ptr<DevInfo>& devinfo, hal::Memory* source,
+                               std::shared_ptr<MemCache> cache)
+    : devinfo_{devinfo}, source_{source}, cache_{std::move(cache)} {
   if (!source_) {
     throw std::logic_error{"The temporary memory management strategy requires memory"};
   }
+  if (!cache_) {
+    cache_ = std::make_shared<MemCache>(source_, hal::BufferAccessMask::DEVICE_RW,
+                                        MemCacheBudget(devinfo_->settings, source_));
+  }
 }
 
 std::shared_ptr<MemChunk> TmpMemStrategy::MakeChunk(const context::Context& ctx, std::uint64_t size) const {
-  auto hal_buffer = cache_->TryAlloc(size);
-  if (!hal_buffer) {
-    auto buffer = source_->MakeBuffer(size, hal::BufferAccessMask::DEVICE_RW);
-    hal_buffer = buffer;
-  }
-  return std::make_shared<TmpMemChunk>(size, cache_, std::move(hal_buffer));
+  tmp_mem_chunks.inc();
+  return std::make_shared<TmpMemChunk>(size, cache_, cache_->Alloc(size));
 }
 
 }  // namespace local_machine
@@ -21,7 +21,9 @@ namespace local_machine {
 // references as long as the underlying memory is in use.
 class TmpMemStrategy final : public MemStrategy {
  public:
-  TmpMemStrategy(const std::shared_ptr<DevInfo>& devinfo, hal::Memory* source);
+  // Strategies for the same source may share a cache; with none supplied, the strategy makes its own.
+  TmpMemStrategy(const std::shared_ptr<DevInfo>& devinfo, hal::Memory* source,
+                 std::shared_ptr<MemCache> cache = nullptr);
 
   std::shared_ptr<MemChunk> MakeChunk(const context::Context& ctx, std::uint64_t size) const final;
 
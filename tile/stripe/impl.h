@@ -2,11 +2,12 @@
 
 #pragma once
 
-#include <map>
+#include <atomic>
 #include <string>
 
 #include <boost/variant.hpp>
 
+#include "tile/math/symbol.h"
 #include "tile/stripe/stripe.h"
 
 namespace vertexai {
@@ -46,7 +47,26 @@ inline std::ostream& operator<<(std::ostream& os, const AttrValue& value) {
 }
 
 struct Taggable::Impl {
-  std::map<std::string, AttrValue> attrs;
+  Impl() = default;
+  explicit Impl(const math::SymbolMap<AttrValue>& attrs) : attrs(attrs) {}
+
+  // Tags are attributes with Void values.  Keys are interned, and the map is a small sorted vector: most statements
+  // carry only a few attributes, and copying a statement's attributes shouldn't allocate per attribute.
+  math::SymbolMap<AttrValue> attrs;
+
+  // Whether a key is present, by identity rather than by name.  A linear scan beats a binary search over names here.
+  bool contains(const math::Symbol& key) const {
+    for (const auto& attr : attrs) {
+      if (attr.first == key) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Set once a second Taggable refers to these attributes, and never cleared: a shared Impl is never modified, so
+  // Taggables on different threads may share one without locking.
+  std::atomic<bool> shared{false};
 };
 
 struct Accessor {
@@ -2,6 +2,7 @@
 
 #include "tile/stripe/stripe.h"
 
+#include <atomic>
 #include <regex>
 #include <sstream>
 
@@ -239,31 +240,60 @@ class CodecRegistry {
 
 }  // namespace
 
-Taggable::Taggable() : impl_(new Impl()) {}
+ResolvedTags::ResolvedTags(const Tags& tags) : tags(tags.begin(), tags.end()) {}
+
+Taggable::Taggable() {
+  static const std::shared_ptr<Impl> empty = std::make_shared<Impl>();
+  impl_ = Share(empty);
+}
 
 Taggable::~Taggable() = default;
 
-Taggable::Taggable(const Taggable& rhs) { set_attrs(rhs); }
+Taggable::Taggable(const Taggable& rhs) : impl_(Share(rhs.impl_)) {}
 
 Taggable& Taggable::operator=(const Taggable& rhs) {
-  set_attrs(rhs);
+  impl_ = Share(rhs.impl_);
   return *this;
 }
 
-void Taggable::set_tag(const std::string& tag) { impl_->attrs.emplace(tag, Void{}); }
+std::shared_ptr<Taggable::Impl> Taggable::Share(const std::shared_ptr<Impl>& impl) {
+  impl->shared.store(true, std::memory_order_release);
+  return impl;
+}
+
+Taggable::Impl* Taggable::mutable_impl() {
+  if (impl_->shared.load(std::memory_order_acquire)) {
+    impl_ = std::make_shared<Impl>(impl_->attrs);
+  }
+  return impl_.get();
+}
+
+void Taggable::set_tag(const std::string& tag) { mutable_impl()->attrs.emplace(tag, Void{}); }
 
 void Taggable::add_tags(const Tags& to_add) {
+  if (to_add.empty()) {
+    return;
+  }
+  auto impl = mutable_impl();
   for (const auto& tag : to_add) {
-    impl_->attrs.emplace(tag, Void{});
+    impl->attrs.emplace(tag, Void{});
   }
 }
 
-void Taggable::clear_tags() { impl_->attrs.clear(); }
+void Taggable::clear_tags() {
+  if (!impl_->attrs.empty()) {
+    mutable_impl()->attrs.clear();
+  }
+}
 
-void Taggable::remove_tag(const std::string& tag) { impl_->attrs.erase(tag); }
+void Taggable::remove_tag(const std::string& tag) {
+  if (has_attr(tag)) {
+    mutable_impl()->attrs.erase(tag);
+  }
+}
 
 void Taggable::set_tags(const Tags& tags) {
-  impl_->attrs.clear();
+  clear_tags();
   add_tags(tags);
 }
 
@@ -278,6 +308,15 @@ bool Taggable::has_tags(const Tags& to_find) const {
   return true;
 }
 
+bool Taggable::has_tags(const ResolvedTags& to_find) const {
+  for (const auto& tag : to_find.tags) {
+    if (!impl_->contains(tag)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 bool Taggable::has_any_tags(const Tags& to_find) const {
   for (const auto& tag : to_find) {
     if (impl_->attrs.count(tag) == 1) {
@@ -287,37 +326,44 @@ bool Taggable::has_any_tags(const Tags& to_find) const {
   return false;
 }
 
-void Taggable::set_attr(const std::string& name) { impl_->attrs.emplace(name, Void{}); }
+bool Taggable::has_any_tags(const ResolvedTags& to_find) const {
+  for (const auto& tag : to_find.tags) {
+    if (impl_->contains(tag)) {
+      return true;
+    }
+  }
+  return false;
+}
 
-void Taggable::set_attr(const std::string& name, bool value) { impl_->attrs.emplace(name, value); }
+void Taggable::set_attr(const std::string& name) { mutable_impl()->attrs.emplace(name, Void{}); }
 
-void Taggable::set_attr(const std::string& name, int64_t value) { impl_->attrs.emplace(name, value); }
+void Taggable::set_attr(const std::string& name, bool value) { mutable_impl()->attrs.emplace(name, value); }
 
-void Taggable::set_attr(const std::string& name, double value) { impl_->attrs.emplace(name, value); }
+void Taggable::set_attr(const std::string& name, int64_t value) { mutable_impl()->attrs.emplace(name, value); }
 
-void Taggable::set_attr(const std::string& name, const std::string& value) { impl_->attrs.emplace(name, value); }
+void Taggable::set_attr(const std::string& name, double value) { mutable_impl()->attrs.emplace(name, value); }
 
-void Taggable::set_attr(const std::string& name, const Any& value) { impl_->attrs.emplace(name, value); }
+void Taggable::set_attr(const std::string& name, const std::string& value) {
+  mutable_impl()->attrs.emplace(name, value);
+}
+
+void Taggable::set_attr(const std::string& name, const Any& value) { mutable_impl()->attrs.emplace(name, value); }
 
 bool Taggable::has_attr(const std::string& name) const { return impl_->attrs.count(name); }
 
-void Taggable::set_attrs(const Taggable& rhs) {
-  if (this != &rhs) {
-    impl_.reset(new Impl(*rhs.impl_));
-  }
-}
+void Taggable::set_attrs(const Taggable& rhs) { impl_ = Share(rhs.impl_); }
 
-bool Taggable::get_attr_bool(const std::string& name) const { return boost::get<bool>(impl_->attrs[name]); }
+bool Taggable::get_attr_bool(const std::string& name) const { return boost::get<bool>(impl_->attrs.at(name)); }
 
-int64_t Taggable::get_attr_int(const std::string& name) const { return boost::get<int64_t>(impl_->attrs[name]); }
+int64_t Taggable::get_attr_int(const std::string& name) const { return boost::get<int64_t>(impl_->attrs.at(name)); }
 
-double Taggable::get_attr_float(const std::string& name) const { return boost::get<double>(impl_->attrs[name]); }
+double Taggable::get_attr_float(const std::string& name) const { return boost::get<double>(impl_->attrs.at(name)); }
 
 std::string Taggable::get_attr_str(const std::string& name) const {
-  return boost::get<std::string>(impl_->attrs[name]);
+  return boost::get<std::string>(impl_->attrs.at(name));
 }
 
-Any Taggable::get_attr_any(const std::string& name) const { return boost::get<Any>(impl_->attrs[name]); }
+Any Taggable::get_attr_any(const std::string& name) const { return boost::get<Any>(impl_->attrs.at(name)); }
 
 bool Taggable::get_attr_bool(const std::string& name, bool def) const {
   return has_attr(name) ? get_attr_bool(name) : def;
@@ -747,8 +793,9 @@ Location RealizeLocation(const Location& loc, const Block& block) {
     for (auto& unit : dev.units) {
       std::map<std::string, Affine> tag_map;
       for (const auto& name_coeff : unit.getMap()) {
-        if (name_coeff.first.size() && name_coeff.first[0] == '#') {
-          auto tag = name_coeff.first.substr(1);
+        const std::string& name = name_coeff.first;
+        if (name.size() && name[0] == '#') {
+          auto tag = name.substr(1);
           for (const auto& idx : block.idxs) {
             if (idx.has_tag(tag)) {
               tag_map[name_coeff.first] = idx.name;
@@ -844,41 +891,51 @@ Location PartialEval(const Location& loc, const std::map<std::string, std::int64
   return result;
 }
 
-class CloneVisitor : RewriteStmtVisitor {
+// Clones statements with make_shared, so each clone and its reference count share a single allocation.
+class CloneVisitor : ConstStmtVisitor {
  public:
   explicit CloneVisitor(int depth) : depth_(depth) {}
-  Load* Visit(const Load& x) { return new Load(x); }
-  Store* Visit(const Store& x) { return new Store(x); }
-  LoadIndex* Visit(const LoadIndex& x) { return new LoadIndex(x); }
-  Constant* Visit(const Constant& x) { return new Constant(x); }
-  Special* Visit(const Special& x) { return new Special(x); }
-  Intrinsic* Visit(const Intrinsic& x) { return new Intrinsic(x); }
-  Block* Visit(const Block& x) {
-    auto ret = new Block(x);
+
+  std::shared_ptr<Statement> Clone(const Statement& stmt) {
+    stmt.Accept(this);
+    return std::move(clone_);
+  }
+
+  std::shared_ptr<Block> CloneBlock(const Block& x) {
+    auto ret = std::make_shared<Block>(x);
     if (depth_ == 0) {
       return ret;
     }
     depth_--;
     std::unordered_map<Statement*, StatementIt> dep_map;  // src-block ptr -> clone-block StatementIt
     for (StatementIt sit = ret->stmts.begin(); sit != ret->stmts.end(); ++sit) {
-      Statement* clone = (*sit)->Accept(this);
+      auto clone = Clone(**sit);
       for (auto& dit : clone->deps) {
         dit = dep_map.at(dit->get());
       }
       dep_map[sit->get()] = sit;
-      sit->reset(clone);
+      *sit = std::move(clone);
     }
     depth_++;
     return ret;
   }
 
+  void Visit(const Load& x) { clone_ = std::make_shared<Load>(x); }
+  void Visit(const Store& x) { clone_ = std::make_shared<Store>(x); }
+  void Visit(const LoadIndex& x) { clone_ = std::make_shared<LoadIndex>(x); }
+  void Visit(const Constant& x) { clone_ = std::make_shared<Constant>(x); }
+  void Visit(const Special& x) { clone_ = std::make_shared<Special>(x); }
+  void Visit(const Intrinsic& x) { clone_ = std::make_shared<Intrinsic>(x); }
+  void Visit(const Block& x) { clone_ = CloneBlock(x); }
+
  private:
   int depth_;
+  std::shared_ptr<Statement> clone_;
 };
 
 std::shared_ptr<Block> CloneBlock(const Block& orig, int depth) {
   CloneVisitor visitor(depth);
-  return std::shared_ptr<Block>(visitor.Visit(orig));
+  return visitor.CloneBlock(orig);
 }
 
 const Index* Block::idx_by_name(const std::string& name) const {
@@ -15,6 +15,7 @@
 
 #include "tile/base/shape.h"
 #include "tile/math/polynomial.h"
+#include "tile/math/symbol.h"
 #include "tile/stripe/stripe.pb.h"
 
 namespace vertexai {
@@ -78,6 +79,15 @@ using StatementIt = StatementList::iterator;
 
 using Tags = std::set<std::string>;
 
+// A set of tags interned up front.  Passes that test many blocks against the same tags resolve them once, so each
+// test compares interned symbols instead of strings.
+struct ResolvedTags {
+  ResolvedTags() = default;
+  ResolvedTags(const Tags& tags);  // NOLINT
+
+  std::vector<math::Symbol> tags;
+};
+
 // Generic properties used by optimization passes
 class Taggable {
   friend struct Accessor;
@@ -102,7 +112,9 @@ class Taggable {
 
   bool has_tag(const std::string& tag) const;
   bool has_tags(const Tags& to_find) const;
+  bool has_tags(const ResolvedTags& to_find) const;
   bool has_any_tags(const Tags& to_find) const;
+  bool has_any_tags(const ResolvedTags& to_find) const;
 
   void set_attr(const std::string& name);
   void set_attr(const std::string& name, bool value);
@@ -126,7 +138,15 @@ class Taggable {
 
  private:
   struct Impl;
-  std::unique_ptr<Impl> impl_;
+
+  // Copies share their attributes until one of them changes them, so cloning IR doesn't copy every index's and
+  // refinement's attributes, and untagged objects (e.g. the keys used by ref_by_into) don't allocate at all.
+  // Attributes are marked when first shared and copied before any change from then on; whether other references
+  // remain isn't consulted, since a use count can't be read reliably while other threads copy and drop them.
+  static std::shared_ptr<Impl> Share(const std::shared_ptr<Impl>& impl);
+  Impl* mutable_impl();
+
+  std::shared_ptr<Impl> impl_;
 };
 
 class Codec {
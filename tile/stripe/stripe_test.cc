@@ -3,6 +3,9 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <thread>
+#include <vector>
+
 #include "tile/stripe/stripe.h"
 
 using ::testing::Combine;
@@ -93,6 +96,86 @@ TEST_P(StripeLocThrowTest, ParserThrows) {
 INSTANTIATE_TEST_CASE_P(InvalidPatterns, StripeLocThrowTest,
                         Values("foo[1, *  ]qux/bar", "foo[1, florp ]/bar", "foo[1, 2* ]/bar"));
 
+TEST(StripeTagsTest, ResolvedTagsMatchLikeTags) {
+  Block block;
+  block.set_tags({"contraction", "kernel"});
+  block.set_attr("threads", int64_t{4});
+
+  EXPECT_THAT(block.has_tags(ResolvedTags{{"kernel"}}), Eq(true));
+  EXPECT_THAT(block.has_tags(ResolvedTags{{"kernel", "contraction"}}), Eq(true));
+  EXPECT_THAT(block.has_tags(ResolvedTags{{"kernel", "eltwise"}}), Eq(false));
+  EXPECT_THAT(block.has_tags(ResolvedTags{}), Eq(true));
+  EXPECT_THAT(block.has_any_tags(ResolvedTags{{"eltwise", "threads"}}), Eq(true));
+  EXPECT_THAT(block.has_any_tags(ResolvedTags{{"eltwise"}}), Eq(false));
+
+  block.remove_tag("kernel");
+  EXPECT_THAT(block.has_tags(ResolvedTags{{"kernel"}}), Eq(false));
+  EXPECT_THAT(block.get_attr_int("threads"), Eq(4));
+}
+
+TEST(StripeTagsTest, CopiesDontSeeEachOthersChanges) {
+  Block orig;
+  orig.set_tag("kernel");
+  Block copy = orig;
+  copy.set_tag("eltwise");
+  orig.remove_tag("kernel");
+
+  EXPECT_THAT(orig.has_tag("kernel"), Eq(false));
+  EXPECT_THAT(orig.has_tag("eltwise"), Eq(false));
+  EXPECT_THAT(copy.has_tags({"kernel", "eltwise"}), Eq(true));
+}
+
+TEST(StripeTagsTest, CopiesChangeIndependentlyOnDifferentThreads) {
+  Block orig;
+  orig.set_tag("kernel");
+  std::vector<Block> copies(8, orig);
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < copies.size(); ++i) {
+    threads.emplace_back([&copies, i]() {
+      for (int64_t n = 0; n < 1000; ++n) {
+        // Copy and drop the attributes while the other threads change theirs.
+        Block scratch = copies[i];
+        copies[i].remove_tag("n");
+        copies[i].set_attr("n", n);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (const auto& copy : copies) {
+    EXPECT_THAT(copy.has_tag("kernel"), Eq(true));
+    EXPECT_THAT(copy.get_attr_int("n"), Eq(999));
+  }
+  EXPECT_THAT(orig.has_attr("n"), Eq(false));
+}
+
+TEST(StripeCloneTest, ClonesNestedBlocksAndDeps) {
+  auto inner = std::make_shared<Block>();
+  inner->name = "inner";
+  inner->set_tag("kernel");
+  inner->stmts.emplace_back(std::make_shared<Load>("A", "$a"));
+  auto store = std::make_shared<Store>("$a", "B");
+  store->deps.push_back(inner->stmts.begin());
+  inner->stmts.emplace_back(store);
+  Block outer;
+  outer.stmts.emplace_back(inner);
+
+  auto clone = CloneBlock(outer);
+  auto inner_clone = clone->SubBlock(0);
+  ASSERT_THAT(inner_clone.get(), Ne(inner.get()));
+  EXPECT_THAT(inner_clone->name, Eq("inner"));
+  EXPECT_THAT(inner_clone->has_tag("kernel"), Eq(true));
+  ASSERT_THAT(inner_clone->stmts.size(), Eq(2));
+  EXPECT_THAT(inner_clone->stmts.front().get(), Ne(inner->stmts.front().get()));
+  const auto& deps = inner_clone->stmts.back()->deps;
+  ASSERT_THAT(deps.size(), Eq(1));
+  EXPECT_THAT(deps.front()->get(), Eq(inner_clone->stmts.front().get()));
+
+  inner_clone->set_tag("eltwise");
+  EXPECT_THAT(inner->has_tag("eltwise"), Eq(false));
+}
+
 }  // namespace
 }  // namespace stripe
 }  // namespace tile
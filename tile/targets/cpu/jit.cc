@@ -2,24 +2,34 @@
 
 #include "tile/targets/cpu/jit.h"
 
+#include <llvm/ADT/StringMap.h>
 #include <llvm/Bitcode/BitcodeWriter.h>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Intrinsics.h>
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/IR/Module.h>
 #include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/Host.h>
 #include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Transforms/IPO/PassManagerBuilder.h>
 #include <llvm/Transforms/Utils/Cloning.h>
 
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <deque>
 #include <memory>
+#include <numeric>
+#include <set>
 
 #include <half.hpp>
 
 #include "base/util/lookup.h"
 #include "tile/stripe/stripe.h"
+#include "tile/targets/cpu/microkernel.h"
+#include "tile/targets/cpu/thread_pool.h"
+#include "tile/util/object_cache.h"
 
 namespace vertexai {
 namespace tile {
@@ -28,18 +38,84 @@ namespace cpu {
 
 namespace {
 const char invoker_name_[] = "__invoke_";
+const char thread_tag_[] = "cpu_thread";
+const char vector_tag_[] = "vectorize";
+const char microkernel_tag_[] = "mac_inner";
+
+// The width of the widest SIMD registers the host supports, in bits.
+unsigned HostVectorBits() {
+  static unsigned bits = []() {
+    llvm::StringMap<bool> features;
+    if (llvm::sys::getHostCPUFeatures(features)) {
+      if (features.lookup("avx512f")) {
+        return 512u;
+      }
+      if (features.lookup("avx")) {
+        return 256u;
+      }
+    }
+    return 128u;
+  }();
+  return bits;
+}
+
+// The host's CPU features, as target attributes for code generation.
+std::vector<std::string> HostAttrs() {
+  std::vector<std::string> attrs;
+  llvm::StringMap<bool> features;
+  if (llvm::sys::getHostCPUFeatures(features)) {
+    for (const auto& feature : features) {
+      attrs.push_back((feature.getValue() ? "+" : "-") + feature.getKey().str());
+    }
+  }
+  return attrs;
+}
+
+// Whether a tensor is laid out densely in row-major order, so that any
+// trailing group of dimensions forms one contiguous run of elements.
+bool IsPacked(const TensorShape& shape) {
+  int64_t stride = 1;
+  for (auto it = shape.dims.rbegin(); it != shape.dims.rend(); ++it) {
+    if (it->size != 1 && it->stride != stride) {
+      return false;
+    }
+    stride *= it->size;
+  }
+  return true;
 }
 
+// Whether a tensor element type may be used to select gather/scatter rows.
+bool IsIndexType(DataType type) { return is_int(type) || is_uint(type) || is_float(type); }
+
+// Whether an access depends on the named index and on no other, so that
+// each value of the index selects a different element along it.
+bool IsolatesIndex(const stripe::Affine& access, const std::string& name) {
+  bool found = false;
+  for (const auto& term : access.getMap()) {
+    if (term.first == name) {
+      found = true;
+    } else if (!term.first.empty()) {
+      return false;
+    }
+  }
+  return found;
+}
+}  // namespace
+
 struct ProgramModule {
   std::unique_ptr<llvm::Module> module;
   std::vector<std::string> parameters;
   std::map<std::string, void*> externals;
+  // With a persistent object cache configured, the key of the module's object,
+  // and the object itself if some earlier process has already compiled it.
+  std::string object_key;
+  std::shared_ptr<llvm::MemoryBuffer> object;
 };
 
 class Executable {
  public:
   explicit Executable(const ProgramModule& module);
-  void Run(const std::map<std::string, void*>& buffers);
+  void Run(const std::map<std::string, void*>& buffers, ThreadPool* pool = nullptr);
   void Save(const std::string& filename);
 
  private:
@@ -71,6 +147,8 @@ class Compiler : private stripe::ConstStmtVisitor {
   explicit Compiler(llvm::LLVMContext* context, llvm::Module* module, const std::map<std::string, External>& externals);
   void GenerateInvoker(const stripe::Block& program, llvm::Function* main);
   llvm::Function* CompileBlock(const stripe::Block& block);
+  llvm::Function* CompileThreadWorker(const stripe::Block& block, llvm::Function* function,
+                                      llvm::StructType* context_type, size_t* scratch_bytes);
   void Visit(const stripe::Load&) override;
   void Visit(const stripe::Store&) override;
   void Visit(const stripe::LoadIndex&) override;
@@ -108,6 +186,9 @@ class Compiler : private stripe::ConstStmtVisitor {
   void Copy(const stripe::Special&);
   void Reshape(const stripe::Special&);
   void PrngStep(const stripe::Special&);
+  void Gather(const stripe::Special&);
+  void Scatter(const stripe::Special&);
+  void Shape(const stripe::Special&);
 
   struct Scalar {
     llvm::Value* value = nullptr;
@@ -132,6 +213,19 @@ class Compiler : private stripe::ConstStmtVisitor {
     llvm::BasicBlock* done = nullptr;
   };
 
+  // A multiply-accumulate block which can be computed by a GEMM microkernel:
+  // c += a * b over the m, n, and k indexes (m and k may be absent). Any other
+  // indexes are looped over around the microkernel call.
+  struct GemmMatch {
+    const Microkernel* kernel = nullptr;
+    const stripe::Refinement* c = nullptr;
+    const stripe::Refinement* a = nullptr;
+    const stripe::Refinement* b = nullptr;
+    std::string m;
+    std::string n;
+    std::string k;
+  };
+
  private:
   Scalar Cast(Scalar, DataType);
   Scalar CheckBool(Scalar);
@@ -140,7 +234,18 @@ class Compiler : private stripe::ConstStmtVisitor {
   llvm::Value* Eval(const stripe::Affine& access);
   void OutputType(llvm::Value* ret, const stripe::Intrinsic&);
   void OutputBool(llvm::Value* ret, const stripe::Intrinsic&);
-  void CallIntrinsicFunc(const stripe::Intrinsic&, const char* name_f32, const char* name_f64);
+  void CallIntrinsicFunc(const stripe::Intrinsic&, const char* name_f32, const char* name_f64,
+                         llvm::Intrinsic::ID vector_id);
+  llvm::Value* Aggregate(const std::string& agg_op, DataType type, llvm::Value* prev, llvm::Value* value);
+  unsigned VectorWidth(const stripe::Block&);
+  llvm::Value* Splat(llvm::Value* value);
+  llvm::Value* LaneOffsets(const stripe::Affine& access);
+  Scalar VectorLoad(const Buffer& buf);
+  void VectorStore(const Buffer& buf, Scalar value);
+  llvm::Value* AggIdentity(const std::string& agg_op, DataType type);
+  llvm::Value* ReduceLanes(llvm::Value* value, const std::string& agg_op, DataType type);
+  GemmMatch MatchGemm(const stripe::Block&);
+  void CallGemm(const stripe::Block&);
   llvm::Type* IndexType();
   llvm::Value* IndexConst(ssize_t val);
   llvm::FunctionType* BlockType(const stripe::Block&);
@@ -148,6 +253,11 @@ class Compiler : private stripe::ConstStmtVisitor {
   llvm::Value* CallocFunction();
   llvm::Value* FreeFunction();
   llvm::Value* PrngStepFunction();
+  llvm::Value* PhiloxStepFunction();
+  llvm::Value* GatherFunction();
+  llvm::Value* ScatterFunction();
+  llvm::Value* GemmFunction(const char* symbol);
+  llvm::Value* ParallelForFunction();
 
   llvm::LLVMContext& context_;
   llvm::IRBuilder<> builder_;
@@ -158,6 +268,18 @@ class Compiler : private stripe::ConstStmtVisitor {
   std::map<std::string, Scalar> scalars_;
   std::map<std::string, Buffer> buffers_;
   std::map<std::string, Index> indexes_;
+
+  // When the innermost index is vectorized, each iteration of its loop covers
+  // vector_width_ consecutive index values, one per lane; scalars become
+  // vectors and lane_mask_ marks the lanes which are in range and satisfy
+  // the block's constraints. vector_width_ is zero for scalar code.
+  unsigned vector_width_ = 0;
+  std::string vector_idx_;
+  llvm::Value* lanes_ = nullptr;
+  llvm::Value* lane_mask_ = nullptr;
+
+  // Set when the block's body is replaced by a microkernel call.
+  GemmMatch gemm_;
 };
 
 Compiler::Compiler(llvm::LLVMContext* context, const std::map<std::string, External>& externals)
@@ -182,25 +304,34 @@ ProgramModule Compiler::CompileProgram(const stripe::Block& program) {
   // Generate a stub function we can invoke from the outside, passing buffers
   // as an array of generic pointers.
   GenerateInvoker(program, main);
-  // Improve the simple-minded IR we've just generated by running module-level
-  // optimization passes; among many other things, this will streamline our
-  // loops to eliminate most branches and inline most block function calls.
-  llvm::PassManagerBuilder pmb;
-  pmb.OptLevel = 3;
-  pmb.SizeLevel = 0;
-  pmb.SLPVectorize = true;
-  pmb.LoopVectorize = true;
-  pmb.MergeFunctions = true;
-  llvm::legacy::PassManager modopt;
-  pmb.populateModulePassManager(modopt);
-  if (VLOG_IS_ON(4)) {
-    IVLOG(4, "\n============================================================\n");
-    module_->print(llvm::errs(), nullptr);
-  }
-  modopt.run(*module_);
-  if (VLOG_IS_ON(4)) {
-    IVLOG(4, "\n============================================================\n");
-    module_->print(llvm::errs(), nullptr);
+  // The object cache keys the module on its unoptimized IR, so that on a hit
+  // neither the optimization passes nor codegen need to run.
+  auto cache = tile::util::ObjectCache::Instance();
+  if (cache) {
+    ret.object_key = cache->Key(*module_);
+    ret.object = cache->Load(ret.object_key);
+  }
+  if (!ret.object) {
+    // Improve the simple-minded IR we've just generated by running module-level
+    // optimization passes; among many other things, this will streamline our
+    // loops to eliminate most branches and inline most block function calls.
+    llvm::PassManagerBuilder pmb;
+    pmb.OptLevel = 3;
+    pmb.SizeLevel = 0;
+    pmb.SLPVectorize = true;
+    pmb.LoopVectorize = true;
+    pmb.MergeFunctions = true;
+    llvm::legacy::PassManager modopt;
+    pmb.populateModulePassManager(modopt);
+    if (VLOG_IS_ON(4)) {
+      IVLOG(4, "\n============================================================\n");
+      module_->print(llvm::errs(), nullptr);
+    }
+    modopt.run(*module_);
+    if (VLOG_IS_ON(4)) {
+      IVLOG(4, "\n============================================================\n");
+      module_->print(llvm::errs(), nullptr);
+    }
   }
   // Wrap the finished module and the parameter names into a ProgramModule.
   for (auto& ref : program.refs) {
@@ -258,6 +389,10 @@ void Compiler::GenerateInvoker(const stripe::Block& program, llvm::Function* mai
   for (unsigned i = 0; i < program.idxs.size(); ++i) {
     args.push_back(IndexConst(0));
   }
+  size_t threaded_idx = ThreadedIndex(program);
+  if (threaded_idx < program.idxs.size()) {
+    args.push_back(IndexConst(program.idxs[threaded_idx].range));
+  }
   // Having built the argument list, we'll call the actual kernel using the
   // parameter signature it expects.
   builder_.CreateCall(main, args, "");
@@ -275,6 +410,16 @@ llvm::Function* Compiler::CompileBlock(const stripe::Block& block) {
   for (const auto& idx : block.idxs) {
     indexes_[idx.name] = Index{&idx};
   }
+  gemm_ = MatchGemm(block);
+  vector_width_ = gemm_.kernel ? 0 : VectorWidth(block);
+  if (vector_width_) {
+    vector_idx_ = block.idxs.back().name;
+    std::vector<llvm::Constant*> lanes;
+    for (unsigned i = 0; i < vector_width_; ++i) {
+      lanes.push_back(llvm::ConstantInt::get(IndexType(), i));
+    }
+    lanes_ = llvm::ConstantVector::get(lanes);
+  }
 
   // create the LLVM function which will implement the Stripe block
   auto linkage = llvm::Function::ExternalLinkage;
@@ -286,6 +431,7 @@ llvm::Function* Compiler::CompileBlock(const stripe::Block& block) {
   builder_.SetInsertPoint(bb);
 
   // associate parameter values with buffers and indexes
+  llvm::Value* outer_range = nullptr;
   for (auto ai = function->arg_begin(); ai != function->arg_end(); ++ai) {
     unsigned idx = ai->getArgNo();
     if (idx < block.refs.size()) {
@@ -295,12 +441,17 @@ llvm::Function* Compiler::CompileBlock(const stripe::Block& block) {
       ai->setName(param_name);
       assert(nullptr == buffers_[param_name].base);
       buffers_[param_name].base = &(*ai);
-    } else {
+    } else if (idx < block.refs.size() + block.idxs.size()) {
       idx -= block.refs.size();
       std::string param_name = block.idxs[idx].name;
       ai->setName(param_name);
       assert(nullptr == indexes_[param_name].init);
       indexes_[param_name].init = &(*ai);
+    } else {
+      // A threaded block runs only part of its threaded index per call, so
+      // the caller supplies the length of that part.
+      ai->setName("__range");
+      outer_range = &(*ai);
     }
   }
 
@@ -324,6 +475,8 @@ llvm::Function* Compiler::CompileBlock(const stripe::Block& block) {
   }
 
   // initialize each loop index and generate the termination check
+  size_t threaded_idx = ThreadedIndex(block);
+  std::vector<llvm::Value*> limits;
   for (size_t i = 0; i < block.idxs.size(); ++i) {
     builder_.CreateBr(loops[i].init);
     builder_.SetInsertPoint(loops[i].init);
@@ -334,8 +487,14 @@ llvm::Function* Compiler::CompileBlock(const stripe::Block& block) {
     builder_.SetInsertPoint(loops[i].test);
     llvm::Value* index = builder_.CreateLoad(variable);
     assert(block.idxs[i].affine == Affine());
-    llvm::Value* range = IndexConst(block.idxs[i].range);
+    llvm::Value* range = (i == threaded_idx && outer_range) ? outer_range : IndexConst(block.idxs[i].range);
+    const auto& name = block.idxs[i].name;
+    if (gemm_.kernel && (name == gemm_.m || name == gemm_.n || name == gemm_.k)) {
+      // The microkernel covers this index's full range in a single call.
+      range = IndexConst(1);
+    }
     llvm::Value* limit = builder_.CreateAdd(init, range);
+    limits.push_back(limit);
     llvm::Value* go = builder_.CreateICmpULT(index, limit);
     builder_.CreateCondBr(go, loops[i].body, loops[i].done);
     builder_.SetInsertPoint(loops[i].body);
@@ -344,10 +503,25 @@ llvm::Function* Compiler::CompileBlock(const stripe::Block& block) {
   // check the constraints against the current index values and decide whether
   // to execute the block body for this iteration
   llvm::Value* go = builder_.getTrue();
-  for (auto& constraint : block.constraints) {
-    llvm::Value* gateval = Eval(constraint);
-    llvm::Value* check = builder_.CreateICmpSGE(gateval, IndexConst(0));
-    go = builder_.CreateAnd(check, go);
+  if (vector_width_) {
+    // Lanes past the end of the vectorized index's range are masked off, as
+    // are lanes which fail a constraint; the body runs if any lane is left.
+    llvm::Value* index = builder_.CreateLoad(indexes_[vector_idx_].variable);
+    llvm::Value* remaining = builder_.CreateSub(limits.back(), index);
+    lane_mask_ = builder_.CreateICmpSLT(lanes_, Splat(remaining));
+    for (auto& constraint : block.constraints) {
+      llvm::Value* gateval = LaneOffsets(constraint);
+      llvm::Value* check = builder_.CreateICmpSGE(gateval, Splat(IndexConst(0)));
+      lane_mask_ = builder_.CreateAnd(check, lane_mask_);
+    }
+    llvm::Value* bits = builder_.CreateBitCast(lane_mask_, builder_.getIntNTy(vector_width_));
+    go = builder_.CreateICmpNE(bits, llvm::ConstantInt::get(bits->getType(), 0));
+  } else {
+    for (auto& constraint : block.constraints) {
+      llvm::Value* gateval = Eval(constraint);
+      llvm::Value* check = builder_.CreateICmpSGE(gateval, IndexConst(0));
+      go = builder_.CreateAnd(check, go);
+    }
   }
   auto block_body = llvm::BasicBlock::Create(context_, "block", function);
   auto block_done = llvm::BasicBlock::Create(context_, "next", function);
@@ -356,8 +530,12 @@ llvm::Function* Compiler::CompileBlock(const stripe::Block& block) {
 
   // process each statement in the block body, generating code to modify the
   // parameter buffer contents
-  for (const auto& stmt : block.stmts) {
-    stmt->Accept(this);
+  if (gemm_.kernel) {
+    CallGemm(block);
+  } else {
+    for (const auto& stmt : block.stmts) {
+      stmt->Accept(this);
+    }
   }
 
   // rejoin instruction flow after the constraint check
@@ -368,7 +546,8 @@ llvm::Function* Compiler::CompileBlock(const stripe::Block& block) {
   for (size_t i = block.idxs.size(); i-- > 0;) {
     llvm::Value* variable = indexes_[block.idxs[i].name].variable;
     llvm::Value* index = builder_.CreateLoad(variable);
-    llvm::Value* increment = IndexConst(1);
+    bool vectorized = vector_width_ && i + 1 == block.idxs.size();
+    llvm::Value* increment = IndexConst(vectorized ? vector_width_ : 1);
     index = builder_.CreateAdd(index, increment);
     builder_.CreateStore(index, variable);
     builder_.CreateBr(loops[i].test);
@@ -383,6 +562,10 @@ void Compiler::Visit(const stripe::Load& load) {
   // op->from is the name of a source buffer
   // op->into is the name of a destination scalar
   Buffer from = buffers_[load.from];
+  if (vector_width_) {
+    scalars_[load.into] = VectorLoad(from);
+    return;
+  }
   // Look up the address of the target element.
   // Load the value from that address and use it to redefine the
   // destination scalar.
@@ -402,50 +585,57 @@ void Compiler::Visit(const stripe::Store& store) {
   // use the specified aggregation to store the value
   Buffer into = buffers_[store.into];
   Scalar from = Cast(scalars_[store.from], into.refinement->interior_shape.type);
+  if (vector_width_) {
+    VectorStore(into, from);
+    return;
+  }
   llvm::Value* value = from.value;
   llvm::Value* element = ElementPtr(into);
   std::string agg_op = into.refinement->agg_op;
-  if ("add" == agg_op) {
+  if (!agg_op.empty() && "assign" != agg_op) {
     llvm::Value* prev = builder_.CreateLoad(element);
-    if (is_float(from.type)) {
-      value = builder_.CreateFAdd(value, prev);
-    } else if (is_int(from.type) || is_uint(from.type)) {
-      value = builder_.CreateAdd(value, prev);
-    } else {
-      throw Error("Invalid addition type: " + to_string(from.type));
+    value = Aggregate(agg_op, from.type, prev, value);
+  }
+  builder_.CreateStore(value, element);
+}
+
+llvm::Value* Compiler::Aggregate(const std::string& agg_op, DataType type, llvm::Value* prev, llvm::Value* value) {
+  // Combine a new value with the previous contents of an aggregated element;
+  // this works equally on scalars and on vectors of lanes.
+  if ("add" == agg_op) {
+    if (is_float(type)) {
+      return builder_.CreateFAdd(value, prev);
+    } else if (is_int(type) || is_uint(type)) {
+      return builder_.CreateAdd(value, prev);
     }
+    throw Error("Invalid addition type: " + to_string(type));
   } else if ("mul" == agg_op) {
-    llvm::Value* prev = builder_.CreateLoad(element);
-    if (is_float(from.type)) {
-      value = builder_.CreateFMul(value, prev);
-    } else if (is_int(from.type) || is_uint(from.type)) {
-      value = builder_.CreateMul(value, prev);
-    } else {
-      throw Error("Invalid multiplication type: " + to_string(from.type));
+    if (is_float(type)) {
+      return builder_.CreateFMul(value, prev);
+    } else if (is_int(type) || is_uint(type)) {
+      return builder_.CreateMul(value, prev);
     }
+    throw Error("Invalid multiplication type: " + to_string(type));
   } else if ("max" == agg_op) {
-    llvm::Value* prev = builder_.CreateLoad(element);
     llvm::Value* flag = nullptr;
-    if (is_float(from.type)) {
+    if (is_float(type)) {
       flag = builder_.CreateFCmpUGT(prev, value);
-    } else if (is_int(from.type)) {
+    } else if (is_int(type)) {
       flag = builder_.CreateICmpSGT(prev, value);
-    } else if (is_uint(from.type)) {
+    } else if (is_uint(type)) {
       flag = builder_.CreateICmpUGT(prev, value);
     }
-    value = builder_.CreateSelect(flag, prev, value);
-  } else if ("assign" == agg_op) {
-    // fall through to assignment
-  } else if (!agg_op.empty()) {
-    throw Error("Unimplemented agg_op: " + to_string(agg_op));
+    return builder_.CreateSelect(flag, prev, value);
+  } else if ("assign" == agg_op || agg_op.empty()) {
+    return value;
   }
-  builder_.CreateStore(value, element);
+  throw Error("Unimplemented agg_op: " + to_string(agg_op));
 }
 
 void Compiler::Visit(const stripe::LoadIndex& load_index) {
   // op->from is an affine
   // op->into is the name of a destination scalar
-  llvm::Value* rval = Eval(load_index.from);
+  llvm::Value* rval = vector_width_ ? LaneOffsets(load_index.from) : Eval(load_index.from);
   scalars_[load_index.into] = Scalar{rval, DataType::INT64};
 }
 
@@ -463,6 +653,9 @@ void Compiler::Visit(const stripe::Constant& constant) {
       scalars_[constant.name] = Scalar{value, DataType::FLOAT64};
     } break;
   }
+  if (vector_width_) {
+    scalars_[constant.name].value = Splat(scalars_[constant.name].value);
+  }
 }
 
 void Compiler::Visit(const stripe::Special& special) {
@@ -474,6 +667,9 @@ void Compiler::Visit(const stripe::Special& special) {
       {"copy", &Compiler::Copy},
       {"reshape", &Compiler::Reshape},
       {"prng_step", &Compiler::PrngStep},
+      {"gather", &Compiler::Gather},
+      {"scatter", &Compiler::Scatter},
+      {"shape", &Compiler::Shape},
   };
   auto it = handlers.find(special.name);
   if (it == handlers.end()) {
@@ -554,11 +750,17 @@ void Compiler::Visit(const stripe::Block& block) {
   // a new buffer for the nested block's use.
   std::vector<llvm::Value*> args;
   std::vector<llvm::Value*> allocs;
+  size_t threaded_idx = ThreadedIndex(block);
+  bool threaded = threaded_idx < block.idxs.size();
   for (auto& ref : block.refs) {
     llvm::Value* buffer = nullptr;
     // When a refinement is neither in nor out, and it has no "from"
     // name, it represents a local allocation.
-    if (ref.dir == stripe::RefDir::None && ref.from.empty()) {
+    if (ref.dir == stripe::RefDir::None && ref.from.empty() && threaded) {
+      // Threads must not share scratch buffers, so the runtime gives each
+      // participant its own; see CompileThreadWorker.
+      buffer = llvm::ConstantPointerNull::get(CType(ref.interior_shape.type)->getPointerTo());
+    } else if (ref.dir == stripe::RefDir::None && ref.from.empty()) {
       // Allocate new storage for the buffer.
       size_t size = ref.interior_shape.byte_size();
       std::vector<llvm::Value*> calloc_args;
@@ -584,8 +786,36 @@ void Compiler::Visit(const stripe::Block& block) {
   for (auto& idx : block.idxs) {
     args.push_back(Eval(idx.affine));
   }
-  // Invoke the function. It does not return a value.
-  builder_.CreateCall(function, args, "");
+  if (threaded) {
+    // Package the arguments into a context structure on the stack and let
+    // the runtime split the threaded index across the thread pool; each
+    // worker call unpacks the context and runs its share of the iterations.
+    std::vector<llvm::Type*> context_fields;
+    for (auto arg : args) {
+      context_fields.push_back(arg->getType());
+    }
+    auto context_type = llvm::StructType::get(context_, context_fields);
+    // Allocate the context in the entry block so that it is not pushed onto
+    // the stack again on every iteration of the enclosing loops.
+    auto& entry = builder_.GetInsertBlock()->getParent()->getEntryBlock();
+    llvm::IRBuilder<> entry_builder(&entry, entry.begin());
+    llvm::Value* context = entry_builder.CreateAlloca(context_type);
+    for (unsigned i = 0; i < args.size(); ++i) {
+      builder_.CreateStore(args[i], builder_.CreateStructGEP(context_type, context, i));
+    }
+    size_t scratch_bytes = 0;
+    auto worker = CompileThreadWorker(block, function, context_type, &scratch_bytes);
+    std::vector<llvm::Value*> pfor_args{
+        builder_.CreateBitCast(worker, builder_.getInt8PtrTy()),
+        builder_.CreateBitCast(context, builder_.getInt8PtrTy()),
+        IndexConst(block.idxs[threaded_idx].range),
+        IndexConst(scratch_bytes),
+    };
+    builder_.CreateCall(ParallelForFunction(), pfor_args, "");
+  } else {
+    // Invoke the function. It does not return a value.
+    builder_.CreateCall(function, args, "");
+  }
   // Free the temporary buffers we allocated as parameter values.
   for (auto ptr : allocs) {
     std::vector<llvm::Value*> free_args;
@@ -595,6 +825,52 @@ void Compiler::Visit(const stripe::Block& block) {
   }
 }
 
+llvm::Function* Compiler::CompileThreadWorker(const stripe::Block& block, llvm::Function* function,
+                                              llvm::StructType* context_type, size_t* scratch_bytes) {
+  // Generate the function the runtime will call for each subrange, with the
+  // signature void(i8* context, i8* scratch, index begin, index end). It
+  // offsets the threaded index by begin and limits it to end - begin
+  // iterations. The runtime allocates one zeroed scratch area of
+  // *scratch_bytes per participating thread and passes it to every subrange
+  // that thread runs, the way a serial call would share one allocation
+  // across all of its iterations; the block's local buffers are carved from
+  // it.
+  llvm::Type* voidtype = builder_.getVoidTy();
+  auto worker_type = llvm::FunctionType::get(
+      voidtype, {builder_.getInt8PtrTy(), builder_.getInt8PtrTy(), IndexType(), IndexType()}, false);
+  auto linkage = llvm::Function::InternalLinkage;
+  auto worker = llvm::Function::Create(worker_type, linkage, function->getName() + "_worker", module_);
+  llvm::IRBuilder<> builder(llvm::BasicBlock::Create(context_, "entry", worker));
+  auto ai = worker->arg_begin();
+  llvm::Value* context = builder.CreateBitCast(&(*ai++), context_type->getPointerTo());
+  llvm::Value* scratch = &(*ai++);
+  llvm::Value* begin = &(*ai++);
+  llvm::Value* end = &(*ai++);
+  std::vector<llvm::Value*> args;
+  for (unsigned i = 0; i < context_type->getNumElements(); ++i) {
+    args.push_back(builder.CreateLoad(builder.CreateStructGEP(context_type, context, i)));
+  }
+  // Each buffer is as aligned as the calloc it used to get of its own.
+  const size_t scratch_align = 16;
+  *scratch_bytes = 0;
+  size_t i = 0;
+  for (const auto& ref : block.refs) {
+    if (ref.dir == stripe::RefDir::None && ref.from.empty()) {
+      llvm::Value* buffer = builder.CreateConstGEP1_64(scratch, *scratch_bytes);
+      args[i] = builder.CreateBitCast(buffer, CType(ref.interior_shape.type)->getPointerTo());
+      size_t size = ref.interior_shape.byte_size();
+      *scratch_bytes += (size + scratch_align - 1) / scratch_align * scratch_align;
+    }
+    ++i;
+  }
+  size_t threaded = block.refs.size() + ThreadedIndex(block);
+  args[threaded] = builder.CreateAdd(args[threaded], begin);
+  args.push_back(builder.CreateSub(end, begin));
+  builder.CreateCall(function, args, "");
+  builder.CreateRetVoid();
+  return worker;
+}
+
 void Compiler::Intrinsic(const stripe::Intrinsic& intrinsic, External handler) {
   // Process an intrinsic statement using an external handler function.
   // Load all the input scalars. Create a vector containing their types.
@@ -959,15 +1235,53 @@ void Compiler::BitRight(const stripe::Intrinsic& stmt) {
   OutputType(ret, stmt);
 }
 
-void Compiler::Sqrt(const stripe::Intrinsic& stmt) { CallIntrinsicFunc(stmt, "sqrtf", "sqrt"); }
+void Compiler::Sqrt(const stripe::Intrinsic& stmt) { CallIntrinsicFunc(stmt, "sqrtf", "sqrt", llvm::Intrinsic::sqrt); }
 
-void Compiler::Exp(const stripe::Intrinsic& stmt) { CallIntrinsicFunc(stmt, "expf", "exp"); }
+void Compiler::Exp(const stripe::Intrinsic& stmt) { CallIntrinsicFunc(stmt, "expf", "exp", llvm::Intrinsic::exp); }
 
-void Compiler::Log(const stripe::Intrinsic& stmt) { CallIntrinsicFunc(stmt, "logf", "log"); }
+void Compiler::Log(const stripe::Intrinsic& stmt) { CallIntrinsicFunc(stmt, "logf", "log", llvm::Intrinsic::log); }
 
-void Compiler::Pow(const stripe::Intrinsic& stmt) { CallIntrinsicFunc(stmt, "powf", "pow"); }
+void Compiler::Pow(const stripe::Intrinsic& stmt) { CallIntrinsicFunc(stmt, "powf", "pow", llvm::Intrinsic::pow); }
 
-void Compiler::Tanh(const stripe::Intrinsic& stmt) { CallIntrinsicFunc(stmt, "tanhf", "tanh"); }
+void Compiler::Tanh(const stripe::Intrinsic& stmt) {
+  if (!vector_width_) {
+    CallIntrinsicFunc(stmt, "tanhf", "tanh", llvm::Intrinsic::not_intrinsic);
+    return;
+  }
+  // LLVM has no tanh intrinsic, so vector code evaluates 1 - 2 / (exp(2x) + 1),
+  // which keeps the whole computation in vector registers. That cancels
+  // catastrophically as x approaches zero, so for |x| < 0.5 the odd Taylor
+  // series is used instead; through x^15 it's within about an ulp of tanhf
+  // there, and the exp form is within a few ulps above it. (VectorWidth only
+  // vectorizes tanh for FLOAT32.)
+  assert(1 == stmt.inputs.size());
+  Scalar op = Cast(scalars_[stmt.inputs[0]], stmt.type);
+  llvm::Type* type = op.value->getType();
+  llvm::Value* x = op.value;
+  auto exp = llvm::Intrinsic::getDeclaration(module_, llvm::Intrinsic::exp, {type});
+  auto fabs = llvm::Intrinsic::getDeclaration(module_, llvm::Intrinsic::fabs, {type});
+  llvm::Value* one = llvm::ConstantFP::get(type, 1.0);
+  llvm::Value* two = llvm::ConstantFP::get(type, 2.0);
+  llvm::Value* e2x = builder_.CreateCall(exp, {builder_.CreateFMul(x, two)});
+  llvm::Value* large = builder_.CreateFSub(one, builder_.CreateFDiv(two, builder_.CreateFAdd(e2x, one)));
+  static const double taylor[] = {1.0,
+                                  -1.0 / 3,
+                                  2.0 / 15,
+                                  -17.0 / 315,
+                                  62.0 / 2835,
+                                  -1382.0 / 155925,
+                                  21844.0 / 6081075,
+                                  -929569.0 / 638512875};
+  llvm::Value* x2 = builder_.CreateFMul(x, x);
+  llvm::Value* poly = llvm::ConstantFP::get(type, taylor[7]);
+  for (int i = 6; i >= 0; --i) {
+    poly = builder_.CreateFAdd(builder_.CreateFMul(poly, x2), llvm::ConstantFP::get(type, taylor[i]));
+  }
+  llvm::Value* small = builder_.CreateFMul(poly, x);
+  llvm::Value* is_small = builder_.CreateFCmpOLT(builder_.CreateCall(fabs, {x}), llvm::ConstantFP::get(type, 0.5));
+  llvm::Value* ret = builder_.CreateSelect(is_small, small, large);
+  OutputType(ret, stmt);
+}
 
 void Compiler::Zero(const stripe::Special& zero) {
   // present in stripe.proto but not defined in the specification
@@ -1002,8 +1316,143 @@ void Compiler::PrngStep(const stripe::Special& prng_step) {
   llvm::Value* dest_arg = builder_.CreateBitCast(dest.base, int32ptrType);
   size_t dest_bytes = dest.refinement->interior_shape.byte_size();
   llvm::Value* count = IndexConst(dest_bytes / sizeof(uint32_t));
-  std::vector<llvm::Value*> args{in_state.base, out_state.base, dest_arg, count};
-  builder_.CreateCall(PrngStepFunction(), args, "");
+  // The generator defaults to the xorshift sequence the other backends
+  // produce; "philox", selected by a [[generator(philox)]] attribute on the
+  // prng_step op, is a counter-based generator which the runtime can fill in
+  // parallel, with results independent of the thread count.
+  auto generator = prng_step.str_params.find("generator");
+  if (generator == prng_step.str_params.end() || generator->second == "xorshift") {
+    std::vector<llvm::Value*> args{in_state.base, out_state.base, dest_arg, count};
+    builder_.CreateCall(PrngStepFunction(), args, "");
+  } else if (generator->second == "philox") {
+    // The state's three rows hold the two key words and the stream number;
+    // with fewer than three words they would overlap.
+    size_t state_words = in_state.refinement->interior_shape.elem_size();
+    if (state_words < 3) {
+      throw Error("prng_step with the philox generator needs at least 3 words of state, not " +
+                  std::to_string(state_words));
+    }
+    std::vector<llvm::Value*> args{in_state.base, out_state.base, dest_arg, IndexConst(state_words), count};
+    builder_.CreateCall(PhiloxStepFunction(), args, "");
+  } else {
+    throw Error("Unknown prng_step generator \"" + generator->second + "\"");
+  }
+}
+
+void Compiler::Gather(const stripe::Special& gather) {
+  // Inputs are a data tensor and a tensor of indexes into its outermost
+  // dimension; the output holds one data row per index, in index order:
+  // out[i, ...] = data[clamp(idx[i]), ...]
+  assert(2 == gather.inputs.size());
+  Buffer data = buffers_[gather.inputs[0]];
+  Buffer idx = buffers_[gather.inputs[1]];
+  assert(1 == gather.outputs.size());
+  Buffer out = buffers_[gather.outputs[0]];
+  const auto& data_shape = data.refinement->interior_shape;
+  const auto& idx_shape = idx.refinement->interior_shape;
+  const auto& out_shape = out.refinement->interior_shape;
+  if (!IsIndexType(idx_shape.type)) {
+    throw Error("Invalid gather index type: " + to_string(idx_shape.type));
+  }
+  if (!IsPacked(data_shape) || !IsPacked(idx_shape) || !IsPacked(out_shape)) {
+    throw Error("Special operation GATHER requires densely packed tensors");
+  }
+  if (data_shape.dims.empty()) {
+    throw Error("Data input to gather must have at least 1 dimension");
+  }
+  // The runtime clamps every index into the data, so there must be a row to
+  // clamp to; this is the only shape problem it can't handle without
+  // throwing through the generated code.
+  size_t data_rows = data_shape.dims[0].size;
+  size_t count = idx_shape.elem_size();
+  if (!data_rows && count) {
+    throw Error("Gather from an empty tensor");
+  }
+  size_t row_bytes = data_rows ? data_shape.byte_size() / data_rows : 0;
+  if (out_shape.byte_size() != count * row_bytes) {
+    throw Error("Gather output does not match its inputs");
+  }
+  llvm::Type* ptrtype = builder_.getInt8PtrTy();
+  std::vector<llvm::Value*> args{
+      builder_.CreateBitCast(out.base, ptrtype),                                    //
+      builder_.CreateBitCast(data.base, ptrtype),                                   //
+      builder_.CreateBitCast(idx.base, ptrtype),                                    //
+      builder_.getInt32(static_cast<int32_t>(idx_shape.type)),                      //
+      IndexConst(count),                                                            //
+      IndexConst(data_rows),                                                        //
+      IndexConst(row_bytes),                                                        //
+  };
+  builder_.CreateCall(GatherFunction(), args, "");
+}
+
+void Compiler::Scatter(const stripe::Special& scatter) {
+  // The reverse of gather: inputs are a tensor of rows to distribute, and a
+  // tensor of the output rows they belong to; rows which land on the same
+  // output row are summed. The output was zeroed beforehand. A third input,
+  // used only to determine the output shape, may be present.
+  assert(2 <= scatter.inputs.size());
+  Buffer expn = buffers_[scatter.inputs[0]];
+  Buffer idx = buffers_[scatter.inputs[1]];
+  assert(1 == scatter.outputs.size());
+  Buffer out = buffers_[scatter.outputs[0]];
+  const auto& expn_shape = expn.refinement->interior_shape;
+  const auto& idx_shape = idx.refinement->interior_shape;
+  const auto& out_shape = out.refinement->interior_shape;
+  if (!IsIndexType(idx_shape.type)) {
+    throw Error("Invalid scatter index type: " + to_string(idx_shape.type));
+  }
+  if (!(is_float(out_shape.type) || is_int(out_shape.type) || is_uint(out_shape.type)) ||
+      expn_shape.type != out_shape.type) {
+    throw Error("Invalid scatter type: " + to_string(out_shape.type));
+  }
+  if (!IsPacked(expn_shape) || !IsPacked(idx_shape) || !IsPacked(out_shape)) {
+    throw Error("Special operation SCATTER requires densely packed tensors");
+  }
+  if (out_shape.dims.empty()) {
+    throw Error("Output of scatter must have at least 1 dimension");
+  }
+  size_t out_rows = out_shape.dims[0].size;
+  size_t count = idx_shape.elem_size();
+  if (!out_rows && count) {
+    throw Error("Scatter into an empty tensor");
+  }
+  size_t row_elems = out_rows ? out_shape.elem_size() / out_rows : 0;
+  if (expn_shape.elem_size() != count * row_elems) {
+    throw Error("Scatter output does not match its inputs");
+  }
+  llvm::Type* ptrtype = builder_.getInt8PtrTy();
+  std::vector<llvm::Value*> args{
+      builder_.CreateBitCast(out.base, ptrtype),                 //
+      builder_.CreateBitCast(expn.base, ptrtype),                //
+      builder_.CreateBitCast(idx.base, ptrtype),                 //
+      builder_.getInt32(static_cast<int32_t>(idx_shape.type)),   //
+      builder_.getInt32(static_cast<int32_t>(out_shape.type)),   //
+      IndexConst(count),                                         //
+      IndexConst(out_rows),                                      //
+      IndexConst(row_elems),                                     //
+  };
+  builder_.CreateCall(ScatterFunction(), args, "");
+}
+
+void Compiler::Shape(const stripe::Special& shape) {
+  // Writes the size of each of the input's dimensions into the output; the
+  // sizes are known at compile time, so these are just constant stores.
+  assert(1 == shape.inputs.size());
+  Buffer data = buffers_[shape.inputs[0]];
+  assert(1 == shape.outputs.size());
+  Buffer out = buffers_[shape.outputs[0]];
+  const auto& dims = data.refinement->interior_shape.dims;
+  const auto& out_shape = out.refinement->interior_shape;
+  if (out_shape.dims.size() != 1 || out_shape.dims[0].size != dims.size()) {
+    throw Error("Shape output must be a vector with one element per input dimension");
+  }
+  llvm::Type* type = CType(out_shape.type);
+  for (size_t i = 0; i < dims.size(); ++i) {
+    llvm::Value* value = is_float(out_shape.type) ? llvm::ConstantFP::get(type, dims[i].size)
+                                                  : llvm::ConstantInt::get(type, dims[i].size);
+    std::vector<llvm::Value*> idxList{IndexConst(i * out_shape.dims[0].stride)};
+    builder_.CreateStore(value, builder_.CreateGEP(out.base, idxList));
+  }
 }
 
 Compiler::Scalar Compiler::Cast(Scalar v, DataType to_type) {
@@ -1011,6 +1460,9 @@ Compiler::Scalar Compiler::Cast(Scalar v, DataType to_type) {
     return v;
   }
   llvm::Type* to_llvmtype = CType(to_type);
+  if (v.value->getType()->isVectorTy()) {
+    to_llvmtype = llvm::VectorType::get(to_llvmtype, vector_width_);
+  }
   bool from_signed = is_int(v.type) || is_float(v.type);
   bool to_signed = is_int(to_type) || is_float(to_type);
   auto op = llvm::CastInst::getCastOpcode(v.value, from_signed, to_llvmtype, to_signed);
@@ -1091,7 +1543,21 @@ void Compiler::OutputBool(llvm::Value* ret, const stripe::Intrinsic& intrinsic)
   scalars_[intrinsic.outputs[0]] = Scalar{ret, DataType::BOOLEAN};
 }
 
-void Compiler::CallIntrinsicFunc(const stripe::Intrinsic& stmt, const char* name_f32, const char* name_f64) {
+void Compiler::CallIntrinsicFunc(const stripe::Intrinsic& stmt, const char* name_f32, const char* name_f64,
+                                 llvm::Intrinsic::ID vector_id) {
+  if (vector_width_) {
+    // Vector code uses the LLVM intrinsic, which the backend lowers to vector
+    // instructions or to a vector math library call. VectorWidth only accepts
+    // these for float32 and float64 operations.
+    std::vector<llvm::Value*> argvals;
+    for (const auto& input : stmt.inputs) {
+      argvals.push_back(Cast(scalars_[input], stmt.type).value);
+    }
+    auto func = llvm::Intrinsic::getDeclaration(module_, vector_id, {argvals[0]->getType()});
+    llvm::Value* ret = builder_.CreateCall(func, argvals, "");
+    OutputType(ret, stmt);
+    return;
+  }
   assert(1 == stmt.inputs.size());
   Scalar op = Cast(scalars_[stmt.inputs[0]], stmt.type);
   std::vector<llvm::Value*> argvals{op.value};
@@ -1107,6 +1573,256 @@ void Compiler::CallIntrinsicFunc(const stripe::Intrinsic& stmt, const char* name
   OutputType(ret, stmt);
 }
 
+unsigned Compiler::VectorWidth(const stripe::Block& block) {
+  // A block is vectorized along its innermost index when the block or that
+  // index is tagged, and every statement in the body has a vector
+  // implementation.
+  if (block.idxs.empty() || block.idxs.back().range < 2) {
+    return 0;
+  }
+  if (!block.has_tag(vector_tag_) && !block.idxs.back().has_tag(vector_tag_)) {
+    return 0;
+  }
+  const std::string& name = block.idxs.back().name;
+  unsigned elem_bits = 32;
+  for (const auto& ref : block.refs) {
+    auto type = ref.interior_shape.type;
+    if (type == DataType::FLOAT16 || type == DataType::BOOLEAN) {
+      return 0;
+    }
+    // A store which does not move with the vectorized index reduces its
+    // lanes, which requires an associative aggregation.
+    if (ref.dir != stripe::RefDir::In && ref.FlatAccess()[name] == 0 && ref.agg_op != "add" && ref.agg_op != "mul" &&
+        ref.agg_op != "max") {
+      return 0;
+    }
+    elem_bits = std::max<unsigned>(elem_bits, byte_width(type) * 8);
+  }
+  for (const auto& stmt : block.stmts) {
+    switch (stmt->kind()) {
+      case stripe::StmtKind::Load:
+      case stripe::StmtKind::Store:
+      case stripe::StmtKind::Constant:
+      case stripe::StmtKind::LoadIndex:
+        break;
+      case stripe::StmtKind::Intrinsic: {
+        auto intrinsic = stripe::Intrinsic::Downcast(stmt);
+        if (external_handlers_.count(intrinsic->name)) {
+          return 0;
+        }
+        // Masked-off lanes hold arbitrary values, so integer division could
+        // trap on them; the math functions only have float intrinsics.
+        static const std::set<std::string> float_only{"div", "mod", "sqrt", "exp", "log", "pow", "tanh"};
+        if (float_only.count(intrinsic->name) && !is_float(intrinsic->type)) {
+          return 0;
+        }
+        // The vector tanh is only accurate to single precision.
+        if (intrinsic->name == "tanh" && intrinsic->type != DataType::FLOAT32) {
+          return 0;
+        }
+      } break;
+      default:
+        return 0;
+    }
+  }
+  return HostVectorBits() / elem_bits;
+}
+
+llvm::Value* Compiler::Splat(llvm::Value* value) { return builder_.CreateVectorSplat(vector_width_, value); }
+
+llvm::Value* Compiler::LaneOffsets(const stripe::Affine& access) {
+  // Evaluate an affine for every lane: lane i sees the vectorized index at
+  // its current value plus i.
+  llvm::Value* offsets = Splat(Eval(access));
+  int64_t stride = access[vector_idx_];
+  if (stride) {
+    offsets = builder_.CreateAdd(offsets, builder_.CreateMul(lanes_, Splat(IndexConst(stride))));
+  }
+  return offsets;
+}
+
+Compiler::Scalar Compiler::VectorLoad(const Buffer& buf) {
+  DataType type = buf.refinement->interior_shape.type;
+  llvm::Type* elem_type = CType(type);
+  llvm::Type* vector_type = llvm::VectorType::get(elem_type, vector_width_);
+  unsigned align = byte_width(type);
+  auto access = buf.refinement->FlatAccess();
+  int64_t stride = access[vector_idx_];
+  llvm::Value* ret = nullptr;
+  if (stride == 0) {
+    ret = Splat(builder_.CreateLoad(ElementPtr(buf)));
+  } else if (stride == 1) {
+    llvm::Value* ptr = builder_.CreateBitCast(ElementPtr(buf), vector_type->getPointerTo());
+    ret = builder_.CreateMaskedLoad(ptr, align, lane_mask_, llvm::UndefValue::get(vector_type));
+  } else {
+    llvm::Value* ptrs = builder_.CreateGEP(buf.base, LaneOffsets(access));
+    ret = builder_.CreateMaskedGather(ptrs, align, lane_mask_, llvm::UndefValue::get(vector_type));
+  }
+  return Scalar{ret, type};
+}
+
+void Compiler::VectorStore(const Buffer& buf, Scalar value) {
+  DataType type = buf.refinement->interior_shape.type;
+  llvm::Type* vector_type = value.value->getType();
+  unsigned align = byte_width(type);
+  auto access = buf.refinement->FlatAccess();
+  int64_t stride = access[vector_idx_];
+  const std::string& agg_op = buf.refinement->agg_op;
+  if (stride == 0) {
+    // Every lane targets the same element: fold the active lanes together,
+    // then aggregate the result into memory once.
+    llvm::Value* lanes = builder_.CreateSelect(lane_mask_, value.value, Splat(AggIdentity(agg_op, type)));
+    llvm::Value* element = ElementPtr(buf);
+    llvm::Value* prev = builder_.CreateLoad(element);
+    builder_.CreateStore(Aggregate(agg_op, type, prev, ReduceLanes(lanes, agg_op, type)), element);
+    return;
+  }
+  bool aggregate = !agg_op.empty() && "assign" != agg_op;
+  if (stride == 1) {
+    llvm::Value* ptr = builder_.CreateBitCast(ElementPtr(buf), vector_type->getPointerTo());
+    llvm::Value* result = value.value;
+    if (aggregate) {
+      llvm::Value* prev = builder_.CreateMaskedLoad(ptr, align, lane_mask_, llvm::UndefValue::get(vector_type));
+      result = Aggregate(agg_op, type, prev, result);
+    }
+    builder_.CreateMaskedStore(result, ptr, align, lane_mask_);
+  } else {
+    llvm::Value* ptrs = builder_.CreateGEP(buf.base, LaneOffsets(access));
+    llvm::Value* result = value.value;
+    if (aggregate) {
+      llvm::Value* prev = builder_.CreateMaskedGather(ptrs, align, lane_mask_, llvm::UndefValue::get(vector_type));
+      result = Aggregate(agg_op, type, prev, result);
+    }
+    builder_.CreateMaskedScatter(result, ptrs, align, lane_mask_);
+  }
+}
+
+llvm::Value* Compiler::AggIdentity(const std::string& agg_op, DataType type) {
+  llvm::Type* ctype = CType(type);
+  if ("mul" == agg_op) {
+    return is_float(type) ? llvm::ConstantFP::get(ctype, 1.0) : llvm::ConstantInt::get(ctype, 1);
+  } else if ("max" == agg_op) {
+    if (is_float(type)) {
+      return llvm::ConstantFP::getInfinity(ctype, true);
+    }
+    unsigned bits = ctype->getIntegerBitWidth();
+    return llvm::ConstantInt::get(ctype, is_int(type) ? llvm::APInt::getSignedMinValue(bits) : llvm::APInt(bits, 0));
+  }
+  return llvm::Constant::getNullValue(ctype);
+}
+
+llvm::Value* Compiler::ReduceLanes(llvm::Value* value, const std::string& agg_op, DataType type) {
+  llvm::Value* ret = builder_.CreateExtractElement(value, uint64_t(0));
+  for (unsigned i = 1; i < vector_width_; ++i) {
+    ret = Aggregate(agg_op, type, ret, builder_.CreateExtractElement(value, uint64_t(i)));
+  }
+  return ret;
+}
+
+Compiler::GemmMatch Compiler::MatchGemm(const stripe::Block& block) {
+  // Blocks tagged by the stencil pass are candidates; the body must be
+  // exactly two loads, their product, and an add-aggregated store of it.
+  GemmMatch match;
+  if (!block.has_tag(microkernel_tag_) || !block.constraints.empty() || block.refs.size() != 3 ||
+      block.stmts.size() != 4 || ThreadedIndex(block) < block.idxs.size()) {
+    return match;
+  }
+  std::map<std::string, const stripe::Refinement*> loads;
+  std::shared_ptr<stripe::Intrinsic> mul;
+  std::shared_ptr<stripe::Store> store;
+  for (const auto& stmt : block.stmts) {
+    switch (stmt->kind()) {
+      case stripe::StmtKind::Load: {
+        auto load = stripe::Load::Downcast(stmt);
+        loads[load->into] = &*block.ref_by_into(load->from);
+      } break;
+      case stripe::StmtKind::Intrinsic:
+        mul = stripe::Intrinsic::Downcast(stmt);
+        break;
+      case stripe::StmtKind::Store:
+        store = stripe::Store::Downcast(stmt);
+        break;
+      default:
+        return match;
+    }
+  }
+  if (!mul || !store || loads.size() != 2 || mul->name != "mul" || mul->inputs.size() != 2 ||
+      mul->outputs.size() != 1 || store->from != mul->outputs[0] || mul->inputs[0] == mul->inputs[1] ||
+      !loads.count(mul->inputs[0]) || !loads.count(mul->inputs[1]) || external_handlers_.count(mul->name)) {
+    return match;
+  }
+  const stripe::Refinement* c = &*block.ref_by_into(store->into);
+  const stripe::Refinement* x = loads[mul->inputs[0]];
+  const stripe::Refinement* y = loads[mul->inputs[1]];
+  DataType type = c->interior_shape.type;
+  if (c->agg_op != "add" || mul->type != type || x->interior_shape.type != type || y->interior_shape.type != type) {
+    return match;
+  }
+  auto c_access = c->FlatAccess();
+  auto x_access = x->FlatAccess();
+  auto y_access = y->FlatAccess();
+  // The n index is contiguous in c and in one input, and unused by the other;
+  // that input becomes b. Prefer the index the stencil pass matched.
+  for (const auto& idx : block.idxs) {
+    bool x_is_b = x_access[idx.name] == 1 && y_access[idx.name] == 0;
+    bool y_is_b = y_access[idx.name] == 1 && x_access[idx.name] == 0;
+    if (c_access[idx.name] != 1 || !(x_is_b || y_is_b)) {
+      continue;
+    }
+    if (match.n.empty() || idx.has_tag("stencil")) {
+      match.n = idx.name;
+      match.a = x_is_b ? y : x;
+      match.b = x_is_b ? x : y;
+    }
+  }
+  if (match.n.empty()) {
+    return match;
+  }
+  auto a_access = match.a->FlatAccess();
+  auto b_access = match.b->FlatAccess();
+  uint64_t m_range = 0;
+  uint64_t k_range = 0;
+  for (const auto& idx : block.idxs) {
+    bool in_c = c_access[idx.name] != 0;
+    bool in_a = a_access[idx.name] != 0;
+    bool in_b = b_access[idx.name] != 0;
+    if (in_c && in_a && !in_b && m_range < idx.range) {
+      match.m = idx.name;
+      m_range = idx.range;
+    } else if (!in_c && in_a && in_b && k_range < idx.range) {
+      match.k = idx.name;
+      k_range = idx.range;
+    }
+  }
+  match.c = c;
+  match.kernel = FindGemmMicrokernel(type, block.idx_by_name(match.n)->range);
+  return match;
+}
+
+void Compiler::CallGemm(const stripe::Block& block) {
+  // The m, n and k indexes are at their initial values here, so each buffer's
+  // element pointer addresses the first element the microkernel touches.
+  auto range = [&](const std::string& idx) { return idx.empty() ? 1 : block.idx_by_name(idx)->range; };
+  auto stride = [](const stripe::Refinement* ref, const std::string& idx) {
+    return idx.empty() ? 0 : ref->FlatAccess()[idx];
+  };
+  llvm::Type* ptrtype = builder_.getInt8PtrTy();
+  llvm::Type* stridetype = builder_.getInt64Ty();
+  std::vector<llvm::Value*> args{
+      builder_.CreateBitCast(ElementPtr(buffers_[gemm_.c->into()]), ptrtype),
+      builder_.CreateBitCast(ElementPtr(buffers_[gemm_.a->into()]), ptrtype),
+      builder_.CreateBitCast(ElementPtr(buffers_[gemm_.b->into()]), ptrtype),
+      IndexConst(range(gemm_.m)),
+      IndexConst(range(gemm_.n)),
+      IndexConst(range(gemm_.k)),
+      llvm::ConstantInt::get(stridetype, stride(gemm_.c, gemm_.m)),
+      llvm::ConstantInt::get(stridetype, stride(gemm_.a, gemm_.m)),
+      llvm::ConstantInt::get(stridetype, stride(gemm_.a, gemm_.k)),
+      llvm::ConstantInt::get(stridetype, stride(gemm_.b, gemm_.k)),
+  };
+  builder_.CreateCall(GemmFunction(gemm_.kernel->symbol), args, "");
+}
+
 llvm::Type* Compiler::IndexType() {
   unsigned archbits = module_->getDataLayout().getPointerSizeInBits();
   return llvm::IntegerType::get(context_, archbits);
@@ -1129,6 +1845,11 @@ llvm::FunctionType* Compiler::BlockType(const stripe::Block& block) {
   for (size_t i = 0; i < block.idxs.size(); ++i) {
     param_types.push_back(IndexType());
   }
+  // Threaded blocks also take the number of threaded index iterations to
+  // run, since each call covers only a slice of the full range.
+  if (ThreadedIndex(block) < block.idxs.size()) {
+    param_types.push_back(IndexType());
+  }
   // Blocks never return a value.
   llvm::Type* return_type = builder_.getVoidTy();
   return llvm::FunctionType::get(return_type, param_types, false);
@@ -1168,26 +1889,93 @@ llvm::Value* Compiler::PrngStepFunction(void) {
   return module_->getOrInsertFunction(funcname, functype);
 }
 
+llvm::Value* Compiler::PhiloxStepFunction(void) {
+  llvm::Type* int32ptrType = builder_.getInt32Ty()->getPointerTo();
+  std::vector<llvm::Type*> argtypes{int32ptrType, int32ptrType, int32ptrType, IndexType(), IndexType()};
+  llvm::Type* rettype = llvm::Type::getVoidTy(context_);
+  auto functype = llvm::FunctionType::get(rettype, argtypes, false);
+  const char* funcname = "philox_step";
+  return module_->getOrInsertFunction(funcname, functype);
+}
+
+llvm::Value* Compiler::GatherFunction(void) {
+  llvm::Type* ptrtype = builder_.getInt8PtrTy();
+  llvm::Type* inttype = builder_.getInt32Ty();
+  std::vector<llvm::Type*> argtypes{ptrtype, ptrtype, ptrtype, inttype, IndexType(), IndexType(), IndexType()};
+  llvm::Type* rettype = llvm::Type::getVoidTy(context_);
+  auto functype = llvm::FunctionType::get(rettype, argtypes, false);
+  const char* funcname = "gather";
+  return module_->getOrInsertFunction(funcname, functype);
+}
+
+llvm::Value* Compiler::ScatterFunction(void) {
+  llvm::Type* ptrtype = builder_.getInt8PtrTy();
+  llvm::Type* inttype = builder_.getInt32Ty();
+  std::vector<llvm::Type*> argtypes{ptrtype, ptrtype,     ptrtype,     inttype,
+                                    inttype, IndexType(), IndexType(), IndexType()};
+  llvm::Type* rettype = llvm::Type::getVoidTy(context_);
+  auto functype = llvm::FunctionType::get(rettype, argtypes, false);
+  const char* funcname = "scatter";
+  return module_->getOrInsertFunction(funcname, functype);
+}
+
+llvm::Value* Compiler::GemmFunction(const char* symbol) {
+  llvm::Type* ptrtype = builder_.getInt8PtrTy();
+  llvm::Type* stridetype = builder_.getInt64Ty();
+  std::vector<llvm::Type*> argtypes{ptrtype,    ptrtype,    ptrtype,    IndexType(), IndexType(),
+                                    IndexType(), stridetype, stridetype, stridetype,  stridetype};
+  llvm::Type* rettype = llvm::Type::getVoidTy(context_);
+  auto functype = llvm::FunctionType::get(rettype, argtypes, false);
+  return module_->getOrInsertFunction(symbol, functype);
+}
+
+llvm::Value* Compiler::ParallelForFunction(void) {
+  llvm::Type* ptrtype = builder_.getInt8PtrTy();
+  std::vector<llvm::Type*> argtypes{ptrtype, ptrtype, IndexType(), IndexType()};
+  llvm::Type* rettype = llvm::Type::getVoidTy(context_);
+  auto functype = llvm::FunctionType::get(rettype, argtypes, false);
+  const char* funcname = "parallel_for";
+  return module_->getOrInsertFunction(funcname, functype);
+}
+
 Executable::Executable(const ProgramModule& module) : parameters_(module.parameters) {
   std::string errStr;
   std::unique_ptr<llvm::LegacyJITSymbolResolver> rez(new Runtime(module.externals));
   assert(module.module);
   std::unique_ptr<llvm::Module> clone(llvm::CloneModule(*module.module));
+  const llvm::Module* cloned = clone.get();
+  auto cache = tile::util::ObjectCache::Instance();
+  if (cache && !module.object_key.empty()) {
+    cache->Bind(cloned, module.object_key, module.object);
+  }
   auto ee = llvm::EngineBuilder(std::move(clone))
                 .setErrorStr(&errStr)
                 .setEngineKind(llvm::EngineKind::JIT)
                 .setVerifyModules(true)
+                .setMCPU(llvm::sys::getHostCPUName())
+                .setMAttrs(HostAttrs())
                 .setSymbolResolver(std::move(rez))
                 .create();
   if (ee) {
+    // With a persistent object cache configured, codegen is skipped for any
+    // program some earlier process has already compiled.
+    if (cache) {
+      ee->setObjectCache(cache);
+    }
     ee->finalizeObject();
     engine_.reset(ee);
   } else {
+    if (cache) {
+      cache->Unbind(cloned);
+    }
     throw Error("Failed to create ExecutionEngine: " + errStr);
   }
 }
 
-void Executable::Run(const std::map<std::string, void*>& buffers) {
+void Executable::Run(const std::map<std::string, void*>& buffers, ThreadPool* pool) {
+  // Threaded blocks find the pool through the calling thread, which keeps it
+  // out of the generated code's signatures.
+  ThreadPool::Scope scope{pool};
   std::vector<void*> args(parameters_.size());
   for (size_t i = 0; i < args.size(); ++i) {
     args[i] = safe_at(buffers, parameters_[i]);
@@ -1216,6 +2004,279 @@ void prng_step(uint32_t* in_state, uint32_t* out_state, uint32_t* buf, size_t co
     in_state = out_state;
   }
 }
+// Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2,
+// 3"). Each 128-bit counter maps to four outputs independently of every
+// other counter, so the buffer can be filled in any order. Counters are
+// processed kPhiloxLanes at a time in structure-of-arrays form so that the
+// compiler can vectorize the rounds.
+constexpr size_t kPhiloxLanes = 8;
+
+void philox_blocks(const uint32_t key[2], uint32_t stream, uint64_t first, uint32_t out[kPhiloxLanes][4]) {
+  uint32_t c0[kPhiloxLanes], c1[kPhiloxLanes], c2[kPhiloxLanes], c3[kPhiloxLanes];
+  for (size_t l = 0; l < kPhiloxLanes; ++l) {
+    c0[l] = static_cast<uint32_t>(first + l);
+    c1[l] = static_cast<uint32_t>((first + l) >> 32);
+    c2[l] = stream;
+    c3[l] = 0;
+  }
+  uint32_t k0 = key[0];
+  uint32_t k1 = key[1];
+  for (int round = 0; round < 10; ++round) {
+    for (size_t l = 0; l < kPhiloxLanes; ++l) {
+      uint64_t p0 = uint64_t(0xD2511F53) * c0[l];
+      uint64_t p1 = uint64_t(0xCD9E8D57) * c2[l];
+      uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1[l] ^ k0;
+      uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3[l] ^ k1;
+      c1[l] = static_cast<uint32_t>(p1);
+      c3[l] = static_cast<uint32_t>(p0);
+      c0[l] = n0;
+      c2[l] = n2;
+    }
+    k0 += 0x9E3779B9;
+    k1 += 0xBB67AE85;
+  }
+  for (size_t l = 0; l < kPhiloxLanes; ++l) {
+    out[l][0] = c0[l];
+    out[l][1] = c1[l];
+    out[l][2] = c2[l];
+    out[l][3] = c3[l];
+  }
+}
+
+void philox_step(uint32_t* in_state, uint32_t* out_state, uint32_t* buf, size_t state_words, size_t count) {
+  // The state is laid out as three rows; the first column's words supply
+  // the key and the stream number. Output i comes from word i % 4 of counter
+  // (i / 4, stream), and the next state selects the following stream.
+  size_t row = state_words / 3;
+  uint32_t key[2] = {in_state[0], in_state[row]};
+  uint32_t stream = in_state[2 * row];
+  size_t blocks = (count + 3) / 4;
+  size_t groups = (blocks + kPhiloxLanes - 1) / kPhiloxLanes;
+  auto fill = [&](size_t begin, size_t end) {
+    uint32_t out[kPhiloxLanes][4];
+    for (size_t g = begin; g < end; ++g) {
+      philox_blocks(key, stream, g * kPhiloxLanes, out);
+      size_t base = g * kPhiloxLanes * 4;
+      size_t n = std::min(kPhiloxLanes * 4, count - base);
+      std::memcpy(buf + base, out, n * sizeof(uint32_t));
+    }
+  };
+  auto pool = ThreadPool::Current();
+  if (pool) {
+    pool->ParallelFor(groups, 256, fill);
+  } else {
+    fill(0, groups);
+  }
+  if (out_state != in_state) {
+    std::memcpy(out_state, in_state, state_words * sizeof(uint32_t));
+  }
+  out_state[2 * row] = stream + 1;
+}
+
+void parallel_for(void (*worker)(void*, void*, size_t, size_t), void* context, size_t range, size_t scratch_bytes) {
+  // Runs the worker over [0, range), splitting the range across the pool
+  // attached to this thread if there is one. Each participant takes
+  // subranges of about 1/chunks_per_thread of its share at a time, which
+  // leaves enough for the others to steal without taking the pool's locks
+  // per iteration, and allocates its scratch area once for the whole loop.
+  const size_t chunks_per_thread = 8;
+  auto pool = ThreadPool::Current();
+  size_t participants = pool ? pool->size() : 1;
+  std::vector<void*> scratch(participants);
+  auto run = [&](size_t slot, size_t begin, size_t end) {
+    if (scratch_bytes && !scratch[slot]) {
+      scratch[slot] = calloc(scratch_bytes, 1);
+    }
+    worker(context, scratch[slot], begin, end);
+  };
+  if (pool) {
+    pool->ParallelForSlots(range, range / (participants * chunks_per_thread), run);
+  } else {
+    run(0, 0, range);
+  }
+  for (auto ptr : scratch) {
+    free(ptr);
+  }
+}
+
+// Reads element i of an index tensor and converts it to a row number in
+// [0, rows), clamping out-of-range values (and flooring floats) the same way
+// the generated gather/scatter kernels do. These runtime functions are called
+// from generated code, which has no unwind info, so they must not throw: the
+// compiler has already checked the types and shapes, and anything it let
+// through is clamped. With no rows at all, every index maps to row 0, which
+// callers must not touch.
+size_t row_index(const void* idx, DataType type, size_t i, size_t rows) {
+  if (!rows) {
+    return 0;
+  }
+  double value = 0;
+  switch (type) {
+    case DataType::INT8:
+      value = static_cast<const int8_t*>(idx)[i];
+      break;
+    case DataType::INT16:
+      value = static_cast<const int16_t*>(idx)[i];
+      break;
+    case DataType::INT32:
+      value = static_cast<const int32_t*>(idx)[i];
+      break;
+    case DataType::INT64: {
+      int64_t v = static_cast<const int64_t*>(idx)[i];
+      return v < 0 ? 0 : std::min<uint64_t>(v, rows - 1);
+    }
+    case DataType::UINT8:
+      value = static_cast<const uint8_t*>(idx)[i];
+      break;
+    case DataType::UINT16:
+      value = static_cast<const uint16_t*>(idx)[i];
+      break;
+    case DataType::UINT32:
+      value = static_cast<const uint32_t*>(idx)[i];
+      break;
+    case DataType::UINT64:
+      return std::min<uint64_t>(static_cast<const uint64_t*>(idx)[i], rows - 1);
+    case DataType::FLOAT16:
+      value = static_cast<const half_float::half*>(idx)[i];
+      break;
+    case DataType::FLOAT32:
+      value = std::floor(static_cast<const float*>(idx)[i]);
+      break;
+    case DataType::FLOAT64:
+      value = std::floor(static_cast<const double*>(idx)[i]);
+      break;
+    default:
+      // Rejected when the kernel was compiled.
+      return 0;
+  }
+  // Written so that NaN selects the first row.
+  if (!(value > 0)) {
+    return 0;
+  }
+  return value < rows - 1 ? static_cast<size_t>(value) : rows - 1;
+}
+
+// Runs body over [0, count) using the current thread pool, if there is one,
+// in pieces large enough that each is worth handing to another thread.
+void parallel_rows(size_t count, size_t row_bytes, const ThreadPool::Body& body) {
+  auto pool = ThreadPool::Current();
+  size_t grain = std::max<size_t>(1, (size_t(64) << 10) / std::max<size_t>(row_bytes, 1));
+  if (!pool) {
+    body(0, count);
+    return;
+  }
+  pool->ParallelFor(count, grain, body);
+}
+
+void gather(uint8_t* out, const uint8_t* data, const void* idx, int32_t idx_type, size_t count, size_t data_rows,
+            size_t row_bytes) {
+  auto type = static_cast<DataType>(idx_type);
+  if (!data_rows) {
+    // Only an empty index tensor may gather from empty data.
+    return;
+  }
+  parallel_rows(count, row_bytes, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      size_t row = row_index(idx, type, i, data_rows);
+      std::memcpy(out + i * row_bytes, data + row * row_bytes, row_bytes);
+    }
+  });
+}
+
+template <typename T>
+void scatter_add(void* out_buf, const void* expn_buf, const std::vector<size_t>& dests, size_t out_rows,
+                 size_t row_elems) {
+  T* out = static_cast<T*>(out_buf);
+  const T* expn = static_cast<const T*>(expn_buf);
+  auto add_row = [&](size_t dest, size_t src) {
+    T* dst_row = out + dest * row_elems;
+    const T* src_row = expn + src * row_elems;
+    for (size_t j = 0; j < row_elems; ++j) {
+      dst_row[j] += src_row[j];
+    }
+  };
+  auto pool = ThreadPool::Current();
+  if (!pool || out_rows < 2) {
+    for (size_t i = 0; i < dests.size(); ++i) {
+      add_row(dests[i], i);
+    }
+    return;
+  }
+  // Conflict-free parallel accumulation: bucket the source rows by their
+  // destination with a stable counting sort, then split the destination rows
+  // among the threads. Every output row is owned by exactly one thread and
+  // sums its sources in their original order, so no atomics are needed and
+  // the result is bit-identical to the serial loop.
+  std::vector<size_t> starts(out_rows + 1);
+  for (auto dest : dests) {
+    ++starts[dest + 1];
+  }
+  std::partial_sum(starts.begin(), starts.end(), starts.begin());
+  std::vector<size_t> order(dests.size());
+  std::vector<size_t> fill(starts.begin(), starts.end() - 1);
+  for (size_t i = 0; i < dests.size(); ++i) {
+    order[fill[dests[i]]++] = i;
+  }
+  size_t row_bytes = row_elems * sizeof(T) * std::max<size_t>(1, dests.size() / out_rows);
+  parallel_rows(out_rows, row_bytes, [&](size_t begin, size_t end) {
+    for (size_t row = begin; row < end; ++row) {
+      for (size_t k = starts[row]; k < starts[row + 1]; ++k) {
+        add_row(row, order[k]);
+      }
+    }
+  });
+}
+
+void scatter(void* out, const void* expn, const void* idx, int32_t idx_type, int32_t elem_type, size_t count,
+             size_t out_rows, size_t row_elems) {
+  if (!out_rows) {
+    // No destination rows, so every source row is dropped.
+    return;
+  }
+  std::vector<size_t> dests(count);
+  auto type = static_cast<DataType>(idx_type);
+  for (size_t i = 0; i < count; ++i) {
+    dests[i] = row_index(idx, type, i, out_rows);
+  }
+  switch (static_cast<DataType>(elem_type)) {
+    case DataType::INT8:
+      scatter_add<int8_t>(out, expn, dests, out_rows, row_elems);
+      break;
+    case DataType::INT16:
+      scatter_add<int16_t>(out, expn, dests, out_rows, row_elems);
+      break;
+    case DataType::INT32:
+      scatter_add<int32_t>(out, expn, dests, out_rows, row_elems);
+      break;
+    case DataType::INT64:
+      scatter_add<int64_t>(out, expn, dests, out_rows, row_elems);
+      break;
+    case DataType::UINT8:
+      scatter_add<uint8_t>(out, expn, dests, out_rows, row_elems);
+      break;
+    case DataType::UINT16:
+      scatter_add<uint16_t>(out, expn, dests, out_rows, row_elems);
+      break;
+    case DataType::UINT32:
+      scatter_add<uint32_t>(out, expn, dests, out_rows, row_elems);
+      break;
+    case DataType::UINT64:
+      scatter_add<uint64_t>(out, expn, dests, out_rows, row_elems);
+      break;
+    case DataType::FLOAT16:
+      scatter_add<half_float::half>(out, expn, dests, out_rows, row_elems);
+      break;
+    case DataType::FLOAT32:
+      scatter_add<float>(out, expn, dests, out_rows, row_elems);
+      break;
+    case DataType::FLOAT64:
+      scatter_add<double>(out, expn, dests, out_rows, row_elems);
+      break;
+    default:
+      // Rejected when the kernel was compiled.
+      break;
+  }
+}
 }  // namespace rt
 
 template <typename T>
@@ -1230,11 +2291,22 @@ llvm::JITSymbol Runtime::findSymbol(const std::string& name) {
       {"__gnu_h2f_ieee", symInfo(rt::h2f)},  {"__gnu_f2h_ieee", symInfo(rt::f2h)},
       {"___truncsfhf2", symInfo(rt::f2h)},   {"___extendhfsf2", symInfo(rt::h2f)},
       {"prng_step", symInfo(rt::prng_step)}, {"_prng_step", symInfo(rt::prng_step)},
+      {"philox_step", symInfo(rt::philox_step)}, {"_philox_step", symInfo(rt::philox_step)},
+      {"parallel_for", symInfo(rt::parallel_for)}, {"_parallel_for", symInfo(rt::parallel_for)},
+      {"gather", symInfo(rt::gather)},       {"_gather", symInfo(rt::gather)},
+      {"scatter", symInfo(rt::scatter)},     {"_scatter", symInfo(rt::scatter)},
   };
   auto loc_rt = symbols.find(name);
   if (loc_rt != symbols.end()) {
     return loc_rt->second;
   }
+  auto kernel = ResolveMicrokernel(name);
+  if (!kernel && name.size() > 1 && name[0] == '_') {
+    kernel = ResolveMicrokernel(name.substr(1));
+  }
+  if (kernel) {
+    return symInfo(kernel);
+  }
   auto loc_extern = externals_.find(name);
   if (loc_extern != externals_.end()) {
     return symInfo(loc_extern->second);
@@ -1267,6 +2339,9 @@ struct Native::Impl {
   llvm::LLVMContext context;
   ProgramModule module;
   std::unique_ptr<Executable> executable;
+  // Created on first use and kept for the lifetime of the Native, so that
+  // repeated runs do not pay for thread startup.
+  std::unique_ptr<ThreadPool> pool;
 
   void compile(const stripe::Block& program, const std::map<std::string, External>& externals) {
     Compiler compiler(&context, externals);
@@ -1275,7 +2350,12 @@ struct Native::Impl {
     executable.reset(new Executable(module));
   }
 
-  void run(const std::map<std::string, void*>& buffers) { executable->Run(buffers); }
+  void run(const std::map<std::string, void*>& buffers) {
+    if (!pool) {
+      pool.reset(new ThreadPool);
+    }
+    executable->Run(buffers, pool.get());
+  }
 
   void save(const std::string& filename) {
     std::error_code ec;
@@ -1293,6 +2373,32 @@ void Native::compile(const stripe::Block& program, const std::map<std::string, E
 void Native::run(const std::map<std::string, void*>& buffers) { m_impl->run(buffers); }
 void Native::save(const std::string& filename) { m_impl->save(filename); }
 
+size_t ThreadedIndex(const stripe::Block& block) {
+  // Split the first index which selects disjoint output elements: one which
+  // alone determines some dimension of every output's access. Splitting an
+  // accumulation index, or one which is combined with another index (as in
+  // O[i + j]), would race on the elements the threads share.
+  auto outs = block.ref_outs();
+  if (!block.has_tag(thread_tag_) || outs.empty()) {
+    return block.idxs.size();
+  }
+  for (size_t i = 0; i < block.idxs.size(); ++i) {
+    const auto& idx = block.idxs[i];
+    if (idx.range < 2) {
+      continue;
+    }
+    bool disjoint = true;
+    for (const auto* ref : outs) {
+      disjoint &= std::any_of(ref->access.begin(), ref->access.end(),
+                              [&idx](const stripe::Affine& access) { return IsolatesIndex(access, idx.name); });
+    }
+    if (disjoint) {
+      return i;
+    }
+  }
+  return block.idxs.size();
+}
+
 void JitExecute(const stripe::Block& program, const std::map<std::string, void*>& buffers) {
   llvm::LLVMContext context;
   std::map<std::string, External> externals;
@@ -33,6 +33,10 @@ class Native {
   void save(const std::string& filename);
 };
 
+// The index of a cpu_thread block which the JIT splits across threads, or
+// block.idxs.size() if the block runs on a single thread.
+size_t ThreadedIndex(const stripe::Block& block);
+
 void JitExecute(const stripe::Block& program, const std::map<std::string, void*>& buffers);
 void JitExecute(const stripe::Block& program, const std::map<std::string, External>& externals,
                 const std::map<std::string, void*>& buffers);
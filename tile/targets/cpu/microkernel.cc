@@ -0,0 +1,224 @@
+// Copyright 2019, Intel Corp.
+
+#include "tile/targets/cpu/microkernel.h"
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define MICROKERNEL_AVX2_FMA 1
+#define TARGET_AVX2_FMA __attribute__((target("avx2,fma")))
+#endif
+
+namespace vertexai {
+namespace tile {
+namespace targets {
+namespace cpu {
+
+namespace {
+
+// Computes one MR x NR tile of C from a K x NR panel of B whose rows are ldb
+// elements apart. The accumulators are fixed-size so the compiler can keep
+// them in vector registers.
+template <typename T, size_t MR, size_t NR>
+void GemmTile(T* c, const T* a, const T* b, int64_t ldb, size_t mr, size_t nr, size_t k_size, int64_t ldc,
+              int64_t lda_m, int64_t lda_k) {
+  T acc[MR][NR] = {};
+  for (size_t k = 0; k < k_size; ++k) {
+    const T* bp = b + static_cast<int64_t>(k) * ldb;
+    for (size_t i = 0; i < MR; ++i) {
+      T av = a[static_cast<int64_t>(i) * lda_m + static_cast<int64_t>(k) * lda_k];
+      for (size_t j = 0; j < NR; ++j) {
+        acc[i][j] += av * bp[j];
+      }
+    }
+  }
+  for (size_t i = 0; i < mr; ++i) {
+    for (size_t j = 0; j < nr; ++j) {
+      c[static_cast<int64_t>(i) * ldc + j] += acc[i][j];
+    }
+  }
+}
+
+#ifdef MICROKERNEL_AVX2_FMA
+
+// The AVX2 vector operations the FMA tile needs, for each element type.
+struct F32x8 {
+  typedef float Elem;
+  typedef __m256 Vec;
+  static constexpr size_t kLanes = 8;
+  static TARGET_AVX2_FMA Vec Zero() { return _mm256_setzero_ps(); }
+  static TARGET_AVX2_FMA Vec Splat(float v) { return _mm256_set1_ps(v); }
+  static TARGET_AVX2_FMA Vec Load(const float* p) { return _mm256_loadu_ps(p); }
+  static TARGET_AVX2_FMA void Store(float* p, Vec v) { _mm256_storeu_ps(p, v); }
+  static TARGET_AVX2_FMA Vec Fma(Vec a, Vec b, Vec c) { return _mm256_fmadd_ps(a, b, c); }
+};
+
+struct F64x4 {
+  typedef double Elem;
+  typedef __m256d Vec;
+  static constexpr size_t kLanes = 4;
+  static TARGET_AVX2_FMA Vec Zero() { return _mm256_setzero_pd(); }
+  static TARGET_AVX2_FMA Vec Splat(double v) { return _mm256_set1_pd(v); }
+  static TARGET_AVX2_FMA Vec Load(const double* p) { return _mm256_loadu_pd(p); }
+  static TARGET_AVX2_FMA void Store(double* p, Vec v) { _mm256_storeu_pd(p, v); }
+  static TARGET_AVX2_FMA Vec Fma(Vec a, Vec b, Vec c) { return _mm256_fmadd_pd(a, b, c); }
+};
+
+// The same tile as GemmTile, with the MR x NR accumulator block held in
+// AVX2 registers and updated by one FMA per vector per k.
+template <typename V, size_t MR, size_t NR>
+TARGET_AVX2_FMA void GemmTileFma(typename V::Elem* c, const typename V::Elem* a, const typename V::Elem* b, int64_t ldb,
+                                 size_t mr, size_t nr, size_t k_size, int64_t ldc, int64_t lda_m, int64_t lda_k) {
+  typedef typename V::Elem T;
+  constexpr size_t NV = NR / V::kLanes;
+  typename V::Vec acc[MR][NV];
+  for (size_t i = 0; i < MR; ++i) {
+    for (size_t j = 0; j < NV; ++j) {
+      acc[i][j] = V::Zero();
+    }
+  }
+  for (size_t k = 0; k < k_size; ++k) {
+    const T* bp = b + static_cast<int64_t>(k) * ldb;
+    typename V::Vec bv[NV];
+    for (size_t j = 0; j < NV; ++j) {
+      bv[j] = V::Load(bp + j * V::kLanes);
+    }
+    for (size_t i = 0; i < MR; ++i) {
+      auto av = V::Splat(a[static_cast<int64_t>(i) * lda_m + static_cast<int64_t>(k) * lda_k]);
+      for (size_t j = 0; j < NV; ++j) {
+        acc[i][j] = V::Fma(av, bv[j], acc[i][j]);
+      }
+    }
+  }
+  T sums[NR];
+  for (size_t i = 0; i < mr; ++i) {
+    for (size_t j = 0; j < NV; ++j) {
+      V::Store(sums + j * V::kLanes, acc[i][j]);
+    }
+    for (size_t j = 0; j < nr; ++j) {
+      c[static_cast<int64_t>(i) * ldc + j] += sums[j];
+    }
+  }
+}
+
+#endif  // MICROKERNEL_AVX2_FMA
+
+template <typename T>
+using TileFn = void (*)(T* c, const T* a, const T* b, int64_t ldb, size_t mr, size_t nr, size_t k_size, int64_t ldc,
+                        int64_t lda_m, int64_t lda_k);
+
+// Walks C in MR x NR tiles, MR = 4, using Tile for whole groups of rows and
+// Row for the leftover rows.
+template <typename T, size_t NR, TileFn<T> Tile, TileFn<T> Row>
+void Gemm(void* c_buf, const void* a_buf, const void* b_buf, size_t m_size, size_t n_size, size_t k_size, int64_t ldc,
+          int64_t lda_m, int64_t lda_k, int64_t ldb) {
+  constexpr size_t MR = 4;
+  T* c = static_cast<T*>(c_buf);
+  const T* a = static_cast<const T*>(a_buf);
+  const T* b = static_cast<const T*>(b_buf);
+  thread_local std::vector<T> panel;
+  for (size_t n0 = 0; n0 < n_size; n0 += NR) {
+    size_t nr = std::min(NR, n_size - n0);
+    // Columns of B are contiguous, so the tiles read a full panel in place;
+    // the JIT calls the kernel once per tile with the same B, and copying the
+    // panel on every call would cost as much memory traffic as the tile
+    // itself. Only a partial final panel is packed, zero-padded to NR.
+    const T* bp = b + n0;
+    int64_t ld = ldb;
+    if (nr < NR) {
+      panel.resize(k_size * NR);
+      for (size_t k = 0; k < k_size; ++k) {
+        for (size_t j = 0; j < NR; ++j) {
+          panel[k * NR + j] = j < nr ? b[static_cast<int64_t>(k) * ldb + n0 + j] : T(0);
+        }
+      }
+      bp = panel.data();
+      ld = NR;
+    }
+    int64_t m0 = 0;
+    int64_t m_end = m_size;
+    for (; m0 + static_cast<int64_t>(MR) <= m_end; m0 += MR) {
+      Tile(c + m0 * ldc + n0, a + m0 * lda_m, bp, ld, MR, nr, k_size, ldc, lda_m, lda_k);
+    }
+    for (; m0 < m_end; ++m0) {
+      Row(c + m0 * ldc + n0, a + m0 * lda_m, bp, ld, 1, nr, k_size, ldc, lda_m, lda_k);
+    }
+  }
+}
+
+template <typename T, size_t NR>
+void GemmGeneric(void* c, const void* a, const void* b, size_t m, size_t n, size_t k, int64_t ldc, int64_t lda_m,
+                 int64_t lda_k, int64_t ldb) {
+  Gemm<T, NR, &GemmTile<T, 4, NR>, &GemmTile<T, 1, NR>>(c, a, b, m, n, k, ldc, lda_m, lda_k, ldb);
+}
+
+#ifdef MICROKERNEL_AVX2_FMA
+template <typename V, size_t NR>
+void GemmFma(void* c, const void* a, const void* b, size_t m, size_t n, size_t k, int64_t ldc, int64_t lda_m,
+             int64_t lda_k, int64_t ldb) {
+  typedef typename V::Elem T;
+  Gemm<T, NR, &GemmTileFma<V, 4, NR>, &GemmTileFma<V, 1, NR>>(c, a, b, m, n, k, ldc, lda_m, lda_k, ldb);
+}
+#endif
+
+// Kernels are listed with the preferred fallback for each type first, and
+// with every ISA's kernels ahead of the kernels of the ISAs it supersedes.
+const Microkernel kMicrokernels[] = {
+#ifdef MICROKERNEL_AVX2_FMA
+    {DataType::FLOAT32, 8, MicrokernelIsa::AVX2_FMA, "microkernel_gemm_f32_8_fma", &GemmFma<F32x8, 8>},
+    {DataType::FLOAT32, 16, MicrokernelIsa::AVX2_FMA, "microkernel_gemm_f32_16_fma", &GemmFma<F32x8, 16>},
+    {DataType::FLOAT64, 4, MicrokernelIsa::AVX2_FMA, "microkernel_gemm_f64_4_fma", &GemmFma<F64x4, 4>},
+    {DataType::FLOAT64, 8, MicrokernelIsa::AVX2_FMA, "microkernel_gemm_f64_8_fma", &GemmFma<F64x4, 8>},
+#endif
+    {DataType::FLOAT32, 8, MicrokernelIsa::GENERIC, "microkernel_gemm_f32_8", &GemmGeneric<float, 8>},
+    {DataType::FLOAT32, 16, MicrokernelIsa::GENERIC, "microkernel_gemm_f32_16", &GemmGeneric<float, 16>},
+    {DataType::FLOAT32, 4, MicrokernelIsa::GENERIC, "microkernel_gemm_f32_4", &GemmGeneric<float, 4>},
+    {DataType::FLOAT64, 4, MicrokernelIsa::GENERIC, "microkernel_gemm_f64_4", &GemmGeneric<double, 4>},
+    {DataType::FLOAT64, 8, MicrokernelIsa::GENERIC, "microkernel_gemm_f64_8", &GemmGeneric<double, 8>},
+};
+
+}  // namespace
+
+bool HostSupports(MicrokernelIsa isa) {
+  if (isa == MicrokernelIsa::GENERIC) {
+    return true;
+  }
+#ifdef MICROKERNEL_AVX2_FMA
+  static const bool avx2_fma = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  return isa == MicrokernelIsa::AVX2_FMA && avx2_fma;
+#else
+  return false;
+#endif
+}
+
+const Microkernel* FindGemmMicrokernel(DataType type, size_t width) {
+  const Microkernel* fallback = nullptr;
+  for (const auto& kernel : kMicrokernels) {
+    if (kernel.type != type || !HostSupports(kernel.isa)) {
+      continue;
+    }
+    if (kernel.width == width) {
+      return &kernel;
+    }
+    if (!fallback) {
+      fallback = &kernel;
+    }
+  }
+  return fallback;
+}
+
+void* ResolveMicrokernel(const std::string& symbol) {
+  for (const auto& kernel : kMicrokernels) {
+    if (symbol == kernel.symbol) {
+      return reinterpret_cast<void*>(kernel.entry);
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace cpu
+}  // namespace targets
+}  // namespace tile
+}  // namespace vertexai
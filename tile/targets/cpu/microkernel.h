@@ -0,0 +1,56 @@
+// Copyright 2019, Intel Corp.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "tile/base/shape.h"
+
+namespace vertexai {
+namespace tile {
+namespace targets {
+namespace cpu {
+
+// A GEMM microkernel accumulates C += A * B, where C is m x n, A is m x k and
+// B is k x n. Columns of C and B are contiguous; every other stride is given
+// in elements and may be anything, including zero, which lets the JIT map
+// the indexes of tiled contractions and convolutions directly onto it.
+typedef void (*GemmKernel)(void* c, const void* a, const void* b,  //
+                           size_t m, size_t n, size_t k,           //
+                           int64_t ldc, int64_t lda_m, int64_t lda_k, int64_t ldb);
+
+// The instruction set a microkernel is compiled for. The JIT target is built
+// for the baseline ISA, so kernels for newer ISAs carry per-function target
+// attributes and are only chosen when the host CPU reports support for them.
+enum class MicrokernelIsa {
+  GENERIC,
+  AVX2_FMA,
+};
+
+struct Microkernel {
+  DataType type;
+  // The number of columns the kernel keeps in registers at once; the JIT
+  // prefers the kernel whose width matches the stencil's unit-stride index.
+  size_t width;
+  MicrokernelIsa isa;
+  // The name generated code uses to call the kernel.
+  const char* symbol;
+  GemmKernel entry;
+};
+
+// Whether the host CPU can run kernels compiled for an ISA.
+bool HostSupports(MicrokernelIsa isa);
+
+// Finds the best GEMM microkernel the host supports for an element type and
+// a unit-stride index range, or returns nullptr if there is none for the type.
+const Microkernel* FindGemmMicrokernel(DataType type, size_t width);
+
+// Resolves a microkernel symbol for the JIT's linker, or returns nullptr.
+void* ResolveMicrokernel(const std::string& symbol);
+
+}  // namespace cpu
+}  // namespace targets
+}  // namespace tile
+}  // namespace vertexai
@@ -1,19 +1,32 @@
 // Copyright 2018, Intel Corp.
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <set>
+#include <thread>
+
 #include <gmock/gmock.h>
 #include <google/protobuf/text_format.h>
 
+#include "tile/codegen/driver.h"
 #include "tile/codegen/tile.h"
 #include "tile/lang/compose.h"
+#include "tile/lang/gen_special.h"
 #include "tile/lang/gen_stripe.h"
 #include "tile/stripe/stripe.h"
 #include "tile/stripe/stripe.pb.h"
 #include "tile/targets/cpu/jit.h"
+#include "tile/targets/cpu/microkernel.h"
+#include "tile/targets/cpu/thread_pool.h"
+#include "tile/targets/targets.h"
 
 namespace gp = google::protobuf;
 
 using ::testing::ContainerEq;
 using ::testing::Eq;
+using ::testing::Le;
 
 namespace vertexai {
 namespace tile {
@@ -21,6 +34,62 @@ namespace targets {
 namespace cpu {
 namespace test {
 
+// Lowers a program through the passes of the shipped CPU configuration.
+static std::shared_ptr<stripe::Program> GenerateCpuStripe(const lang::RunInfo& runinfo) {
+  auto program = GenerateStripe(runinfo);
+  auto cfgs = GetConfigs();
+  const auto& stage = cfgs.configs().at("cpu").stages().at("default");
+  codegen::CompilerState state(program);
+  codegen::Optimize(&state, stage.passes(), codegen::OptimizeOptions{});
+  return program;
+}
+
+// Collects the blocks nested within a block, itself included, which carry a tag.
+static void FindTagged(const std::shared_ptr<stripe::Block>& block, const std::string& tag,
+                       std::vector<std::shared_ptr<stripe::Block>>* found) {
+  if (block->has_tag(tag)) {
+    found->push_back(block);
+  }
+  for (const auto& stmt : block->stmts) {
+    auto inner = stripe::Block::Downcast(stmt);
+    if (inner) {
+      FindTagged(inner, tag, found);
+    }
+  }
+}
+
+// Fills the inputs of an M x K by K x N matmul with small integers, so that
+// the result is exact however the sums are ordered, and computes the result.
+static void FillMatMul(size_t M, size_t K, size_t N, std::vector<float>* A, std::vector<float>* B,
+                       std::vector<float>* expected) {
+  A->resize(M * K);
+  B->resize(K * N);
+  expected->assign(M * N, 0);
+  for (size_t i = 0; i < A->size(); ++i) {
+    (*A)[i] = static_cast<float>(i % 7) - 3;
+  }
+  for (size_t i = 0; i < B->size(); ++i) {
+    (*B)[i] = static_cast<float>(i % 5) - 2;
+  }
+  for (size_t m = 0; m < M; ++m) {
+    for (size_t n = 0; n < N; ++n) {
+      for (size_t k = 0; k < K; ++k) {
+        (*expected)[m * N + n] += (*A)[m * K + k] * (*B)[k * N + n];
+      }
+    }
+  }
+}
+
+static lang::RunInfo MatMulRunInfo(size_t M, size_t K, size_t N) {
+  lang::RunInfo runinfo;
+  runinfo.program_name = "matmul";
+  runinfo.code = "function (A[M, K], B[K, N]) -> (C) { C[m, n : M, N] = +(A[m, k] * B[k, n]); }";
+  runinfo.input_shapes.emplace("A", SimpleShape(DataType::FLOAT32, {M, K}));
+  runinfo.input_shapes.emplace("B", SimpleShape(DataType::FLOAT32, {K, N}));
+  runinfo.output_shapes.emplace("C", SimpleShape(DataType::FLOAT32, {M, N}));
+  return runinfo;
+}
+
 TEST(Jit, JitIntrinsicMUL_F32) {
   stripe::proto::Block input_proto;
   gp::TextFormat::ParseFromString(R"(
@@ -329,6 +398,104 @@ TEST(Jit, JitMatMul) {
   EXPECT_THAT(bufC, ContainerEq(expected));
 }
 
+TEST(Jit, JitMicrokernelMatMul) {
+  // Sizes are chosen so that neither rows nor columns divide evenly into the
+  // microkernel's register tiles.
+  const size_t M = 9;
+  const size_t K = 13;
+  const size_t N = 11;
+  std::vector<float> bufA(M * K);
+  std::vector<float> bufB(K * N);
+  std::vector<float> bufC(M * N);
+  std::vector<float> expected(M * N);
+  for (size_t i = 0; i < bufA.size(); ++i) {
+    bufA[i] = static_cast<float>(i % 7) - 3;
+  }
+  for (size_t i = 0; i < bufB.size(); ++i) {
+    bufB[i] = static_cast<float>(i % 5) - 2;
+  }
+  for (size_t m = 0; m < M; ++m) {
+    for (size_t n = 0; n < N; ++n) {
+      for (size_t k = 0; k < K; ++k) {
+        expected[m * N + n] += bufA[m * K + k] * bufB[k * N + n];
+      }
+    }
+  }
+
+  lang::RunInfo runinfo;
+  runinfo.program_name = "matmul";
+  runinfo.code = "function (A[M, K], B[K, N]) -> (C) { C[m, n : M, N] = +(A[m, k] * B[k, n]); }";
+  runinfo.input_shapes.emplace("A", SimpleShape(DataType::FLOAT32, {M, K}));
+  runinfo.input_shapes.emplace("B", SimpleShape(DataType::FLOAT32, {K, N}));
+  runinfo.output_shapes.emplace("C", SimpleShape(DataType::FLOAT32, {M, N}));
+
+  auto program = GenerateStripe(runinfo);
+  auto main = program->entry->SubBlock(0);
+  // Mark the contraction as the stencil pass would, so the JIT hands it to
+  // the GEMM microkernel rather than generating loops.
+  for (const auto& stmt : main->stmts) {
+    auto kernel = stripe::Block::Downcast(stmt);
+    if (kernel && kernel->has_tag("contraction")) {
+      kernel->set_tag("mac_inner");
+    }
+  }
+
+  std::map<std::string, void*> data = {
+      {"A", bufA.data()},
+      {"B", bufB.data()},
+      {"C", bufC.data()},
+  };
+  JitExecute(*main, data);
+
+  EXPECT_THAT(bufC, ContainerEq(expected));
+}
+
+// Checks a GEMM microkernel against a naive product, with sizes that leave
+// partial tiles in both m and n.
+template <typename T>
+static void CheckGemmMicrokernel(const Microkernel& kernel) {
+  const size_t M = 9;
+  const size_t K = 13;
+  const size_t N = 2 * kernel.width + 3;
+  std::vector<T> a(M * K);
+  std::vector<T> b(K * N);
+  std::vector<T> c(M * N, 1);
+  std::vector<T> expected(M * N, 1);
+  for (size_t i = 0; i < a.size(); ++i) {
+    a[i] = static_cast<T>(i % 7) - 3;
+  }
+  for (size_t i = 0; i < b.size(); ++i) {
+    b[i] = static_cast<T>(i % 5) - 2;
+  }
+  for (size_t m = 0; m < M; ++m) {
+    for (size_t n = 0; n < N; ++n) {
+      for (size_t k = 0; k < K; ++k) {
+        expected[m * N + n] += a[m * K + k] * b[k * N + n];
+      }
+    }
+  }
+  kernel.entry(c.data(), a.data(), b.data(), M, N, K, N, K, 1, N);
+  EXPECT_THAT(c, ContainerEq(expected)) << kernel.symbol;
+}
+
+TEST(Jit, MicrokernelUsesFmaWhenHostSupportsIt) {
+  // The JIT library is built for the baseline ISA, so the FMA kernels are
+  // only reachable through the CPUID check.
+  auto expected_isa = HostSupports(MicrokernelIsa::AVX2_FMA) ? MicrokernelIsa::AVX2_FMA : MicrokernelIsa::GENERIC;
+  for (size_t width : {8, 16}) {
+    auto kernel = FindGemmMicrokernel(DataType::FLOAT32, width);
+    ASSERT_NE(kernel, nullptr);
+    EXPECT_THAT(kernel->isa, Eq(expected_isa)) << kernel->symbol;
+    CheckGemmMicrokernel<float>(*kernel);
+  }
+  for (size_t width : {4, 8}) {
+    auto kernel = FindGemmMicrokernel(DataType::FLOAT64, width);
+    ASSERT_NE(kernel, nullptr);
+    EXPECT_THAT(kernel->isa, Eq(expected_isa)) << kernel->symbol;
+    CheckGemmMicrokernel<double>(*kernel);
+  }
+}
+
 TEST(Jit, JitNestedAlloc) {
   stripe::proto::Block input_proto;
   gp::TextFormat::ParseFromString(R"(
@@ -952,6 +1119,672 @@ TEST(Jit, JitExpSub4Nested) {
   EXPECT_FLOAT_EQ(X_T7[2], 0.0451117);
 }
 
+TEST(Jit, JitThreadedLoop) {
+  stripe::proto::Block input_proto;
+  gp::TextFormat::ParseFromString(R"(
+    loc {}
+    refs [
+      {
+        key: "bufA"
+        value {
+          loc {}
+          dir: 1
+          interior_shape { type: FLOAT32 dims: {size:1000 stride:1} }
+          access { }
+        }
+      },
+      {
+        key: "bufB"
+        value {
+          loc {}
+          dir: 2
+          interior_shape { type: FLOAT32 dims: {size:1000 stride:1} }
+          access { }
+        }
+      }
+    ]
+    stmts {
+      attrs { key: "cpu_thread" value {} }
+      block {
+        idxs { name: "i" range: 1000 }
+        refs [
+          {
+            key: "bufA"
+            value {
+              loc {}
+              dir: 1
+              interior_shape { type: FLOAT32 dims: {size:1 stride:1} }
+              access { offset: 0 terms {key:"i" value:1} }
+            }
+          },
+          {
+            key: "bufB"
+            value {
+              loc {}
+              dir: 2
+              interior_shape { type: FLOAT32 dims: {size:1 stride:1} }
+              access { offset: 0 terms {key:"i" value:1} }
+            }
+          }
+        ]
+        stmts { load { from:"bufA" into:"$1" } }
+        stmts { intrinsic { name:"add" type:FLOAT32 inputs:"$1" inputs:"$1" outputs:"$2"} }
+        stmts { store { from:"$2" into:"bufB"} }
+      }
+    }
+  )",
+                                  &input_proto);
+  std::shared_ptr<stripe::Block> block{stripe::FromProto(input_proto)};
+
+  std::vector<float> bufA(1000);
+  std::vector<float> bufB(1000);
+  std::vector<float> expected(1000);
+  for (size_t i = 0; i < bufA.size(); ++i) {
+    bufA[i] = i;
+    expected[i] = 2 * i;
+  }
+
+  // Run twice through the same Native to exercise reuse of its thread pool.
+  Native native;
+  std::map<std::string, External> externals;
+  native.compile(*block, externals);
+  std::map<std::string, void*> buffers{{"bufA", bufA.data()}, {"bufB", bufB.data()}};
+  for (int run = 0; run < 2; ++run) {
+    std::fill(bufB.begin(), bufB.end(), 0);
+    native.run(buffers);
+    EXPECT_THAT(bufB, ContainerEq(expected));
+  }
+}
+
+TEST(Jit, JitVectorizedLoop) {
+  // The innermost range is deliberately not a multiple of any vector width,
+  // so the final iteration of each row runs with some lanes masked off.
+  stripe::proto::Block input_proto;
+  gp::TextFormat::ParseFromString(R"(
+    loc {}
+    idxs { name: "i" range: 4 }
+    idxs { name: "j" range: 37 attrs { key: "vectorize" value {} } }
+    refs [
+      {
+        key: "bufA"
+        value {
+          loc {}
+          dir: 1
+          access { offset: 0 terms {key:"i" value:1} }
+          access { offset: 0 terms {key:"j" value:1} }
+          interior_shape { type: FLOAT32 dims: {size:4 stride:37} dims: {size:37 stride:1} }
+        }
+      },
+      {
+        key: "bufB"
+        value {
+          loc {}
+          dir: 2
+          access { offset: 0 terms {key:"i" value:1} }
+          access { offset: 0 terms {key:"j" value:1} }
+          interior_shape { type: FLOAT32 dims: {size:4 stride:37} dims: {size:37 stride:1} }
+        }
+      },
+      {
+        key: "bufC"
+        value {
+          loc {}
+          dir: 3
+          agg_op: "add"
+          access { offset: 0 terms {key:"i" value:1} }
+          interior_shape { type: FLOAT32 dims: {size:4 stride:1} }
+        }
+      }
+    ]
+    stmts { load { from:"bufA" into:"$1" } }
+    stmts { intrinsic { name:"sqrt" type:FLOAT32 inputs:"$1" outputs:"$2"} }
+    stmts { store { from:"$2" into:"bufB"} }
+    stmts { store { from:"$1" into:"bufC"} }
+  )",
+                                  &input_proto);
+  std::shared_ptr<stripe::Block> block{stripe::FromProto(input_proto)};
+
+  std::vector<float> bufA(4 * 37);
+  std::vector<float> bufB(4 * 37);
+  std::vector<float> bufC(4);
+  std::vector<float> expectedB(4 * 37);
+  std::vector<float> expectedC(4);
+  for (size_t i = 0; i < 4; ++i) {
+    for (size_t j = 0; j < 37; ++j) {
+      float root = i + j;
+      bufA[i * 37 + j] = root * root;
+      expectedB[i * 37 + j] = root;
+      expectedC[i] += root * root;
+    }
+  }
+
+  std::map<std::string, void*> buffers{{"bufA", bufA.data()}, {"bufB", bufB.data()}, {"bufC", bufC.data()}};
+  JitExecute(*block, buffers);
+
+  EXPECT_THAT(bufB, ContainerEq(expectedB));
+  EXPECT_THAT(bufC, ContainerEq(expectedC));
+}
+
+TEST(Jit, JitVectorizedTanh) {
+  // The inputs span tiny magnitudes, where 1 - 2 / (exp(2x) + 1) loses all of
+  // its significant bits, through saturation.
+  stripe::proto::Block input_proto;
+  gp::TextFormat::ParseFromString(R"(
+    loc {}
+    idxs { name: "i" range: 61 attrs { key: "vectorize" value {} } }
+    refs [
+      {
+        key: "bufA"
+        value {
+          loc {}
+          dir: 1
+          access { offset: 0 terms {key:"i" value:1} }
+          interior_shape { type: FLOAT32 dims: {size:61 stride:1} }
+        }
+      },
+      {
+        key: "bufB"
+        value {
+          loc {}
+          dir: 2
+          access { offset: 0 terms {key:"i" value:1} }
+          interior_shape { type: FLOAT32 dims: {size:61 stride:1} }
+        }
+      }
+    ]
+    stmts { load { from:"bufA" into:"$1" } }
+    stmts { intrinsic { name:"tanh" type:FLOAT32 inputs:"$1" outputs:"$2"} }
+    stmts { store { from:"$2" into:"bufB"} }
+  )",
+                                  &input_proto);
+  std::shared_ptr<stripe::Block> block{stripe::FromProto(input_proto)};
+
+  std::vector<float> bufA;
+  for (int e = -28; e <= 0; ++e) {
+    bufA.push_back(std::ldexp(1.5f, e));
+    bufA.push_back(-std::ldexp(1.25f, e / 2));
+  }
+  // Either side of the switch between the two approximations, and saturation.
+  bufA.push_back(0.4999f);
+  bufA.push_back(-0.5001f);
+  bufA.push_back(9.0f);
+  std::vector<float> bufB(bufA.size());
+
+  std::map<std::string, void*> buffers{{"bufA", bufA.data()}, {"bufB", bufB.data()}};
+  JitExecute(*block, buffers);
+
+  for (size_t i = 0; i < bufA.size(); ++i) {
+    float expected = std::tanh(bufA[i]);
+    EXPECT_NEAR(bufB[i], expected, 8 * std::numeric_limits<float>::epsilon() * std::abs(expected)) << bufA[i];
+  }
+}
+
+TEST(Jit, JitConfiguredVectorize) {
+  // A max reduction isn't a multiply-accumulate, so it reaches the JIT as a
+  // contract_inner block, which the configuration tags for vectorization.
+  const size_t M = 48;
+  const size_t K = 80;
+  lang::RunInfo runinfo;
+  runinfo.program_name = "max_rows";
+  runinfo.code = "function (A[M, K]) -> (C) { C[m : M] = >(A[m, k]); }";
+  runinfo.input_shapes.emplace("A", SimpleShape(DataType::FLOAT32, {M, K}));
+  runinfo.output_shapes.emplace("C", SimpleShape(DataType::FLOAT32, {M}));
+  auto program = GenerateCpuStripe(runinfo);
+
+  std::vector<std::shared_ptr<stripe::Block>> vectorized;
+  FindTagged(program->entry, "vectorize", &vectorized);
+  auto has_vector_loop = [](const std::shared_ptr<stripe::Block>& block) {
+    return !block->idxs.empty() && block->idxs.back().range > 1;
+  };
+  EXPECT_TRUE(std::any_of(vectorized.begin(), vectorized.end(), has_vector_loop));
+
+  std::vector<float> A(M * K);
+  std::vector<float> C(M);
+  std::vector<float> expected(M, -std::numeric_limits<float>::infinity());
+  for (size_t m = 0; m < M; ++m) {
+    for (size_t k = 0; k < K; ++k) {
+      A[m * K + k] = static_cast<float>((m * 7 + k * 13) % 101) - 50;
+      expected[m] = std::max(expected[m], A[m * K + k]);
+    }
+  }
+  std::map<std::string, void*> buffers{{"A", A.data()}, {"C", C.data()}};
+  JitExecute(*program->entry, buffers);
+  EXPECT_THAT(C, ContainerEq(expected));
+}
+
+TEST(Jit, JitGather) {
+  // Indexes are 64-bit, and the last one is out of range, so it is clamped.
+  // Rows are 16KiB, so the 11 output rows span several parallel chunks.
+  const size_t kRows = 4;
+  const size_t kCols = 4096;
+  stripe::proto::Block input_proto;
+  gp::TextFormat::ParseFromString(R"(
+    loc {}
+    refs [
+      {
+        key: "data"
+        value {
+          loc {}
+          dir: 1
+          interior_shape { type: FLOAT32 dims: {size:4 stride:4096} dims: {size:4096 stride:1} }
+        }
+      },
+      {
+        key: "idx"
+        value {
+          loc {}
+          dir: 1
+          interior_shape { type: INT64 dims: {size:11 stride:1} }
+        }
+      },
+      {
+        key: "out"
+        value {
+          loc {}
+          dir: 2
+          interior_shape { type: FLOAT32 dims: {size:11 stride:4096} dims: {size:4096 stride:1} }
+        }
+      }
+    ]
+    stmts { special { name: "gather" inputs: "data" inputs: "idx" outputs: "out" } }
+  )",
+                                  &input_proto);
+  std::shared_ptr<stripe::Block> block{stripe::FromProto(input_proto)};
+
+  std::vector<float> data(kRows * kCols);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = i;
+  }
+  std::vector<int64_t> idx = {2, 0, 2, 1, 3, 3, 0, 1, 2, 0, 7};
+  std::vector<float> out(idx.size() * kCols);
+  std::vector<float> expected(idx.size() * kCols);
+  for (size_t i = 0; i < idx.size(); ++i) {
+    size_t row = std::min<size_t>(idx[i], kRows - 1);
+    std::copy_n(data.begin() + row * kCols, kCols, expected.begin() + i * kCols);
+  }
+
+  Native native;
+  std::map<std::string, External> externals;
+  native.compile(*block, externals);
+  native.run({{"data", data.data()}, {"idx", idx.data()}, {"out", out.data()}});
+
+  EXPECT_THAT(out, ContainerEq(expected));
+}
+
+TEST(Jit, JitGatherFromEmptyTensorIsRejected) {
+  // With no data rows there's nothing to clamp an index to, and the runtime
+  // can't report that from inside the generated code, so compilation fails.
+  stripe::proto::Block input_proto;
+  gp::TextFormat::ParseFromString(R"(
+    loc {}
+    refs [
+      {
+        key: "data"
+        value {
+          loc {}
+          dir: 1
+          interior_shape { type: FLOAT32 dims: {size:0 stride:8} dims: {size:8 stride:1} }
+        }
+      },
+      {
+        key: "idx"
+        value {
+          loc {}
+          dir: 1
+          interior_shape { type: INT32 dims: {size:3 stride:1} }
+        }
+      },
+      {
+        key: "out"
+        value {
+          loc {}
+          dir: 2
+          interior_shape { type: FLOAT32 dims: {size:3 stride:8} dims: {size:8 stride:1} }
+        }
+      }
+    ]
+    stmts { special { name: "gather" inputs: "data" inputs: "idx" outputs: "out" } }
+  )",
+                                  &input_proto);
+  std::shared_ptr<stripe::Block> block{stripe::FromProto(input_proto)};
+
+  Native native;
+  std::map<std::string, External> externals;
+  EXPECT_THROW(native.compile(*block, externals), std::runtime_error);
+}
+
+TEST(Jit, JitScatter) {
+  // Several source rows land on the same output row; they must all be summed
+  // even though the output rows are split across threads. Each output row
+  // gathers about 170KiB of sources, so every row is its own parallel chunk.
+  const size_t kCount = 300;
+  const size_t kRows = 7;
+  const size_t kCols = 1024;
+  stripe::proto::Block input_proto;
+  gp::TextFormat::ParseFromString(R"(
+    loc {}
+    refs [
+      {
+        key: "expn"
+        value {
+          loc {}
+          dir: 1
+          interior_shape { type: INT32 dims: {size:300 stride:1024} dims: {size:1024 stride:1} }
+        }
+      },
+      {
+        key: "idx"
+        value {
+          loc {}
+          dir: 1
+          interior_shape { type: INT32 dims: {size:300 stride:1} }
+        }
+      },
+      {
+        key: "out"
+        value {
+          loc {}
+          dir: 2
+          interior_shape { type: INT32 dims: {size:7 stride:1024} dims: {size:1024 stride:1} }
+        }
+      }
+    ]
+    stmts { special { name: "scatter" inputs: "expn" inputs: "idx" outputs: "out" } }
+  )",
+                                  &input_proto);
+  std::shared_ptr<stripe::Block> block{stripe::FromProto(input_proto)};
+
+  std::vector<int32_t> expn(kCount * kCols);
+  std::vector<int32_t> idx(kCount);
+  std::vector<int32_t> out(kRows * kCols);
+  std::vector<int32_t> expected(kRows * kCols);
+  for (size_t i = 0; i < kCount; ++i) {
+    idx[i] = (i * 5) % kRows;
+    for (size_t j = 0; j < kCols; ++j) {
+      expn[i * kCols + j] = i + j;
+      expected[idx[i] * kCols + j] += i + j;
+    }
+  }
+
+  Native native;
+  std::map<std::string, External> externals;
+  native.compile(*block, externals);
+  native.run({{"expn", expn.data()}, {"idx", idx.data()}, {"out", out.data()}});
+
+  EXPECT_THAT(out, ContainerEq(expected));
+}
+
+TEST(Jit, JitPhiloxStep) {
+  // A zero key and counter must reproduce the Philox4x32-10 known-answer
+  // vector, and the buffer must not depend on how many threads filled it.
+  const size_t kCount = 100003;
+  stripe::proto::Block input_proto;
+  gp::TextFormat::ParseFromString(R"(
+    loc {}
+    refs [
+      {
+        key: "state"
+        value {
+          loc {}
+          dir: 1
+          interior_shape { type: UINT32 dims: {size:3 stride:2} dims: {size:2 stride:1} }
+        }
+      },
+      {
+        key: "new_state"
+        value {
+          loc {}
+          dir: 2
+          interior_shape { type: UINT32 dims: {size:3 stride:2} dims: {size:2 stride:1} }
+        }
+      },
+      {
+        key: "out"
+        value {
+          loc {}
+          dir: 2
+          interior_shape { type: UINT32 dims: {size:100003 stride:1} }
+        }
+      }
+    ]
+    stmts {
+      special {
+        name: "prng_step"
+        inputs: "state"
+        outputs: "new_state"
+        outputs: "out"
+        str_params { key: "generator" value: "philox" }
+      }
+    }
+  )",
+                                  &input_proto);
+  std::shared_ptr<stripe::Block> block{stripe::FromProto(input_proto)};
+
+  std::vector<uint32_t> state(6);
+  std::vector<uint32_t> new_state(6);
+  std::vector<uint32_t> serial(kCount);
+  JitExecute(*block, {{"state", state.data()}, {"new_state", new_state.data()}, {"out", serial.data()}});
+
+  std::vector<uint32_t> first(serial.begin(), serial.begin() + 4);
+  std::vector<uint32_t> expected = {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8};
+  EXPECT_THAT(first, ContainerEq(expected));
+  EXPECT_THAT(new_state[4], Eq(1u));
+
+  std::vector<uint32_t> threaded(kCount);
+  Native native;
+  std::map<std::string, External> externals;
+  native.compile(*block, externals);
+  native.run({{"state", state.data()}, {"new_state", new_state.data()}, {"out", threaded.data()}});
+  EXPECT_THAT(threaded, ContainerEq(serial));
+
+  // The next state selects a different stream.
+  native.run({{"state", new_state.data()}, {"new_state", state.data()}, {"out", threaded.data()}});
+  EXPECT_NE(threaded, serial);
+  EXPECT_THAT(state[4], Eq(2u));
+}
+
+TEST(Jit, JitPhiloxSelectedByAttribute) {
+  // Tile code reaches the Philox generator through an attribute on the
+  // prng_step op; a zero state reproduces the known-answer vector.
+  lang::RunInfo runinfo;
+  runinfo.program_name = "philox";
+  runinfo.code = R"(
+    function (S) -> (O, NS) {
+      [[generator(philox)]] T = prng_step(S, 8);
+      NS = prng_state(T);
+      O = prng_value(T);
+    }
+  )";
+  runinfo.input_shapes.emplace("S", SimpleShape(DataType::UINT32, {3, lang::k_rng_size}));
+  runinfo.output_shapes.emplace("O", SimpleShape(DataType::FLOAT32, {8}));
+  runinfo.output_shapes.emplace("NS", SimpleShape(DataType::UINT32, {3, lang::k_rng_size}));
+  // The shipped passes prune the op's tuple result, which has no storage.
+  auto program = GenerateCpuStripe(runinfo);
+
+  std::vector<uint32_t> state(3 * lang::k_rng_size);
+  std::vector<uint32_t> new_state(3 * lang::k_rng_size);
+  std::vector<uint32_t> out(8);
+  Native native;
+  std::map<std::string, External> externals;
+  native.compile(*program->entry, externals);
+  native.run({{"S", state.data()}, {"NS", new_state.data()}, {"O", out.data()}});
+
+  std::vector<uint32_t> first(out.begin(), out.begin() + 4);
+  std::vector<uint32_t> expected = {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8};
+  EXPECT_THAT(first, ContainerEq(expected));
+  EXPECT_THAT(new_state[2 * lang::k_rng_size], Eq(1u));
+}
+
+TEST(Jit, JitPhiloxRejectsOverlappingState) {
+  // Two words of state can't hold a separate key and stream number.
+  stripe::proto::Block input_proto;
+  gp::TextFormat::ParseFromString(R"(
+    loc {}
+    refs [
+      {
+        key: "state"
+        value { loc {} dir: 1 interior_shape { type: UINT32 dims: {size:2 stride:1} } }
+      },
+      {
+        key: "new_state"
+        value { loc {} dir: 2 interior_shape { type: UINT32 dims: {size:2 stride:1} } }
+      },
+      {
+        key: "out"
+        value { loc {} dir: 2 interior_shape { type: UINT32 dims: {size:16 stride:1} } }
+      }
+    ]
+    stmts {
+      special {
+        name: "prng_step"
+        inputs: "state"
+        outputs: "new_state"
+        outputs: "out"
+        str_params { key: "generator" value: "philox" }
+      }
+    }
+  )",
+                                  &input_proto);
+  std::shared_ptr<stripe::Block> block{stripe::FromProto(input_proto)};
+
+  Native native;
+  std::map<std::string, External> externals;
+  EXPECT_THROW(native.compile(*block, externals), std::runtime_error);
+}
+
+TEST(Jit, ThreadedIndexNeedsDisjointWrites) {
+  auto parse = [](const std::string& access) {
+    stripe::proto::Block input_proto;
+    gp::TextFormat::ParseFromString(R"(
+      loc {}
+      idxs { name: "a" range: 8 }
+      idxs { name: "i" range: 8 }
+      idxs { name: "j" range: 4 }
+      refs [
+        {
+          key: "out"
+          value {
+            loc {}
+            dir: 2
+            agg_op: "add"
+            interior_shape { type: FLOAT32 dims: {size:32 stride:1} }
+            )" + access + R"(
+          }
+        }
+      ]
+    )",
+                                    &input_proto);
+    std::shared_ptr<stripe::Block> block{stripe::FromProto(input_proto)};
+    block->set_tag("cpu_thread");
+    return block;
+  };
+  // a is accumulated over, and i and j only together pick an element.
+  auto overlapping = parse(R"(access { terms {key:"i" value:1} terms {key:"j" value:1} })");
+  EXPECT_THAT(ThreadedIndex(*overlapping), Eq(3));
+  // i alone picks the element, so its values write disjoint elements.
+  auto disjoint = parse(R"(access { offset: 1 terms {key:"i" value:4} })");
+  EXPECT_THAT(ThreadedIndex(*disjoint), Eq(1));
+}
+
+TEST(Jit, JitConfiguredMatMulThreads) {
+  // Stripe orders indexes by name, so the first index of the tiled matmul is
+  // the accumulation index k; the JIT must split m or n instead.
+  const size_t M = 128;
+  const size_t K = 128;
+  const size_t N = 128;
+  std::vector<float> bufA;
+  std::vector<float> bufB;
+  std::vector<float> bufC(M * N);
+  std::vector<float> expected;
+  FillMatMul(M, K, N, &bufA, &bufB, &expected);
+
+  auto program = GenerateCpuStripe(MatMulRunInfo(M, K, N));
+  std::vector<std::shared_ptr<stripe::Block>> threaded;
+  FindTagged(program->entry, "cpu_thread", &threaded);
+  ASSERT_THAT(threaded.size(), Eq(1));
+  auto block = threaded[0];
+  size_t idx = ThreadedIndex(*block);
+  ASSERT_LT(idx, block->idxs.size());
+  EXPECT_THAT(block->accumulation_idxs().count(&block->idxs[idx]), Eq(0));
+
+  Native native;
+  std::map<std::string, External> externals;
+  native.compile(*program->entry, externals);
+  native.run({{"A", bufA.data()}, {"B", bufB.data()}, {"C", bufC.data()}});
+  EXPECT_THAT(bufC, ContainerEq(expected));
+}
+
+TEST(Jit, JitConfiguredMatMulGemm) {
+  // The shipped stencil must hand the microkernel a whole m x n x k tile per
+  // call, not a single row of the output.
+  const size_t M = 64;
+  const size_t K = 96;
+  const size_t N = 40;
+  std::vector<float> bufA;
+  std::vector<float> bufB;
+  std::vector<float> bufC(M * N);
+  std::vector<float> expected;
+  FillMatMul(M, K, N, &bufA, &bufB, &expected);
+
+  auto program = GenerateCpuStripe(MatMulRunInfo(M, K, N));
+  std::vector<std::shared_ptr<stripe::Block>> inner;
+  FindTagged(program->entry, "mac_inner", &inner);
+  ASSERT_THAT(inner.size(), Eq(1));
+  std::map<std::string, uint64_t> ranges;
+  for (const auto& idx : inner[0]->idxs) {
+    ranges[idx.name] = idx.range;
+  }
+  EXPECT_THAT(ranges["m"], Eq(4));
+  EXPECT_THAT(ranges["n"], Eq(8));
+  EXPECT_THAT(ranges["k"], Eq(K));
+  EXPECT_TRUE(inner[0]->constraints.empty());
+
+  Native native;
+  std::map<std::string, External> externals;
+  native.compile(*program->entry, externals);
+  native.run({{"A", bufA.data()}, {"B", bufB.data()}, {"C", bufC.data()}});
+  EXPECT_THAT(bufC, ContainerEq(expected));
+}
+
+TEST(Jit, ThreadPoolCoversRange) {
+  ThreadPool pool(4);
+  std::vector<std::atomic<int>> hits(10007);
+  for (auto& hit : hits) {
+    hit = 0;
+  }
+  pool.ParallelFor(hits.size(), 16, [&hits](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      hits[i]++;
+    }
+  });
+  for (auto& hit : hits) {
+    EXPECT_THAT(hit.load(), Eq(1));
+  }
+}
+
+TEST(Jit, ThreadPoolSlotsStayOnOneThread) {
+  ThreadPool pool(4);
+  std::vector<std::atomic<int>> hits(10007);
+  for (auto& hit : hits) {
+    hit = 0;
+  }
+  std::vector<std::set<std::thread::id>> threads(pool.size());
+  pool.ParallelForSlots(hits.size(), 64, [&](size_t slot, size_t begin, size_t end) {
+    // Only the slot's own participant touches its entries.
+    threads[slot].insert(std::this_thread::get_id());
+    EXPECT_THAT(end - begin, Le(64));
+    for (size_t i = begin; i < end; ++i) {
+      hits[i]++;
+    }
+  });
+  for (const auto& slot_threads : threads) {
+    EXPECT_THAT(slot_threads.size(), Le(1));
+  }
+  for (auto& hit : hits) {
+    EXPECT_THAT(hit.load(), Eq(1));
+  }
+}
+
 }  // namespace test
 }  // namespace cpu
 }  // namespace targets
@@ -0,0 +1,197 @@
+// Copyright 2019, Intel Corp.
+
+#include "tile/targets/cpu/thread_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace vertexai {
+namespace tile {
+namespace targets {
+namespace cpu {
+
+namespace {
+thread_local ThreadPool* current_pool_ = nullptr;
+}  // namespace
+
+ThreadPool::ThreadPool(size_t threads) {
+  if (!threads) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (size_t i = 0; i < threads; ++i) {
+    slots_.emplace_back(new Slot);
+  }
+  // Slot zero belongs to whichever thread calls ParallelFor.
+  for (size_t i = 1; i < threads; ++i) {
+    workers_.emplace_back(&ThreadPool::WorkerMain, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock{mu_};
+    shutdown_ = true;
+  }
+  work_cv_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+ThreadPool* ThreadPool::Current() { return current_pool_; }
+
+ThreadPool::Scope::Scope(ThreadPool* pool) : prev_{current_pool_} { current_pool_ = pool; }
+
+ThreadPool::Scope::~Scope() { current_pool_ = prev_; }
+
+void ThreadPool::ParallelFor(size_t range, size_t grain, const Body& body) {
+  ParallelForSlots(range, grain, [&body](size_t, size_t begin, size_t end) { body(begin, end); });
+}
+
+void ThreadPool::ParallelForSlots(size_t range, size_t grain, const SlotBody& body) {
+  if (!range) {
+    return;
+  }
+  grain = std::max<size_t>(grain, 1);
+  if (slots_.size() == 1 || range <= grain) {
+    Scope serial{nullptr};
+    body(0, 0, range);
+    return;
+  }
+  std::lock_guard<std::mutex> run_lock{run_mu_};
+  {
+    std::unique_lock<std::mutex> lock{mu_};
+    // Workers which woke up late for the previous loop may still be looking
+    // at the slots; wait for them to drain before handing out new work.
+    done_cv_.wait(lock, [this] { return !active_; });
+    size_t parts = slots_.size();
+    for (size_t i = 0; i < parts; ++i) {
+      std::lock_guard<std::mutex> slot_lock{slots_[i]->mu};
+      slots_[i]->begin = range * i / parts;
+      slots_[i]->end = range * (i + 1) / parts;
+    }
+    body_ = &body;
+    grain_ = grain;
+    remaining_ = range;
+    error_ = nullptr;
+    ++generation_;
+    ++active_;
+  }
+  work_cv_.notify_all();
+  Work(0, body, grain);
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> lock{mu_};
+    --active_;
+    done_cv_.wait(lock, [this] { return !remaining_ && !active_; });
+    body_ = nullptr;
+    std::swap(error, error_);
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void ThreadPool::WorkerMain(size_t slot) {
+  size_t seen = 0;
+  for (;;) {
+    const SlotBody* body = nullptr;
+    size_t grain = 1;
+    {
+      std::unique_lock<std::mutex> lock{mu_};
+      work_cv_.wait(lock, [&] { return shutdown_ || seen != generation_; });
+      if (shutdown_) {
+        return;
+      }
+      seen = generation_;
+      if (!body_) {
+        continue;
+      }
+      body = body_;
+      grain = grain_;
+      ++active_;
+    }
+    Work(slot, *body, grain);
+    {
+      std::lock_guard<std::mutex> lock{mu_};
+      --active_;
+    }
+    done_cv_.notify_all();
+  }
+}
+
+void ThreadPool::Work(size_t slot, const SlotBody& body, size_t grain) {
+  Scope serial{nullptr};
+  size_t begin;
+  size_t end;
+  while (Take(slot, grain, &begin, &end) || (Steal(slot) && Take(slot, grain, &begin, &end))) {
+    try {
+      body(slot, begin, end);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock{mu_};
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+    }
+    if (remaining_.fetch_sub(end - begin) == end - begin) {
+      // Notifying under the lock keeps a waiter from missing the last update.
+      std::lock_guard<std::mutex> lock{mu_};
+      done_cv_.notify_all();
+    }
+  }
+}
+
+bool ThreadPool::Take(size_t slot, size_t grain, size_t* begin, size_t* end) {
+  auto& own = *slots_[slot];
+  std::lock_guard<std::mutex> lock{own.mu};
+  if (own.begin == own.end) {
+    return false;
+  }
+  *begin = own.begin;
+  *end = std::min(own.end, own.begin + grain);
+  own.begin = *end;
+  return true;
+}
+
+bool ThreadPool::Steal(size_t slot) {
+  for (;;) {
+    // Pick the participant with the most work left; the sizes may change
+    // while we look, so the choice is re-validated under the victim's lock.
+    size_t victim = slot;
+    size_t most = 0;
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      if (i == slot) {
+        continue;
+      }
+      std::lock_guard<std::mutex> lock{slots_[i]->mu};
+      size_t left = slots_[i]->end - slots_[i]->begin;
+      if (most < left) {
+        most = left;
+        victim = i;
+      }
+    }
+    if (victim == slot) {
+      return false;
+    }
+    auto& from = *slots_[victim];
+    auto& into = *slots_[slot];
+    std::lock(from.mu, into.mu);
+    std::lock_guard<std::mutex> from_lock{from.mu, std::adopt_lock};
+    std::lock_guard<std::mutex> into_lock{into.mu, std::adopt_lock};
+    if (from.begin == from.end) {
+      continue;
+    }
+    // Take the back half, leaving the front (the part the victim is about to
+    // run next) in place; a single remaining iteration is taken whole.
+    size_t mid = from.begin + (from.end - from.begin) / 2;
+    into.begin = mid;
+    into.end = from.end;
+    from.end = mid;
+    return true;
+  }
+}
+
+}  // namespace cpu
+}  // namespace targets
+}  // namespace tile
+}  // namespace vertexai
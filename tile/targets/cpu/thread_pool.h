@@ -0,0 +1,97 @@
+// Copyright 2019, Intel Corp.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vertexai {
+namespace tile {
+namespace targets {
+namespace cpu {
+
+// A fixed set of worker threads which cooperatively execute parallel-for
+// loops. Each participant starts with a contiguous slice of the iteration
+// range; once its own slice is exhausted it steals the back half of the
+// largest remaining slice, so uneven iterations still balance out without
+// giving up locality between neighbouring iterations.
+class ThreadPool {
+ public:
+  using Body = std::function<void(size_t begin, size_t end)>;
+  using SlotBody = std::function<void(size_t slot, size_t begin, size_t end)>;
+
+  // A thread count of zero means one thread per hardware thread.
+  explicit ThreadPool(size_t threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Number of participants in each loop, including the calling thread.
+  size_t size() const { return slots_.size(); }
+
+  // Invokes body over disjoint subranges which together cover [0, range),
+  // using the calling thread as one of the participants. Returns once every
+  // iteration has completed; rethrows the first exception raised by body.
+  void ParallelFor(size_t range, size_t grain, const Body& body);
+
+  // As ParallelFor, also passing body the participant running each
+  // subrange, in [0, size()). A participant runs on one thread throughout a
+  // loop, so per-participant state indexed by slot needs no locking.
+  void ParallelForSlots(size_t range, size_t grain, const SlotBody& body);
+
+  // The pool attached to the calling thread, or nullptr if there is none.
+  // Code running inside a ParallelFor body never sees a current pool, so
+  // nested parallel loops run serially on the thread which reached them.
+  static ThreadPool* Current();
+
+  // Attaches a pool to the calling thread for the lifetime of the scope.
+  class Scope {
+   public:
+    explicit Scope(ThreadPool* pool);
+    ~Scope();
+
+   private:
+    ThreadPool* prev_;
+  };
+
+ private:
+  struct Slot {
+    std::mutex mu;
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+  void WorkerMain(size_t slot);
+  void Work(size_t slot, const SlotBody& body, size_t grain);
+  bool Take(size_t slot, size_t grain, size_t* begin, size_t* end);
+  bool Steal(size_t slot);
+
+  std::vector<std::unique_ptr<Slot>> slots_;
+  std::vector<std::thread> workers_;
+
+  std::mutex run_mu_;  // Serializes ParallelFor calls from different threads
+
+  std::mutex mu_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  const SlotBody* body_ = nullptr;
+  size_t grain_ = 1;
+  size_t generation_ = 0;
+  std::atomic<size_t> remaining_{0};  // Iterations not yet run; only reaching zero takes mu_
+  size_t active_ = 0;
+  bool shutdown_ = false;
+  std::exception_ptr error_;
+};
+
+}  // namespace cpu
+}  // namespace targets
+}  // namespace tile
+}  // namespace vertexai
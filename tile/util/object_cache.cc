@@ -0,0 +1,172 @@
+// Copyright 2019 Intel Corporation.
+
+#include "tile/util/object_cache.h"
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <iomanip>
+#include <sstream>
+#include <utility>
+
+#include "base/util/env.h"
+#include "base/util/file.h"
+#include "base/util/logging.h"
+#include "base/util/perf_counter.h"
+#include "tile/lang/fnv1a64.h"
+
+namespace fs = boost::filesystem;
+
+namespace vertexai {
+namespace tile {
+namespace util {
+namespace {
+
+PerfCounter cache_hits("llvm_object_cache_hits");
+PerfCounter cache_misses("llvm_object_cache_misses");
+
+std::string HostDescription() {
+  // Anything which changes the generated machine code for the same IR must be
+  // part of the key.
+  std::ostringstream ss;
+  ss << llvm::sys::getProcessTriple() << ';' << llvm::sys::getHostCPUName().str();
+  llvm::StringMap<bool> features;
+  if (llvm::sys::getHostCPUFeatures(features)) {
+    std::map<std::string, bool> sorted;
+    for (const auto& feature : features) {
+      sorted.emplace(feature.getKey().str(), feature.getValue());
+    }
+    for (const auto& feature : sorted) {
+      ss << ';' << (feature.second ? '+' : '-') << feature.first;
+    }
+  }
+  return ss.str();
+}
+
+}  // namespace
+
+ObjectCache* ObjectCache::Instance() {
+  static std::unique_ptr<ObjectCache> instance = []() -> std::unique_ptr<ObjectCache> {
+    auto env_cache = env::Get("PLAIDML_LLVM_CACHE");
+    if (env_cache.empty()) {
+      return nullptr;
+    }
+    VLOG(1) << "Using LLVM object cache directory: " << env_cache;
+    return std::make_unique<ObjectCache>(env_cache);
+  }();
+  return instance.get();
+}
+
+ObjectCache::ObjectCache(const fs::path& dir) : dir_{dir}, host_{HostDescription()} {
+  boost::system::error_code ec;
+  fs::create_directories(dir_, ec);
+  if (ec) {
+    LOG(WARNING) << "Unable to create LLVM object cache directory " << dir_ << ": " << ec.message();
+  }
+}
+
+std::string ObjectCache::Key(const llvm::Module& module) const {
+  std::string ir;
+  llvm::raw_string_ostream os(ir);
+  module.print(os, nullptr);
+  os.flush();
+  std::ostringstream ss;
+  auto hash = fnv1a64::hash(host_.data(), host_.size());
+  ss << std::hex << std::setw(16) << std::setfill('0') << fnv1a64::hash(ir.data(), ir.size(), hash);
+  return ss.str();
+}
+
+fs::path ObjectCache::ObjectPath(const std::string& key) const { return dir_ / (key + ".o"); }
+
+std::shared_ptr<llvm::MemoryBuffer> ObjectCache::Load(const std::string& key) {
+  auto path = ObjectPath(key);
+  if (!fs::is_regular_file(path)) {
+    return nullptr;
+  }
+  try {
+    std::shared_ptr<llvm::MemoryBuffer> obj = llvm::MemoryBuffer::getMemBufferCopy(ReadFile(path, true), key);
+    auto parsed = llvm::object::ObjectFile::createObjectFile(obj->getMemBufferRef());
+    if (parsed) {
+      return obj;
+    }
+    LOG(WARNING) << "Removing corrupt cached LLVM object " << path << ": " << llvm::toString(parsed.takeError());
+  } catch (const std::exception& ex) {
+    LOG(WARNING) << "Removing unreadable cached LLVM object " << path << ": " << ex.what();
+  }
+  boost::system::error_code ec;
+  fs::remove(path, ec);
+  return nullptr;
+}
+
+void ObjectCache::Bind(const llvm::Module* module, std::string key, std::shared_ptr<llvm::MemoryBuffer> obj) {
+  std::lock_guard<std::mutex> lock{mu_};
+  bound_[module] = Binding{std::move(key), std::move(obj)};
+}
+
+void ObjectCache::Unbind(const llvm::Module* module) {
+  std::lock_guard<std::mutex> lock{mu_};
+  bound_.erase(module);
+}
+
+std::unique_ptr<llvm::MemoryBuffer> ObjectCache::getObject(const llvm::Module* module) {
+  Binding binding;
+  bool bound = false;
+  {
+    std::lock_guard<std::mutex> lock{mu_};
+    auto it = bound_.find(module);
+    if (it != bound_.end()) {
+      binding = std::move(it->second);
+      bound_.erase(it);
+      bound = true;
+    }
+  }
+  if (!bound) {
+    binding.key = Key(*module);
+    binding.obj = Load(binding.key);
+  }
+  auto path = ObjectPath(binding.key);
+  if (binding.obj) {
+    VLOG(2) << "LLVM object cache hit: " << path;
+    cache_hits.inc();
+    return llvm::MemoryBuffer::getMemBufferCopy(binding.obj->getBuffer(), module->getModuleIdentifier());
+  }
+  VLOG(2) << "LLVM object cache miss: " << path;
+  cache_misses.inc();
+  std::lock_guard<std::mutex> lock{mu_};
+  pending_[module] = std::move(binding.key);
+  return nullptr;
+}
+
+void ObjectCache::notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef obj) {
+  std::string key;
+  {
+    std::lock_guard<std::mutex> lock{mu_};
+    auto it = pending_.find(module);
+    if (it == pending_.end()) {
+      return;
+    }
+    key = std::move(it->second);
+    pending_.erase(it);
+  }
+  // Write to a unique temporary name, then rename into place, so concurrent
+  // processes never observe a partially written object.
+  auto path = ObjectPath(key);
+  auto tmp = path;
+  tmp += fs::unique_path(".%%%%-%%%%-%%%%.tmp");
+  try {
+    WriteFile(tmp, std::string(obj.getBufferStart(), obj.getBufferSize()), true);
+    fs::rename(tmp, path);
+  } catch (const std::exception& ex) {
+    LOG(WARNING) << "Unable to write LLVM object to cache " << path << ": " << ex.what();
+    boost::system::error_code ec;
+    fs::remove(tmp, ec);
+  }
+}
+
+}  // namespace util
+}  // namespace tile
+}  // namespace vertexai
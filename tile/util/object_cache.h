@@ -0,0 +1,73 @@
+// Copyright 2019 Intel Corporation.
+
+#pragma once
+
+#include <llvm/ExecutionEngine/ObjectCache.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+namespace vertexai {
+namespace tile {
+namespace util {
+
+// A persistent, content-addressed cache of compiled LLVM objects. Each object
+// is stored under a hash of the textual IR of the module it was compiled from,
+// combined with the target triple and host CPU features, so a process that
+// compiles a module some earlier process already compiled can load the object
+// instead of running codegen. Hits and misses are counted in the
+// "llvm_object_cache_hits" and "llvm_object_cache_misses" perf counters.
+//
+// A caller which optimizes its IR before handing it to MCJIT computes the key
+// from the unoptimized module, loads the object itself (skipping optimization
+// on a hit), and binds the key and object to the module passed to MCJIT.
+class ObjectCache final : public llvm::ObjectCache {
+ public:
+  // Returns the process-wide cache rooted at the directory named by the
+  // PLAIDML_LLVM_CACHE environment variable, or nullptr if it is not set.
+  static ObjectCache* Instance();
+
+  explicit ObjectCache(const boost::filesystem::path& dir);
+
+  // Computes the key of a module's object.
+  std::string Key(const llvm::Module& module) const;
+
+  // Loads the object stored under a key. Returns nullptr on a miss, or if
+  // the stored entry isn't a valid object file, in which case it's removed.
+  std::shared_ptr<llvm::MemoryBuffer> Load(const std::string& key);
+
+  // Makes the next getObject call for the module serve obj, or report a miss
+  // if obj is null, with the resulting object being stored under key.
+  void Bind(const llvm::Module* module, std::string key, std::shared_ptr<llvm::MemoryBuffer> obj);
+
+  // Drops a binding which MCJIT will never consume, e.g. because creating the
+  // execution engine failed.
+  void Unbind(const llvm::Module* module);
+
+  void notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef obj) final;
+  std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module* module) final;
+
+ private:
+  struct Binding {
+    std::string key;
+    std::shared_ptr<llvm::MemoryBuffer> obj;
+  };
+
+  boost::filesystem::path ObjectPath(const std::string& key) const;
+
+  boost::filesystem::path dir_;
+  std::string host_;
+  std::mutex mu_;
+  // Keys and objects bound to modules which MCJIT hasn't asked for yet.
+  std::map<const llvm::Module*, Binding> bound_;
+  // Keys of the modules which missed, computed before codegen touches the IR.
+  std::map<const llvm::Module*, std::string> pending_;
+};
+
+}  // namespace util
+}  // namespace tile
+}  // namespace vertexai
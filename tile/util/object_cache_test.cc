@@ -0,0 +1,121 @@
+// Copyright 2019 Intel Corporation.
+
+#include <gtest/gtest.h>
+
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/TargetSelect.h>
+
+#include <memory>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include "base/util/file.h"
+#include "base/util/perf_counter.h"
+#include "tile/util/object_cache.h"
+
+namespace fs = boost::filesystem;
+
+namespace vertexai {
+namespace tile {
+namespace util {
+namespace {
+
+class ObjectCacheTest : public ::testing::Test {
+ protected:
+  static void SetUpTestCase() {
+    LLVMInitializeNativeTarget();
+    LLVMLinkInMCJIT();
+    LLVMInitializeNativeAsmPrinter();
+    LLVMInitializeNativeAsmParser();
+  }
+
+  void SetUp() override {
+    dir_ = fs::temp_directory_path() / fs::unique_path("object_cache_test_%%%%-%%%%-%%%%");
+    cache_ = std::make_unique<ObjectCache>(dir_);
+  }
+
+  void TearDown() override {
+    boost::system::error_code ec;
+    fs::remove_all(dir_, ec);
+  }
+
+  // Builds a module defining a function returning 42.
+  std::unique_ptr<llvm::Module> MakeModule() {
+    auto module = std::make_unique<llvm::Module>("object_cache_test", context_);
+    llvm::IRBuilder<> builder{context_};
+    auto* functype = llvm::FunctionType::get(builder.getInt32Ty(), false);
+    auto* func = llvm::Function::Create(functype, llvm::Function::ExternalLinkage, "answer", module.get());
+    builder.SetInsertPoint(llvm::BasicBlock::Create(context_, "entry", func));
+    builder.CreateRet(builder.getInt32(42));
+    return module;
+  }
+
+  // Compiles the module through MCJIT the way the CPU JIT does, and calls its function.
+  int Run(std::unique_ptr<llvm::Module> module) {
+    auto key = cache_->Key(*module);
+    cache_->Bind(module.get(), key, cache_->Load(key));
+    std::string err;
+    std::unique_ptr<llvm::ExecutionEngine> ee{
+        llvm::EngineBuilder(std::move(module)).setErrorStr(&err).setEngineKind(llvm::EngineKind::JIT).create()};
+    EXPECT_NE(ee, nullptr) << err;
+    ee->setObjectCache(cache_.get());
+    ee->finalizeObject();
+    auto answer = reinterpret_cast<int (*)()>(ee->getFunctionAddress("answer"));
+    return answer();
+  }
+
+  fs::path ObjectPath() { return dir_ / (cache_->Key(*MakeModule()) + ".o"); }
+
+  llvm::LLVMContext context_;
+  fs::path dir_;
+  std::unique_ptr<ObjectCache> cache_;
+};
+
+TEST_F(ObjectCacheTest, MissStoresObjectForLaterHit) {
+  auto key = cache_->Key(*MakeModule());
+  EXPECT_EQ(cache_->Load(key), nullptr);
+
+  auto hits = GetPerfCounter("llvm_object_cache_hits");
+  auto misses = GetPerfCounter("llvm_object_cache_misses");
+  EXPECT_EQ(Run(MakeModule()), 42);
+  EXPECT_EQ(GetPerfCounter("llvm_object_cache_misses"), misses + 1);
+  EXPECT_TRUE(fs::is_regular_file(ObjectPath()));
+  EXPECT_NE(cache_->Load(key), nullptr);
+
+  EXPECT_EQ(Run(MakeModule()), 42);
+  EXPECT_EQ(GetPerfCounter("llvm_object_cache_hits"), hits + 1);
+  EXPECT_EQ(GetPerfCounter("llvm_object_cache_misses"), misses + 1);
+}
+
+TEST_F(ObjectCacheTest, TruncatedEntryIsRecompiled) {
+  EXPECT_EQ(Run(MakeModule()), 42);
+  auto path = ObjectPath();
+  auto obj = ReadFile(path, true);
+  WriteFile(path, obj.substr(0, obj.size() / 2), true);
+
+  // The truncated entry is dropped rather than loaded, and the recompiled object replaces it.
+  auto key = cache_->Key(*MakeModule());
+  EXPECT_EQ(cache_->Load(key), nullptr);
+  EXPECT_FALSE(fs::exists(path));
+  auto misses = GetPerfCounter("llvm_object_cache_misses");
+  EXPECT_EQ(Run(MakeModule()), 42);
+  EXPECT_EQ(GetPerfCounter("llvm_object_cache_misses"), misses + 1);
+  EXPECT_EQ(ReadFile(path, true), obj);
+}
+
+TEST_F(ObjectCacheTest, GarbageEntryIsRecompiled) {
+  auto path = ObjectPath();
+  WriteFile(path, "not an object file", true);
+  EXPECT_EQ(Run(MakeModule()), 42);
+  EXPECT_NE(cache_->Load(cache_->Key(*MakeModule())), nullptr);
+}
+
+}  // namespace
+}  // namespace util
+}  // namespace tile
+}  // namespace vertexai